@@ -87,9 +87,16 @@ export default function AutomaticIrrigationPage() {
     }
     try {
       const url = `http://${sensorEspIP}/${command}`;
-      const response = await fetch(url, { method: 'GET' });
+      let response = await fetch(url, { method: 'GET' });
       if (!response.ok) throw new Error(`HTTP ${response.status}`);
-      const data = await response.json();
+      let data = await response.json();
+      // Probe checks answer 202 with a job to poll until the reading is in
+      for (let tries = 0; response.status === 202 && data.poll && tries < 20; tries++) {
+        await new Promise(resolve => setTimeout(resolve, 300));
+        response = await fetch(`http://${sensorEspIP}${data.poll}`, { method: 'GET' });
+        if (!response.ok) throw new Error(`HTTP ${response.status}`);
+        data = await response.json();
+      }
       setSensorHistory(prev => [data, ...prev.slice(0, 4)]);
       setIsConnected(true);
     } catch (error) {
@@ -154,26 +161,47 @@ export default function AutomaticIrrigationPage() {
     };
   }, [motorEspIP, sensorEspIP, isAutoMode]);
 
-  // Status polling - check ESP32 status while in automatic mode
+  // Live status - the board pushes changed fields over /events (Server-Sent Events).
+  // Boards without /events are polled on /status instead.
   useEffect(() => {
-    if (isAutoMode && isConnected) {
-      const statusInterval = setInterval(async () => {
+    if (!isAutoMode || !isConnected) return;
+
+    const applyStatus = (data: Partial<StatusType> & { status?: string }) => {
+      setStatus(prev => ({ ...prev, ...data }));
+      if (data.mode === "automatic") {
+        setAutoModeStatus(`Active - ${data.status || "Running automatic cycle"}`);
+      }
+    };
+
+    let statusInterval: ReturnType<typeof setInterval> | undefined;
+    const startPolling = () => {
+      statusInterval = setInterval(async () => {
         try {
           const res = await fetch(`http://${motorEspIP}/status`, { method: 'GET' });
-          if (res.ok) {
-            const data = await res.json();
-            setStatus(prev => ({ ...prev, ...data }));
-            if (data.mode === "automatic") {
-              setAutoModeStatus(`Active - ${data.status || "Running automatic cycle"}`);
-            }
-          }
+          if (res.ok) applyStatus(await res.json());
         } catch (error) {
           // ESP32 may be busy
         }
       }, 15000); // Check every 15 seconds
+    };
 
-      return () => clearInterval(statusInterval);
-    }
+    const events = new EventSource(`http://${motorEspIP}/events`);
+    events.onmessage = (e) => {
+      try {
+        applyStatus(JSON.parse(e.data));
+      } catch (error) {
+        // Ignore malformed event
+      }
+    };
+    events.onerror = () => {
+      // CLOSED means the board refused the stream; otherwise EventSource reconnects itself
+      if (events.readyState === EventSource.CLOSED && !statusInterval) startPolling();
+    };
+
+    return () => {
+      events.close();
+      if (statusInterval) clearInterval(statusInterval);
+    };
   }, [isAutoMode, isConnected, motorEspIP]);
 
   return (
@@ -0,0 +1,161 @@
+// Decoder for the boards' compact binary answers (esp/binframe.h), asked for with
+// ?fmt=bin. The layouts must match the firmware; a frame with another version is
+// rejected so a stale client fails loudly instead of showing wrong numbers.
+//
+// Decoded objects use the same field names as the JSON answers, so callers can switch
+// between the two without other changes.
+
+export const BIN_VERSION = 1;
+export const BIN_PING = 1;
+export const BIN_HISTORY = 2;
+
+const PING_AUTOMATIC = 0x01;
+const PING_PUMP = 0x02;
+const PING_DOSING = 0x04;
+const PING_SERVO_DOWN = 0x08;
+const PING_CLIMATE = 0x10;
+
+export type PingFrame = {
+  mode: "automatic" | "manual";
+  pumpStatus: "running" | "stopped";
+  dosing: boolean;
+  servoPosition: "down" | "up";
+  soilMoisture: number;
+  temperature: number | null;
+  humidity: number | null;
+  climateAgeMs: number;
+  waterLevel: number;
+  uptime: number;
+  freeHeap: number;
+};
+
+export type HistoryFrame = {
+  boot: number;
+  now: number;
+  from: number;
+  to: number;
+  step: number;
+  zone: number;
+  records: number;
+  soil: (number | null)[];
+  water: (number | null)[];
+  temperature: (number | null)[];
+  humidity: (number | null)[];
+  pumpSec: number[];
+};
+
+class FrameReader {
+  private pos = 0;
+
+  constructor(private bytes: Uint8Array) {}
+
+  byte(): number {
+    if (this.pos >= this.bytes.length) throw new Error("Truncated frame");
+    return this.bytes[this.pos++];
+  }
+
+  // LEB128, at most 5 bytes for 32 bits. Multiplication keeps values above 2^31 positive.
+  varint(): number {
+    let result = 0;
+    for (let n = 0; n < 5; n++) {
+      const b = this.byte();
+      result += (b & 0x7f) * 2 ** (7 * n);
+      if (!(b & 0x80)) return result;
+    }
+    throw new Error("Bad varint");
+  }
+
+  signed(): number {
+    const v = this.varint();
+    return v % 2 ? -(v + 1) / 2 : v / 2;
+  }
+
+  header(kind: number) {
+    const version = this.byte();
+    if (version !== BIN_VERSION) throw new Error(`Unsupported frame version ${version}`);
+    const got = this.byte();
+    if (got !== kind) throw new Error(`Expected frame kind ${kind}, got ${got}`);
+  }
+}
+
+export function decodePing(buffer: ArrayBuffer): PingFrame {
+  const r = new FrameReader(new Uint8Array(buffer));
+  r.header(BIN_PING);
+  const flags = r.byte();
+  const soilMoisture = r.varint();
+  const climate = (flags & PING_CLIMATE) !== 0;
+  const temperature = climate ? r.signed() / 10 : null;
+  const humidity = climate ? r.signed() / 10 : null;
+  return {
+    mode: flags & PING_AUTOMATIC ? "automatic" : "manual",
+    pumpStatus: flags & PING_PUMP ? "running" : "stopped",
+    dosing: (flags & PING_DOSING) !== 0,
+    servoPosition: flags & PING_SERVO_DOWN ? "down" : "up",
+    soilMoisture,
+    temperature,
+    humidity,
+    climateAgeMs: r.varint(),
+    waterLevel: r.varint(),
+    uptime: r.varint(),
+    freeHeap: r.varint(),
+  };
+}
+
+export function decodeHistory(buffer: ArrayBuffer): HistoryFrame {
+  const r = new FrameReader(new Uint8Array(buffer));
+  r.header(BIN_HISTORY);
+  const boot = r.varint();
+  const now = r.varint();
+  const from = r.varint();
+  const to = r.varint();
+  const step = r.varint();
+  const zone = r.signed();
+  const records = r.varint();
+  const buckets = r.varint();
+
+  // Per series: bitmap of the buckets with a value, then the values as changes
+  const series = (scale: number): (number | null)[] => {
+    const present: boolean[] = [];
+    for (let i = 0; i < Math.ceil(buckets / 8); i++) {
+      const bits = r.byte();
+      for (let b = 0; b < 8 && i * 8 + b < buckets; b++) present.push((bits & (1 << b)) !== 0);
+    }
+    // Changes wrap at 32 bits like the firmware's deltaEncode(); | 0 does the same here
+    let value = 0;
+    return present.map((has) => {
+      if (!has) return null;
+      value = (value + r.signed()) | 0;
+      return value / scale;
+    });
+  };
+
+  const soil = series(1);
+  const water = series(1);
+  const temperature = series(10);
+  const humidity = series(10);
+  const pumpSec = series(10).map((v) => v ?? 0);
+  return { boot, now, from, to, step, zone, records, soil, water, temperature, humidity, pumpSec };
+}
+
+async function fetchFrame(url: string, signal?: AbortSignal): Promise<ArrayBuffer> {
+  const response = await fetch(url, { method: "GET", signal });
+  if (!response.ok) throw new Error(`HTTP ${response.status}`);
+  return response.arrayBuffer();
+}
+
+export async function fetchPing(host: string, signal?: AbortSignal): Promise<PingFrame> {
+  return decodePing(await fetchFrame(`http://${host}/ping?fmt=bin`, signal));
+}
+
+// Times are seconds since boot, negative ones back from now (see /history on the board)
+export async function fetchHistory(
+  host: string,
+  query: { from?: number; to?: number; step?: number; zone?: number; boot?: number } = {},
+  signal?: AbortSignal
+): Promise<HistoryFrame> {
+  const params = new URLSearchParams({ fmt: "bin" });
+  for (const [key, value] of Object.entries(query)) {
+    if (value !== undefined) params.set(key, String(value));
+  }
+  return decodeHistory(await fetchFrame(`http://${host}/history?${params}`, signal));
+}
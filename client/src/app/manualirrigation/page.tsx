@@ -454,6 +454,7 @@
 "use client";
 
 import { useEffect, useRef, useState } from "react";
+import { fetchPing } from "../lib/telemetry";
 
 type StatusType = {
   leftMotor: string;
@@ -498,6 +499,28 @@ export default function ManualIrrigationPage() {
     if (savedPort) setCameraPort(savedPort);
   }, []);
 
+  // Sensor board state from the binary ping (~20 bytes instead of ~300), fetched on
+  // load and after each command instead of polled, so an idle page costs the board nothing
+  const refreshSensorState = async (ip: string = sensorEspIP) => {
+    if (!ip) return;
+    try {
+      const ping = await fetchPing(ip);
+      setSensorData((prev: any) => ({
+        ...prev,
+        soilMoisture: ping.soilMoisture,
+        servoPosition: ping.servoPosition,
+        pump: ping.pumpStatus === "running" ? "ON" : "OFF",
+        timestamp: new Date().toLocaleTimeString(),
+      }));
+    } catch (error) {
+      // Board busy or out of range, the next command or refresh retries
+    }
+  };
+
+  useEffect(() => {
+    refreshSensorState(sensorEspIP);
+  }, [sensorEspIP]);
+
   const handleError = (error: unknown, context: string) => {
     if (error instanceof Error) {
       if (error.name === 'AbortError') {
@@ -553,6 +576,7 @@ export default function ManualIrrigationPage() {
       const data = await response.json();
       setSensorData((prev: any) => ({ ...prev, pump: data.pump, timestamp: new Date().toLocaleTimeString() }));
       setIsConnected(true);
+      refreshSensorState();
     } catch (error) {
       handleError(error, "Pump Start");
       setIsConnected(false);
@@ -572,6 +596,7 @@ export default function ManualIrrigationPage() {
       const data = await response.json();
       setSensorData((prev: any) => ({ ...prev, pump: data.pump, timestamp: new Date().toLocaleTimeString() }));
       setIsConnected(true);
+      refreshSensorState();
     } catch (error) {
       handleError(error, "Pump Stop");
       setIsConnected(false);
@@ -620,6 +645,7 @@ export default function ManualIrrigationPage() {
         timestamp: new Date().toLocaleTimeString()
       }));
       setIsConnected(true);
+      refreshSensorState();
     } catch (error) {
       handleError(error, "Read Soil Sensor");
       setIsConnected(false);
@@ -787,7 +813,10 @@ export default function ManualIrrigationPage() {
                     {!sensorData.pump && 'Unavailable'}
                   </span>
                 </p>
-                <p className="text-xs text-gray-600">Last updated: {sensorData.timestamp}</p>
+                <p className="text-xs text-gray-600">
+                  Last updated: {sensorData.timestamp}
+                  <button onClick={() => refreshSensorState()} className="ml-2 text-blue-600 hover:underline">Refresh</button>
+                </p>
               </div>
             </div>
           )}
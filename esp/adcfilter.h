@@ -0,0 +1,132 @@
+#ifndef ADCFILTER_H
+#define ADCFILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Filtered analog input for the soil and water level sensors.
+//
+// loop() pushes a raw analogRead() sample every few milliseconds; handlers read the
+// filtered value without touching the ADC. Each sample goes through a moving median
+// over the last WINDOW samples (removes single-sample spikes from WiFi bursts and the
+// servo) followed by an integer EMA (smooths what is left, so a reading sitting near a
+// threshold does not flap). push() is O(WINDOW), median() and value() are O(1).
+//
+// Call reset() when the physical input changes, e.g. when the probe is lowered into the
+// soil, so old samples taken in the air do not leak into the next reading.
+//
+// save() and restore() copy the window and EMA to and from an AdcFilterState, plain data
+// a board in battery mode keeps in RTC memory through deep sleep (sleepcycle.h): each
+// wake then adds a few samples to the window instead of refilling it.
+
+// Window and EMA as plain data (no constructor, so it can live in RTC memory)
+template <size_t WINDOW>
+struct AdcFilterState {
+  static_assert(WINDOW < 256, "window too long for the saved state");
+  int ring[WINDOW];
+  uint8_t count;
+  uint8_t head;
+  long emaScaled;
+};
+
+template <size_t WINDOW = 15>
+class AdcFilter {
+public:
+  // EMA weight of a new median is 1 / 2^alphaShift
+  explicit AdcFilter(uint8_t alphaShift = 2) : alphaShift_(alphaShift) { reset(); }
+
+  void reset() {
+    count_ = 0;
+    head_ = 0;
+    median_ = 0;
+    emaScaled_ = 0;
+  }
+
+  void push(int sample) {
+    if (count_ == WINDOW) {
+      removeSorted(ring_[head_]);
+    } else {
+      count_++;
+    }
+    ring_[head_] = sample;
+    head_ = (head_ + 1) % WINDOW;
+    insertSorted(sample);
+
+    median_ = sorted_[(count_ - 1) / 2];
+    long scaled = (long)median_ * EMA_SCALE;
+    if (count_ == 1) {
+      emaScaled_ = scaled;
+    } else {
+      emaScaled_ += (scaled - emaScaled_) / (1L << alphaShift_);
+    }
+  }
+
+  // Window is full, the filtered value no longer depends on startup samples
+  bool ready() const { return count_ == WINDOW; }
+  size_t count() const { return count_; }
+
+  int median() const { return median_; }
+
+  void save(AdcFilterState<WINDOW>* out) const {
+    memcpy(out->ring, ring_, sizeof(ring_));
+    out->count = (uint8_t)count_;
+    out->head = (uint8_t)head_;
+    out->emaScaled = emaScaled_;
+  }
+
+  // A state that does not fit this window (never saved) leaves the filter empty
+  void restore(const AdcFilterState<WINDOW>& in) {
+    reset();
+    if (in.count == 0 || in.count > WINDOW || in.head >= WINDOW) return;
+    memcpy(ring_, in.ring, sizeof(ring_));
+    for (size_t i = 0; i < in.count; i++) {
+      count_++;
+      insertSorted(ring_[(in.head + WINDOW - in.count + i) % WINDOW]);
+    }
+    head_ = in.head;
+    median_ = sorted_[(count_ - 1) / 2];
+    emaScaled_ = in.emaScaled;
+  }
+
+  // Median + EMA filtered value, rounded
+  int value() const {
+    return (int)((emaScaled_ + (emaScaled_ >= 0 ? EMA_SCALE / 2 : -EMA_SCALE / 2)) / EMA_SCALE);
+  }
+
+private:
+  static const long EMA_SCALE = 16;
+
+  // Binary search for the insert position, then shift the tail up by one
+  void insertSorted(int sample) {
+    size_t n = count_ - 1;   // entries already in sorted_
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (sorted_[mid] < sample) lo = mid + 1;
+      else hi = mid;
+    }
+    memmove(&sorted_[lo + 1], &sorted_[lo], (n - lo) * sizeof(int));
+    sorted_[lo] = sample;
+  }
+
+  void removeSorted(int sample) {
+    size_t lo = 0, hi = count_;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (sorted_[mid] < sample) lo = mid + 1;
+      else hi = mid;
+    }
+    memmove(&sorted_[lo], &sorted_[lo + 1], (count_ - lo - 1) * sizeof(int));
+  }
+
+  uint8_t alphaShift_;
+  int ring_[WINDOW];
+  int sorted_[WINDOW];
+  size_t count_;
+  size_t head_;
+  int median_;
+  long emaScaled_;
+};
+
+#endif
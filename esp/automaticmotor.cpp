@@ -1,6 +1,16 @@
 #include <ESP8266WiFi.h>
 #include <ESP8266WebServer.h>
-#include <ESP8266HTTPClient.h>
+#include <WiFiUdp.h>
+#include <LittleFS.h>
+#include "peerlink.h"
+#include "peerproto.h"
+#include "dosecontroller.h"
+#include "motionqueue.h"
+#include "routeplanner.h"
+#include "wifilink.h"
+#include "peerbeacon.h"
+#include "drivetrain.h"
+#include "telemetryserver.h"
 
 // WiFi credentials
 const char* ssid = "SDP";
@@ -9,6 +19,10 @@ const char* password = "123456789";
 // Web server on port 80
 ESP8266WebServer server(80);
 
+// Network join from the cached access point and lease, peers found by their beacons
+WiFiLink<fs::FS> wifi(LittleFS);
+PeerBeacon<WiFiUDP> beacon(PEER_ROLE_ROVER, "automaticmotor");
+
 // Motor control pins (adjust to your ESP8266 GPIOs)
 const int ENA = D1;
 const int ENB = D2;
@@ -16,82 +30,262 @@ const int IN1 = D5;
 const int IN2 = D6;
 const int IN3 = D7;
 const int IN4 = D8;
+DriveTrain<ENA, ENB, IN1, IN2, IN3, IN4, AnalogEnable> drive;   // soft start/stop needs PWM on ENA/ENB
 
 bool automaticMode = false;
 unsigned long lastAutoMove = 0;
-const unsigned long AUTO_MOVE_INTERVAL = 10000; // 15 seconds
+const unsigned long AUTO_MOVE_INTERVAL = 10000; // pause between rounds
 
 String sensorEspIP = "";
 const int SOIL_THRESHOLD = 500; // Adjust as needed
+const int SOIL_TARGET = 700;    // Water until the reading is back up here
+
+// Soft start/stop on ENA/ENB instead of switching them full on
+MotionQueue<4> motion;
+const uint8_t DRIVE_SPEED = 255;
+const unsigned long MOTION_TICK_INTERVAL = 10; // ms between ramp steps
+unsigned long lastMotionTick = 0;
+
+// Binary datagram channel to the sensor ESP; HTTP link kept as fallback for sensor
+// firmware that does not speak the binary protocol
+PeerChannel<WiFiUDP> sensorChannel;
+PeerLink<WiFiClient> sensorLink;
+bool sensorSpeaksBinary = true;
+
+// Automatic cycle, once per plot in the planned order: drive there -> ask for soil value ->
+// dose if dry -> next plot. After the last plot the rover waits AUTO_MOVE_INTERVAL.
+enum AutoPhase { AUTO_WAITING, AUTO_MOVING, AUTO_AWAIT_SOIL, AUTO_PUMPING };
+AutoPhase autoPhase = AUTO_WAITING;
+unsigned long soilRequestedAt = 0;
+const uint16_t AUTO_MOVE_RAMP = 400;
+const unsigned long AUTO_SOIL_TIMEOUT = 10000;   // no reading by then: skip the plot
+const unsigned long AUTO_PUMP_DURATION = 3000;   // longest single pulse
+const unsigned long AUTO_DOSE_BUDGET = 15000;    // pump time per stop
+
+// Pulses of up to 3 s, the sensor board is asked for a new reading 3 s after each one.
+// This sensor reads low when dry; 50 units/s is the guess until the first pulse is seen.
+DoseController<1> dose(DoseTiming{1000, AUTO_PUMP_DURATION, 3000, 20}, false, 50);
+
+// Plots in mm from the dock (x ahead, y to the left); /route?plots= replaces them.
+// There are no wheel encoders on this board, so the rover's position is where the plan
+// says it should be, and automatic mode starts from the dock facing along x.
+const PlotPoint DEFAULT_PLOTS[] = {{1500, 0}, {3000, 1200}, {800, 1800}, {2500, -900}, {3800, 400}};
+RoutePlanner<16> route;
+// Measured at full duty: 250 mm/s straight, 90 deg/s turning on the spot at duty 200
+const RouteDrive ROVER_DRIVE = {DRIVE_SPEED, 200, 250, 90, AUTO_MOVE_RAMP};
+PlotPoint roverAt = {0, 0};
+int roverHeading = 0;    // degrees, counterclockwise from x
+int legHeading = 0;      // heading once the current leg is driven
+// A leg cut short by /stop leaves the rover between plots: no round is planned from there
+// until /automatic puts it back at the dock
+bool poseKnown = true;
+// /route?plots= during a leg: the leg is driven to its end first
+PlotPoint pendingPlots[16];
+int pendingPlotCount = -1;
+
+// Forward declarations
+void runAutomaticCycle();
+bool startRound();
+void driveToCurrentPlot();
+void nextPlot();
+void skipPlot();
+void leaveRound();
+void setPlots(const PlotPoint* plots, int n);
+void handleRoute();
+void handleRoot();
+void moveForward();
+void stopMotors();
+void handleForward();
+void handleBackward();
+void handleLeft();
+void handleRight();
+void handleStop();
+void handleAutomatic();
+void handleManual();
+void handleSetSensorIP();
+void handleMetrics();
+void useSensor(const char* host);
+void onPeerFound(const PeerInfo& peer, void* context);
+void requestSoilValueFromSensorESP();
+void onSoilRequestDelivered(uint16_t seq, bool delivered, void* context);
+void onSensorMessage(const PeerPacket& pkt, void* context);
+void onSoilValue(int httpCode, const char* payload, void* context);
+void handleSoilValue(int soilValue);
+void startSensorPump(unsigned long runMs);
+void stopSensorPump();
+void sendModeToSensor(uint8_t mode);
+void sendSensorCommand(const char* endpoint);
+
+constexpr Route ROUTES[] = {
+  {"/", ROUTE_GET | ROUTE_POST, handleRoot},
+  {"/forward", ROUTE_GET, handleForward},
+  {"/backward", ROUTE_GET, handleBackward},
+  {"/left", ROUTE_GET, handleLeft},
+  {"/right", ROUTE_GET, handleRight},
+  {"/stop", ROUTE_GET, handleStop},
+  {"/automatic", ROUTE_GET, handleAutomatic},
+  {"/manual", ROUTE_GET, handleManual},
+  {"/set_sensor_ip", ROUTE_GET, handleSetSensorIP},
+  {"/route", ROUTE_GET | ROUTE_POST, handleRoute},
+  {"/metrics", ROUTE_GET, handleMetrics},
+};
+constexpr uint32_t ROUTE_SEED = routeSeed(ROUTES);
+TelemetryServer<ESP8266WebServer, sizeof(ROUTES) / sizeof(ROUTES[0])> web(server, ROUTES, ROUTE_SEED);
 
 void setup() {
   Serial.begin(115200);
 
-  pinMode(ENA, OUTPUT); digitalWrite(ENA, LOW);
-  pinMode(ENB, OUTPUT); digitalWrite(ENB, LOW);
-  pinMode(IN1, OUTPUT); digitalWrite(IN1, LOW);
-  pinMode(IN2, OUTPUT); digitalWrite(IN2, LOW);
-  pinMode(IN3, OUTPUT); digitalWrite(IN3, LOW);
-  pinMode(IN4, OUTPUT); digitalWrite(IN4, LOW);
+  drive.begin();   // all motor pins low
 
-  stopMotors();
+  for (size_t i = 0; i < sizeof(DEFAULT_PLOTS) / sizeof(DEFAULT_PLOTS[0]); i++) {
+    route.addPlot(DEFAULT_PLOTS[i].xMm, DEFAULT_PLOTS[i].yMm);
+  }
 
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, password);
-  Serial.print("Connecting to WiFi");
-  WiFi.setSleep(false);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
-  }
-  Serial.println("\nConnected!");
-  Serial.print("IP Address: ");
-  Serial.println(WiFi.localIP());
-
-  // Route definitions
-  server.on("/", handleRoot);
-  server.on("/forward", HTTP_GET, handleForward);
-  server.on("/backward", HTTP_GET, handleBackward);
-  server.on("/left", HTTP_GET, handleLeft);
-  server.on("/right", HTTP_GET, handleRight);
-  server.on("/stop", HTTP_GET, handleStop);
-  server.on("/automatic", HTTP_GET, handleAutomatic);
-  server.on("/manual", HTTP_GET, handleManual);
-  server.on("/set_sensor_ip", HTTP_GET, handleSetSensorIP);
-
-  server.begin();
+  // Joins in the background from loop(), from the cached access point when there is one
+  LittleFS.begin();
+  wifi.begin(ssid, password);
+  beacon.begin();
+  beacon.onPeer(onPeerFound);
+  sensorLink.measure(&web.metrics().peerRtt());
+
+  // Route definitions (ROUTES), CORS and preflight included
+  web.begin();
   Serial.println("HTTP server started");
+
+  // Hardware RNG: micros() at this point is nearly the same on every boot
+  sensorChannel.begin(PEER_UDP_PORT, (uint16_t)RANDOM_REG32);
+  sensorChannel.onMessage(onSensorMessage);
 }
 
 void loop() {
-  server.handleClient();
+  web.metrics().tickLoop(micros());
+  web.handleClient();
+  wifi.tick(millis());
+  beacon.tick(millis(), wifi.connected());
+  sensorChannel.tick(millis());
+  sensorLink.tick(millis());
+
+  if (millis() - lastMotionTick >= MOTION_TICK_INTERVAL) {
+    lastMotionTick = millis();
+    if (motion.tick(lastMotionTick)) drive.apply(motion.direction(), motion.duty());
+  }
 
   if (automaticMode && sensorEspIP.length() > 0) {
-    if (millis() - lastAutoMove > AUTO_MOVE_INTERVAL) {
-      lastAutoMove = millis();
-
-      // 1. Move forward for 2 seconds
-      moveForward();
-      delay(2000);
-      stopMotors();
-
-      // 2. Request soil value from ESP32
-      int soilValue = getSoilValueFromSensorESP();
-      Serial.printf("Soil value from Sensor ESP: %d\n", soilValue);
-
-      // 3. If soil is dry, start pump for 3 seconds
-      if (soilValue != -1 && soilValue < SOIL_THRESHOLD) {
-        Serial.println("Soil dry, starting pump...");
-        sendSensorCommand("/pump_start");
-        delay(3000);
-        sendSensorCommand("/pump_stop");
-        Serial.println("Pump stopped.");
-      } else {
-        Serial.println("Soil OK, not starting pump.");
+    runAutomaticCycle();
+  }
+}
+
+void runAutomaticCycle() {
+  unsigned long now = millis();
+  switch (autoPhase) {
+    case AUTO_WAITING:
+      if (route.done()) {
+        if (now - lastAutoMove <= AUTO_MOVE_INTERVAL) break;
+        lastAutoMove = now;
+        if (!startRound()) break;
       }
-      // 4. Wait for next cycle (handled by AUTO_MOVE_INTERVAL)
-    }
+      driveToCurrentPlot();
+      break;
+
+    case AUTO_MOVING:
+      // The leg ends with its own ramp down
+      if (!motion.busy()) {
+        roverAt = route.plot(route.current());
+        roverHeading = legHeading;
+        if (pendingPlotCount >= 0) {
+          // New plots came in during the leg: plan the next round with them from here
+          setPlots(pendingPlots, pendingPlotCount);
+          autoPhase = AUTO_WAITING;
+          break;
+        }
+        autoPhase = AUTO_AWAIT_SOIL;
+        soilRequestedAt = now;
+        requestSoilValueFromSensorESP();
+      }
+      break;
+
+    case AUTO_AWAIT_SOIL:
+      // Waiting for onSoilValue()
+      if (now - soilRequestedAt >= AUTO_SOIL_TIMEOUT) {
+        Serial.println("No soil value from Sensor ESP.");
+        skipPlot();
+      }
+      break;
+
+    case AUTO_PUMPING:
+      switch (dose.tick(now)) {
+        case DOSE_PUMP_ON: startSensorPump(dose.pulseMs()); break;
+        case DOSE_PUMP_OFF: stopSensorPump(); break;
+        case DOSE_SAMPLE: requestSoilValueFromSensorESP(); break;
+        case DOSE_DONE:
+          Serial.printf("Dose %s: %u pulses, %lu ms, gain %ld/s\n", DoseController<1>::resultName(dose.result()),
+                        dose.pulses(), dose.pumpedMs(), dose.gain(0));
+          nextPlot();
+          break;
+        default: break;
+      }
+      break;
+  }
+}
+
+bool startRound() {
+  if (route.plotCount() == 0) return false;
+  if (!poseKnown) {
+    Serial.println("Rover position unknown after a stop, /automatic to start again from the dock.");
+    return false;
   }
+  size_t moves = route.plan(roverAt.xMm, roverAt.yMm);
+  Serial.printf("Round of %u plots, %lu mm (%u 2-opt moves)\n", (unsigned int)route.tourSize(), route.tourLengthMm(),
+                (unsigned int)moves);
+  return true;
+}
+
+void driveToCurrentPlot() {
+  MotionSegment legs[2];
+  int plot = route.current();
+  size_t n = routeLegSegments(roverAt, roverHeading, route.plot(plot), ROVER_DRIVE, legs, &legHeading);
+  for (size_t i = 0; i < n; i++) motion.push(legs[i]);
+  Serial.printf("Driving to plot %d (%ld, %ld)\n", plot, (long)route.plot(plot).xMm, (long)route.plot(plot).yMm);
+  autoPhase = AUTO_MOVING;
+}
+
+// Plot sampled (and watered if it was dry)
+void nextPlot() {
+  route.advance();
+  autoPhase = AUTO_WAITING;
+  if (route.done()) {
+    Serial.println("Round done.");
+    lastAutoMove = millis();
+  }
+}
+
+// No reading at this plot: leave it for the next round and re-plan the rest from here
+void skipPlot() {
+  Serial.printf("Skipping plot %d this round.\n", route.current());
+  route.skip(roverAt);
+  autoPhase = AUTO_WAITING;
+  if (route.done()) lastAutoMove = millis();
+}
+
+// /stop in automatic mode: the round is over, the next one starts after the pause
+void leaveRound() {
+  if (autoPhase == AUTO_MOVING) {
+    poseKnown = false;   // stopped somewhere on the leg, not at its plot
+  } else if (autoPhase == AUTO_PUMPING) {
+    if (dose.cancel(millis())) stopSensorPump();
+  }
+  if (pendingPlotCount >= 0) setPlots(pendingPlots, pendingPlotCount);
+  route.cancelRound();
+  autoPhase = AUTO_WAITING;
+  lastAutoMove = millis();
+  Serial.println("Round stopped.");
+}
+
+void setPlots(const PlotPoint* plots, int n) {
+  route.clearPlots();
+  for (int i = 0; i < n; i++) route.addPlot(plots[i].xMm, plots[i].yMm);
+  pendingPlotCount = -1;
+  Serial.printf("%d plots set\n", n);
 }
 
 // ======= HANDLERS & UTILITIES =======
@@ -111,30 +305,44 @@ void handleRoot() {
   server.send(200, "text/html", html);
 }
 
+void handleMetrics() {
+  web.sendMetrics();
+}
+
 void moveForward() {
-  digitalWrite(IN1, HIGH); digitalWrite(IN2, LOW);
-  digitalWrite(IN3, HIGH); digitalWrite(IN4, LOW);
-  digitalWrite(ENA, HIGH); digitalWrite(ENB, HIGH);
+  motion.drive(MOTION_FORWARD, DRIVE_SPEED, MOTION_DEFAULT_RAMP);
   Serial.println("Moving forward");
 }
 
+// Immediate stop without ramp
 void stopMotors() {
-  digitalWrite(IN1, LOW); digitalWrite(IN2, LOW);
-  digitalWrite(IN3, LOW); digitalWrite(IN4, LOW);
-  digitalWrite(ENA, LOW); digitalWrite(ENB, LOW);
+  motion.halt();
+  drive.stop();
   Serial.println("Motors stopped");
 }
 
 void handleForward()  { if (!automaticMode) moveForward(); server.send(200, "text/plain", "Forward"); }
-void handleBackward() { Serial.println("Backward"); server.send(200, "text/plain", "Backward"); }
-void handleLeft()     { Serial.println("Left"); server.send(200, "text/plain", "Left"); }
-void handleRight()    { Serial.println("Right"); server.send(200, "text/plain", "Right"); }
-void handleStop()     { stopMotors(); server.send(200, "text/plain", "Stopped"); }
+void handleBackward() { if (!automaticMode) motion.drive(MOTION_BACKWARD, DRIVE_SPEED, MOTION_DEFAULT_RAMP); server.send(200, "text/plain", "Backward"); }
+void handleLeft()     { if (!automaticMode) motion.drive(MOTION_LEFT, DRIVE_SPEED, MOTION_DEFAULT_RAMP); server.send(200, "text/plain", "Left"); }
+void handleRight()    { if (!automaticMode) motion.drive(MOTION_RIGHT, DRIVE_SPEED, MOTION_DEFAULT_RAMP); server.send(200, "text/plain", "Right"); }
+void handleStop() {
+  motion.stop();
+  if (automaticMode) leaveRound();
+  server.send(200, "text/plain", "Stopped");
+}
 
 void handleAutomatic() {
   automaticMode = true;
   stopMotors();
+  autoPhase = AUTO_WAITING;
   lastAutoMove = millis();
+  route.cancelRound();
+  if (pendingPlotCount >= 0) setPlots(pendingPlots, pendingPlotCount);
+  roverAt.xMm = 0;
+  roverAt.yMm = 0;
+  roverHeading = 0;
+  poseKnown = true;
+  sendModeToSensor(1);
   server.send(200, "text/plain", "Automatic mode enabled");
   Serial.println("Automatic mode enabled");
 }
@@ -142,53 +350,164 @@ void handleAutomatic() {
 void handleManual() {
   automaticMode = false;
   stopMotors();
+  if (autoPhase == AUTO_PUMPING) {
+    dose.cancel(millis());
+    stopSensorPump();
+  }
+  autoPhase = AUTO_WAITING;
+  sendModeToSensor(0);
   server.send(200, "text/plain", "Manual mode enabled");
   Serial.println("Manual mode enabled");
 }
 
 void handleSetSensorIP() {
   if (server.hasArg("ip")) {
-    sensorEspIP = server.arg("ip");
-    Serial.print("Sensor ESP IP set to: ");
-    Serial.println(sensorEspIP);
+    useSensor(server.arg("ip").c_str());
     server.send(200, "text/plain", "Sensor ESP IP set to " + sensorEspIP);
   } else {
     server.send(400, "text/plain", "Missing 'ip' parameter");
   }
 }
 
-int getSoilValueFromSensorESP() {
-  if (sensorEspIP.length() == 0) return -1;
+// Pump/probe board found by its beacon; /set_sensor_ip still overrides until it moves
+void onPeerFound(const PeerInfo& peer, void* /*context*/) {
+  if (peer.role == PEER_ROLE_PROBE_PUMP) useSensor(peer.host);
+}
+
+void useSensor(const char* host) {
+  sensorEspIP = host;
+  sensorLink.setHost(host);
+  sensorChannel.setPeer(host);
+  sensorSpeaksBinary = true;
+  Serial.print("Sensor ESP IP set to: ");
+  Serial.println(sensorEspIP);
+}
+
+void requestSoilValueFromSensorESP() {
+  if (sensorSpeaksBinary &&
+      sensorChannel.sendReliable(millis(), MSG_SOIL_REQUEST, NULL, 0, onSoilRequestDelivered)) {
+    return;
+  }
+  if (!sensorLink.send("/servo_start", onSoilValue)) {
+    Serial.println("Sensor ESP queue full, skipping this plot.");
+    if (autoPhase == AUTO_PUMPING) {
+      if (dose.cancel(millis())) stopSensorPump();
+      nextPlot();
+    } else if (autoPhase == AUTO_AWAIT_SOIL) {
+      skipPlot();
+    }
+  }
+}
+
+void onSoilRequestDelivered(uint16_t /*seq*/, bool delivered, void* /*context*/) {
+  if (delivered) return;
+  // No ack: sensor firmware without the binary protocol, use HTTP from now on
+  Serial.println("Sensor ESP did not ack binary request, falling back to HTTP.");
+  sensorSpeaksBinary = false;
+  if (autoPhase == AUTO_AWAIT_SOIL || autoPhase == AUTO_PUMPING) requestSoilValueFromSensorESP();
+}
 
-  WiFiClient client;
-  HTTPClient http;
-  String url = "http://" + sensorEspIP + "/servo_start";
-  http.begin(client, url);
+void onSensorMessage(const PeerPacket& pkt, void* /*context*/) {
+  sensorSpeaksBinary = true;
+  if (pkt.type == MSG_SOIL_READING && pkt.length >= 2) {
+    handleSoilValue((int16_t)peerGet16(pkt.payload));
+  }
+}
 
-  int httpCode = http.GET();
+// Reply to /servo_start, e.g. {"servo_angle":30,"soil_value":1234}
+void onSoilValue(int httpCode, const char* payload, void* /*context*/) {
   int soilValue = -1;
 
   if (httpCode == 200) {
-    String payload = http.getString();
-    int idx = payload.indexOf("soil_value");
-    if (idx != -1) {
-      int start = payload.indexOf(":", idx) + 1;
-      int end = payload.indexOf("}", start);
-      soilValue = payload.substring(start, end).toInt();
+    const char* key = strstr(payload, "soil_value");
+    const char* colon = key ? strchr(key, ':') : NULL;
+    if (colon) soilValue = atoi(colon + 1);
+  }
+  handleSoilValue(soilValue);
+}
+
+void handleSoilValue(int soilValue) {
+  Serial.printf("Soil value from Sensor ESP: %d\n", soilValue);
+
+  // Reading between two dose pulses
+  if (autoPhase == AUTO_PUMPING) {
+    if (soilValue == -1) {
+      Serial.println("No soil reading, dose aborted.");
+      if (dose.cancel(millis())) stopSensorPump();
+      nextPlot();
+    } else {
+      dose.sample(soilValue, millis());
     }
+    return;
   }
 
-  http.end();
-  return soilValue;
+  // Mode may have changed while the request was in flight
+  if (autoPhase != AUTO_AWAIT_SOIL) return;
+
+  if (soilValue == -1) {
+    skipPlot();
+  } else if (soilValue < SOIL_THRESHOLD && dose.begin(0, soilValue, SOIL_TARGET, AUTO_DOSE_BUDGET, millis())) {
+    Serial.printf("Soil dry, dosing about %lu ms...\n", dose.estimateMs(0, soilValue, SOIL_TARGET));
+    autoPhase = AUTO_PUMPING;
+  } else {
+    Serial.println("Soil OK, not starting pump.");
+    nextPlot();
+  }
 }
 
-void sendSensorCommand(const String& endpoint) {
-  if (sensorEspIP.length() == 0) return;
+// GET /route: planned round and progress. ?plots=x:y,x:y,... (mm) replaces the plots;
+// a round in progress is dropped and the next one uses the new plots. A leg being driven
+// is finished first, so the rover knows where it is when the next round is planned.
+void handleRoute() {
+  if (server.hasArg("plots")) {
+    PlotPoint plots[16];
+    size_t errorAt = 0;
+    int n = parsePlotPoints(server.arg("plots").c_str(), plots, route.capacity(), &errorAt);
+    if (n < 0) {
+      server.send(400, "text/plain", "Bad plot " + String((unsigned long)errorAt));
+      return;
+    }
+    if (autoPhase == AUTO_MOVING) {
+      memcpy(pendingPlots, plots, n * sizeof(PlotPoint));
+      pendingPlotCount = n;
+    } else {
+      if (autoPhase == AUTO_AWAIT_SOIL) autoPhase = AUTO_WAITING;
+      setPlots(plots, n);
+    }
+  }
+
+  JsonWriter<768> json;
+  addRouteJson(json, route);
+  json.add("roverX", (long)roverAt.xMm).add("roverY", (long)roverAt.yMm).add("heading", roverHeading)
+      .add("automatic", automaticMode).add("poseKnown", poseKnown).add("plotsPending", pendingPlotCount >= 0);
+  sendJson(server, 200, json);
+}
 
-  WiFiClient client;
-  HTTPClient http;
-  String url = "http://" + sensorEspIP + endpoint;
-  http.begin(client, url);
-  http.GET();
-  http.end();
+void startSensorPump(unsigned long runMs) {
+  if (sensorSpeaksBinary) {
+    // The sensor stops the pump on its own after the run time, even if the stop is lost
+    uint8_t payload[5];
+    payload[0] = 1;
+    peerPut32(payload + 1, runMs);
+    if (sensorChannel.sendReliable(millis(), MSG_PUMP_COMMAND, payload, sizeof(payload))) return;
+  }
+  sendSensorCommand("/pump_start");
+}
+
+void stopSensorPump() {
+  if (sensorSpeaksBinary) {
+    uint8_t payload[5] = {0, 0, 0, 0, 0};
+    if (sensorChannel.sendReliable(millis(), MSG_PUMP_COMMAND, payload, sizeof(payload))) return;
+  }
+  sendSensorCommand("/pump_stop");
+}
+
+void sendModeToSensor(uint8_t mode) {
+  if (!sensorSpeaksBinary || !sensorChannel.hasPeer()) return;
+  sensorChannel.sendReliable(millis(), MSG_MODE_CHANGE, &mode, 1);
+}
+
+void sendSensorCommand(const char* endpoint) {
+  if (sensorEspIP.length() == 0) return;
+  sensorLink.send(endpoint);
 }
\ No newline at end of file
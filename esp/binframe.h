@@ -0,0 +1,96 @@
+#ifndef BINFRAME_H
+#define BINFRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "varint.h"
+
+// Compact binary answers for the dashboard on a weak link. A handler that supports them
+// checks wantsBinary() (?fmt=bin, or "application/octet-stream" in the Accept header,
+// which the sketch must list in server.collectHeaders()); JSON stays the default.
+//
+// A frame is a version byte, a kind byte, then the fields of that kind in a fixed
+// order: unsigned numbers as varints, signed ones zig-zag, booleans packed into one
+// flags byte. Time series are sent as changes from the previous point, so a slowly
+// moving sensor costs about a byte per point. /ping drops from ~300 bytes of JSON to
+// ~20. The decoder is client/src/app/lib/telemetry.ts; change both together and bump
+// BIN_VERSION when a layout changes.
+
+const uint8_t BIN_VERSION = 1;
+const char* const BIN_CONTENT_TYPE = "application/octet-stream";
+
+enum BinKind {
+  BIN_PING = 1,
+  BIN_HISTORY,
+  BIN_BATCH        // battery node report, sent as a UDP broadcast (sleepcycle.h)
+};
+
+// Ping flags
+const uint8_t PING_AUTOMATIC = 0x01;
+const uint8_t PING_PUMP = 0x02;
+const uint8_t PING_DOSING = 0x04;
+const uint8_t PING_SERVO_DOWN = 0x08;
+const uint8_t PING_CLIMATE = 0x10;   // temperature and humidity follow
+
+template <size_t N>
+class BinFrame {
+public:
+  explicit BinFrame(uint8_t kind) { reset(kind); }
+
+  void reset(uint8_t kind) {
+    len_ = 0;
+    overflow_ = false;
+    byte(BIN_VERSION);
+    byte(kind);
+  }
+
+  // Continues a frame whose header was already sent (a streamed series)
+  void clear() {
+    len_ = 0;
+    overflow_ = false;
+  }
+
+  BinFrame& byte(uint8_t value) {
+    if (len_ < N) buf_[len_++] = value;
+    else overflow_ = true;
+    return *this;
+  }
+
+  BinFrame& put(uint32_t value) {
+    size_t n = putVarint(buf_ + len_, N - len_, value);
+    if (!n) overflow_ = true;
+    len_ += n;
+    return *this;
+  }
+
+  BinFrame& putSigned(int32_t value) {
+    size_t n = putSignedVarint(buf_ + len_, N - len_, value);
+    if (!n) overflow_ = true;
+    len_ += n;
+    return *this;
+  }
+
+  const char* data() const { return (const char*)buf_; }
+  size_t length() const { return len_; }
+  bool overflow() const { return overflow_; }
+
+private:
+  uint8_t buf_[N];
+  size_t len_;
+  bool overflow_;
+};
+
+template <class Server>
+bool wantsBinary(Server& server) {
+  if (server.hasArg("fmt")) return server.arg("fmt") == "bin";
+  return server.hasHeader("Accept") && server.header("Accept").indexOf(BIN_CONTENT_TYPE) >= 0;
+}
+
+template <class Server, size_t N>
+void sendBinary(Server& server, int code, const BinFrame<N>& frame) {
+  server.setContentLength(frame.length());
+  server.send(code, BIN_CONTENT_TYPE, "");
+  server.sendContent(frame.data(), frame.length());
+}
+
+#endif
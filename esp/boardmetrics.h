@@ -0,0 +1,191 @@
+#ifndef BOARDMETRICS_H
+#define BOARDMETRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Run-time numbers of a board, served as Prometheus text on /metrics.
+//
+//   http_request_duration_seconds   handler time per route (histogram)
+//   peer_rpc_duration_seconds       request to reply on the PeerLink(s) (histogram)
+//   loop_interval_seconds           time between two loop() passes (histogram)
+//   loop_iterations_per_second      over the last full second
+//   loop_stall_max_seconds          longest time between two loop() passes since boot
+//   heap_free_bytes, heap_free_min_bytes
+//
+// Histograms have log2 buckets: the first ends at 128 us, each next one is twice as
+// wide, the last finite one ends at ~4.2 s. Recording a value is one count leading zeros
+// and two adds, so the instrumentation stays on in production; a histogram is 80 bytes.
+// Routes nobody has called yet are left out of the output.
+//
+// TelemetryServer (telemetryserver.h) owns one, times every route through the route
+// table and answers /metrics with sendMetrics(); loop() calls tickLoop(micros()) first
+// thing, PeerLink::measure() points a link at peerRtt(). On the two-core sketches route
+// times and peer round trips are written by the network task, which also serves
+// /metrics, and the loop numbers by the control loop. Nothing is locked: a scrape that
+// races tickLoop() may miss that one pass.
+
+const uint8_t METRICS_BUCKETS = 16;
+const uint8_t METRICS_FIRST_BUCKET_LOG2 = 7;          // 128 us
+const unsigned long METRICS_WINDOW_US = 1000000;     // loop rate and heap sample
+
+class LatencyHistogram {
+public:
+  LatencyHistogram() : count_(0), sumUs_(0) {
+    for (uint8_t i = 0; i <= METRICS_BUCKETS; i++) buckets_[i] = 0;
+  }
+
+  void record(uint32_t us) {
+    buckets_[bucket(us)]++;
+    count_++;
+    sumUs_ += us;
+  }
+
+  uint32_t count() const { return count_; }
+  uint64_t sumUs() const { return sumUs_; }
+  uint32_t bucketCount(uint8_t i) const { return buckets_[i]; }
+
+  // Upper bound of bucket i, which holds values in (bound(i - 1), bound(i)]
+  static uint32_t bound(uint8_t i) { return (uint32_t)1 << (METRICS_FIRST_BUCKET_LOG2 + i); }
+
+  // Slot METRICS_BUCKETS is everything above the last bound
+  static uint8_t bucket(uint32_t us) {
+    if (us <= bound(0)) return 0;
+    uint8_t log2 = (uint8_t)(32 - __builtin_clz(us - 1));   // smallest n with us <= 2^n
+    uint8_t i = (uint8_t)(log2 - METRICS_FIRST_BUCKET_LOG2);
+    return i < METRICS_BUCKETS ? i : METRICS_BUCKETS;
+  }
+
+private:
+  uint32_t buckets_[METRICS_BUCKETS + 1];
+  uint32_t count_;
+  uint64_t sumUs_;
+};
+
+template <size_t ROUTES>
+class BoardMetrics {
+public:
+  BoardMetrics() : lastLoopUs_(0), windowStartUs_(0), windowLoops_(0), loopRate_(0), stallMaxUs_(0), heapFree_(0), heapMin_(0) {}
+
+  void routeServed(size_t route, uint32_t us) {
+    if (route < ROUTES) routes_[route].record(us);
+  }
+
+  LatencyHistogram& peerRtt() { return peerRtt_; }
+
+  // Call at the top of loop()
+  void tickLoop(unsigned long nowUs) {
+    if (windowStartUs_ == 0) {
+      windowStartUs_ = nowUs ? nowUs : 1;
+      sampleHeap();
+    } else {
+      uint32_t gap = (uint32_t)(nowUs - lastLoopUs_);
+      loopInterval_.record(gap);
+      if (gap > stallMaxUs_) stallMaxUs_ = gap;
+    }
+    lastLoopUs_ = nowUs;
+    windowLoops_++;
+    unsigned long elapsed = nowUs - windowStartUs_;
+    if (elapsed >= METRICS_WINDOW_US) {
+      loopRate_ = (uint32_t)((uint64_t)windowLoops_ * 1000000 / elapsed);
+      windowLoops_ = 0;
+      windowStartUs_ = nowUs ? nowUs : 1;
+      sampleHeap();
+    }
+  }
+
+  // Out has print(const char*) (PageStream); paths are the route table's, by index
+  template <class Out, class Paths>
+  void write(Out& out, const Paths& paths) const {
+    header(out, "http_request_duration_seconds", "histogram", "Handler time per route");
+    for (size_t i = 0; i < ROUTES; i++) {
+      if (routes_[i].count()) histogram(out, "http_request_duration_seconds", "route", paths.path(i), routes_[i]);
+    }
+    header(out, "peer_rpc_duration_seconds", "histogram", "Peer request to reply");
+    histogram(out, "peer_rpc_duration_seconds", NULL, NULL, peerRtt_);
+    header(out, "loop_interval_seconds", "histogram", "Time between two loop() passes");
+    histogram(out, "loop_interval_seconds", NULL, NULL, loopInterval_);
+    header(out, "loop_iterations_per_second", "gauge", "loop() passes over the last second");
+    value(out, "loop_iterations_per_second", loopRate_);
+    header(out, "loop_stall_max_seconds", "gauge", "Longest time between two loop() passes since boot");
+    seconds(out, "loop_stall_max_seconds", NULL, NULL, stallMaxUs_);
+    header(out, "heap_free_bytes", "gauge", "Free heap at the last sample");
+    value(out, "heap_free_bytes", heapFree_);
+    header(out, "heap_free_min_bytes", "gauge", "Lowest free heap since boot");
+    value(out, "heap_free_min_bytes", heapMin_);
+  }
+
+private:
+  void sampleHeap() {
+    heapFree_ = ESP.getFreeHeap();
+#if defined(ESP8266)
+    if (heapMin_ == 0 || heapFree_ < heapMin_) heapMin_ = heapFree_;
+#else
+    heapMin_ = ESP.getMinFreeHeap();   // the allocator's own low-water mark
+#endif
+  }
+
+  template <class Out>
+  static void header(Out& out, const char* name, const char* type, const char* help) {
+    char line[128];
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    out.print(line);
+  }
+
+  template <class Out>
+  static void value(Out& out, const char* name, uint32_t v) {
+    char line[64];
+    snprintf(line, sizeof(line), "%s %lu\n", name, (unsigned long)v);
+    out.print(line);
+  }
+
+  // name{label="labelValue"} in seconds, without printf("%f")
+  template <class Out>
+  static void seconds(Out& out, const char* name, const char* label, const char* labelValue, uint64_t us) {
+    char line[176];
+    char labels[80] = "";
+    if (label) snprintf(labels, sizeof(labels), "{%s=\"%s\"}", label, labelValue);
+    snprintf(line, sizeof(line), "%s%s %lu.%06lu\n", name, labels, (unsigned long)(us / 1000000), (unsigned long)(us % 1000000));
+    out.print(line);
+  }
+
+  template <class Out>
+  static void histogram(Out& out, const char* name, const char* label, const char* labelValue, const LatencyHistogram& h) {
+    char line[160];
+    char prefix[96];
+    if (label) snprintf(prefix, sizeof(prefix), "%s_bucket{%s=\"%s\",", name, label, labelValue);
+    else snprintf(prefix, sizeof(prefix), "%s_bucket{", name);
+    uint32_t cumulative = 0;
+    for (uint8_t i = 0; i <= METRICS_BUCKETS; i++) {
+      cumulative += h.bucketCount(i);
+      if (i < METRICS_BUCKETS) {
+        uint32_t b = LatencyHistogram::bound(i);
+        snprintf(line, sizeof(line), "%sle=\"%lu.%06lu\"} %lu\n", prefix, (unsigned long)(b / 1000000),
+                 (unsigned long)(b % 1000000), (unsigned long)cumulative);
+      } else {
+        snprintf(line, sizeof(line), "%sle=\"+Inf\"} %lu\n", prefix, (unsigned long)cumulative);
+      }
+      out.print(line);
+    }
+    char sumName[64];
+    snprintf(sumName, sizeof(sumName), "%s_sum", name);
+    seconds(out, sumName, label, labelValue, h.sumUs());
+    if (label) snprintf(line, sizeof(line), "%s_count{%s=\"%s\"} %lu\n", name, label, labelValue, (unsigned long)h.count());
+    else snprintf(line, sizeof(line), "%s_count %lu\n", name, (unsigned long)h.count());
+    out.print(line);
+  }
+
+  LatencyHistogram routes_[ROUTES];
+  LatencyHistogram peerRtt_;
+  LatencyHistogram loopInterval_;
+  unsigned long lastLoopUs_;
+  unsigned long windowStartUs_;   // 0 until the first tickLoop()
+  uint32_t windowLoops_;
+  uint32_t loopRate_;
+  uint32_t stallMaxUs_;
+  uint32_t heapFree_;
+  uint32_t heapMin_;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef CORETASKS_H
+#define CORETASKS_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Network and control on the two cores of the ESP32.
+//
+// In one loop() a slow HTTP client, a flash write or a blocking request held up the
+// pump timer and the servo sequence. The ESP32 sketches now run everything that waits
+// on the network or on flash (web server, WiFi, peers, history log) in a task pinned to
+// NETWORK_CORE, next to the WiFi driver; loop() keeps running on the other core (Arduino
+// pins it there) and does nothing but control: sensors, servo, pump, motors. Each pass
+// of it takes a bounded time whatever arrives over the network.
+//
+// The two sides share no variables. The network task hands requests to the control
+// loop through a ControlLink:
+//
+//   network task                          control loop (loop())
+//   link.run(command)  -- SpscQueue -->   link.next(&command), apply it
+//                      <-- Snapshot ---   fill link.edit(), link.publish()
+//   link.state()
+//
+// run() waits until the command has been applied and the state after it published
+// (a millisecond or two), so a handler answers with the new state as before. Handlers
+// read everything else from state(); the control loop publishes it every few tens of
+// milliseconds and after every batch of commands. A reference from state() stays valid
+// until the next state(), run() or waitFor(). Work the control loop hands back to
+// the network (history records, notifications to other boards) goes through a second
+// SpscQueue the other way.
+//
+// SpscQueue is a ring of fixed slots with one atomic index per side, and Snapshot a
+// triple buffer: neither side ever takes a lock or waits for the other. Both are only
+// safe with exactly one producer and one consumer task.
+//
+// Include this after the board's Arduino core (millis(), vTaskDelay()); the host build
+// runs the tasks as pthreads (host/freertos/task.h).
+
+const int NETWORK_CORE = 0;
+const unsigned NETWORK_TASK_PRIORITY = 1;
+const uint32_t NETWORK_TASK_STACK = 8192;       // bytes
+const unsigned long CONTROL_REPLY_MS = 250;     // longest wait for a command to be applied
+
+template <class T, size_t N>
+class SpscQueue {
+public:
+  static_assert(N > 0 && (N & (N - 1)) == 0, "queue size must be a power of two");
+
+  SpscQueue() : head_(0), tail_(0) {}
+
+  // Producer only; false when the queue is full
+  bool push(const T& item) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == N) return false;
+    items_[head & (N - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only; false when the queue is empty
+  bool pop(T* out) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == tail) return false;
+    *out = items_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Free slots as the producer sees them (the consumer can only add to them)
+  size_t room() const { return N - (head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire)); }
+
+private:
+  T items_[N];
+  std::atomic<size_t> head_;
+  std::atomic<size_t> tail_;
+};
+
+// Latest state from one writer task for one reader task. The writer fills the buffer
+// from edit() completely (it holds an old state) and publishes it; the reader gets the
+// newest published buffer from read(), which stays untouched until its next read().
+template <class T>
+class Snapshot {
+public:
+  explicit Snapshot(const T& initial) : buffers_{initial, initial, initial}, middle_(1), back_(0), front_(2) {}
+
+  T& edit() { return buffers_[back_]; }
+
+  void publish() { back_ = middle_.exchange((uint8_t)(back_ | FRESH), std::memory_order_acq_rel) & INDEX; }
+
+  const T& read() {
+    if (middle_.load(std::memory_order_relaxed) & FRESH) {
+      front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+    }
+    return buffers_[front_];
+  }
+
+private:
+  static const uint8_t INDEX = 0x03;
+  static const uint8_t FRESH = 0x04;
+
+  T buffers_[3];
+  std::atomic<uint8_t> middle_;   // index of the buffer between the two, FRESH once published
+  uint8_t back_;                  // writer's
+  uint8_t front_;                 // reader's
+};
+
+// Command is a struct with a uint32_t seq member, State the control loop's published state
+template <class Command, class State, size_t N = 16>
+class ControlLink {
+public:
+  explicit ControlLink(const State& initial) : state_(initial), posted_(0), taken_(0), applied_(0) {}
+
+  // --- network task ---
+
+  // Queues a command and returns its number, 0 when the queue is full
+  uint32_t post(Command command) {
+    command.seq = posted_ + 1;
+    if (!commands_.push(command)) return 0;
+    return ++posted_;
+  }
+
+  // Queues a command and waits until the state after it is published
+  bool run(const Command& command, unsigned long timeoutMs = CONTROL_REPLY_MS) {
+    uint32_t seq = post(command);
+    return seq && waitFor([this, seq](const State&) { return (int32_t)(applied() - seq) >= 0; }, timeoutMs);
+  }
+
+  // Waits until done(state) holds, re-reading the state every millisecond
+  template <class Done>
+  bool waitFor(Done done, unsigned long timeoutMs) {
+    unsigned long start = millis();
+    while (!done(state())) {
+      if (millis() - start >= timeoutMs) return false;
+      vTaskDelay(1);
+    }
+    return true;
+  }
+
+  const State& state() { return state_.read(); }
+  size_t room() const { return commands_.room(); }
+  uint32_t applied() const { return applied_.load(std::memory_order_acquire); }
+
+  // --- control loop ---
+
+  bool next(Command* out) {
+    if (!commands_.pop(out)) return false;
+    taken_ = out->seq;
+    return true;
+  }
+
+  State& edit() { return state_.edit(); }
+
+  // Commands taken with next() count as applied once this state is out
+  void publish() {
+    state_.publish();
+    applied_.store(taken_, std::memory_order_release);
+  }
+
+private:
+  SpscQueue<Command, N> commands_;
+  Snapshot<State> state_;
+  uint32_t posted_;   // network task's
+  uint32_t taken_;    // control loop's
+  std::atomic<uint32_t> applied_;
+};
+
+#endif
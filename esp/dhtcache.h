@@ -0,0 +1,76 @@
+#ifndef DHTCACHE_H
+#define DHTCACHE_H
+
+#include <math.h>
+#include <stdint.h>
+
+// Cached DHT22 temperature/humidity.
+//
+// A DHT22 transaction bit-bangs for several milliseconds with interrupts off, and the
+// sensor returns stale data if read more often than every 2 s. tick() is called from
+// loop() and reads the sensor on its own schedule; handlers use the last good values and
+// their age and never touch the sensor themselves.
+//
+// A failed read (NaN) keeps the previous good values and is retried with exponential
+// backoff, 2 s doubling up to DHT_MAX_BACKOFF_MS. Before the first good read the values
+// are NaN, which JsonWriter reports as null.
+//
+// SensorT is the Adafruit DHT class (readTemperature()/readHumidity()).
+
+const unsigned long DHT_MIN_INTERVAL_MS = 2000;
+const unsigned long DHT_MAX_BACKOFF_MS = 60000;
+
+template <class SensorT>
+class DhtCache {
+public:
+  explicit DhtCache(SensorT& sensor, unsigned long refreshMs = DHT_MIN_INTERVAL_MS)
+    : sensor_(sensor), refresh_(refreshMs < DHT_MIN_INTERVAL_MS ? DHT_MIN_INTERVAL_MS : refreshMs),
+      temperature_(NAN), humidity_(NAN), lastGood_(0), nextRead_(0), failures_(0), valid_(false) {}
+
+  // Returns true when the sensor was read on this call (successfully or not).
+  bool tick(unsigned long now) {
+    if ((long)(now - nextRead_) < 0) return false;
+
+    float t = sensor_.readTemperature();
+    float h = sensor_.readHumidity();
+    if (isnan(t) || isnan(h)) {
+      if (failures_ < 255) failures_++;
+      unsigned long backoff = DHT_MIN_INTERVAL_MS;
+      for (uint8_t i = 1; i < failures_ && backoff < DHT_MAX_BACKOFF_MS; i++) backoff *= 2;
+      nextRead_ = now + (backoff < DHT_MAX_BACKOFF_MS ? backoff : DHT_MAX_BACKOFF_MS);
+      return true;
+    }
+
+    temperature_ = t;
+    humidity_ = h;
+    lastGood_ = now;
+    failures_ = 0;
+    valid_ = true;
+    nextRead_ = now + refresh_;
+    return true;
+  }
+
+  // At least one good reading so far
+  bool valid() const { return valid_; }
+
+  float temperature() const { return temperature_; }
+  float humidity() const { return humidity_; }
+
+  // Milliseconds since the values were read, 0 before the first good read
+  unsigned long age(unsigned long now) const { return valid_ ? now - lastGood_ : 0; }
+
+  // Consecutive failed reads since the last good one
+  uint8_t failures() const { return failures_; }
+
+private:
+  SensorT& sensor_;
+  unsigned long refresh_;
+  float temperature_;
+  float humidity_;
+  unsigned long lastGood_;
+  unsigned long nextRead_;
+  uint8_t failures_;
+  bool valid_;
+};
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef DOSECONTROLLER_H
+#define DOSECONTROLLER_H
+
+#include <stddef.h>
+
+// Closed-loop watering: pulse the pump, let the water soak in, re-sample, repeat.
+//
+// The dose is estimated from the gap between the soil reading and the target and a
+// per-zone gain (how many ADC units one second of pumping moves the reading). Each pulse
+// covers 3/4 of the remaining estimate, so the soil approaches the target from the dry
+// side instead of overshooting. Every pulse/sample pair updates the zone's gain, so later
+// doses start closer to the right size.
+//
+// Same model as SensorCycle: the sketch calls begin() with a fresh reading and
+// tick(millis()) from loop(). tick() returns the one thing the sketch has to do now
+// (switch the pump, take a soil sample and hand it to sample()). A dose ends when the
+// target is reached, the run-time budget is spent, or two pulses in a row moved the
+// reading by less than minResponse (probe out of the soil, empty tank).
+
+enum DoseAction {
+  DOSE_IDLE = 0,       // nothing to do this tick
+  DOSE_PUMP_ON,        // start the pump for pulseMs()
+  DOSE_PUMP_OFF,       // stop the pump
+  DOSE_SAMPLE,         // read the soil and pass the value to sample()
+  DOSE_DONE            // dose finished, see result()
+};
+
+enum DoseResult {
+  DOSE_NONE = 0,
+  DOSE_TARGET_REACHED,
+  DOSE_BUDGET_SPENT,
+  DOSE_NO_RESPONSE,
+  DOSE_CANCELLED
+};
+
+struct DoseTiming {
+  unsigned long minPulseMs;    // shorter pulses are not worth switching the relay for
+  unsigned long maxPulseMs;    // longest single pulse
+  unsigned long soakMs;        // wait after a pulse before re-sampling
+  int minResponse;             // smaller changes of the reading are sensor noise
+};
+
+const long DOSE_GAIN_SCALE = 16;         // gains are ADC units per second * 16
+const long DOSE_GAIN_MIN = DOSE_GAIN_SCALE;
+const long DOSE_GAIN_MAX = 4095L * DOSE_GAIN_SCALE;
+const int DOSE_NO_RESPONSE_LIMIT = 2;
+
+template <size_t MAX_ZONES = 8>
+class DoseController {
+public:
+  // higherIsDrier follows the sensor: true for the capacitive probes on the ESP32
+  // boards (reading rises as the soil dries), false for sensors that read low when dry.
+  // initialGain is the guess (ADC units per second) used until a zone has been learned.
+  DoseController(const DoseTiming& timing, bool higherIsDrier, long initialGain)
+    : timing_(timing), higherIsDrier_(higherIsDrier), phase_(PHASE_IDLE), pending_(DOSE_IDLE),
+      result_(DOSE_NONE), zone_(0), target_(0), lastReading_(0), budgetMs_(0), pumpedMs_(0),
+      pulseMs_(0), phaseStart_(0), pulses_(0), noResponse_(0) {
+    for (size_t i = 0; i < MAX_ZONES; i++) {
+      gain_[i] = clampGain(initialGain * DOSE_GAIN_SCALE);
+      learned_[i] = 0;
+    }
+  }
+
+  // Starts a dose for the zone. Returns false (and does nothing) when the soil is
+  // already at the target or the budget does not allow a single pulse.
+  bool begin(int zone, int reading, int target, unsigned long budgetMs, unsigned long now) {
+    if (active() || zone < 0 || (size_t)zone >= MAX_ZONES) return false;
+    zone_ = zone;
+    target_ = target;
+    budgetMs_ = budgetMs;
+    pumpedMs_ = 0;
+    pulses_ = 0;
+    noResponse_ = 0;
+    result_ = DOSE_NONE;
+    lastReading_ = reading;
+    return nextPulse(reading, now);
+  }
+
+  DoseAction tick(unsigned long now) {
+    if (pending_ != DOSE_IDLE) {
+      DoseAction action = pending_;
+      pending_ = DOSE_IDLE;
+      return action;
+    }
+
+    unsigned long elapsed = now - phaseStart_;
+    switch (phase_) {
+      case PHASE_PULSING:
+        if (elapsed < pulseMs_) return DOSE_IDLE;
+        pumpedMs_ += pulseMs_;
+        enter(PHASE_SOAKING, now);
+        return DOSE_PUMP_OFF;
+
+      case PHASE_SOAKING:
+        if (elapsed < timing_.soakMs) return DOSE_IDLE;
+        enter(PHASE_AWAIT_SAMPLE, now);
+        return DOSE_SAMPLE;
+
+      default:
+        return DOSE_IDLE;
+    }
+  }
+
+  // Reading taken after DOSE_SAMPLE. Learns from the last pulse and schedules the next.
+  void sample(int reading, unsigned long now) {
+    if (phase_ != PHASE_AWAIT_SAMPLE) return;
+    long moved = higherIsDrier_ ? (long)lastReading_ - reading : (long)reading - lastReading_;
+    if (moved >= timing_.minResponse && moved > 0) {
+      long observed = clampGain(moved * 1000L * DOSE_GAIN_SCALE / (long)pulseMs_);
+      long& gain = gain_[zone_];
+      gain = learned_[zone_] ? (3 * gain + observed) / 4 : observed;
+      if (learned_[zone_] < 0xFFFF) learned_[zone_]++;
+      noResponse_ = 0;
+    } else if (++noResponse_ >= DOSE_NO_RESPONSE_LIMIT) {
+      lastReading_ = reading;
+      finish(DOSE_NO_RESPONSE);
+      return;
+    }
+    lastReading_ = reading;
+    nextPulse(reading, now);
+  }
+
+  // Stops the dose right away. Returns true when the pump was on and has to be stopped
+  // by the caller (no DOSE_PUMP_OFF is issued).
+  bool cancel(unsigned long now) {
+    if (!active()) return false;
+    bool pumping = phase_ == PHASE_PULSING;
+    if (pumping) {
+      unsigned long ran = now - phaseStart_;
+      pumpedMs_ += ran < pulseMs_ ? ran : pulseMs_;
+    }
+    finish(DOSE_CANCELLED);
+    pending_ = DOSE_IDLE;
+    return pumping;
+  }
+
+  // Pump run time (ms) expected to bring the reading to the target with the zone's gain
+  unsigned long estimateMs(int zone, int reading, int target) const {
+    long gap = higherIsDrier_ ? (long)reading - target : (long)target - reading;
+    if (gap <= 0 || zone < 0 || (size_t)zone >= MAX_ZONES) return 0;
+    return (unsigned long)(gap * 1000L * DOSE_GAIN_SCALE / gain_[zone]);
+  }
+
+  bool active() const { return phase_ != PHASE_IDLE || pending_ != DOSE_IDLE; }
+  bool pumping() const { return phase_ == PHASE_PULSING; }
+  int zone() const { return zone_; }
+  unsigned long pulseMs() const { return pulseMs_; }
+  unsigned long pumpedMs() const { return pumpedMs_; }
+  unsigned int pulses() const { return pulses_; }
+  int lastReading() const { return lastReading_; }
+  DoseResult result() const { return result_; }
+
+  // Learned response in ADC units per second of pumping
+  long gain(int zone) const { return gain_[zone] / DOSE_GAIN_SCALE; }
+  unsigned int learnedPulses(int zone) const { return learned_[zone]; }
+
+  static const char* resultName(DoseResult result) {
+    switch (result) {
+      case DOSE_TARGET_REACHED: return "target_reached";
+      case DOSE_BUDGET_SPENT: return "budget_spent";
+      case DOSE_NO_RESPONSE: return "no_response";
+      case DOSE_CANCELLED: return "cancelled";
+      default: return "none";
+    }
+  }
+
+private:
+  enum Phase {
+    PHASE_IDLE = 0,
+    PHASE_PULSING,       // pump on
+    PHASE_SOAKING,       // pump off, water soaking towards the probe
+    PHASE_AWAIT_SAMPLE   // waiting for sample()
+  };
+
+  bool nextPulse(int reading, unsigned long now) {
+    unsigned long estimate = estimateMs(zone_, reading, target_);
+    if (estimate == 0) {
+      finish(DOSE_TARGET_REACHED);
+      return false;
+    }
+    unsigned long pulse = estimate * 3 / 4;
+    unsigned long left = budgetMs_ > pumpedMs_ ? budgetMs_ - pumpedMs_ : 0;
+    if (pulse < timing_.minPulseMs) pulse = timing_.minPulseMs;
+    if (pulse > timing_.maxPulseMs) pulse = timing_.maxPulseMs;
+    if (pulse > left) pulse = left;
+    if (pulse < timing_.minPulseMs) {
+      finish(DOSE_BUDGET_SPENT);
+      return false;
+    }
+    pulseMs_ = pulse;
+    pulses_++;
+    enter(PHASE_PULSING, now);
+    pending_ = DOSE_PUMP_ON;
+    return true;
+  }
+
+  void enter(Phase phase, unsigned long now) {
+    phase_ = phase;
+    phaseStart_ = now;
+  }
+
+  void finish(DoseResult result) {
+    bool started = pulses_ > 0;
+    phase_ = PHASE_IDLE;
+    result_ = result;
+    pending_ = started ? DOSE_DONE : DOSE_IDLE;
+  }
+
+  static long clampGain(long gain) {
+    if (gain < DOSE_GAIN_MIN) return DOSE_GAIN_MIN;
+    if (gain > DOSE_GAIN_MAX) return DOSE_GAIN_MAX;
+    return gain;
+  }
+
+  DoseTiming timing_;
+  bool higherIsDrier_;
+  Phase phase_;
+  DoseAction pending_;
+  DoseResult result_;
+  int zone_;
+  int target_;
+  int lastReading_;
+  unsigned long budgetMs_;
+  unsigned long pumpedMs_;
+  unsigned long pulseMs_;
+  unsigned long phaseStart_;
+  unsigned int pulses_;
+  int noResponse_;
+  long gain_[MAX_ZONES];
+  unsigned int learned_[MAX_ZONES];
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef DRIVETRAIN_H
+#define DRIVETRAIN_H
+
+#include <stdint.h>
+#include "motionqueue.h"
+
+// Two-motor H-bridge (L298N) shared by the rover boards. IN1/IN2 drive the left motor,
+// IN3/IN4 the right one and ENA/ENB set their speed; turns spin the wheels against each
+// other. Directions are MotionDirection codes, so MotionQueue output goes straight in.
+//
+// How ENA/ENB are driven is the enable policy, picked per board:
+//
+//   DigitalEnable      switched full on or off
+//   AnalogEnable       analogWrite() duty 0-255 (ESP8266)
+//   LedcEnable<A, B>   LEDC channels A and B, 1 kHz 8-bit (ESP32)
+//
+// Only the policy a sketch names is instantiated. Direction pins are written only when
+// the direction changes, the enables on every apply().
+
+struct DigitalEnable {
+  static void begin(int ena, int enb) {
+    pinMode(ena, OUTPUT);
+    pinMode(enb, OUTPUT);
+  }
+  static void write(int ena, int enb, uint8_t left, uint8_t right) {
+    digitalWrite(ena, left ? HIGH : LOW);
+    digitalWrite(enb, right ? HIGH : LOW);
+  }
+};
+
+struct AnalogEnable {
+  static void begin(int ena, int enb) {
+    pinMode(ena, OUTPUT);
+    pinMode(enb, OUTPUT);
+    analogWriteRange(255);   // duty 0-255 like the ESP32 boards
+  }
+  static void write(int ena, int enb, uint8_t left, uint8_t right) {
+    analogWrite(ena, left);
+    analogWrite(enb, right);
+  }
+};
+
+#if !defined(ESP8266)
+template <uint8_t CHANNEL_A, uint8_t CHANNEL_B>
+struct LedcEnable {
+  static void begin(int ena, int enb) {
+    ledcSetup(CHANNEL_A, 1000, 8);
+    ledcAttachPin(ena, CHANNEL_A);
+    ledcSetup(CHANNEL_B, 1000, 8);
+    ledcAttachPin(enb, CHANNEL_B);
+  }
+  static void write(int ena, int enb, uint8_t left, uint8_t right) {
+    (void)ena;
+    (void)enb;
+    ledcWrite(CHANNEL_A, left);
+    ledcWrite(CHANNEL_B, right);
+  }
+};
+#endif
+
+template <int ENA, int ENB, int IN1, int IN2, int IN3, int IN4, class Enable>
+class DriveTrain {
+public:
+  DriveTrain() : direction_(MOTION_STOP) {}
+
+  void begin() {
+    const int pins[] = {IN1, IN2, IN3, IN4};
+    for (int pin : pins) {
+      pinMode(pin, OUTPUT);
+      digitalWrite(pin, LOW);
+    }
+    Enable::begin(ENA, ENB);
+    stop();
+  }
+
+  // Per-wheel duty; returns true when the direction changed
+  bool apply(uint8_t direction, uint8_t leftDuty, uint8_t rightDuty) {
+    bool changed = direction != direction_;
+    if (changed) {
+      writeDirection(direction);
+      direction_ = direction;
+    }
+    if (direction == MOTION_STOP) leftDuty = rightDuty = 0;
+    Enable::write(ENA, ENB, leftDuty, rightDuty);
+    return changed;
+  }
+
+  bool apply(uint8_t direction, uint8_t duty) { return apply(direction, duty, duty); }
+
+  // Immediate stop, every pin low
+  void stop() {
+    writeDirection(MOTION_STOP);
+    Enable::write(ENA, ENB, 0, 0);
+    direction_ = MOTION_STOP;
+  }
+
+  uint8_t direction() const { return direction_; }
+  bool moving() const { return direction_ != MOTION_STOP; }
+
+private:
+  static void writeDirection(uint8_t direction) {
+    bool leftAhead = direction == MOTION_FORWARD || direction == MOTION_RIGHT;
+    bool leftBack = direction == MOTION_BACKWARD || direction == MOTION_LEFT;
+    bool rightAhead = direction == MOTION_FORWARD || direction == MOTION_LEFT;
+    bool rightBack = direction == MOTION_BACKWARD || direction == MOTION_RIGHT;
+    digitalWrite(IN1, leftAhead ? HIGH : LOW);
+    digitalWrite(IN2, leftBack ? HIGH : LOW);
+    digitalWrite(IN3, rightAhead ? HIGH : LOW);
+    digitalWrite(IN4, rightBack ? HIGH : LOW);
+  }
+
+  uint8_t direction_;
+};
+
+#endif
@@ -1,5 +1,11 @@
 #include <ESP8266WiFi.h>
 #include <ESP8266WebServer.h>
+#include <LittleFS.h>
+#include <WiFiUdp.h>
+#include "wifilink.h"
+#include "peerbeacon.h"
+#include "pumpactuator.h"
+#include "telemetryserver.h"
 
 // WiFi credentials
 const char* ssid = "SDP";
@@ -10,31 +16,52 @@ const int RELAY_PIN = D4; // Relay IN connected to D4 (GPIO2 on ESP8266)
 
 ESP8266WebServer server(80);
 
+// Network join from the cached access point and lease, peers found by their beacons
+WiFiLink<fs::FS> wifi(LittleFS);
+PeerBeacon<WiFiUDP> beacon(PEER_ROLE_PUMP, "esppump");
+
+PumpActuator<RELAY_PIN, true> pump;   // active LOW relay
+
+// Forward declarations
+void handleRoot();
+void handlePumpStart();
+void handlePumpStop();
+void handleMetrics();
+
+constexpr Route ROUTES[] = {
+  {"/", ROUTE_GET, handleRoot},
+  {"/pump_start", ROUTE_GET, handlePumpStart},
+  {"/pump_stop", ROUTE_GET, handlePumpStop},
+  {"/metrics", ROUTE_GET, handleMetrics},
+};
+constexpr uint32_t ROUTE_SEED = routeSeed(ROUTES);
+TelemetryServer<ESP8266WebServer, sizeof(ROUTES) / sizeof(ROUTES[0])> web(server, ROUTES, ROUTE_SEED);
+
 void setup() {
   Serial.begin(115200);
-  pinMode(RELAY_PIN, OUTPUT);
-  digitalWrite(RELAY_PIN, HIGH); // Pump OFF at startup (active LOW relay)
-
-  WiFi.begin(ssid, password);
-  Serial.print("Connecting to WiFi...");
-  WiFi.setSleep(false);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(250);
-    Serial.print(".");
-  }
-  Serial.println("\nConnected!");
-  Serial.print("IP: "); Serial.println(WiFi.localIP());
+  pump.begin();   // Pump OFF at startup
 
-  server.on("/", HTTP_GET, handleRoot);
-  server.on("/pump_start", HTTP_GET, handlePumpStart);
-  server.on("/pump_stop", HTTP_GET, handlePumpStop);
+  // Joins in the background from loop(), from the cached access point when there is one
+  LittleFS.begin();
+  wifi.begin(ssid, password);
+  beacon.begin();
 
-  server.begin();
+  web.begin();   // ROUTES, CORS and preflight included
   Serial.println("HTTP server started");
+  enableLoopWatchdog();
 }
 
 void loop() {
-  server.handleClient();
+  web.metrics().tickLoop(micros());
+  web.handleClient();
+  wifi.tick(millis());
+  beacon.tick(millis(), wifi.connected());
+
+  // The timer interrupt has already switched the relay off
+  if (pump.due(millis())) {
+    pump.stop(millis());
+    Serial.println("Pump stopped (longest run reached)");
+  }
 }
 
 void handleRoot() {
@@ -46,16 +73,18 @@ void handleRoot() {
   server.send(200, "text/html", html);
 }
 
+void handleMetrics() {
+  web.sendMetrics();
+}
+
 void handlePumpStart() {
-  digitalWrite(RELAY_PIN, LOW); // Turn ON relay (pump ON, active LOW)
+  pump.start(millis());   // runs until /pump_stop, PUMP_MAX_RUN_MS at most
   Serial.println("Pump started");
-  server.sendHeader("Access-Control-Allow-Origin", "*");
   server.send(200, "application/json", "{\"pump\":\"ON\"}");
 }
 
 void handlePumpStop() {
-  digitalWrite(RELAY_PIN, HIGH); // Turn OFF relay (pump OFF, active LOW)
+  pump.stop(millis());
   Serial.println("Pump stopped");
-  server.sendHeader("Access-Control-Allow-Origin", "*");
   server.send(200, "application/json", "{\"pump\":\"OFF\"}");
 }
\ No newline at end of file
@@ -0,0 +1,540 @@
+#ifndef HISTORYSTORE_H
+#define HISTORYSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "binframe.h"
+#include "pagestream.h"
+#include "varint.h"
+
+// Sensor history: a RAM ring of compressed blocks, sealed blocks appended to a flash log.
+//
+// Records are soil readings, climate samples (water level, temperature, humidity) and
+// pump runs, timestamped in seconds since boot. They are packed into 256-byte blocks:
+// each record is a kind byte, the time since the previous record and, per channel, the
+// change from the previous record of the same kind, all as (zig-zag) varints. A climate
+// sample a minute apart takes about 5 bytes. Every block starts from zero, so any block
+// decodes on its own.
+//
+// The newest BLOCKS blocks stay in RAM (4 KB for 16). A block is sealed when it is full
+// or an hour old, and handed to onSeal(), which the sketches use to append it to a
+// HistoryLog on LittleFS: two files of 32 KB that take turns, about ten days of history.
+// On power loss at most the open block (up to an hour) is lost.
+//
+// Each boot gets the next number from the log, so older runs stay queryable by boot
+// even though their timestamps restart at 0. HistoryQuery averages (or sums) the
+// records that fall into fixed time buckets, so /history answers with at most 60 points
+// per series however long the range is, as JSON or as a binary frame (binframe.h).
+//
+// A board that deep-sleeps between samples (battery mode, sleepcycle.h) restarts at
+// every wake. It keeps the open block in RTC memory instead (retain() before sleeping,
+// resume() after the wake), so the block goes on filling under the same boot number
+// and the time since the first boot.
+
+enum HistoryKind {
+  HISTORY_CLIMATE = 1,   // water level, temperature * 10, humidity * 10
+  HISTORY_SOIL,          // soil reading, zone
+  HISTORY_PUMP           // run time in 0.1 s, zone
+};
+
+const int HISTORY_KINDS = 4;
+const int HISTORY_CHANNELS = 3;
+const int32_t HISTORY_MISSING = -32768;     // no value (failed DHT read)
+const size_t HISTORY_BLOCK_SIZE = 256;
+const size_t HISTORY_HEADER_SIZE = 12;      // magic, boot, start second, length, records
+const uint16_t HISTORY_MAGIC = 0x4853;
+const uint32_t HISTORY_SEAL_SEC = 3600;
+const char* const HISTORY_LOG_CURRENT = "/history.0";
+const char* const HISTORY_LOG_PREVIOUS = "/history.1";
+
+struct HistoryRecord {
+  uint32_t sec;
+  uint8_t kind;
+  int32_t value[HISTORY_CHANNELS];
+};
+
+inline int historyChannels(uint8_t kind) {
+  switch (kind) {
+    case HISTORY_CLIMATE: return 3;
+    case HISTORY_SOIL:
+    case HISTORY_PUMP: return 2;
+    default: return 0;
+  }
+}
+
+// Block headers are little-endian
+inline uint16_t historyGet16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+inline uint32_t historyGet32(const uint8_t* p) { return historyGet16(p) | ((uint32_t)historyGet16(p + 2) << 16); }
+inline void historyPut16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+inline void historyPut32(uint8_t* p, uint32_t v) { historyPut16(p, (uint16_t)v); historyPut16(p + 2, (uint16_t)(v >> 16)); }
+
+inline bool historyBlockValid(const uint8_t* block) {
+  return historyGet16(block) == HISTORY_MAGIC && historyGet16(block + 8) <= HISTORY_BLOCK_SIZE - HISTORY_HEADER_SIZE;
+}
+inline uint16_t historyBlockBoot(const uint8_t* block) { return historyGet16(block + 2); }
+inline uint32_t historyBlockStart(const uint8_t* block) { return historyGet32(block + 4); }
+
+class HistoryBlockReader {
+public:
+  explicit HistoryBlockReader(const uint8_t* block)
+    : block_(block), pos_(HISTORY_HEADER_SIZE), end_(HISTORY_HEADER_SIZE + historyGet16(block + 8)),
+      sec_(historyBlockStart(block)) {
+    memset(last_, 0, sizeof(last_));
+  }
+
+  // False at the end of the block (or at a record that does not decode)
+  bool next(HistoryRecord* out) {
+    if (pos_ >= end_) return false;
+    uint8_t kind = block_[pos_++];
+    int channels = historyChannels(kind);
+    uint32_t dt;
+    size_t n = channels ? getVarint(block_ + pos_, end_ - pos_, &dt) : 0;
+    if (!n) return stop();
+    pos_ += n;
+    sec_ += dt;
+    out->sec = sec_;
+    out->kind = kind;
+    for (int c = 0; c < HISTORY_CHANNELS; c++) {
+      if (c < channels) {
+        int32_t delta;
+        n = getSignedVarint(block_ + pos_, end_ - pos_, &delta);
+        if (!n) return stop();
+        pos_ += n;
+        last_[kind][c] = deltaDecode(last_[kind][c], delta);
+      }
+      out->value[c] = c < channels ? last_[kind][c] : 0;
+    }
+    return true;
+  }
+
+private:
+  bool stop() {
+    pos_ = end_;
+    return false;
+  }
+
+  const uint8_t* block_;
+  size_t pos_;
+  size_t end_;
+  uint32_t sec_;
+  int32_t last_[HISTORY_KINDS][HISTORY_CHANNELS];
+};
+
+// Open block and encoder state as plain data, for RTC memory
+struct HistoryRetained {
+  uint16_t boot;
+  bool open;
+  uint32_t lastSec;
+  int32_t last[HISTORY_KINDS][HISTORY_CHANNELS];
+  uint8_t block[HISTORY_BLOCK_SIZE];
+};
+
+typedef void (*HistorySealCallback)(const uint8_t* block, void* context);
+
+template <size_t BLOCKS = 16>
+class HistoryStore {
+public:
+  HistoryStore()
+    : boot_(0), head_(0), count_(0), open_(false), seconds_(0), lastMs_(0), lastSec_(0), sealed_(NULL),
+      sealedContext_(NULL) {}
+
+  void begin(uint16_t boot, unsigned long now) {
+    boot_ = boot;
+    lastMs_ = now;
+    seconds_ = 0;
+  }
+
+  // Picks up after retain() on an earlier wake; sec is the time since the first boot.
+  // Sealed blocks are on flash already, RAM starts with the open block only.
+  void resume(const HistoryRetained& in, uint32_t sec, unsigned long now) {
+    boot_ = in.boot;
+    seconds_ = sec;
+    lastMs_ = now;
+    head_ = 0;
+    count_ = 0;
+    open_ = false;
+    if (!in.open || historyGet16(in.block) != HISTORY_MAGIC) return;
+    memcpy(blocks_[0], in.block, HISTORY_BLOCK_SIZE);
+    memcpy(last_, in.last, sizeof(last_));
+    lastSec_ = in.lastSec;
+    count_ = 1;
+    open_ = true;
+  }
+
+  void retain(HistoryRetained* out) const {
+    out->boot = boot_;
+    out->open = open_;
+    out->lastSec = lastSec_;
+    memcpy(out->last, last_, sizeof(last_));
+    if (open_) memcpy(out->block, openBlockData(), HISTORY_BLOCK_SIZE);
+  }
+
+  void onSeal(HistorySealCallback callback, void* context = NULL) {
+    sealed_ = callback;
+    sealedContext_ = context;
+  }
+
+  // Seconds since boot; keeps counting when millis() wraps
+  uint32_t seconds(unsigned long now) {
+    unsigned long whole = (now - lastMs_) / 1000;
+    seconds_ += whole;
+    lastMs_ += whole * 1000;
+    return seconds_;
+  }
+
+  bool record(uint8_t kind, const int32_t* values, unsigned long now) {
+    if (!historyChannels(kind)) return false;
+    uint32_t sec = seconds(now);
+    if (!open_) openBlock(sec);
+    uint8_t buf[1 + VARINT_MAX_BYTES * (1 + HISTORY_CHANNELS)];
+    size_t n = encode(kind, values, sec, buf);
+    uint8_t* block = openBlockData();
+    size_t length = historyGet16(block + 8);
+    if (HISTORY_HEADER_SIZE + length + n > HISTORY_BLOCK_SIZE) {
+      seal();
+      openBlock(sec);
+      n = encode(kind, values, sec, buf);
+      block = openBlockData();
+      length = 0;
+    }
+    memcpy(block + HISTORY_HEADER_SIZE + length, buf, n);
+    historyPut16(block + 8, (uint16_t)(length + n));
+    historyPut16(block + 10, (uint16_t)(historyGet16(block + 10) + 1));
+    for (int c = 0; c < historyChannels(kind); c++) last_[kind][c] = values[c];
+    lastSec_ = sec;
+    return true;
+  }
+
+  bool record(uint8_t kind, int32_t a, int32_t b, unsigned long now) {
+    int32_t values[HISTORY_CHANNELS] = {a, b, 0};
+    return record(kind, values, now);
+  }
+
+  bool record(uint8_t kind, int32_t a, int32_t b, int32_t c, unsigned long now) {
+    int32_t values[HISTORY_CHANNELS] = {a, b, c};
+    return record(kind, values, now);
+  }
+
+  // Seals the open block once it is HISTORY_SEAL_SEC old, so quiet boards still reach flash
+  void tick(unsigned long now) {
+    if (open_ && seconds(now) - historyBlockStart(openBlockData()) >= HISTORY_SEAL_SEC) seal();
+  }
+
+  // Calls fn(record) for every record in RAM, oldest first
+  template <class F>
+  void forEach(F& fn) const {
+    HistoryRecord record;
+    for (size_t i = 0; i < count_; i++) {
+      HistoryBlockReader reader(blocks_[(head_ + i) % BLOCKS]);
+      while (reader.next(&record)) fn(record);
+    }
+  }
+
+  // Records older than this are only in the flash log
+  uint32_t oldestSec() const { return count_ ? historyBlockStart(blocks_[head_]) : seconds_; }
+  uint16_t boot() const { return boot_; }
+  size_t bytesUsed() const {
+    size_t total = 0;
+    for (size_t i = 0; i < count_; i++) total += HISTORY_HEADER_SIZE + historyGet16(blocks_[(head_ + i) % BLOCKS] + 8);
+    return total;
+  }
+  size_t capacity() const { return BLOCKS * HISTORY_BLOCK_SIZE; }
+
+private:
+  uint8_t* openBlockData() { return blocks_[(head_ + count_ - 1) % BLOCKS]; }
+  const uint8_t* openBlockData() const { return blocks_[(head_ + count_ - 1) % BLOCKS]; }
+
+  void openBlock(uint32_t sec) {
+    if (count_ == BLOCKS) {
+      head_ = (head_ + 1) % BLOCKS;
+      count_--;
+    }
+    count_++;
+    uint8_t* block = openBlockData();
+    memset(block, 0, HISTORY_BLOCK_SIZE);
+    historyPut16(block, HISTORY_MAGIC);
+    historyPut16(block + 2, boot_);
+    historyPut32(block + 4, sec);
+    memset(last_, 0, sizeof(last_));
+    lastSec_ = sec;
+    open_ = true;
+  }
+
+  void seal() {
+    if (!open_) return;
+    open_ = false;
+    if (sealed_) sealed_(openBlockData(), sealedContext_);
+  }
+
+  size_t encode(uint8_t kind, const int32_t* values, uint32_t sec, uint8_t* out) const {
+    size_t n = 0;
+    out[n++] = kind;
+    n += putVarint(out + n, VARINT_MAX_BYTES, sec - lastSec_);
+    for (int c = 0; c < historyChannels(kind); c++) {
+      n += putSignedVarint(out + n, VARINT_MAX_BYTES, deltaEncode(values[c], last_[kind][c]));
+    }
+    return n;
+  }
+
+  uint8_t blocks_[BLOCKS][HISTORY_BLOCK_SIZE];
+  uint16_t boot_;
+  size_t head_;
+  size_t count_;
+  bool open_;
+  uint32_t seconds_;
+  unsigned long lastMs_;
+  uint32_t lastSec_;
+  int32_t last_[HISTORY_KINDS][HISTORY_CHANNELS];
+  HistorySealCallback sealed_;
+  void* sealedContext_;
+};
+
+// Sealed blocks on flash: appended to the current file, which becomes the previous one
+// when it reaches fileBytes (the old previous file is deleted).
+template <class FS>
+class HistoryLog {
+public:
+  explicit HistoryLog(FS& fs, size_t fileBytes = 32768) : fs_(fs), fileBytes_(fileBytes), ready_(false) {}
+
+  // Call after mounting the file system. Returns the number for this boot: one more
+  // than the newest boot in the log.
+  uint16_t begin() {
+    ready_ = true;
+    uint16_t newest = 0;
+    uint8_t header[HISTORY_HEADER_SIZE];
+    const char* paths[2] = {HISTORY_LOG_PREVIOUS, HISTORY_LOG_CURRENT};
+    for (int f = 0; f < 2; f++) {
+      auto file = fs_.open(paths[f], "r");
+      if (!file) continue;
+      size_t size = file.size();
+      for (size_t pos = 0; pos + HISTORY_BLOCK_SIZE <= size; pos += HISTORY_BLOCK_SIZE) {
+        if (!file.seek(pos) || file.read(header, sizeof(header)) != sizeof(header)) break;
+        if (historyGet16(header) == HISTORY_MAGIC && historyBlockBoot(header) > newest) newest = historyBlockBoot(header);
+      }
+      file.close();
+    }
+    return (uint16_t)(newest + 1);
+  }
+
+  bool append(const uint8_t* block) {
+    if (!ready_) return false;
+    auto file = fs_.open(HISTORY_LOG_CURRENT, "a");
+    if (file && file.size() + HISTORY_BLOCK_SIZE > fileBytes_) {
+      file.close();
+      fs_.remove(HISTORY_LOG_PREVIOUS);
+      fs_.rename(HISTORY_LOG_CURRENT, HISTORY_LOG_PREVIOUS);
+      file = fs_.open(HISTORY_LOG_CURRENT, "a");
+    }
+    if (!file) return false;
+    bool ok = file.write(block, HISTORY_BLOCK_SIZE) == HISTORY_BLOCK_SIZE;
+    file.close();
+    return ok;
+  }
+
+  // Calls fn(record) for the records of one boot in blocks started before beforeSec,
+  // oldest first
+  template <class F>
+  void forEach(uint16_t boot, uint32_t beforeSec, F& fn) {
+    if (!ready_) return;
+    uint8_t block[HISTORY_BLOCK_SIZE];
+    HistoryRecord record;
+    const char* paths[2] = {HISTORY_LOG_PREVIOUS, HISTORY_LOG_CURRENT};
+    for (int f = 0; f < 2; f++) {
+      auto file = fs_.open(paths[f], "r");
+      if (!file) continue;
+      while (file.read(block, HISTORY_HEADER_SIZE) == HISTORY_HEADER_SIZE) {
+        size_t rest = HISTORY_BLOCK_SIZE - HISTORY_HEADER_SIZE;
+        bool wanted = historyBlockValid(block) && historyBlockBoot(block) == boot && historyBlockStart(block) < beforeSec;
+        if (!wanted) {
+          if (!file.seek(file.position() + rest)) break;
+          continue;
+        }
+        if (file.read(block + HISTORY_HEADER_SIZE, rest) != rest) break;
+        HistoryBlockReader reader(block);
+        while (reader.next(&record)) fn(record);
+      }
+      file.close();
+    }
+  }
+
+  bool ready() const { return ready_; }
+
+private:
+  FS& fs_;
+  size_t fileBytes_;
+  bool ready_;
+};
+
+// Series in a /history answer
+enum HistorySeries {
+  SERIES_SOIL = 0,
+  SERIES_WATER,
+  SERIES_TEMPERATURE,
+  SERIES_HUMIDITY,
+  SERIES_PUMP,
+  SERIES_COUNT
+};
+
+// Buckets records of [fromSec, toSec) into at most MAX_BUCKETS steps. Soil, water,
+// temperature and humidity are averaged per bucket, pump run time is summed. zone >= 0
+// keeps only that zone's soil readings and pump runs.
+template <size_t MAX_BUCKETS = 60>
+class HistoryQuery {
+public:
+  void begin(uint32_t fromSec, uint32_t toSec, uint32_t stepSec, int zone) {
+    from_ = fromSec;
+    to_ = toSec > fromSec ? toSec : fromSec + 1;
+    uint32_t span = to_ - from_;
+    uint32_t minStep = (span + MAX_BUCKETS - 1) / MAX_BUCKETS;
+    step_ = stepSec > minStep ? stepSec : minStep;
+    buckets_ = (span + step_ - 1) / step_;
+    zone_ = zone;
+    records_ = 0;
+    memset(sum_, 0, sizeof(sum_));
+    memset(count_, 0, sizeof(count_));
+  }
+
+  void operator()(const HistoryRecord& r) {
+    if (r.sec < from_ || r.sec >= to_) return;
+    size_t b = (r.sec - from_) / step_;
+    records_++;
+    switch (r.kind) {
+      case HISTORY_CLIMATE:
+        add(SERIES_WATER, b, r.value[0]);
+        add(SERIES_TEMPERATURE, b, r.value[1]);
+        add(SERIES_HUMIDITY, b, r.value[2]);
+        break;
+      case HISTORY_SOIL:
+        if (zone_ < 0 || r.value[1] == zone_) add(SERIES_SOIL, b, r.value[0]);
+        break;
+      case HISTORY_PUMP:
+        if (zone_ < 0 || r.value[1] == zone_) add(SERIES_PUMP, b, r.value[0]);
+        break;
+    }
+  }
+
+  uint32_t from() const { return from_; }
+  uint32_t to() const { return to_; }
+  uint32_t step() const { return step_; }
+  size_t buckets() const { return buckets_; }
+  int zone() const { return zone_; }
+  unsigned long records() const { return records_; }
+  bool empty(int series, size_t b) const { return count_[series][b] == 0; }
+  // Mean per bucket; the pump series is the total in 0.1 s
+  long value(int series, size_t b) const {
+    if (!count_[series][b]) return 0;
+    if (series == SERIES_PUMP) return sum_[series][b];
+    long n = count_[series][b];
+    long s = sum_[series][b];
+    return (s >= 0 ? s + n / 2 : s - n / 2) / n;
+  }
+
+private:
+  void add(int series, size_t b, int32_t value) {
+    if (value == HISTORY_MISSING || count_[series][b] == 0xFFFF) return;
+    sum_[series][b] += value;
+    count_[series][b]++;
+  }
+
+  uint32_t from_;
+  uint32_t to_;
+  uint32_t step_;
+  size_t buckets_;
+  int zone_;
+  unsigned long records_;
+  int32_t sum_[SERIES_COUNT][MAX_BUCKETS];
+  uint16_t count_[SERIES_COUNT][MAX_BUCKETS];
+};
+
+// Query times are seconds since boot; negative values count back from now
+inline uint32_t historyTime(long value, uint32_t nowSec) {
+  if (value >= 0) return (uint32_t)value;
+  return (long)nowSec + value > 0 ? (uint32_t)((long)nowSec + value) : 0;
+}
+
+// Runs the query over one boot: older records from the flash log, then the RAM ring
+template <size_t BLOCKS, class FS, size_t B>
+void collectHistory(HistoryStore<BLOCKS>& store, HistoryLog<FS>& log, uint16_t boot, HistoryQuery<B>& query) {
+  if (boot != store.boot()) {
+    log.forEach(boot, UINT32_MAX, query);
+    return;
+  }
+  if (query.from() < store.oldestSec()) log.forEach(boot, store.oldestSec(), query);
+  store.forEach(query);
+}
+
+// Streams the buckets as JSON arrays (null for empty buckets)
+template <class Server, size_t B>
+void sendHistoryJson(Server& server, const HistoryQuery<B>& query, uint16_t boot, uint32_t nowSec) {
+  static const char* const NAMES[SERIES_COUNT] = {"soil", "water", "temperature", "humidity", "pumpSec"};
+  PageStream<Server, 128> out(server);
+  out.begin(200, "application/json");
+  out.print("{\"boot\":");
+  out.print((long)boot);
+  out.print(",\"now\":");
+  out.print((long)nowSec);
+  out.print(",\"from\":");
+  out.print((long)query.from());
+  out.print(",\"to\":");
+  out.print((long)query.to());
+  out.print(",\"step\":");
+  out.print((long)query.step());
+  out.print(",\"zone\":");
+  out.print((long)query.zone());
+  out.print(",\"records\":");
+  out.print((long)query.records());
+  for (int s = 0; s < SERIES_COUNT; s++) {
+    out.print(",\"");
+    out.print(NAMES[s]);
+    out.print("\":[");
+    for (size_t b = 0; b < query.buckets(); b++) {
+      if (b) out.print(",");
+      if (query.empty(s, b)) {
+        out.print(s == SERIES_PUMP ? "0" : "null");
+      } else if (s == SERIES_TEMPERATURE || s == SERIES_HUMIDITY || s == SERIES_PUMP) {
+        out.print(query.value(s, b) / 10.0f, 1);
+      } else {
+        out.print(query.value(s, b));
+      }
+    }
+    out.print("]");
+  }
+  out.print("}");
+  out.end();
+}
+
+// Same answer as a BIN_HISTORY frame: boot, now, from, to, step, zone (signed), records
+// and bucket count, then per series a bitmap of the buckets that have a value (bit b % 8
+// of byte b / 8) followed by those values, each as the change from the previous one.
+// Values are raw: temperature, humidity and pump time in tenths.
+template <class Server, size_t B>
+void sendHistoryBinary(Server& server, const HistoryQuery<B>& query, uint16_t boot, uint32_t nowSec) {
+  PageStream<Server, 128> out(server);
+  out.begin(200, BIN_CONTENT_TYPE);
+  BinFrame<(B + 7) / 8 + B * VARINT_MAX_BYTES> frame(BIN_HISTORY);
+  frame.put(boot).put(nowSec).put(query.from()).put(query.to()).put(query.step()).putSigned(query.zone())
+      .put((uint32_t)query.records()).put((uint32_t)query.buckets());
+  out.write(frame.data(), frame.length());
+  for (int s = 0; s < SERIES_COUNT; s++) {
+    frame.clear();
+    for (size_t i = 0; i < (query.buckets() + 7) / 8; i++) {
+      uint8_t bits = 0;
+      for (size_t b = i * 8; b < query.buckets() && b < i * 8 + 8; b++) {
+        if (!query.empty(s, b)) bits |= (uint8_t)(1 << (b % 8));
+      }
+      frame.byte(bits);
+    }
+    int32_t previous = 0;
+    for (size_t b = 0; b < query.buckets(); b++) {
+      if (query.empty(s, b)) continue;
+      int32_t value = (int32_t)query.value(s, b);
+      frame.putSigned(deltaEncode(value, previous));
+      previous = value;
+    }
+    out.write(frame.data(), frame.length());
+  }
+  out.end();
+}
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Arduino core API for building the sketches as Linux programs.
+//
+// Together with the WiFi/WebServer/Servo/DHT headers next to it, this is the hardware
+// abstraction the sketches run on when built for the host: GPIO, PWM and sensors are
+// simulated by hostsim.h, networking uses real sockets. See hostmain.cpp for how to
+// build and run a sketch.
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "WString.h"
+#include "IPAddress.h"
+#include "hostsim.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp32-hal-timer.h"
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+// ESP32 analog pin aliases
+#define A0 36
+#define A3 39
+#define A4 32
+#define A5 33
+#define A6 34
+#define A7 35
+
+// Flash strings are ordinary strings on the host
+#define PROGMEM
+#define PGM_P const char*
+#define F(text) (text)
+#define FPSTR(p) (p)
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// --- GPIO, PWM, ADC ---
+inline void pinMode(int pin, int mode) { (void)pin; (void)mode; }
+inline void digitalWrite(int pin, int level) { hostSim().digitalWrite(pin, level); }
+inline int digitalRead(int pin) { return hostSim().digitalRead(pin); }
+inline int analogRead(int pin) { return hostSim().analogRead(pin); }
+
+// ESP32 core 2.x LEDC API
+inline double ledcSetup(uint8_t channel, double freq, uint8_t bits) { (void)channel; (void)bits; return freq; }
+inline void ledcAttachPin(uint8_t pin, uint8_t channel) { hostSim().trace("ledc attach pin", pin, channel); }
+inline void ledcWrite(uint8_t channel, uint32_t duty) { hostSim().pwmWrite(channel, duty); }
+
+// analogWrite() PWM (ESP8266, ESP32 core 2.x); the host keeps the duty under the pin number
+inline void analogWrite(uint8_t pin, int value) { hostSim().pwmWrite(pin, (uint32_t)value); }
+inline void analogWriteRange(uint32_t range) { (void)range; }
+
+// --- Interrupts (encoder pulses are simulated, see HAL_ENCODER) ---
+#define IRAM_ATTR
+#define RISING 1
+#define FALLING 2
+#define CHANGE 3
+#define digitalPinToInterrupt(pin) (pin)
+inline void attachInterrupt(int pin, void (*isr)(), int mode) { (void)mode; hostSim().attachInterrupt(pin, isr); }
+inline void detachInterrupt(int pin) { hostSim().detachInterrupt(pin); }
+inline void interrupts() {}
+inline void noInterrupts() {}
+
+// --- Time ---
+inline unsigned long millis() { return hostSim().millis(); }
+inline unsigned long micros() { return (unsigned long)hostSim().micros(); }
+inline void delay(unsigned long ms) { hostSim().delayMicros((uint64_t)ms * 1000); }
+inline void delayMicroseconds(unsigned int us) { hostSim().delayMicros(us); }
+inline void yield() {}
+// SNTP (both cores); time() on the host already is the wall clock
+inline void configTime(long gmtOffsetSec, int dstOffsetSec, const char* server) {
+  (void)gmtOffsetSec; (void)dstOffsetSec; (void)server;
+}
+
+inline uint32_t esp_random() { return hostSim().random(); }
+// The ESP8266 core's hardware RNG register (esp8266_peri.h), read as a value
+#define RANDOM_REG32 (hostSim().random())
+
+// --- Deep sleep (ESP32) ---
+// RTC memory is a section of its own that hostmain.cpp saves before the sleep and loads
+// after the wake; esp_deep_sleep_start() restarts the program, like the board's reset.
+#define RTC_DATA_ATTR __attribute__((section("rtc_data")))
+typedef int esp_err_t;
+enum esp_sleep_wakeup_cause_t { ESP_SLEEP_WAKEUP_UNDEFINED = 0, ESP_SLEEP_WAKEUP_TIMER = 4 };
+inline esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+  return hostSim().wake() > 0 ? ESP_SLEEP_WAKEUP_TIMER : ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+inline esp_err_t esp_sleep_enable_timer_wakeup(uint64_t us) { hostSim().setSleepTimer(us); return 0; }
+void esp_deep_sleep_start() __attribute__((noreturn));
+
+// --- Task watchdog on the loop task (ESP32) ---
+// hostmain.cpp feeds it after every loop() pass; a loop that stops for 5 s (the core's
+// default) restarts the program cold, like the board's watchdog reset.
+void enableLoopWDT();
+void disableLoopWDT();
+void feedLoopWDT();
+
+// --- Serial (stdout) ---
+class HardwareSerial {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+
+  size_t print(const char* text) { return write(text ? text : ""); }
+  size_t print(const String& text) { return write(text.c_str()); }
+  size_t print(char c) { char s[2] = {c, '\0'}; return write(s); }
+  size_t print(int value) { return print(String(value)); }
+  size_t print(unsigned int value) { return print(String(value)); }
+  size_t print(long value) { return print(String(value)); }
+  size_t print(unsigned long value) { return print(String(value)); }
+  size_t print(double value, int decimals = 2) { return print(String(value, (unsigned int)decimals)); }
+  size_t print(const IPAddress& ip) { return print(ip.toString()); }
+
+  template <class T>
+  size_t println(const T& value) { size_t n = print(value); return n + write("\n"); }
+  size_t println(double value, int decimals) { size_t n = print(value, decimals); return n + write("\n"); }
+  size_t println() { return write("\n"); }
+
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    write(buf);
+    return n > 0 ? (size_t)n : 0;
+  }
+
+private:
+  size_t write(const char* text) {
+    if (hostSim().quiet()) return strlen(text);
+    return fwrite(text, 1, strlen(text), stdout);
+  }
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+  uint32_t getFreeHeap() const { return 200000; }
+  uint32_t getMinFreeHeap() const { return 180000; }
+  void restart() { exit(0); }
+};
+
+extern EspClass ESP;
+
+// Implemented by the sketch
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef HOST_DHT_H
+#define HOST_DHT_H
+
+#include "Arduino.h"
+
+#define DHT11 11
+#define DHT22 22
+
+// Simulated DHT sensor with the Adafruit library's behaviour: a real transfer blocks
+// for HAL_DHT_READ_US, and reads within 2 s of the last one return the same values
+// without touching the sensor. HAL_DHT_FAIL_PCT makes transfers fail (NaN).
+class DHT {
+public:
+  DHT(uint8_t pin, uint8_t type) : pin_(pin), type_(type), lastRead_(0), read_(false), ok_(false),
+                                   temperature_(NAN), humidity_(NAN) {}
+
+  void begin() {}
+
+  float readTemperature(bool fahrenheit = false, bool force = false) {
+    if (!transfer(force)) return NAN;
+    return fahrenheit ? temperature_ * 1.8f + 32 : temperature_;
+  }
+
+  float readHumidity(bool force = false) {
+    if (!transfer(force)) return NAN;
+    return humidity_;
+  }
+
+private:
+  bool transfer(bool force) {
+    unsigned long now = millis();
+    if (!force && read_ && now - lastRead_ < 2000) return ok_;
+    read_ = true;
+    lastRead_ = now;
+    hostSim().busyWait(hostSim().dhtReadUs());
+    ok_ = !hostSim().dhtFails();
+    if (ok_) {
+      // Slow drift around 24 C / 55 %
+      float phase = (float)(now % 600000) / 600000.0f * 6.2831853f;
+      temperature_ = 24.0f + 1.5f * sinf(phase) + (float)(hostSim().random() % 10) / 50.0f;
+      humidity_ = 55.0f - 5.0f * sinf(phase) + (float)(hostSim().random() % 10) / 20.0f;
+    }
+    return ok_;
+  }
+
+  uint8_t pin_;
+  uint8_t type_;
+  unsigned long lastRead_;
+  bool read_;
+  bool ok_;
+  float temperature_;
+  float humidity_;
+};
+
+#endif
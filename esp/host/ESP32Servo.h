@@ -0,0 +1,32 @@
+#ifndef HOST_ESP32SERVO_H
+#define HOST_ESP32SERVO_H
+
+#include "Arduino.h"
+
+// Servo that remembers its angle; moves are traced with HAL_TRACE=1
+class Servo {
+public:
+  Servo() : pin_(-1), angle_(0) {}
+
+  int attach(int pin) {
+    pin_ = pin;
+    hostSim().trace("servo attach pin", pin, 0);
+    return 1;
+  }
+  void detach() { pin_ = -1; }
+  bool attached() const { return pin_ >= 0; }
+
+  void write(int angle) {
+    if (angle < 0) angle = 0;
+    if (angle > 180) angle = 180;
+    angle_ = angle;
+    hostSim().trace("servo angle pin", pin_, angle);
+  }
+  int read() const { return angle_; }
+
+private:
+  int pin_;
+  int angle_;
+};
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef HOST_ESP8266WEBSERVER_H
+#define HOST_ESP8266WEBSERVER_H
+
+#include "WebServer.h"
+
+typedef WebServer ESP8266WebServer;
+
+#endif
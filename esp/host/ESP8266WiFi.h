@@ -0,0 +1,17 @@
+#ifndef HOST_ESP8266WIFI_H
+#define HOST_ESP8266WIFI_H
+
+#include "WiFi.h"
+
+// NodeMCU pin labels
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+
+#endif
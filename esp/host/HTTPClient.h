@@ -0,0 +1,110 @@
+#ifndef HOST_HTTPCLIENT_H
+#define HOST_HTTPCLIENT_H
+
+// Blocking HTTPClient (ESP32/ESP8266 API subset) over WiFiClient. One request per
+// connection, like the Arduino class when reuse is off.
+
+#include <string>
+#include "Arduino.h"
+#include "WiFi.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED -1
+#define HTTPC_ERROR_SEND_HEADER_FAILED -2
+#define HTTPC_ERROR_CONNECTION_LOST    -5
+#define HTTPC_ERROR_READ_TIMEOUT       -11
+
+class HTTPClient {
+public:
+  HTTPClient() : port_(80), timeoutMs_(5000), code_(0) {}
+
+  bool begin(const String& url) { return parseUrl(url.str()); }
+  bool begin(WiFiClient& client, const String& url) { (void)client; return parseUrl(url.str()); }
+  void end() { client_.stop(); }
+
+  void setTimeout(uint16_t ms) { timeoutMs_ = ms; }
+  void addHeader(const String& name, const String& value) { extraHeaders_ += name.str() + ": " + value.str() + "\r\n"; }
+
+  int GET() { return request("GET", ""); }
+  int POST(const String& body) { return request("POST", body.str()); }
+
+  String getString() const { return String(body_); }
+  int getSize() const { return (int)body_.size(); }
+
+private:
+  bool parseUrl(const std::string& url) {
+    std::string rest = url.compare(0, 7, "http://") == 0 ? url.substr(7) : url;
+    size_t slash = rest.find('/');
+    std::string authority = rest.substr(0, slash);
+    path_ = slash == std::string::npos ? "/" : rest.substr(slash);
+    size_t colon = authority.find(':');
+    host_ = authority.substr(0, colon);
+    port_ = colon == std::string::npos ? 80 : (uint16_t)atoi(authority.c_str() + colon + 1);
+    return !host_.empty();
+  }
+
+  int request(const char* method, const std::string& body) {
+    body_.clear();
+    client_.setTimeout(timeoutMs_);
+    if (!client_.connect(host_.c_str(), port_, (int32_t)timeoutMs_)) return code_ = HTTPC_ERROR_CONNECTION_REFUSED;
+
+    std::string req = std::string(method) + " " + path_ + " HTTP/1.1\r\nHost: " + host_ +
+                      "\r\nConnection: close\r\n" + extraHeaders_;
+    if (!body.empty()) req += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    req += "\r\n" + body;
+    if (client_.write((const uint8_t*)req.data(), req.size()) != req.size()) {
+      client_.stop();
+      return code_ = HTTPC_ERROR_SEND_HEADER_FAILED;
+    }
+
+    // Read until the peer closes (Connection: close) or the timeout runs out
+    std::string raw;
+    unsigned long start = millis();
+    char buf[1024];
+    while (millis() - start < timeoutMs_) {
+      int n = client_.read((uint8_t*)buf, sizeof(buf));
+      if (n > 0) {
+        raw.append(buf, (size_t)n);
+        continue;
+      }
+      if (!client_.connected()) break;
+      pollfd p = {client_.fd(), POLLIN, 0};
+      poll(&p, 1, 20);
+    }
+    client_.stop();
+
+    size_t headerEnd = raw.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) return code_ = raw.empty() ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+    size_t space = raw.find(' ');
+    code_ = space < headerEnd ? atoi(raw.c_str() + space + 1) : HTTPC_ERROR_CONNECTION_LOST;
+
+    std::string head = raw.substr(0, headerEnd);
+    body_ = raw.substr(headerEnd + 4);
+    if (head.find("chunked") != std::string::npos) body_ = unchunk(body_);
+    return code_;
+  }
+
+  static std::string unchunk(const std::string& in) {
+    std::string out;
+    size_t pos = 0;
+    while (pos < in.size()) {
+      size_t lineEnd = in.find("\r\n", pos);
+      if (lineEnd == std::string::npos) break;
+      size_t size = (size_t)strtoul(in.c_str() + pos, NULL, 16);
+      if (size == 0) break;
+      out += in.substr(lineEnd + 2, size);
+      pos = lineEnd + 2 + size + 2;
+    }
+    return out;
+  }
+
+  WiFiClient client_;
+  std::string host_;
+  uint16_t port_;
+  std::string path_;
+  std::string extraHeaders_;
+  unsigned long timeoutMs_;
+  int code_;
+  std::string body_;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef HOST_IPADDRESS_H
+#define HOST_IPADDRESS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "WString.h"
+
+class IPAddress {
+public:
+  IPAddress() { bytes_[0] = bytes_[1] = bytes_[2] = bytes_[3] = 0; }
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    bytes_[0] = a; bytes_[1] = b; bytes_[2] = c; bytes_[3] = d;
+  }
+
+  uint8_t operator[](int index) const { return bytes_[index]; }
+  uint8_t& operator[](int index) { return bytes_[index]; }
+
+  bool fromString(const char* text) {
+    unsigned int a, b, c, d;
+    if (sscanf(text, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255) return false;
+    *this = IPAddress((uint8_t)a, (uint8_t)b, (uint8_t)c, (uint8_t)d);
+    return true;
+  }
+
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes_[0], bytes_[1], bytes_[2], bytes_[3]);
+    return String(buf);
+  }
+
+  bool operator==(const IPAddress& other) const {
+    return bytes_[0] == other.bytes_[0] && bytes_[1] == other.bytes_[1] &&
+           bytes_[2] == other.bytes_[2] && bytes_[3] == other.bytes_[3];
+  }
+
+private:
+  uint8_t bytes_[4];
+};
+
+#endif
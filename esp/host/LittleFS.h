@@ -0,0 +1,107 @@
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <memory>
+#include "Arduino.h"
+
+// LittleFS backed by a directory, so flash logs survive a restart of the program like
+// they survive a reboot of the board. HAL_FS_DIR picks the directory (default
+// /tmp/hal-littlefs); HAL_FS_SIZE the reported capacity in bytes (default 1.5 MB, the
+// ESP32 default partition).
+
+namespace fs {
+
+class File {
+public:
+  File() {}
+  explicit File(FILE* f) : f_(f, fclose) {}
+
+  explicit operator bool() const { return (bool)f_; }
+
+  size_t write(const uint8_t* data, size_t length) { return f_ ? fwrite(data, 1, length, f_.get()) : 0; }
+  size_t read(uint8_t* data, size_t length) { return f_ ? fread(data, 1, length, f_.get()) : 0; }
+  bool seek(uint32_t position) { return f_ && fseek(f_.get(), (long)position, SEEK_SET) == 0; }
+  size_t position() const { return f_ ? (size_t)ftell(f_.get()) : 0; }
+
+  size_t size() const {
+    if (!f_) return 0;
+    struct stat st;
+    fflush(f_.get());
+    return fstat(fileno(f_.get()), &st) == 0 ? (size_t)st.st_size : 0;
+  }
+
+  void flush() { if (f_) fflush(f_.get()); }
+  void close() { f_.reset(); }
+
+private:
+  std::shared_ptr<FILE> f_;
+};
+
+class LittleFSFS {
+public:
+  bool begin(bool /*formatOnFail*/ = false) {
+    const char* dir = getenv("HAL_FS_DIR");
+    snprintf(root_, sizeof(root_), "%s", dir && *dir ? dir : "/tmp/hal-littlefs");
+    if (mkdir(root_, 0755) != 0 && errno != EEXIST) return false;
+    mounted_ = true;
+    return true;
+  }
+
+  void end() { mounted_ = false; }
+
+  // mode "r", "w" or "a" like the Arduino core
+  File open(const char* path, const char* mode = "r") {
+    if (!mounted_) return File();
+    char full[320];
+    resolve(path, full, sizeof(full));
+    const char* m = mode[0] == 'w' ? "wb" : mode[0] == 'a' ? "ab" : "rb";
+    FILE* f = fopen(full, m);
+    return f ? File(f) : File();
+  }
+
+  bool exists(const char* path) {
+    char full[320];
+    resolve(path, full, sizeof(full));
+    struct stat st;
+    return mounted_ && stat(full, &st) == 0;
+  }
+
+  bool remove(const char* path) {
+    char full[320];
+    resolve(path, full, sizeof(full));
+    return mounted_ && ::remove(full) == 0;
+  }
+
+  bool rename(const char* from, const char* to) {
+    char a[320], b[320];
+    resolve(from, a, sizeof(a));
+    resolve(to, b, sizeof(b));
+    return mounted_ && ::rename(a, b) == 0;
+  }
+
+  size_t totalBytes() {
+    const char* size = getenv("HAL_FS_SIZE");
+    return size ? (size_t)atol(size) : 1536 * 1024;
+  }
+
+private:
+  void resolve(const char* path, char* out, size_t size) {
+    snprintf(out, size, "%s/%s", root_, path[0] == '/' ? path + 1 : path);
+  }
+
+  char root_[256] = "";
+  bool mounted_ = false;
+};
+
+// ESP32's LittleFSFS and ESP8266's LittleFS are both an fs::FS
+typedef LittleFSFS FS;
+
+}  // namespace fs
+
+using fs::File;
+
+extern fs::LittleFSFS LittleFS;
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef HOST_WSTRING_H
+#define HOST_WSTRING_H
+
+// Arduino String for the host build, backed by std::string. Covers the subset the
+// sketches use: construction from text and numbers, concatenation, comparison.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+class String {
+public:
+  String() {}
+  String(const char* text) : s_(text ? text : "") {}
+  String(const std::string& text) : s_(text) {}
+  String(char c) : s_(1, c) {}
+  String(int value) : s_(format("%d", value)) {}
+  String(unsigned int value) : s_(format("%u", value)) {}
+  String(long value) : s_(format("%ld", value)) {}
+  String(unsigned long value) : s_(format("%lu", value)) {}
+  String(float value, unsigned int decimals = 2) : s_(formatFloat(value, decimals)) {}
+  String(double value, unsigned int decimals = 2) : s_(formatFloat(value, decimals)) {}
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned int length() const { return (unsigned int)s_.size(); }
+  bool isEmpty() const { return s_.empty(); }
+  void reserve(unsigned int size) { s_.reserve(size); }
+
+  char operator[](unsigned int index) const { return index < s_.size() ? s_[index] : '\0'; }
+
+  String& operator+=(const String& other) { s_ += other.s_; return *this; }
+  String& operator+=(const char* text) { if (text) s_ += text; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+  String& operator+=(int value) { return *this += String(value); }
+  String& operator+=(unsigned int value) { return *this += String(value); }
+  String& operator+=(long value) { return *this += String(value); }
+  String& operator+=(unsigned long value) { return *this += String(value); }
+  String& operator+=(float value) { return *this += String(value); }
+
+  bool concat(const String& other) { s_ += other.s_; return true; }
+
+  bool operator==(const String& other) const { return s_ == other.s_; }
+  bool operator==(const char* text) const { return s_ == (text ? text : ""); }
+  bool operator!=(const String& other) const { return s_ != other.s_; }
+  bool operator!=(const char* text) const { return !(*this == text); }
+  bool equals(const String& other) const { return s_ == other.s_; }
+
+  int indexOf(char c, unsigned int from = 0) const { return find(s_.find(c, from)); }
+  int indexOf(const String& text, unsigned int from = 0) const { return find(s_.find(text.s_, from)); }
+  bool startsWith(const String& prefix) const { return s_.compare(0, prefix.s_.size(), prefix.s_) == 0; }
+  String substring(unsigned int from) const { return from < s_.size() ? String(s_.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < to && from < s_.size() ? String(s_.substr(from, to - from)) : String();
+  }
+  long toInt() const { return atol(s_.c_str()); }
+  float toFloat() const { return (float)atof(s_.c_str()); }
+
+  const std::string& str() const { return s_; }
+
+private:
+  static int find(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+
+  template <class T>
+  static std::string format(const char* fmt, T value) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), fmt, value);
+    return buf;
+  }
+
+  static std::string formatFloat(double value, unsigned int decimals) {
+    char buf[40];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimals, value);
+    return buf;
+  }
+
+  std::string s_;
+};
+
+inline String operator+(const String& a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+inline String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, char b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, int b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, unsigned int b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, long b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, unsigned long b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, float b) { String r(a); r += b; return r; }
+
+#endif
@@ -0,0 +1,332 @@
+#ifndef HOST_WEBSERVER_H
+#define HOST_WEBSERVER_H
+
+// ESP32 WebServer on a Linux listening socket.
+//
+// Same model as the board: handleClient() accepts at most one connection, reads one
+// request, runs the matching handler and closes the connection (Connection: close).
+// Handlers that keep server.client() (e.g. TelemetryPush) keep the socket open.
+// HAL_HTTP_PORT overrides the port given to the constructor.
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "WiFi.h"
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+const unsigned long HOST_HTTP_READ_TIMEOUT_MS = 5000;
+
+class WebServer {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  explicit WebServer(int port = 80)
+    : listener_(hostSim().httpPort() ? hostSim().httpPort() : port), method_(HTTP_ANY),
+      contentLength_(CONTENT_LENGTH_NOT_SET), chunked_(false), cors_(false) {}
+
+  void begin() {
+    listener_.begin();
+    fprintf(stderr, "host: http server on port %u\n", listener_.port());
+  }
+  void begin(uint16_t port) {
+    listener_ = WiFiServer(hostSim().httpPort() ? hostSim().httpPort() : port);
+    begin();
+  }
+  void close() { listener_.end(); }
+
+  void on(const char* uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+  void on(const char* uri, HTTPMethod method, THandlerFunction handler) {
+    Route route;
+    route.uri = uri;
+    route.method = method;
+    route.handler = handler;
+    routes_.push_back(route);
+  }
+  void onNotFound(THandlerFunction handler) { notFound_ = handler; }
+
+  void enableCORS(bool enable) { cors_ = enable; }
+
+  void collectHeaders(const char* headerKeys[], size_t count) {
+    collect_.clear();
+    for (size_t i = 0; i < count; i++) collect_.push_back(lower(headerKeys[i]));
+  }
+
+  void handleClient() {
+    client_ = listener_.accept();
+    if (!client_.connected()) return;
+    if (readRequest()) dispatch();
+    client_.stop();
+  }
+
+  // --- Request ---
+  String uri() const { return String(path_); }
+  HTTPMethod method() const { return method_; }
+  WiFiClient client() { return client_; }
+
+  int args() const { return (int)args_.size(); }
+  String arg(int index) const { return index >= 0 && index < args() ? String(args_[index].value) : String(); }
+  String argName(int index) const { return index >= 0 && index < args() ? String(args_[index].name) : String(); }
+  String arg(const String& name) const {
+    for (size_t i = 0; i < args_.size(); i++) {
+      if (args_[i].name == name.str()) return String(args_[i].value);
+    }
+    return String();
+  }
+  bool hasArg(const String& name) const {
+    for (size_t i = 0; i < args_.size(); i++) {
+      if (args_[i].name == name.str()) return true;
+    }
+    return false;
+  }
+
+  bool hasHeader(const String& name) const { return findHeader(name) != NULL; }
+  String header(const String& name) const {
+    const Pair* h = findHeader(name);
+    return h ? String(h->value) : String();
+  }
+
+  // --- Response ---
+  void sendHeader(const String& name, const String& value, bool first = false) {
+    std::string line = name.str() + ": " + value.str() + "\r\n";
+    if (first) responseHeaders_ = line + responseHeaders_;
+    else responseHeaders_ += line;
+  }
+
+  void setContentLength(size_t length) { contentLength_ = length; }
+
+  void send(int code, const char* contentType = NULL, const String& content = String()) {
+    size_t length = contentLength_ == CONTENT_LENGTH_NOT_SET ? content.length() : contentLength_;
+    writeHead(code, contentType, length);
+    if (content.length()) client_.write((const uint8_t*)content.c_str(), content.length());
+  }
+  void send(int code, const String& contentType, const String& content) { send(code, contentType.c_str(), content); }
+  void send_P(int code, PGM_P contentType, PGM_P content) { send(code, contentType, String(content)); }
+
+  void sendContent(const String& content) { sendContent(content.c_str(), content.length()); }
+  void sendContent(const char* content, size_t length) {
+    if (!chunked_) {
+      client_.write((const uint8_t*)content, length);
+      return;
+    }
+    char size[19];   // 16 hex digits + CRLF + NUL
+    snprintf(size, sizeof(size), "%zx\r\n", length);
+    client_.write((const uint8_t*)size, strlen(size));
+    client_.write((const uint8_t*)content, length);
+    client_.write((const uint8_t*)"\r\n", 2);
+    if (length == 0) chunked_ = false;   // zero-size chunk ends the response
+  }
+  void sendContent_P(PGM_P content) { sendContent(content, strlen(content)); }
+  void sendContent_P(PGM_P content, size_t length) { sendContent(content, length); }
+
+private:
+  struct Route {
+    std::string uri;
+    HTTPMethod method;
+    THandlerFunction handler;
+  };
+
+  struct Pair {
+    std::string name;
+    std::string value;
+  };
+
+  bool readRequest() {
+    args_.clear();
+    headers_.clear();
+    responseHeaders_.clear();
+    contentLength_ = CONTENT_LENGTH_NOT_SET;
+    chunked_ = false;
+
+    std::string raw;
+    size_t headerEnd;
+    unsigned long start = millis();
+    while ((headerEnd = raw.find("\r\n\r\n")) == std::string::npos) {
+      if (!readSome(raw, start)) return false;
+    }
+
+    size_t lineEnd = raw.find("\r\n");
+    std::string requestLine = raw.substr(0, lineEnd);
+    size_t sp1 = requestLine.find(' ');
+    size_t sp2 = requestLine.find(' ', sp1 + 1);
+    if (sp1 == std::string::npos || sp2 == std::string::npos) return false;
+    method_ = parseMethod(requestLine.substr(0, sp1));
+    std::string target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+    size_t query = target.find('?');
+    path_ = decode(target.substr(0, query));
+    if (query != std::string::npos) parseArgs(target.substr(query + 1));
+
+    size_t bodyLength = 0;
+    size_t pos = lineEnd + 2;
+    while (pos < headerEnd) {
+      size_t end = raw.find("\r\n", pos);
+      std::string line = raw.substr(pos, end - pos);
+      pos = end + 2;
+      size_t colon = line.find(':');
+      if (colon == std::string::npos) continue;
+      std::string name = lower(line.substr(0, colon));
+      std::string value = trim(line.substr(colon + 1));
+      if (name == "content-length") bodyLength = (size_t)atol(value.c_str());
+      for (size_t i = 0; i < collect_.size(); i++) {
+        if (collect_[i] == name) {
+          Pair h = {name, value};
+          headers_.push_back(h);
+        }
+      }
+    }
+
+    std::string body = raw.substr(headerEnd + 4);
+    while (body.size() < bodyLength) {
+      if (!readSome(body, start)) return false;
+    }
+    if (bodyLength) {
+      Pair plain = {"plain", body.substr(0, bodyLength)};
+      args_.push_back(plain);
+    }
+    return true;
+  }
+
+  bool readSome(std::string& into, unsigned long start) {
+    char buf[1024];
+    int n = client_.read((uint8_t*)buf, sizeof(buf));
+    if (n > 0) {
+      into.append(buf, (size_t)n);
+      return true;
+    }
+    if (!client_.connected() || millis() - start > HOST_HTTP_READ_TIMEOUT_MS) return false;
+    pollfd p = {client_.fd(), POLLIN, 0};
+    poll(&p, 1, 50);
+    return true;
+  }
+
+  void dispatch() {
+    for (size_t i = 0; i < routes_.size(); i++) {
+      const Route& route = routes_[i];
+      if (route.uri == path_ && (route.method == HTTP_ANY || route.method == method_)) {
+        route.handler();
+        return;
+      }
+    }
+    if (notFound_) {
+      notFound_();
+      return;
+    }
+    send(404, "text/plain", String("Not found: ") + path_.c_str());
+  }
+
+  void writeHead(int code, const char* contentType, size_t length) {
+    std::string head = "HTTP/1.1 " + std::to_string(code) + " " + reason(code) + "\r\n";
+    if (contentType && *contentType) head += std::string("Content-Type: ") + contentType + "\r\n";
+    if (length == CONTENT_LENGTH_UNKNOWN) {
+      head += "Transfer-Encoding: chunked\r\n";
+      chunked_ = true;
+    } else {
+      head += "Content-Length: " + std::to_string(length) + "\r\n";
+    }
+    head += "Connection: close\r\n";
+    if (cors_) head += "Access-Control-Allow-Origin: *\r\n";
+    head += responseHeaders_ + "\r\n";
+    responseHeaders_.clear();
+    client_.write((const uint8_t*)head.data(), head.size());
+  }
+
+  void parseArgs(const std::string& query) {
+    size_t pos = 0;
+    while (pos <= query.size()) {
+      size_t amp = query.find('&', pos);
+      std::string item = query.substr(pos, amp == std::string::npos ? std::string::npos : amp - pos);
+      if (!item.empty()) {
+        size_t eq = item.find('=');
+        Pair a = {decode(item.substr(0, eq)), eq == std::string::npos ? "" : decode(item.substr(eq + 1))};
+        args_.push_back(a);
+      }
+      if (amp == std::string::npos) break;
+      pos = amp + 1;
+    }
+  }
+
+  const Pair* findHeader(const String& name) const {
+    std::string key = lower(name.str());
+    for (size_t i = 0; i < headers_.size(); i++) {
+      if (headers_[i].name == key) return &headers_[i];
+    }
+    return NULL;
+  }
+
+  static HTTPMethod parseMethod(const std::string& m) {
+    if (m == "GET") return HTTP_GET;
+    if (m == "HEAD") return HTTP_HEAD;
+    if (m == "POST") return HTTP_POST;
+    if (m == "PUT") return HTTP_PUT;
+    if (m == "PATCH") return HTTP_PATCH;
+    if (m == "DELETE") return HTTP_DELETE;
+    if (m == "OPTIONS") return HTTP_OPTIONS;
+    return HTTP_ANY;
+  }
+
+  static const char* reason(int code) {
+    switch (code) {
+      case 200: return "OK";
+      case 202: return "Accepted";
+      case 204: return "No Content";
+      case 304: return "Not Modified";
+      case 400: return "Bad Request";
+      case 404: return "Not Found";
+      case 405: return "Method Not Allowed";
+      case 409: return "Conflict";
+      case 500: return "Internal Server Error";
+      case 503: return "Service Unavailable";
+      default: return "";
+    }
+  }
+
+  static std::string decode(const std::string& text) {
+    std::string out;
+    for (size_t i = 0; i < text.size(); i++) {
+      if (text[i] == '+') {
+        out += ' ';
+      } else if (text[i] == '%' && i + 2 < text.size()) {
+        out += (char)strtol(text.substr(i + 1, 2).c_str(), NULL, 16);
+        i += 2;
+      } else {
+        out += text[i];
+      }
+    }
+    return out;
+  }
+
+  static std::string lower(std::string text) {
+    for (size_t i = 0; i < text.size(); i++) {
+      if (text[i] >= 'A' && text[i] <= 'Z') text[i] = (char)(text[i] - 'A' + 'a');
+    }
+    return text;
+  }
+
+  static std::string trim(const std::string& text) {
+    size_t b = text.find_first_not_of(" \t");
+    size_t e = text.find_last_not_of(" \t");
+    return b == std::string::npos ? std::string() : text.substr(b, e - b + 1);
+  }
+
+  WiFiServer listener_;
+  WiFiClient client_;
+  std::vector<Route> routes_;
+  THandlerFunction notFound_;
+  std::vector<std::string> collect_;
+
+  HTTPMethod method_;
+  std::string path_;
+  std::vector<Pair> args_;
+  std::vector<Pair> headers_;
+
+  std::string responseHeaders_;
+  size_t contentLength_;
+  bool chunked_;
+  bool cors_;
+};
+
+#endif
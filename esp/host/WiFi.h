@@ -0,0 +1,312 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+// WiFi, WiFiClient and WiFiServer on Linux TCP sockets.
+//
+// WiFi.begin() joins a simulated access point: after HAL_WIFI_JOIN_MS (default 0) with a
+// scan, after HAL_WIFI_FAST_MS (default 0) when given its channel and BSSID. The AP is on
+// channel 6 with BSSID 02:00:00:00:00:01, or the last byte set by HAL_WIFI_BSSID to
+// simulate a replaced router. localIP() is 127.0.0.1 unless set with config(). WiFiClient copies
+// share one socket like on the ESP32: stop() releases this copy, the socket closes
+// when the last copy lets go of it.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "Arduino.h"
+
+typedef enum { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_DISCONNECTED = 6 } wl_status_t;
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } WiFiMode_t;
+
+// Owns the file descriptor shared by WiFiClient copies
+class HostSocket {
+public:
+  explicit HostSocket(int fd) : fd_(fd), refs_(1) {}
+  ~HostSocket() { if (fd_ >= 0) close(fd_); }
+
+  int fd() const { return fd_; }
+  void retain() { refs_++; }
+  void release() { if (--refs_ == 0) delete this; }
+
+private:
+  HostSocket(const HostSocket&);
+  HostSocket& operator=(const HostSocket&);
+
+  int fd_;
+  int refs_;
+};
+
+class WiFiClient {
+public:
+  WiFiClient() : sock_(NULL), timeoutMs_(1000) {}
+  explicit WiFiClient(int fd) : sock_(new HostSocket(fd)), timeoutMs_(1000) { applyTimeout(); }
+  WiFiClient(const WiFiClient& other) : sock_(other.sock_), timeoutMs_(other.timeoutMs_) { if (sock_) sock_->retain(); }
+  ~WiFiClient() { stop(); }
+
+  WiFiClient& operator=(const WiFiClient& other) {
+    if (other.sock_) other.sock_->retain();
+    stop();
+    sock_ = other.sock_;
+    timeoutMs_ = other.timeoutMs_;
+    return *this;
+  }
+
+  int connect(const char* host, uint16_t port) { return connect(host, port, (int32_t)timeoutMs_); }
+
+  int connect(const char* host, uint16_t port, int32_t timeoutMs) {
+    stop();
+    sockaddr_in addr;
+    if (!resolve(host, port, addr)) return 0;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return 0;
+
+    // Non-blocking connect so the timeout applies, then back to blocking
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int rc = ::connect(fd, (sockaddr*)&addr, sizeof(addr));
+    if (rc != 0 && errno == EINPROGRESS) {
+      pollfd p = {fd, POLLOUT, 0};
+      int err = 0;
+      socklen_t len = sizeof(err);
+      if (poll(&p, 1, timeoutMs) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) rc = 0;
+    }
+    if (rc != 0) {
+      close(fd);
+      return 0;
+    }
+    fcntl(fd, F_SETFL, flags);
+    sock_ = new HostSocket(fd);
+    applyTimeout();
+    return 1;
+  }
+
+  void stop() {
+    if (sock_) sock_->release();
+    sock_ = NULL;
+  }
+
+  uint8_t connected() {
+    if (!sock_) return 0;
+    char c;
+    ssize_t n = recv(sock_->fd(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n > 0) return 1;
+    if (n == 0) return 0;
+    return errno == EAGAIN || errno == EWOULDBLOCK ? 1 : 0;
+  }
+
+  operator bool() { return connected(); }
+
+  int available() {
+    if (!sock_) return 0;
+    int n = 0;
+    if (ioctl(sock_->fd(), FIONREAD, &n) != 0) return 0;
+    return n;
+  }
+
+  int read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+
+  int read(uint8_t* buf, size_t len) {
+    if (!sock_) return -1;
+    ssize_t n = recv(sock_->fd(), buf, len, MSG_DONTWAIT);
+    return n > 0 ? (int)n : -1;
+  }
+
+  // Waits up to the timeout for a line, like Stream::readStringUntil()
+  String readStringUntil(char terminator) {
+    String out;
+    unsigned long start = millis();
+    while (sock_ && millis() - start < timeoutMs_) {
+      int c = read();
+      if (c < 0) {
+        pollfd p = {sock_->fd(), POLLIN, 0};
+        if (poll(&p, 1, 10) == 1 && available() == 0 && !connected()) break;
+        continue;
+      }
+      if (c == terminator) break;
+      out += (char)c;
+    }
+    return out;
+  }
+
+  size_t write(const uint8_t* data, size_t len) {
+    if (!sock_) return 0;
+    size_t sent = 0;
+    while (sent < len) {
+      ssize_t n = send(sock_->fd(), data + sent, len - sent, MSG_NOSIGNAL);
+      if (n <= 0) break;
+      sent += (size_t)n;
+    }
+    return sent;
+  }
+  size_t write(uint8_t byte) { return write(&byte, 1); }
+  size_t print(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+  size_t print(const String& text) { return write((const uint8_t*)text.c_str(), text.length()); }
+
+  void flush() {}
+  void setNoDelay(bool on) {
+    if (!sock_) return;
+    int flag = on ? 1 : 0;
+    setsockopt(sock_->fd(), IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  }
+  void setTimeout(unsigned long ms) { timeoutMs_ = ms; applyTimeout(); }
+
+  IPAddress remoteIP() const {
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (!sock_ || getpeername(sock_->fd(), (sockaddr*)&addr, &len) != 0) return IPAddress();
+    const uint8_t* b = (const uint8_t*)&addr.sin_addr.s_addr;
+    return IPAddress(b[0], b[1], b[2], b[3]);
+  }
+
+  int fd() const { return sock_ ? sock_->fd() : -1; }
+
+private:
+  static bool resolve(const char* host, uint16_t port, sockaddr_in& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) == 1) return true;
+    addrinfo hints;
+    addrinfo* found = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, NULL, &hints, &found) != 0 || !found) return false;
+    addr.sin_addr = ((sockaddr_in*)found->ai_addr)->sin_addr;
+    freeaddrinfo(found);
+    return true;
+  }
+
+  // Bounds blocking writes so a stalled peer cannot hang loop() forever
+  void applyTimeout() {
+    if (!sock_) return;
+    timeval tv;
+    tv.tv_sec = (time_t)(timeoutMs_ / 1000);
+    tv.tv_usec = (suseconds_t)(timeoutMs_ % 1000) * 1000;
+    setsockopt(sock_->fd(), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  }
+
+  HostSocket* sock_;
+  unsigned long timeoutMs_;
+};
+
+class WiFiServer {
+public:
+  explicit WiFiServer(uint16_t port = 80) : port_(port), fd_(-1) {}
+  ~WiFiServer() { end(); }
+
+  void begin(uint16_t port = 0) {
+    if (port) port_ = port;
+    end();
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd_ < 0) return;
+    int one = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port_);
+    if (bind(fd_, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd_, 64) != 0) {
+      fprintf(stderr, "host: cannot listen on port %u: %s\n", port_, strerror(errno));
+      end();
+      return;
+    }
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL, 0) | O_NONBLOCK);
+  }
+
+  void end() {
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+  }
+
+  // Next pending connection, or an unconnected client
+  WiFiClient accept() {
+    if (fd_ < 0) return WiFiClient();
+    int fd = ::accept(fd_, NULL, NULL);
+    if (fd < 0) return WiFiClient();
+    return WiFiClient(fd);
+  }
+  WiFiClient available() { return accept(); }
+
+  uint16_t port() const { return port_; }
+
+private:
+  uint16_t port_;
+  int fd_;
+};
+
+class WiFiClass {
+public:
+  WiFiClass() : status_(WL_DISCONNECTED), connectAt_(0), local_(127, 0, 0, 1), gateway_(127, 0, 0, 1), subnet_(255, 0, 0, 0), dns_(127, 0, 0, 1) {
+    memcpy(bssid_, "\x02\x00\x00\x00\x00\x01", 6);
+    const char* last = getenv("HAL_WIFI_BSSID");
+    if (last) bssid_[5] = (uint8_t)atoi(last);
+  }
+
+  wl_status_t begin(const char* ssid, const char* password, int32_t channel = 0, const uint8_t* bssid = NULL, bool connect = true) {
+    (void)ssid; (void)password;
+    if (!connect) return status_;
+    if (bssid && memcmp(bssid, bssid_, 6) != 0) {
+      status_ = WL_DISCONNECTED;   // that AP is gone, the station keeps failing
+      connectAt_ = 0;
+      return status_;
+    }
+    bool fast = bssid && channel == HOST_WIFI_CHANNEL;
+    const char* wait = getenv(fast ? "HAL_WIFI_FAST_MS" : "HAL_WIFI_JOIN_MS");
+    status_ = WL_IDLE_STATUS;
+    connectAt_ = millis() + (wait ? strtoul(wait, NULL, 10) : 0);
+    return status();
+  }
+  wl_status_t status() {
+    if (status_ == WL_IDLE_STATUS && (long)(millis() - connectAt_) >= 0) status_ = WL_CONNECTED;
+    return status_;
+  }
+  bool disconnect(bool wifiOff = false) { (void)wifiOff; status_ = WL_DISCONNECTED; connectAt_ = 0; return true; }
+
+  // All zero switches back to DHCP
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns = IPAddress()) {
+    static const IPAddress none;
+    local_ = local == none ? IPAddress(127, 0, 0, 1) : local;
+    gateway_ = gateway == none ? IPAddress(127, 0, 0, 1) : gateway;
+    subnet_ = subnet == none ? IPAddress(255, 0, 0, 0) : subnet;
+    dns_ = dns == none ? gateway_ : dns;
+    return true;
+  }
+
+  bool setSleep(bool enabled) { (void)enabled; return true; }
+  bool mode(WiFiMode_t mode) { (void)mode; return true; }
+  void persistent(bool persistent) { (void)persistent; }
+  bool setAutoReconnect(bool autoReconnect) { (void)autoReconnect; return true; }
+  IPAddress localIP() const { return local_; }
+  IPAddress gatewayIP() const { return gateway_; }
+  IPAddress subnetMask() const { return subnet_; }
+  IPAddress dnsIP(uint8_t n = 0) const { (void)n; return dns_; }
+  uint8_t* BSSID() { return status_ == WL_CONNECTED ? bssid_ : NULL; }
+  int32_t channel() const { return status_ == WL_CONNECTED ? HOST_WIFI_CHANNEL : 0; }
+
+private:
+  static const int32_t HOST_WIFI_CHANNEL = 6;
+
+  wl_status_t status_;
+  unsigned long connectAt_;
+  IPAddress local_;
+  IPAddress gateway_;
+  IPAddress subnet_;
+  IPAddress dns_;
+  uint8_t bssid_[6];
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef HOST_WIFIUDP_H
+#define HOST_WIFIUDP_H
+
+#include "Arduino.h"
+#include "loopbackudp.h"
+
+typedef LoopbackUdp WiFiUDP;
+
+#endif
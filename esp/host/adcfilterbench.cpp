@@ -0,0 +1,100 @@
+// ADC filter benchmark: push() cost and filtering quality against the window size.
+//
+// A synthetic soil probe signal (fixed seed, so runs are comparable): a level with
+// +-20 units of noise, a spike to full scale on 1 sample in 50 (WiFi bursts, the servo)
+// and a step of 800 units halfway. For every window it reports the time push() takes,
+// the same median computed by copying and sorting the window (what AdcFilter replaces),
+// the largest error outside the step, and how many samples the output needs to get
+// within 20 units of the new level. Build from esp/ with:
+//
+//   g++ -std=gnu++11 -O2 -I. -o /tmp/adcfilterbench host/adcfilterbench.cpp
+//   /tmp/adcfilterbench
+//
+// The sketches sample every few milliseconds with WINDOW = 15; ESP32 numbers are
+// roughly 20 to 50 times slower than a desktop core.
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "adcfilter.h"
+
+static const int SAMPLES = 200000;
+static const int LEVEL = 2000;
+static const int STEP = 800;
+static const int NOISE = 20;
+static const int SPIKE_EVERY = 50;
+static const int ADC_MAX = 4095;
+
+static int samples[SAMPLES];
+static volatile int sink;
+
+static double nowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int truth(int i) { return i < SAMPLES / 2 ? LEVEL : LEVEL + STEP; }
+
+static void makeSignal(unsigned int seed) {
+  srand(seed);
+  for (int i = 0; i < SAMPLES; i++) {
+    int v = truth(i) + rand() % (2 * NOISE + 1) - NOISE;
+    if (rand() % SPIKE_EVERY == 0) v = rand() % 2 ? ADC_MAX : 0;
+    samples[i] = v;
+  }
+}
+
+template <size_t WINDOW>
+static void bench() {
+  AdcFilter<WINDOW> filter;
+
+  double t0 = nowUs();
+  for (int i = 0; i < SAMPLES; i++) {
+    filter.push(samples[i]);
+    sink = filter.value();
+  }
+  double pushNs = (nowUs() - t0) * 1000.0 / SAMPLES;
+
+  // Same median the slow way: copy the window, partially sort it
+  int ring[WINDOW], work[WINDOW];
+  size_t count = 0, head = 0;
+  t0 = nowUs();
+  for (int i = 0; i < SAMPLES; i++) {
+    ring[head] = samples[i];
+    head = (head + 1) % WINDOW;
+    if (count < WINDOW) count++;
+    memcpy(work, ring, count * sizeof(int));
+    std::nth_element(work, work + (count - 1) / 2, work + count);
+    sink = work[(count - 1) / 2];
+  }
+  double sortNs = (nowUs() - t0) * 1000.0 / SAMPLES;
+
+  // Quality: error before the step once the window is full, samples to settle after it
+  filter.reset();
+  int maxError = 0, settle = -1;
+  for (int i = 0; i < SAMPLES; i++) {
+    filter.push(samples[i]);
+    int error = abs(filter.value() - truth(i));
+    if (i >= (int)WINDOW && i < SAMPLES / 2 && error > maxError) maxError = error;
+    if (i >= SAMPLES / 2 && settle < 0 && error <= NOISE) settle = i - SAMPLES / 2;
+  }
+
+  printf("%6zu %10.1f %10.1f %10d %8d\n", WINDOW, pushNs, sortNs, maxError, settle);
+}
+
+int main() {
+  makeSignal(1234);
+  printf("%6s %10s %10s %10s %8s\n", "window", "push_ns", "sort_ns", "max_err", "settle");
+  bench<3>();
+  bench<5>();
+  bench<9>();
+  bench<15>();
+  bench<31>();
+  bench<63>();
+  bench<127>();
+  bench<255>();
+  return 0;
+}
@@ -0,0 +1,304 @@
+// Round trip of the compact binary encodings (varint.h, binframe.h) through decoders
+// that read them the way the dashboard (client/src/app/lib/telemetry.ts) and the
+// gateway (gateway/fleet.h) do.
+//
+// Covers varints at every length boundary, truncated and over-long input, zig-zag at
+// the 32-bit limits, delta series with INT32_MIN/MAX changes, empty series, the packed
+// /ping flags, HISTORY_MISSING in a /history frame and SLEEP_MISSING in a battery
+// report. Build from esp/ and run with:
+//
+//   g++ -std=gnu++11 -O2 -Ihost -I. -o /tmp/binframetest host/binframetest.cpp
+//   /tmp/binframetest
+//
+// Prints every failed check and exits with 1 if there was one.
+
+#include <limits.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "WebServer.h"
+#include "binframe.h"
+#include "historystore.h"
+#include "sleepcycle.h"
+#include "varint.h"
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(cond)                                                           \
+  do {                                                                        \
+    checks++;                                                                 \
+    if (!(cond)) {                                                            \
+      failures++;                                                             \
+      printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond);                \
+    }                                                                         \
+  } while (0)
+
+// Collects what a handler sends, chunked or not
+struct CaptureServer {
+  int code;
+  std::string contentType;
+  std::string body;
+
+  void setContentLength(size_t) {}
+  void send(int c, const char* type, const char*) {
+    code = c;
+    contentType = type;
+    body.clear();
+  }
+  void sendContent(const char* data, size_t length) { body.append(data, length); }
+  void sendContent_P(PGM_P data) { body.append(data); }
+};
+
+// Reads a frame like the dashboard's FrameReader
+class Reader {
+public:
+  Reader(const uint8_t* data, size_t length) : data_(data), length_(length), pos_(0), ok_(true) {}
+
+  uint8_t byte() {
+    if (pos_ >= length_) {
+      ok_ = false;
+      return 0;
+    }
+    return data_[pos_++];
+  }
+
+  uint32_t varint() {
+    uint32_t value = 0;
+    size_t n = getVarint(data_ + pos_, length_ - pos_, &value);
+    if (!n) ok_ = false;
+    pos_ += n;
+    return value;
+  }
+
+  int32_t signedVarint() {
+    int32_t value = 0;
+    size_t n = getSignedVarint(data_ + pos_, length_ - pos_, &value);
+    if (!n) ok_ = false;
+    pos_ += n;
+    return value;
+  }
+
+  bool ok() const { return ok_; }
+  bool done() const { return pos_ == length_; }
+
+private:
+  const uint8_t* data_;
+  size_t length_;
+  size_t pos_;
+  bool ok_;
+};
+
+static void testVarint() {
+  static const uint32_t values[] = {0, 1, 127, 128, 16383, 16384, 2097151, 2097152, 268435455, 268435456, UINT32_MAX};
+  static const size_t lengths[] = {1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5};
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    uint8_t buf[VARINT_MAX_BYTES];
+    size_t n = putVarint(buf, sizeof(buf), values[i]);
+    CHECK(n == lengths[i]);
+    uint32_t back = 0;
+    CHECK(getVarint(buf, n, &back) == n && back == values[i]);
+    if (n > 1) {
+      CHECK(getVarint(buf, n - 1, &back) == 0);        // truncated
+      CHECK(putVarint(buf, n - 1, values[i]) == 0);    // no room
+    }
+  }
+  uint8_t overlong[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x00};
+  uint32_t back = 0;
+  CHECK(getVarint(overlong, sizeof(overlong), &back) == 0);
+  CHECK(getVarint(overlong, 0, &back) == 0);
+  CHECK(putVarint(overlong, 0, 0) == 0);
+}
+
+static void testZigzag() {
+  CHECK(zigzagEncode(0) == 0);
+  CHECK(zigzagEncode(-1) == 1);
+  CHECK(zigzagEncode(1) == 2);
+  CHECK(zigzagEncode(-2) == 3);
+  CHECK(zigzagEncode(INT32_MAX) == UINT32_MAX - 1);
+  CHECK(zigzagEncode(INT32_MIN) == UINT32_MAX);
+  static const int32_t values[] = {0, 1, -1, 63, -64, 64, -65, HISTORY_MISSING, INT32_MAX, INT32_MIN, INT32_MIN + 1};
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    CHECK(zigzagDecode(zigzagEncode(values[i])) == values[i]);
+    uint8_t buf[VARINT_MAX_BYTES];
+    int32_t back = 0;
+    size_t n = putSignedVarint(buf, sizeof(buf), values[i]);
+    CHECK(n > 0 && getSignedVarint(buf, n, &back) == n && back == values[i]);
+  }
+}
+
+// A series as the history and battery encoders write it: count, then changes
+static bool roundTripSeries(const std::vector<int32_t>& series, size_t* bytes) {
+  BinFrame<8 + 64 * VARINT_MAX_BYTES> frame(BIN_HISTORY);
+  frame.put((uint32_t)series.size());
+  int32_t previous = 0;
+  for (size_t i = 0; i < series.size(); i++) {
+    frame.putSigned(deltaEncode(series[i], previous));
+    previous = series[i];
+  }
+  if (frame.overflow()) return false;
+  *bytes = frame.length() - 2;
+
+  Reader r((const uint8_t*)frame.data(), frame.length());
+  if (r.byte() != BIN_VERSION || r.byte() != BIN_HISTORY) return false;
+  uint32_t count = r.varint();
+  if (count != series.size()) return false;
+  int32_t value = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    value = deltaDecode(value, r.signedVarint());
+    if (!r.ok() || value != series[i]) return false;
+  }
+  return r.done();
+}
+
+static void testDeltaSeries() {
+  size_t bytes = 0;
+  CHECK(roundTripSeries(std::vector<int32_t>(), &bytes) && bytes == 1);
+
+  static const int32_t extremes[] = {INT32_MAX, INT32_MIN, INT32_MAX, 0, INT32_MIN, -1, INT32_MIN, INT32_MAX, 1};
+  CHECK(roundTripSeries(std::vector<int32_t>(extremes, extremes + sizeof(extremes) / sizeof(extremes[0])), &bytes));
+  CHECK(deltaEncode(INT32_MIN, INT32_MAX) == 1);
+  CHECK(deltaEncode(INT32_MAX, INT32_MIN) == -1);
+  CHECK(deltaDecode(INT32_MAX, 1) == INT32_MIN);
+
+  static const int32_t missing[] = {HISTORY_MISSING, 0, HISTORY_MISSING, HISTORY_MISSING, 32767, HISTORY_MISSING};
+  CHECK(roundTripSeries(std::vector<int32_t>(missing, missing + sizeof(missing) / sizeof(missing[0])), &bytes));
+
+  // A slowly moving sensor costs a byte per point
+  std::vector<int32_t> ramp;
+  for (int i = 0; i < 60; i++) ramp.push_back(2400 - i * 3 + (i % 2));
+  CHECK(roundTripSeries(ramp, &bytes) && bytes <= 1 + 2 + 60);
+}
+
+// Every flag combination through the /ping layout (sendPingBinary in sensoresp.cpp)
+static void testPingFlags() {
+  for (uint8_t flags = 0; flags < 0x20; flags++) {
+    bool climate = flags & PING_CLIMATE;
+    BinFrame<48> frame(BIN_PING);
+    frame.byte(flags).put(4095);
+    if (climate) frame.putSigned(-125).putSigned(1000);
+    frame.put(UINT32_MAX).put(0).put(UINT32_MAX).put(123456);
+    CHECK(!frame.overflow() && frame.length() <= 30);
+
+    Reader r((const uint8_t*)frame.data(), frame.length());
+    CHECK(r.byte() == BIN_VERSION && r.byte() == BIN_PING);
+    uint8_t got = r.byte();
+    CHECK(got == flags);
+    CHECK(((got & PING_AUTOMATIC) != 0) == ((flags & 0x01) != 0));
+    CHECK(((got & PING_PUMP) != 0) == ((flags & 0x02) != 0));
+    CHECK(((got & PING_DOSING) != 0) == ((flags & 0x04) != 0));
+    CHECK(((got & PING_SERVO_DOWN) != 0) == ((flags & 0x08) != 0));
+    CHECK(r.varint() == 4095);
+    if (got & PING_CLIMATE) {
+      CHECK(r.signedVarint() == -125);
+      CHECK(r.signedVarint() == 1000);
+    }
+    CHECK(r.varint() == UINT32_MAX && r.varint() == 0 && r.varint() == UINT32_MAX && r.varint() == 123456);
+    CHECK(r.ok() && r.done());
+  }
+}
+
+// A /history frame: failed DHT reads (HISTORY_MISSING) leave their buckets empty
+static void testHistoryFrame() {
+  HistoryQuery<8> query;
+  query.begin(0, 80, 10, -1);
+  HistoryRecord climate = {5, HISTORY_CLIMATE, {80, 215, 550}};
+  query(climate);
+  HistoryRecord failed = {25, HISTORY_CLIMATE, {79, HISTORY_MISSING, HISTORY_MISSING}};
+  query(failed);
+  HistoryRecord cold = {45, HISTORY_CLIMATE, {78, -400, 1000}};
+  query(cold);
+  HistoryRecord soil = {35, HISTORY_SOIL, {3100, 0}};
+  query(soil);
+
+  CaptureServer server;
+  sendHistoryBinary(server, query, 7, 100);
+  CHECK(server.code == 200 && server.contentType == BIN_CONTENT_TYPE);
+
+  Reader r((const uint8_t*)server.body.data(), server.body.size());
+  CHECK(r.byte() == BIN_VERSION && r.byte() == BIN_HISTORY);
+  CHECK(r.varint() == 7 && r.varint() == 100 && r.varint() == 0 && r.varint() == 80 && r.varint() == 10);
+  CHECK(r.signedVarint() == -1 && r.varint() == 4);
+  uint32_t buckets = r.varint();
+  CHECK(buckets == 8);
+
+  // soil, water, temperature, humidity, pump: bucket -> value, -1 for none
+  static const int32_t expected[SERIES_COUNT][8] = {
+      {-1, -1, -1, 3100, -1, -1, -1, -1},
+      {80, -1, 79, -1, 78, -1, -1, -1},
+      {215, -1, -1, -1, -400, -1, -1, -1},
+      {550, -1, -1, -1, 1000, -1, -1, -1},
+      {-1, -1, -1, -1, -1, -1, -1, -1},
+  };
+  for (int s = 0; s < SERIES_COUNT; s++) {
+    uint8_t bits = r.byte();
+    int32_t value = 0;
+    for (uint32_t b = 0; b < buckets; b++) {
+      bool present = bits & (1 << b);
+      CHECK(present == (expected[s][b] != -1));
+      if (!present) continue;
+      value = deltaDecode(value, r.signedVarint());
+      CHECK(value == expected[s][b]);
+    }
+  }
+  CHECK(r.ok() && r.done());
+
+  // No records at all: every series is just its empty bitmap
+  HistoryQuery<8> empty;
+  empty.begin(0, 80, 10, -1);
+  sendHistoryBinary(server, empty, 7, 100);
+  Reader e((const uint8_t*)server.body.data(), server.body.size());
+  CHECK(e.byte() == BIN_VERSION && e.byte() == BIN_HISTORY);
+  for (int i = 0; i < 8; i++) e.varint();
+  for (int s = 0; s < SERIES_COUNT; s++) CHECK(e.byte() == 0);
+  CHECK(e.ok() && e.done());
+}
+
+// A battery report as the gateway reads it, with a sample the DHT missed
+static void testBatchFrame() {
+  static SleepCycle<4> cycle;
+  cycle.begin(false);
+  SleepSample samples[] = {
+      {30, 2400, 80, 215, 550},
+      {60, 2390, 80, SLEEP_MISSING, SLEEP_MISSING},
+      {90, 4095, 0, -400, 1000},
+  };
+  for (size_t i = 0; i < 3; i++) cycle.add(samples[i]);
+  BinFrame<32 + 20 * 4> frame(BIN_BATCH);
+  cycle.encode(frame, 0);
+  CHECK(!frame.overflow());
+
+  Reader r((const uint8_t*)frame.data(), frame.length());
+  CHECK(r.byte() == BIN_VERSION && r.byte() == BIN_BATCH);
+  for (int i = 0; i < 4; i++) r.varint();   // wake, report, duty, dropped
+  uint32_t count = r.varint();
+  CHECK(count == 3);
+  uint32_t sec = 0;
+  int32_t value[4] = {0, 0, 0, 0};
+  for (uint32_t s = 0; s < count && s < 3; s++) {
+    sec += r.varint();
+    for (int i = 0; i < 4; i++) value[i] += r.signedVarint();
+    CHECK(sec == samples[s].sec);
+    CHECK(value[0] == samples[s].soil && value[1] == samples[s].water);
+    CHECK(value[2] == samples[s].temperature && value[3] == samples[s].humidity);
+  }
+  CHECK(r.ok() && r.done());
+
+  cycle.begin(false);
+  cycle.encode(frame, 0);
+  Reader e((const uint8_t*)frame.data(), frame.length());
+  CHECK(e.byte() == BIN_VERSION && e.byte() == BIN_BATCH);
+  for (int i = 0; i < 4; i++) e.varint();
+  CHECK(e.varint() == 0 && e.ok() && e.done());
+}
+
+int main() {
+  testVarint();
+  testZigzag();
+  testDeltaSeries();
+  testPingFlags();
+  testHistoryFrame();
+  testBatchFrame();
+  printf("%d checks, %d failed\n", checks, failures);
+  return failures ? 1 : 0;
+}
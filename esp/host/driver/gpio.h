@@ -0,0 +1,15 @@
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+
+// Pad hold from the ESP-IDF GPIO driver: keeps an output at its level through deep sleep.
+// The host has no pads to float, so holding is only traced.
+
+#include "Arduino.h"
+
+typedef int gpio_num_t;
+
+inline esp_err_t gpio_hold_en(gpio_num_t pin) { hostSim().trace("gpio hold", pin, 1); return 0; }
+inline esp_err_t gpio_hold_dis(gpio_num_t pin) { hostSim().trace("gpio hold", pin, 0); return 0; }
+inline void gpio_deep_sleep_hold_en() {}
+
+#endif
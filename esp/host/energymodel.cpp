@@ -0,0 +1,120 @@
+// Energy model for the sensor board's battery mode (sleepcycle.h): duty cycle, average
+// current and battery life for the wake interval and report cadence.
+//
+// A wake costs the boot (ROM, bootloader, setup() until millis() starts), the sampling
+// with the radio off, and on every SLEEP_REPORT_EVERY-th wake the network join and the
+// report with the radio on. In between the board sleeps. The defaults are datasheet
+// figures for an ESP32 module; override any of them with name=value arguments, the
+// awake times best with the "Awake ... ms" lines of the board's own serial log:
+//
+//   g++ -std=gnu++11 -O2 -I. -o /tmp/energymodel host/energymodel.cpp
+//   /tmp/energymodel awake_ms=110 radio_ms=450 sleep_ua=60
+//
+// sleep_ua is the whole board asleep: the ESP32 with its RTC timer (~10 uA), the DHT22
+// in standby (~50 uA) and the regulator's quiescent current, which on dev boards with
+// an AMS1117 alone is ~5 mA. A capacitive soil probe wired to 3.3 V adds its ~5 mA too.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sleepcycle.h"
+
+struct EnergyParams {
+  double intervalMs;
+  double reportEvery;
+  double bootMs;       // reset to setup()
+  double awakeMs;      // sampling, radio off
+  double radioMs;      // join and report, on report wakes
+  double cpuMa;
+  double radioMa;      // average over join and send, TX peaks are higher
+  double sleepUa;
+  double alwaysOnMa;   // the board without battery mode: radio on, loop() spinning
+  double batteryMah;
+};
+
+struct EnergyResult {
+  double duty;         // share of time awake
+  double averageMa;
+  double mahPerDay;
+  double days;
+};
+
+static EnergyResult model(const EnergyParams& p) {
+  double radioMs = p.radioMs / p.reportEvery;   // spread over the wakes
+  double awakeMs = p.bootMs + p.awakeMs + radioMs;
+  double sleepMs = p.intervalMs - awakeMs;
+  if (sleepMs < 0) sleepMs = 0;
+  double charge = (p.bootMs + p.awakeMs) * p.cpuMa + radioMs * p.radioMa + sleepMs * p.sleepUa / 1000;
+  EnergyResult r;
+  r.duty = awakeMs / p.intervalMs;
+  r.averageMa = charge / p.intervalMs;
+  r.mahPerDay = r.averageMa * 24;
+  r.days = p.batteryMah / r.mahPerDay;
+  return r;
+}
+
+static bool setParam(EnergyParams& p, const char* arg) {
+  static const struct {
+    const char* name;
+    double EnergyParams::*field;
+  } names[] = {
+    {"interval_ms", &EnergyParams::intervalMs}, {"report_every", &EnergyParams::reportEvery},
+    {"boot_ms", &EnergyParams::bootMs},         {"awake_ms", &EnergyParams::awakeMs},
+    {"radio_ms", &EnergyParams::radioMs},       {"cpu_ma", &EnergyParams::cpuMa},
+    {"radio_ma", &EnergyParams::radioMa},       {"sleep_ua", &EnergyParams::sleepUa},
+    {"always_on_ma", &EnergyParams::alwaysOnMa}, {"battery_mah", &EnergyParams::batteryMah},
+  };
+  const char* eq = strchr(arg, '=');
+  if (!eq) return false;
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (strlen(names[i].name) == (size_t)(eq - arg) && strncmp(arg, names[i].name, eq - arg) == 0) {
+      p.*names[i].field = atof(eq + 1);
+      return p.*names[i].field >= 0;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  EnergyParams p = {(double)SLEEP_INTERVAL_MS, (double)SLEEP_REPORT_EVERY, 150, 120, 450, 40, 120, 150, 120, 2000};
+  for (int i = 1; i < argc; i++) {
+    if (!setParam(p, argv[i])) {
+      fprintf(stderr, "unknown or bad parameter: %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (p.intervalMs <= 0 || p.reportEvery < 1) {
+    fprintf(stderr, "interval_ms must be > 0 and report_every >= 1\n");
+    return 1;
+  }
+
+  EnergyResult r = model(p);
+  printf("wake every %.0f s, report every %.0f wakes: boot %.0f ms + sample %.0f ms at %.0f mA, "
+         "radio %.0f ms at %.0f mA, sleep at %.0f uA\n",
+         p.intervalMs / 1000, p.reportEvery, p.bootMs, p.awakeMs, p.cpuMa, p.radioMs, p.radioMa, p.sleepUa);
+  printf("  duty cycle    %.2f %%\n", r.duty * 100);
+  printf("  average       %.2f mA (%.1f mAh per day)\n", r.averageMa, r.mahPerDay);
+  printf("  %4.0f mAh      %.0f days\n", p.batteryMah, r.days);
+  printf("  always on     %.0f mA, %.1f days (%.0fx less)\n\n", p.alwaysOnMa, p.batteryMah / (p.alwaysOnMa * 24),
+         p.alwaysOnMa / r.averageMa);
+
+  static const double intervals[] = {10, 30, 60, 120, 300, 600};
+  static const double cadences[] = {1, 4, 10};
+  printf("%-10s", "interval");
+  for (size_t c = 0; c < sizeof(cadences) / sizeof(cadences[0]); c++) printf("  report every %-2.0f      ", cadences[c]);
+  printf("\n%-10s", "");
+  for (size_t c = 0; c < sizeof(cadences) / sizeof(cadences[0]); c++) printf("  %6s %7s %6s", "duty", "mA", "days");
+  printf("\n");
+  for (size_t i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++) {
+    printf("%6.0f s  ", intervals[i]);
+    for (size_t c = 0; c < sizeof(cadences) / sizeof(cadences[0]); c++) {
+      EnergyParams q = p;
+      q.intervalMs = intervals[i] * 1000;
+      q.reportEvery = cadences[c];
+      EnergyResult s = model(q);
+      printf("  %5.2f%% %7.3f %6.0f", s.duty * 100, s.averageMa, s.days);
+    }
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,120 @@
+#ifndef HOST_ESP32_HAL_TIMER_H
+#define HOST_ESP32_HAL_TIMER_H
+
+// ESP32 core 2.x hardware timer API (timerBegin(), timerAlarmWrite(), ...).
+//
+// Each timer is a thread that watches the simulated clock and calls the attached
+// handler when the alarm count is reached, so the "interrupt" comes while loop() is busy
+// or stuck, as on the board. Counting is 80 MHz (APB) over the divider; the alarm fires
+// within about a quarter of a millisecond. The handler runs with the timer's lock held,
+// so once timerAlarmDisable() returns it will not fire any more.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include "hostsim.h"
+
+const uint8_t HOST_TIMERS = 4;
+const long HOST_TIMER_POLL_NS = 200000;
+
+struct hw_timer_t {
+  uint8_t num;
+  bool started;
+  uint16_t divider;
+  void (*handler)();
+  bool alarmEnabled;
+  bool autoreload;
+  uint64_t alarm;      // ticks
+  uint64_t zeroUs;     // simulated time at count 0
+  pthread_mutex_t lock;
+};
+
+inline uint64_t hostTimerCount(const hw_timer_t* timer) {
+  return (hostSim().micros() - timer->zeroUs) * 80 / timer->divider;
+}
+
+inline void* hostTimerMain(void* param) {
+  hw_timer_t* timer = (hw_timer_t*)param;
+  for (;;) {
+    struct timespec pause = {0, HOST_TIMER_POLL_NS};
+    nanosleep(&pause, NULL);
+    pthread_mutex_lock(&timer->lock);
+    if (timer->alarmEnabled && timer->handler && hostTimerCount(timer) >= timer->alarm) {
+      hostSim().trace("timer alarm", timer->num, 1);
+      if (timer->autoreload) {
+        timer->zeroUs = hostSim().micros();
+      } else {
+        timer->alarmEnabled = false;
+      }
+      timer->handler();
+    }
+    pthread_mutex_unlock(&timer->lock);
+  }
+  return NULL;
+}
+
+inline hw_timer_t* timerBegin(uint8_t num, uint16_t divider, bool countUp) {
+  static hw_timer_t timers[HOST_TIMERS];
+  (void)countUp;
+  if (num >= HOST_TIMERS) return NULL;
+  hw_timer_t* timer = &timers[num];
+  if (!timer->started) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);   // handlers may re-arm
+    pthread_mutex_init(&timer->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, hostTimerMain, timer) != 0) return NULL;
+    pthread_detach(thread);
+    timer->started = true;
+  }
+  pthread_mutex_lock(&timer->lock);
+  timer->num = num;
+  timer->divider = divider ? divider : 1;
+  timer->alarmEnabled = false;
+  timer->zeroUs = hostSim().micros();
+  pthread_mutex_unlock(&timer->lock);
+  return timer;
+}
+
+inline void timerAttachInterrupt(hw_timer_t* timer, void (*handler)(), bool edge) {
+  (void)edge;
+  pthread_mutex_lock(&timer->lock);
+  timer->handler = handler;
+  pthread_mutex_unlock(&timer->lock);
+}
+
+inline void timerAlarmWrite(hw_timer_t* timer, uint64_t alarm, bool autoreload) {
+  pthread_mutex_lock(&timer->lock);
+  timer->alarm = alarm;
+  timer->autoreload = autoreload;
+  pthread_mutex_unlock(&timer->lock);
+}
+
+inline void timerAlarmEnable(hw_timer_t* timer) {
+  pthread_mutex_lock(&timer->lock);
+  timer->alarmEnabled = true;
+  pthread_mutex_unlock(&timer->lock);
+}
+
+inline void timerAlarmDisable(hw_timer_t* timer) {
+  pthread_mutex_lock(&timer->lock);
+  timer->alarmEnabled = false;
+  pthread_mutex_unlock(&timer->lock);
+}
+
+inline void timerWrite(hw_timer_t* timer, uint64_t count) {
+  pthread_mutex_lock(&timer->lock);
+  timer->zeroUs = hostSim().micros() - count * timer->divider / 80;
+  pthread_mutex_unlock(&timer->lock);
+}
+
+inline uint64_t timerRead(hw_timer_t* timer) {
+  pthread_mutex_lock(&timer->lock);
+  uint64_t count = hostTimerCount(timer);
+  pthread_mutex_unlock(&timer->lock);
+  return count;
+}
+
+#endif
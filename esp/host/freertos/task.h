@@ -0,0 +1,71 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+// FreeRTOS tasks as pthreads, so the ESP32 sketches' network task runs on the host.
+//
+// A task pinned to core n runs on CPU n when the machine has it; priorities are not
+// mapped, every thread is under the normal scheduler. Stacks get at least 256 KB: glibc's
+// printf and the socket shims need more than the board's FreeRTOS tasks. The clock is
+// shared with the Arduino main thread, so vTaskDelay() sleeps in real time even with
+// HAL_FAST_DELAY (which only moves the main thread's delay()).
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "FreeRTOS.h"
+
+struct HostTask {
+  TaskFunction_t fn;
+  void* arg;
+};
+
+inline void* hostTaskMain(void* param) {
+  HostTask task = *(HostTask*)param;
+  delete (HostTask*)param;
+  task.fn(task.arg);
+  return NULL;
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackBytes, void* arg,
+                                          UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+  (void)priority;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, stackBytes > 262144 ? stackBytes : 262144);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  HostTask* task = new HostTask{fn, arg};
+  pthread_t thread;
+  int rc = pthread_create(&thread, &attr, hostTaskMain, task);
+  pthread_attr_destroy(&attr);
+  if (rc != 0) {
+    delete task;
+    return pdFAIL;
+  }
+  char shortName[16];
+  snprintf(shortName, sizeof(shortName), "%s", name);
+  pthread_setname_np(thread, shortName);
+  if (core != tskNO_AFFINITY) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    pthread_setaffinity_np(thread, sizeof(cpus), &cpus);   // stays unpinned on a 1-CPU machine
+  }
+  if (handle) *handle = (TaskHandle_t)thread;
+  return pdPASS;
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+  struct timespec ts;
+  ts.tv_sec = (time_t)(ticks / 1000);
+  ts.tv_nsec = (long)(ticks % 1000) * 1000000L;
+  nanosleep(&ts, NULL);
+}
+
+inline BaseType_t xPortGetCoreID() {
+  int cpu = sched_getcpu();
+  return cpu < 0 ? 0 : cpu;
+}
+
+#endif
@@ -0,0 +1,170 @@
+// Runs a sketch as a Linux program.
+//
+// The headers in this directory stand in for the Arduino core and libraries (Arduino.h,
+// WiFi.h, WebServer.h, ESP8266*.h, WiFiUdp.h, HTTPClient.h, ESP32Servo.h, DHT.h).
+// Networking uses real sockets, so the dashboard, curl or a load generator can talk to
+// the sketch; the clock, GPIO and sensors are simulated (see hostsim.h for settings).
+//
+// Build any of the sketches from esp/ with:
+//
+//   g++ -std=gnu++11 -O2 -g -Ihost -o /tmp/sensoresp sensoresp.cpp host/hostmain.cpp
+//
+// and run it on an unprivileged port:
+//
+//   HAL_HTTP_PORT=8080 /tmp/sensoresp
+//   curl http://127.0.0.1:8080/ping
+//
+// HAL_RUN_MS stops the program after that many (simulated) milliseconds, which is
+// handy under valgrind or perf. HAL_LOOP_IDLE_US sleeps between loop() passes so an
+// idle sketch does not spin a core (default 100, 0 spins like the board).
+//
+// FreeRTOS tasks are threads (freertos/task.h): the ESP32 sketches serve HTTP from their
+// network task while loop() runs in the main thread, as on the board's two cores.
+//
+// enableLoopWDT() starts a watchdog thread that restarts the program cold when loop()
+// has not come round for 5 s. HAL_LOOP_STALL=at_ms:for_ms hangs the loop once, at that
+// (simulated) time and for that long, to try it and the pump interlock (pumpactuator.h):
+//
+//   HAL_TRACE=1 HAL_LOOP_STALL=2000:8000 /tmp/sensoresp
+//
+// esp_deep_sleep_start() behaves like the board's reset: the RTC_DATA_ATTR variables
+// (the rtc_data section) are written to HAL_RTC_FILE, the process sleeps for the timer
+// (not with HAL_FAST_DELAY) and starts itself over with HAL_WAKE counting the wakes,
+// which loads them back before setup(). HAL_WAKES ends the run after that many wakes:
+//
+//   g++ -std=gnu++11 -O2 -g -Ihost -DBATTERY_MODE=1 -o /tmp/sensoresp-battery sensoresp.cpp host/hostmain.cpp
+//   HAL_FAST_DELAY=1 HAL_WAKES=8 /tmp/sensoresp-battery
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include "Arduino.h"
+#include "WiFi.h"
+#include "LittleFS.h"
+
+HardwareSerial Serial;
+WiFiClass WiFi;
+EspClass ESP;
+fs::LittleFSFS LittleFS;
+
+static volatile sig_atomic_t stopRequested = 0;
+static char** hostArgv = NULL;
+
+static const uint64_t LOOP_WDT_US = 5000000;
+static volatile bool loopWdtOn = false;
+static volatile uint64_t loopFedUs = 0;
+
+// Bounds of the rtc_data section, set by the linker; NULL when the sketch keeps nothing there
+extern char __start_rtc_data[] __attribute__((weak));
+extern char __stop_rtc_data[] __attribute__((weak));
+
+static void onSignal(int) { stopRequested = 1; }
+
+static const char* rtcFile() {
+  const char* path = getenv("HAL_RTC_FILE");
+  return path && *path ? path : "/tmp/hal-rtc.bin";
+}
+
+static size_t rtcSize() { return __start_rtc_data ? (size_t)(__stop_rtc_data - __start_rtc_data) : 0; }
+
+// A cold start keeps the zeroed section, like the board at power-on
+static void loadRtc() {
+  if (!rtcSize() || hostSim().wake() == 0) return;
+  FILE* file = fopen(rtcFile(), "rb");
+  if (!file) return;
+  if (fread(__start_rtc_data, 1, rtcSize(), file) != rtcSize()) memset(__start_rtc_data, 0, rtcSize());
+  fclose(file);
+}
+
+// Starts the program over; wake 0 is a cold boot
+static void restart(int wake) __attribute__((noreturn));
+static void restart(int wake) {
+  if (wake > 0) {
+    char value[16];
+    snprintf(value, sizeof(value), "%d", wake);
+    setenv("HAL_WAKE", value, 1);
+  } else {
+    unsetenv("HAL_WAKE");
+    unsetenv("HAL_LOOP_STALL");   // the hang does not come back after the reset
+  }
+  fflush(stdout);
+  for (int fd = 3; fd < 1024; fd++) close(fd);   // the reset drops every socket
+  execv("/proc/self/exe", hostArgv);
+  perror("hal: restart");
+  _exit(1);
+}
+
+void esp_deep_sleep_start() {
+  FILE* file = rtcSize() ? fopen(rtcFile(), "wb") : NULL;
+  if (file) {
+    fwrite(__start_rtc_data, 1, rtcSize(), file);
+    fclose(file);
+  }
+  int wake = hostSim().wake() + 1;
+  const char* wakes = getenv("HAL_WAKES");
+  fprintf(stderr, "hal: deep sleep for %llu ms\n", (unsigned long long)(hostSim().sleepTimerUs() / 1000));
+  if (wakes && *wakes && wake > atoi(wakes)) exit(0);
+  hostSim().delayMicros(hostSim().sleepTimerUs());
+  restart(wake);
+}
+
+static void* loopWatchdogMain(void*) {
+  for (;;) {
+    usleep(50000);
+    uint64_t idle = hostSim().micros() - loopFedUs;
+    if (!loopWdtOn || idle < LOOP_WDT_US) continue;
+    fprintf(stderr, "[%8lu] hal: task watchdog: loop() stuck for %llu ms, resetting\n", millis(),
+            (unsigned long long)(idle / 1000));
+    restart(0);
+  }
+  return NULL;
+}
+
+void feedLoopWDT() { loopFedUs = hostSim().micros(); }
+
+void enableLoopWDT() {
+  static bool started = false;
+  feedLoopWDT();
+  loopWdtOn = true;
+  if (started) return;
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, loopWatchdogMain, NULL) != 0) return;
+  pthread_detach(thread);
+  started = true;
+}
+
+void disableLoopWDT() { loopWdtOn = false; }
+
+int main(int argc, char** argv) {
+  (void)argc;
+  hostArgv = argv;
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  const char* runEnv = getenv("HAL_RUN_MS");
+  const char* idleEnv = getenv("HAL_LOOP_IDLE_US");
+  const char* stallEnv = getenv("HAL_LOOP_STALL");
+  unsigned long runMs = runEnv ? strtoul(runEnv, NULL, 10) : 0;
+  useconds_t idleUs = idleEnv ? (useconds_t)strtoul(idleEnv, NULL, 10) : 100;
+  unsigned long stallAt = 0, stallMs = 0;
+  if (stallEnv && sscanf(stallEnv, "%lu:%lu", &stallAt, &stallMs) != 2) stallMs = 0;
+
+  loadRtc();
+  setup();
+  while (!stopRequested && (runMs == 0 || millis() < runMs)) {
+    loop();
+    if (stallMs && millis() >= stallAt) {
+      fprintf(stderr, "[%8lu] hal: loop() stalls for %lu ms\n", millis(), stallMs);
+      hostSim().delayMicros((uint64_t)stallMs * 1000);
+      stallMs = 0;
+    }
+    feedLoopWDT();
+    hostSim().runEncoders();
+    if (idleUs) usleep(idleUs);
+  }
+  // Tasks the sketch started may still be running: leave without the static destructors
+  fflush(NULL);
+  _exit(0);
+}
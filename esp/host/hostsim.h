@@ -0,0 +1,235 @@
+#ifndef HOST_HOSTSIM_H
+#define HOST_HOSTSIM_H
+
+// Simulated board behind the host Arduino shims: clock, GPIO, ADC and DHT values.
+//
+// Configured from the environment when the program starts:
+//
+//   HAL_HTTP_PORT=8080         port for every WebServer (port 80 needs root)
+//   HAL_FAST_DELAY=1           delay() advances the clock instead of sleeping
+//   HAL_ANALOG=36=3100,39=900  ADC value per GPIO (default 2048)
+//   HAL_ANALOG_NOISE=30        +/- uniform noise on every ADC sample
+//   HAL_ANALOG_SPIKE_PCT=1     percentage of samples replaced by a spike
+//   HAL_DHT_FAIL_PCT=0         percentage of DHT reads that return NaN
+//   HAL_DHT_READ_US=4000       time a DHT read blocks, like the real bit-banged transfer
+//   HAL_ENCODER=35:0,39:1:90   wheel encoder pin:PWM channel[:efficiency %], interrupts
+//                              fire at a rate that follows the channel's duty
+//   HAL_ENCODER_TPS=60         encoder ticks per second at full duty
+//   HAL_TRACE=1                log GPIO, PWM and servo changes to stderr
+//   HAL_QUIET=1                drop Serial output (for profiling)
+//   HAL_FS_DIR=/tmp/hal-littlefs  directory behind LittleFS (see LittleFS.h)
+//   HAL_RTC_FILE=/tmp/hal-rtc.bin  RTC memory kept here through deep sleep (hostmain.cpp)
+//   HAL_WAKES=10               exit instead of sleeping after that many timer wakes
+//   HAL_WAKE                   set by the program itself: number of this timer wake
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+const int HOST_PINS = 64;
+const int HOST_PWM_CHANNELS = 16;
+const int HOST_ENCODERS = 4;
+
+class HostSim {
+public:
+  HostSim() : clockSkewUs_(0), rng_(0), encoderCount_(0), lastEncoderUs_(0) {
+    startUs_ = monotonicUs();
+    rng_ = (uint32_t)startUs_ ^ 0x9E3779B9u ^ (uint32_t)getpid();
+    if (!rng_) rng_ = 1;
+    httpPort_ = envInt("HAL_HTTP_PORT", 0);
+    fastDelay_ = envInt("HAL_FAST_DELAY", 0) != 0;
+    analogNoise_ = envInt("HAL_ANALOG_NOISE", 30);
+    analogSpikePct_ = envInt("HAL_ANALOG_SPIKE_PCT", 1);
+    dhtFailPct_ = envInt("HAL_DHT_FAIL_PCT", 0);
+    dhtReadUs_ = envInt("HAL_DHT_READ_US", 4000);
+    encoderTps_ = envInt("HAL_ENCODER_TPS", 60);
+    trace_ = envInt("HAL_TRACE", 0) != 0;
+    quiet_ = envInt("HAL_QUIET", 0) != 0;
+    wake_ = envInt("HAL_WAKE", 0);
+    sleepUs_ = 0;
+    for (int i = 0; i < HOST_PINS; i++) {
+      pinLevel_[i] = 0;
+      analogBase_[i] = 2048;
+      isr_[i] = NULL;
+    }
+    for (int i = 0; i < HOST_PWM_CHANNELS; i++) pwmDuty_[i] = 0;
+    parseAnalog(getenv("HAL_ANALOG"));
+    parseEncoders(getenv("HAL_ENCODER"));
+  }
+
+  // --- Clock ---
+  uint64_t micros() const { return monotonicUs() - startUs_ + clockSkewUs_; }
+  uint32_t millis() const { return (uint32_t)(micros() / 1000); }
+
+  void delayMicros(uint64_t us) {
+    if (fastDelay_) {
+      clockSkewUs_ += us;
+      return;
+    }
+    struct timespec ts;
+    ts.tv_sec = (time_t)(us / 1000000);
+    ts.tv_nsec = (long)(us % 1000000) * 1000;
+    nanosleep(&ts, NULL);
+  }
+
+  // Simulated hardware that holds the CPU (DHT transfer) always burns real time
+  void busyWait(uint64_t us) const {
+    uint64_t until = monotonicUs() + us;
+    while (monotonicUs() < until) {}
+  }
+
+  // --- GPIO / PWM ---
+  void digitalWrite(int pin, int level) {
+    if (!validPin(pin)) return;
+    if (trace_ && pinLevel_[pin] != level) fprintf(stderr, "[%8u] gpio %d = %d\n", millis(), pin, level);
+    pinLevel_[pin] = level;
+  }
+  int digitalRead(int pin) const { return validPin(pin) ? pinLevel_[pin] : 0; }
+
+  void pwmWrite(int channel, uint32_t duty) {
+    if (channel < 0 || channel >= HOST_PWM_CHANNELS) return;
+    if (trace_ && pwmDuty_[channel] != duty) fprintf(stderr, "[%8u] pwm ch%d = %u\n", millis(), channel, duty);
+    pwmDuty_[channel] = duty;
+  }
+  uint32_t pwmDuty(int channel) const {
+    return channel >= 0 && channel < HOST_PWM_CHANNELS ? pwmDuty_[channel] : 0;
+  }
+
+  // --- Interrupts ---
+  void attachInterrupt(int pin, void (*isr)()) {
+    if (validPin(pin)) isr_[pin] = isr;
+  }
+  void detachInterrupt(int pin) {
+    if (validPin(pin)) isr_[pin] = NULL;
+  }
+
+  // Fires the encoder interrupts due since the last call (hostmain calls it between loops)
+  void runEncoders() {
+    uint64_t now = micros();
+    double seconds = lastEncoderUs_ ? (double)(now - lastEncoderUs_) / 1e6 : 0;
+    lastEncoderUs_ = now;
+    for (int i = 0; i < encoderCount_; i++) {
+      Encoder& e = encoders_[i];
+      e.pending += seconds * encoderTps_ * e.efficiency / 100.0 * pwmDuty(e.channel) / 255.0;
+      while (e.pending >= 1.0) {
+        e.pending -= 1.0;
+        if (isr_[e.pin]) isr_[e.pin]();
+      }
+    }
+  }
+
+  // --- Sensors ---
+  void setAnalog(int pin, int value) { if (validPin(pin)) analogBase_[pin] = value; }
+
+  int analogRead(int pin) {
+    if (!validPin(pin)) return 0;
+    int value = analogBase_[pin];
+    if (analogSpikePct_ > 0 && (int)(random() % 100) < analogSpikePct_) {
+      value += (random() & 1) ? 1500 : -1500;
+    } else if (analogNoise_ > 0) {
+      value += (int)(random() % (uint32_t)(2 * analogNoise_ + 1)) - analogNoise_;
+    }
+    if (value < 0) value = 0;
+    if (value > 4095) value = 4095;
+    return value;
+  }
+
+  bool dhtFails() { return dhtFailPct_ > 0 && (int)(random() % 100) < dhtFailPct_; }
+  uint64_t dhtReadUs() const { return (uint64_t)dhtReadUs_; }
+
+  void trace(const char* what, int a, int b) const {
+    if (trace_) fprintf(stderr, "[%8u] %s %d = %d\n", millis(), what, a, b);
+  }
+
+  // xorshift32, also behind esp_random()
+  uint32_t random() {
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 17;
+    rng_ ^= rng_ << 5;
+    return rng_;
+  }
+
+  // --- Deep sleep ---
+  int wake() const { return wake_; }   // 0 after a cold start
+  void setSleepTimer(uint64_t us) { sleepUs_ = us; }
+  uint64_t sleepTimerUs() const { return sleepUs_; }
+
+  int httpPort() const { return httpPort_; }
+  bool quiet() const { return quiet_; }
+
+private:
+  static uint64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+  }
+
+  static int envInt(const char* name, int fallback) {
+    const char* value = getenv(name);
+    return value && *value ? atoi(value) : fallback;
+  }
+
+  static bool validPin(int pin) { return pin >= 0 && pin < HOST_PINS; }
+
+  // "36=3100,39=900"
+  void parseAnalog(const char* spec) {
+    while (spec && *spec) {
+      int pin, value;
+      if (sscanf(spec, "%d=%d", &pin, &value) == 2) setAnalog(pin, value);
+      spec = strchr(spec, ',');
+      if (spec) spec++;
+    }
+  }
+
+  // "35:0,39:1:90"
+  void parseEncoders(const char* spec) {
+    while (spec && *spec && encoderCount_ < HOST_ENCODERS) {
+      Encoder& e = encoders_[encoderCount_];
+      e.efficiency = 100;
+      e.pending = 0;
+      if (sscanf(spec, "%d:%d:%d", &e.pin, &e.channel, &e.efficiency) >= 2 && validPin(e.pin)) encoderCount_++;
+      spec = strchr(spec, ',');
+      if (spec) spec++;
+    }
+  }
+
+  struct Encoder {
+    int pin;
+    int channel;
+    int efficiency;
+    double pending;
+  };
+
+  uint64_t startUs_;
+  uint64_t clockSkewUs_;
+  uint32_t rng_;
+  int httpPort_;
+  bool fastDelay_;
+  int analogNoise_;
+  int analogSpikePct_;
+  int dhtFailPct_;
+  int dhtReadUs_;
+  bool trace_;
+  bool quiet_;
+  int wake_;
+  uint64_t sleepUs_;
+  int pinLevel_[HOST_PINS];
+  int analogBase_[HOST_PINS];
+  uint32_t pwmDuty_[HOST_PWM_CHANNELS];
+  void (*isr_[HOST_PINS])();
+  Encoder encoders_[HOST_ENCODERS];
+  int encoderCount_;
+  int encoderTps_;
+  uint64_t lastEncoderUs_;
+};
+
+// The one simulated board of this process
+inline HostSim& hostSim() {
+  static HostSim sim;
+  return sim;
+}
+
+#endif
@@ -0,0 +1,141 @@
+// JSON response benchmark: heap allocations and build time of a /ping body, built the
+// way the sketches used to (String concatenation) and with JsonWriter.
+//
+// Global operator new is replaced to count every allocation made while a response is
+// built; both builders must produce the same text. Build from esp/ with:
+//
+//   g++ -std=gnu++11 -O2 -Ihost -I. -o /tmp/jsonbench host/jsonbench.cpp
+//   /tmp/jsonbench
+//
+// The host String is std::string, whose small-string buffer hides allocations for
+// pieces under 16 bytes; the Arduino cores keep fewer bytes inline, so the counts on a
+// board are at least these. Every one of them is a malloc/free pair on a heap that
+// fragments, which is what the fixed buffer avoids.
+
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "WString.h"
+#include "jsonwriter.h"
+
+static const int REPEATS = 200000;
+
+static unsigned long allocations = 0;
+static unsigned long allocatedBytes = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  allocatedBytes += size;
+  void* p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static double nowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// A sensor board's state, varied per call so nothing is folded away
+struct PingState {
+  bool automaticMode;
+  bool pumpRunning;
+  bool servoDown;
+  int soilMoisture;
+  float temperature;
+  float humidity;
+  int waterLevel;
+  unsigned long uptime;
+  unsigned long freeHeap;
+};
+
+static PingState stateFor(int i) {
+  PingState s;
+  s.automaticMode = i & 1;
+  s.pumpRunning = i & 2;
+  s.servoDown = i & 4;
+  s.soilMoisture = 1000 + i % 3000;
+  s.temperature = 18.0f + (i % 100) / 10.0f;
+  s.humidity = 40.0f + (i % 300) / 10.0f;
+  s.waterLevel = i % 100;
+  s.uptime = 1000000UL + (unsigned long)i;
+  s.freeHeap = 180000UL - (unsigned long)(i % 5000);
+  return s;
+}
+
+static size_t buildString(const PingState& s, char* out, size_t outSize) {
+  String response = "{";
+  response += "\"status\":\"online\",";
+  response += "\"device\":\"ESP32 Sensor Controller\",";
+  response += "\"mode\":\"" + String(s.automaticMode ? "automatic" : "manual") + "\",";
+  response += "\"pumpStatus\":\"" + String(s.pumpRunning ? "running" : "stopped") + "\",";
+  response += "\"servoPosition\":\"" + String(s.servoDown ? "down" : "up") + "\",";
+  response += "\"soilMoisture\":" + String(s.soilMoisture) + ",";
+  response += "\"temperature\":" + String(s.temperature, 1) + ",";
+  response += "\"humidity\":" + String(s.humidity, 1) + ",";
+  response += "\"waterLevel\":" + String(s.waterLevel) + ",";
+  response += "\"uptime\":" + String(s.uptime) + ",";
+  response += "\"freeHeap\":" + String(s.freeHeap) + ",";
+  response += "\"timestamp\":\"" + String(s.uptime) + "\"";
+  response += "}";
+  size_t len = response.length() < outSize - 1 ? response.length() : outSize - 1;
+  memcpy(out, response.c_str(), len);
+  out[len] = '\0';
+  return len;
+}
+
+static size_t buildWriter(const PingState& s, char* out, size_t outSize) {
+  JsonWriter<384> json;
+  json.add("status", "online")
+      .add("device", "ESP32 Sensor Controller")
+      .add("mode", s.automaticMode ? "automatic" : "manual")
+      .add("pumpStatus", s.pumpRunning ? "running" : "stopped")
+      .add("servoPosition", s.servoDown ? "down" : "up")
+      .add("soilMoisture", s.soilMoisture)
+      .add("temperature", s.temperature, 1)
+      .add("humidity", s.humidity, 1)
+      .add("waterLevel", s.waterLevel)
+      .add("uptime", s.uptime)
+      .add("freeHeap", s.freeHeap)
+      .addQuoted("timestamp", s.uptime);
+  size_t len = json.length() < outSize - 1 ? json.length() : outSize - 1;
+  memcpy(out, json.c_str(), len);
+  out[len] = '\0';
+  return len;
+}
+
+typedef size_t (*BuildFn)(const PingState&, char*, size_t);
+
+static void run(const char* name, BuildFn build) {
+  char out[512];
+  unsigned long allocs0 = allocations, bytes0 = allocatedBytes;
+  size_t total = 0;
+  double t0 = nowUs();
+  for (int i = 0; i < REPEATS; i++) total += build(stateFor(i), out, sizeof(out));
+  double us = nowUs() - t0;
+  printf("%-8s %10.2f %12.1f %10.1f %8zu\n", name, (double)(allocations - allocs0) / REPEATS,
+         (double)(allocatedBytes - bytes0) / REPEATS, us * 1000.0 / REPEATS, total / REPEATS);
+}
+
+int main() {
+  char a[512], b[512];
+  for (int i = 0; i < 1000; i++) {
+    buildString(stateFor(i), a, sizeof(a));
+    buildWriter(stateFor(i), b, sizeof(b));
+    if (strcmp(a, b) != 0) {
+      printf("outputs differ for state %d:\n  %s\n  %s\n", i, a, b);
+      return 1;
+    }
+  }
+
+  printf("%-8s %10s %12s %10s %8s\n", "builder", "allocs", "alloc_bytes", "ns", "bytes");
+  run("String", buildString);
+  run("Writer", buildWriter);
+  return 0;
+}
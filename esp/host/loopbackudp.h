@@ -0,0 +1,144 @@
+#ifndef LOOPBACKUDP_H
+#define LOOPBACKUDP_H
+
+// Linux implementation of the Arduino UDP interface used by PeerChannel.
+//
+// Lets peerproto.h run between two processes (or two channels in one process) on a
+// dev machine, e.g. a motor channel on port 4210 and a sensor channel on 4211, both
+// pointed at 127.0.0.1. Sockets are non-blocking, like WiFiUDP.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+struct LoopbackAddress {
+  uint8_t bytes[4];
+  uint8_t operator[](int index) const { return bytes[index]; }
+};
+
+class LoopbackUdp {
+public:
+  LoopbackUdp() : fd_(-1), txLen_(0), rxLen_(0), rxPos_(0), remotePort_(0) {
+    memset(&txAddr_, 0, sizeof(txAddr_));
+    memset(&remote_, 0, sizeof(remote_));
+  }
+
+  ~LoopbackUdp() { stop(); }
+
+  uint8_t begin(uint16_t port) {
+    stop();
+    fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd_ < 0) return 0;
+    int one = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd_, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL, 0) | O_NONBLOCK);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd_, (sockaddr*)&addr, sizeof(addr)) != 0) {
+      stop();
+      return 0;
+    }
+    return 1;
+  }
+
+  void stop() {
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+  }
+
+  int beginPacket(const char* host, uint16_t port) {
+    if (fd_ < 0) return 0;
+    memset(&txAddr_, 0, sizeof(txAddr_));
+    txAddr_.sin_family = AF_INET;
+    txAddr_.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &txAddr_.sin_addr) != 1) {
+      addrinfo hints;
+      addrinfo* found = NULL;
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_INET;
+      hints.ai_socktype = SOCK_DGRAM;
+      if (getaddrinfo(host, NULL, &hints, &found) != 0 || !found) return 0;
+      txAddr_.sin_addr = ((sockaddr_in*)found->ai_addr)->sin_addr;
+      freeaddrinfo(found);
+    }
+    txLen_ = 0;
+    return 1;
+  }
+
+  size_t write(const uint8_t* data, size_t len) {
+    if (txLen_ + len > sizeof(tx_)) len = sizeof(tx_) - txLen_;
+    memcpy(tx_ + txLen_, data, len);
+    txLen_ += len;
+    return len;
+  }
+
+  size_t write(uint8_t byte) { return write(&byte, 1); }
+
+  int endPacket() {
+    if (fd_ < 0) return 0;
+    ssize_t sent = sendto(fd_, tx_, txLen_, 0, (sockaddr*)&txAddr_, sizeof(txAddr_));
+    txLen_ = 0;
+    return sent >= 0 ? 1 : 0;
+  }
+
+  // Returns the size of the next datagram, 0 if none is waiting.
+  int parsePacket() {
+    if (fd_ < 0) return 0;
+    socklen_t addrLen = sizeof(remote_);
+    ssize_t n = recvfrom(fd_, rx_, sizeof(rx_), 0, (sockaddr*)&remote_, &addrLen);
+    if (n <= 0) {
+      rxLen_ = 0;
+      return 0;
+    }
+    rxLen_ = (size_t)n;
+    rxPos_ = 0;
+    remotePort_ = ntohs(remote_.sin_port);
+    return (int)n;
+  }
+
+  int available() const { return (int)(rxLen_ - rxPos_); }
+
+  int read(uint8_t* buf, size_t len) {
+    size_t n = rxLen_ - rxPos_;
+    if (n > len) n = len;
+    memcpy(buf, rx_ + rxPos_, n);
+    rxPos_ += n;
+    return (int)n;
+  }
+
+  int read() {
+    if (rxPos_ >= rxLen_) return -1;
+    return rx_[rxPos_++];
+  }
+
+  LoopbackAddress remoteIP() const {
+    LoopbackAddress ip;
+    memcpy(ip.bytes, &remote_.sin_addr.s_addr, 4);
+    return ip;
+  }
+
+  uint16_t remotePort() const { return remotePort_; }
+
+private:
+  int fd_;
+  sockaddr_in txAddr_;
+  uint8_t tx_[1472];
+  size_t txLen_;
+  uint8_t rx_[1472];
+  size_t rxLen_;
+  size_t rxPos_;
+  sockaddr_in remote_;
+  uint16_t remotePort_;
+};
+
+#endif
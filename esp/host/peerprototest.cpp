@@ -0,0 +1,300 @@
+// Two PeerChannels (peerproto.h) talking over 127.0.0.1 with LoopbackUdp, driven by a
+// fake clock.
+//
+// Covers acks, retransmits at the doubling interval (first send dropped) up to giving
+// up, duplicates from a lost ack handled once, CRC-8 rejecting corrupted packets (every
+// single-bit error, and a corrupted send on the wire that only its retransmit
+// delivers), and sequence numbers wrapping past 0xFFFF. Build from esp/ and run with:
+//
+//   g++ -std=gnu++11 -O2 -Ihost -I. -o /tmp/peerprototest host/peerprototest.cpp
+//   /tmp/peerprototest
+//
+// Uses UDP ports 47210 and 47211. Prints every failed check and exits with 1 if there
+// was one.
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "loopbackudp.h"
+#include "peerproto.h"
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(cond)                                                           \
+  do {                                                                        \
+    checks++;                                                                 \
+    if (!(cond)) {                                                            \
+      failures++;                                                             \
+      printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond);                \
+    }                                                                         \
+  } while (0)
+
+static const uint16_t PORT_A = 47210;
+static const uint16_t PORT_B = 47211;
+
+static unsigned long fakeNow = 0;
+
+struct Sent {
+  unsigned long at;
+  uint8_t flags;
+  uint16_t seq;
+  uint16_t ack;
+};
+
+// LoopbackUdp that drops or corrupts the next datagrams of one side on request and
+// logs what it sends. ID tells the two channels' transports apart.
+template <int ID>
+class FaultyUdp : public LoopbackUdp {
+public:
+  static int dropSends;
+  static int corruptSends;
+  static std::vector<Sent> log;
+
+  int beginPacket(const char* host, uint16_t port) {
+    len_ = 0;
+    return LoopbackUdp::beginPacket(host, port);
+  }
+
+  size_t write(const uint8_t* data, size_t len) {
+    if (len_ + len > sizeof(buf_)) len = sizeof(buf_) - len_;
+    memcpy(buf_ + len_, data, len);
+    len_ += len;
+    return len;
+  }
+
+  int endPacket() {
+    PeerPacket pkt;
+    if (peerDecode(buf_, len_, pkt)) {
+      Sent sent = {fakeNow, pkt.flags, pkt.seq, pkt.ack};
+      log.push_back(sent);
+    }
+    if (dropSends > 0) {
+      dropSends--;
+      return 1;   // lost on the air
+    }
+    if (corruptSends > 0 && len_ > PEER_HEADER_SIZE) {
+      corruptSends--;
+      buf_[len_ - 1] ^= 0x10;
+    }
+    LoopbackUdp::write(buf_, len_);
+    return LoopbackUdp::endPacket();
+  }
+
+private:
+  uint8_t buf_[PEER_HEADER_SIZE + PEER_MAX_PAYLOAD];
+  size_t len_;
+};
+
+template <int ID> int FaultyUdp<ID>::dropSends = 0;
+template <int ID> int FaultyUdp<ID>::corruptSends = 0;
+template <int ID> std::vector<Sent> FaultyUdp<ID>::log;
+
+typedef FaultyUdp<0> UdpA;
+typedef FaultyUdp<1> UdpB;
+
+struct Received {
+  int count;
+  uint16_t lastSeq;
+  uint8_t lastType;
+  uint8_t payload[PEER_MAX_PAYLOAD];
+};
+
+struct Delivery {
+  int delivered;
+  int failed;
+  uint16_t seq;
+  unsigned long at;
+};
+
+static void onMessage(const PeerPacket& pkt, void* context) {
+  Received* r = (Received*)context;
+  r->count++;
+  r->lastSeq = pkt.seq;
+  r->lastType = pkt.type;
+  memcpy(r->payload, pkt.payload, pkt.length);
+}
+
+static void onDelivery(uint16_t seq, bool delivered, void* context) {
+  Delivery* d = (Delivery*)context;
+  if (delivered) d->delivered++;
+  else d->failed++;
+  d->seq = seq;
+  d->at = fakeNow;
+}
+
+static void resetFaults() {
+  UdpA::dropSends = UdpA::corruptSends = 0;
+  UdpB::dropSends = UdpB::corruptSends = 0;
+  UdpA::log.clear();
+  UdpB::log.clear();
+}
+
+struct Pair {
+  PeerChannel<UdpA> a;
+  PeerChannel<UdpB> b;
+  Received gotA, gotB;
+
+  Pair(uint16_t seedA, uint16_t seedB) {
+    memset(&gotA, 0, sizeof(gotA));
+    memset(&gotB, 0, sizeof(gotB));
+    bool ok = a.begin(PORT_A, seedA) && b.begin(PORT_B, seedB);
+    CHECK(ok);
+    a.setPeer("127.0.0.1", PORT_B);
+    b.setPeer("127.0.0.1", PORT_A);
+    a.onMessage(onMessage, &gotA);
+    b.onMessage(onMessage, &gotB);
+    resetFaults();
+  }
+
+  // Ticks both sides every millisecond, as their loops would
+  void run(unsigned long ms) {
+    for (unsigned long i = 0; i < ms; i++) {
+      a.tick(fakeNow);
+      b.tick(fakeNow);
+      a.tick(fakeNow);   // picks up the ack of what b just received
+      fakeNow++;
+    }
+  }
+};
+
+static void testAck() {
+  Pair p(100, 500);
+  Delivery d = {0, 0, 0, 0};
+  uint8_t reading[4];
+  peerPut16(reading, 2345);
+  peerPut16(reading + 2, 77);
+  unsigned long start = fakeNow;
+  uint16_t seq = p.a.sendReliable(fakeNow, MSG_SOIL_READING, reading, sizeof(reading), onDelivery, &d);
+  CHECK(seq == 100 && p.a.inFlight() == 1);
+  p.run(10);
+  CHECK(d.delivered == 1 && d.failed == 0 && d.seq == seq && d.at == start);
+  CHECK(p.a.inFlight() == 0);
+  CHECK(p.gotB.count == 1 && p.gotB.lastSeq == seq && p.gotB.lastType == MSG_SOIL_READING);
+  CHECK(peerGet16(p.gotB.payload) == 2345 && peerGet16(p.gotB.payload + 2) == 77);
+  CHECK(UdpA::log.size() == 1);
+  CHECK(UdpB::log.size() == 1 && (UdpB::log[0].flags & PEER_FLAG_ACK) && UdpB::log[0].ack == seq);
+
+  // Fire-and-forget: handled, never acked or repeated
+  uint16_t plain = p.a.send(MSG_MODE_CHANGE);
+  p.run(200);
+  CHECK(plain == 101 && p.gotB.count == 2 && p.gotB.lastSeq == plain);
+  CHECK(UdpA::log.size() == 2 && UdpB::log.size() == 1);
+}
+
+static void testRetransmit() {
+  Pair p(1, 1);
+  Delivery d = {0, 0, 0, 0};
+  UdpA::dropSends = 1;
+  unsigned long start = fakeNow;
+  uint16_t seq = p.a.sendReliable(fakeNow, MSG_PUMP_COMMAND, NULL, 0, onDelivery, &d);
+  p.run(PEER_RETRY_MS - 1);
+  CHECK(d.delivered == 0 && p.gotB.count == 0);
+  p.run(10);
+  CHECK(d.delivered == 1 && p.gotB.count == 1 && p.gotB.lastSeq == seq);
+  CHECK(UdpA::log.size() == 2);
+  if (UdpA::log.size() == 2) CHECK(UdpA::log[1].at - start == PEER_RETRY_MS && UdpA::log[1].seq == seq);
+
+  // Peer gone: every retry waits twice as long as the one before, then it gives up
+  Delivery lost = {0, 0, 0, 0};
+  resetFaults();
+  UdpA::dropSends = 1000;
+  start = fakeNow;
+  seq = p.a.sendReliable(fakeNow, MSG_PUMP_COMMAND, NULL, 0, onDelivery, &lost);
+  p.run(5000);
+  CHECK(UdpA::log.size() == 1 + PEER_MAX_RETRIES);
+  unsigned long gap = PEER_RETRY_MS, at = start;
+  for (size_t i = 1; i < UdpA::log.size(); i++) {
+    at += gap;
+    CHECK(UdpA::log[i].at == at && UdpA::log[i].seq == seq);
+    gap *= 2;
+  }
+  CHECK(lost.failed == 1 && lost.delivered == 0 && lost.seq == seq && lost.at == at + gap);
+  CHECK(p.a.inFlight() == 0 && p.gotB.count == 1);
+}
+
+// The ack is lost: the retransmit is acked again but handled only once
+static void testDuplicate() {
+  Pair p(1, 1);
+  Delivery d = {0, 0, 0, 0};
+  UdpB::dropSends = 1;
+  uint16_t seq = p.a.sendReliable(fakeNow, MSG_PUMP_COMMAND, NULL, 0, onDelivery, &d);
+  p.run(PEER_RETRY_MS + 10);
+  CHECK(d.delivered == 1 && p.gotB.count == 1 && p.gotB.lastSeq == seq);
+  CHECK(UdpA::log.size() == 2 && UdpB::log.size() == 2);
+  if (UdpB::log.size() == 2) CHECK(UdpB::log[0].ack == seq && UdpB::log[1].ack == seq);
+
+  // A later packet with a new sequence number still gets through
+  p.a.sendReliable(fakeNow, MSG_MODE_CHANGE, NULL, 0, onDelivery, &d);
+  p.run(10);
+  CHECK(d.delivered == 2 && p.gotB.count == 2 && p.gotB.lastType == MSG_MODE_CHANGE);
+}
+
+static void testCrc() {
+  PeerPacket pkt;
+  memset(&pkt, 0, sizeof(pkt));
+  pkt.type = MSG_SOIL_READING;
+  pkt.flags = PEER_FLAG_RELIABLE;
+  pkt.seq = 0x1234;
+  pkt.length = 4;
+  peerPut32(pkt.payload, 0xDEADBEEF);
+  uint8_t buf[PEER_HEADER_SIZE + PEER_MAX_PAYLOAD];
+  size_t len = peerEncode(pkt, buf, sizeof(buf));
+  PeerPacket back;
+  CHECK(len == PEER_HEADER_SIZE + 4 && peerDecode(buf, len, back) && peerGet32(back.payload) == 0xDEADBEEF);
+  int accepted = 0;
+  for (size_t byte = 0; byte < len; byte++) {
+    for (int bit = 0; bit < 8; bit++) {
+      buf[byte] ^= (uint8_t)(1 << bit);
+      if (peerDecode(buf, len, back)) accepted++;
+      buf[byte] ^= (uint8_t)(1 << bit);
+    }
+  }
+  CHECK(accepted == 0);
+
+  // On the wire: the corrupted first send is dropped unacked, the retransmit delivers
+  Pair p(1, 1);
+  Delivery d = {0, 0, 0, 0};
+  UdpA::corruptSends = 1;
+  uint8_t reading[4];
+  peerPut16(reading, 1500);
+  peerPut16(reading + 2, 60);
+  p.a.sendReliable(fakeNow, MSG_SOIL_READING, reading, sizeof(reading), onDelivery, &d);
+  p.run(PEER_RETRY_MS - 1);
+  CHECK(p.gotB.count == 0 && UdpB::log.empty() && d.delivered == 0);
+  p.run(10);
+  CHECK(d.delivered == 1 && p.gotB.count == 1);
+  CHECK(peerGet16(p.gotB.payload) == 1500 && peerGet16(p.gotB.payload + 2) == 60);
+}
+
+// Sequence numbers wrap past 0xFFFF and skip 0, in both directions
+static void testSequenceWrap() {
+  Pair p(0xFFFE, 0xFFFF);
+  Delivery d = {0, 0, 0, 0};
+  static const uint16_t expected[] = {0xFFFE, 0xFFFF, 1, 2};
+  for (size_t i = 0; i < 4; i++) {
+    uint16_t seq = p.a.sendReliable(fakeNow, MSG_PUMP_COMMAND, NULL, 0, onDelivery, &d);
+    CHECK(seq == expected[i]);
+    p.run(5);
+    CHECK(p.gotB.count == (int)i + 1 && p.gotB.lastSeq == expected[i]);
+  }
+  CHECK(d.delivered == 4 && d.failed == 0);
+  CHECK(UdpB::log.size() == 4);
+  if (UdpB::log.size() == 4) CHECK(UdpB::log[0].seq == 0xFFFF && UdpB::log[1].seq == 1);   // b's acks wrapped too
+
+  // Duplicate filtering still works right after the wrap
+  UdpB::dropSends = 1;
+  uint16_t seq = p.a.sendReliable(fakeNow, MSG_PUMP_COMMAND, NULL, 0, onDelivery, &d);
+  p.run(PEER_RETRY_MS + 10);
+  CHECK(seq == 3 && d.delivered == 5 && p.gotB.count == 5);
+}
+
+int main() {
+  testAck();
+  testRetransmit();
+  testDuplicate();
+  testCrc();
+  testSequenceWrap();
+  printf("%d checks, %d failed\n", checks, failures);
+  return failures ? 1 : 0;
+}
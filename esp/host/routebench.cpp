@@ -0,0 +1,70 @@
+// Route planner benchmark: plan time and tour quality for 10 to 1000 plots.
+//
+// Plots are scattered at random over a 100 m x 100 m field (fixed seed, so runs are
+// comparable) and the rover starts in a corner. For every size it reports the nearest
+// neighbour tour, the tour after 2-opt, the 2-opt moves, the time plan() takes, and the
+// time skip() takes to re-plan the rest of the round after dropping a plot halfway.
+// Build from esp/ with:
+//
+//   g++ -std=gnu++11 -O2 -I. -o /tmp/routebench host/routebench.cpp
+//   /tmp/routebench
+//
+// The planner is the header the rover uses; ESP8266 numbers are roughly two orders of
+// magnitude slower than a desktop core.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "routeplanner.h"
+
+static const size_t BENCH_MAX_PLOTS = 1000;
+static const long FIELD_MM = 100000;
+static const int REPEATS = 5;
+
+static RoutePlanner<BENCH_MAX_PLOTS> route;
+
+static double nowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void scatter(size_t count, unsigned int seed) {
+  srand(seed);
+  route.clearPlots();
+  for (size_t i = 0; i < count; i++) route.addPlot(rand() % FIELD_MM, rand() % FIELD_MM);
+}
+
+int main() {
+  static const size_t sizes[] = {10, 20, 50, 100, 200, 500, 1000};
+
+  printf("%6s %12s %12s %7s %7s %11s %11s\n", "plots", "nn_mm", "2opt_mm", "gain%", "moves", "plan_us",
+         "skip_us");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    size_t count = sizes[s];
+    double nnMm = 0, optMm = 0, planUs = 0, skipUs = 0;
+    size_t moves = 0;
+
+    for (int r = 0; r < REPEATS; r++) {
+      scatter(count, 1000 + r);
+      route.plan(0, 0, 0);   // no passes: nearest neighbour only
+      nnMm += route.tourLengthMm();
+
+      double t0 = nowUs();
+      moves += route.plan(0, 0, 1000);
+      planUs += nowUs() - t0;
+      optMm += route.tourLengthMm();
+
+      // Rover halfway through the round, the next plot cannot be sampled
+      while (route.position() < count / 2) route.advance();
+      PlotPoint at = route.plot(route.tourAt(route.position() - 1));
+      t0 = nowUs();
+      route.skip(at, 1000);
+      skipUs += nowUs() - t0;
+    }
+
+    printf("%6zu %12.0f %12.0f %7.1f %7zu %11.0f %11.0f\n", count, nnMm / REPEATS, optMm / REPEATS,
+           100.0 * (nnMm - optMm) / nnMm, moves / REPEATS, planUs / REPEATS, skipUs / REPEATS);
+  }
+  return 0;
+}
@@ -0,0 +1,216 @@
+// SensorCycle (sensorcycle.h) driven by a fake clock through every phase.
+//
+// Checks the lower -> settle -> sample -> raise order and its timing to the
+// millisecond, the job ids behind /check_sensors' 202 + ?job= poll (a second request
+// joins the running check, a finished job serves its result, an unknown one is 404),
+// the 409 the servo endpoints give while a check runs, a check that leaves the probe
+// down, and a cycle that runs across the clock wrapping. It also times tick() itself
+// against the sketches' 10 ms loop budget. Build from esp/ and run with:
+//
+//   g++ -std=gnu++11 -O2 -I. -o /tmp/sensorcycletest host/sensorcycletest.cpp
+//   /tmp/sensorcycletest
+//
+// Prints every failed check and exits with 1 if there was one.
+
+#include <limits.h>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+#include "sensorcycle.h"
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(cond)                                                           \
+  do {                                                                        \
+    checks++;                                                                 \
+    if (!(cond)) {                                                            \
+      failures++;                                                             \
+      printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond);                \
+    }                                                                         \
+  } while (0)
+
+// sensoresp.cpp's timing: 1 s servo travel, 2 s settle, 1 s hold
+static const SensorCycleTiming TIMING = {1000, 2000, 1000};
+static const double LOOP_BUDGET_US = 10000;
+
+struct Step {
+  SensorCycleAction action;
+  unsigned long at;
+};
+
+static double nowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Ticks every millisecond from start until CYCLE_DONE (or limitMs), like loop() would
+static std::vector<Step> run(SensorCycle& cycle, unsigned long start, unsigned long limitMs, double* slowestUs) {
+  std::vector<Step> steps;
+  for (unsigned long t = 0; t <= limitMs; t++) {
+    unsigned long now = start + t;
+    double t0 = nowUs();
+    SensorCycleAction action = cycle.tick(now);
+    double us = nowUs() - t0;
+    if (slowestUs && us > *slowestUs) *slowestUs = us;
+    if (action == CYCLE_IDLE) continue;
+    Step step = {action, t};
+    steps.push_back(step);
+    if (action == CYCLE_DONE) break;
+  }
+  return steps;
+}
+
+// The answer /check_sensors?job= gives (handleCheckSensors): result, pending or unknown
+static int pollAnswer(const SensorCycle& cycle, unsigned long jobId) {
+  if (jobId != 0 && jobId == cycle.lastCompletedJobId()) return 200;
+  if (jobId != 0 && jobId == cycle.activeJobId()) return 202;
+  return 404;
+}
+
+// The answer /servo_down and /servo_up give (handleServoDown, handleServoUp)
+static int servoAnswer(const SensorCycle& cycle) { return cycle.busy() ? 409 : 200; }
+
+static void testFullCycle(unsigned long start) {
+  SensorCycle cycle(TIMING);
+  CHECK(!cycle.busy() && cycle.phase() == PHASE_IDLE && cycle.activeJobId() == 0);
+
+  unsigned long job = cycle.begin(start, true, 7);
+  CHECK(job == 1 && cycle.busy() && cycle.tag() == 7);
+  CHECK(pollAnswer(cycle, job) == 202);
+  CHECK(servoAnswer(cycle) == 409);
+
+  std::vector<Step> steps = run(cycle, start, 10000, NULL);
+  CHECK(steps.size() == 4);
+  if (steps.size() == 4) {
+    CHECK(steps[0].action == CYCLE_LOWER_SERVO && steps[0].at == 0);
+    CHECK(steps[1].action == CYCLE_SAMPLE && steps[1].at == 3000);        // travel + settle
+    CHECK(steps[2].action == CYCLE_RAISE_SERVO && steps[2].at == 4000);   // + hold
+    CHECK(steps[3].action == CYCLE_DONE && steps[3].at == 5000);          // + travel
+  }
+  CHECK(!cycle.busy() && !cycle.servoDown() && cycle.phase() == PHASE_IDLE);
+  CHECK(cycle.lastCompletedJobId() == job && cycle.activeJobId() == 0);
+  CHECK(pollAnswer(cycle, job) == 200);
+  CHECK(pollAnswer(cycle, job + 1) == 404);
+  CHECK(pollAnswer(cycle, 0) == 404);
+  CHECK(servoAnswer(cycle) == 200);
+}
+
+// Nothing happens a millisecond early, whatever the tick rate
+static void testPhaseBoundaries() {
+  SensorCycle cycle(TIMING);
+  cycle.begin(100, true);
+  CHECK(cycle.tick(100) == CYCLE_LOWER_SERVO);
+  CHECK(cycle.servoDown() && cycle.phase() == PHASE_LOWERING);
+  CHECK(cycle.tick(1099) == CYCLE_IDLE && cycle.phase() == PHASE_LOWERING);
+  CHECK(cycle.tick(1100) == CYCLE_IDLE && cycle.phase() == PHASE_SETTLING);
+  CHECK(cycle.tick(3099) == CYCLE_IDLE);
+  CHECK(cycle.tick(3100) == CYCLE_SAMPLE && cycle.phase() == PHASE_HOLDING);
+  CHECK(cycle.tick(4099) == CYCLE_IDLE);
+  CHECK(cycle.tick(4100) == CYCLE_RAISE_SERVO && cycle.phase() == PHASE_RAISING && !cycle.servoDown());
+  CHECK(cycle.tick(5099) == CYCLE_IDLE);
+  CHECK(cycle.tick(5100) == CYCLE_DONE && !cycle.busy());
+  CHECK(cycle.tick(5101) == CYCLE_IDLE);
+
+  // A slow loop skips no action: each late tick still returns them in order
+  cycle.begin(10000, true);
+  CHECK(cycle.tick(20000) == CYCLE_LOWER_SERVO);
+  CHECK(cycle.tick(30000) == CYCLE_IDLE);      // travel done, settling starts now
+  CHECK(cycle.tick(40000) == CYCLE_SAMPLE);
+  CHECK(cycle.tick(50000) == CYCLE_RAISE_SERVO);
+  CHECK(cycle.tick(60000) == CYCLE_DONE);
+}
+
+// A second request while a check runs joins it instead of stacking another
+static void testJoin() {
+  SensorCycle cycle(TIMING);
+  unsigned long job = cycle.begin(0, true);
+  CHECK(cycle.tick(0) == CYCLE_LOWER_SERVO);
+  CHECK(cycle.begin(500, false, 3) == job);
+  CHECK(cycle.tag() == 0);                     // the joined check keeps its settings
+  std::vector<Step> steps = run(cycle, 501, 10000, NULL);
+  CHECK(steps.size() == 3 && steps.back().action == CYCLE_DONE);
+  CHECK(cycle.lastCompletedJobId() == job);
+
+  unsigned long next = cycle.begin(20000, true);
+  CHECK(next == job + 1);
+  CHECK(pollAnswer(cycle, job) == 200);        // kept until the next check finishes
+  CHECK(pollAnswer(cycle, next) == 202);
+  run(cycle, 20000, 10000, NULL);
+  CHECK(pollAnswer(cycle, next) == 200 && pollAnswer(cycle, job) == 404);
+}
+
+// raiseAfter = false: the probe stays in the soil, the next check skips lowering
+static void testStayDown() {
+  SensorCycle cycle(TIMING);
+  unsigned long job = cycle.begin(0, false);
+  std::vector<Step> steps = run(cycle, 0, 10000, NULL);
+  CHECK(steps.size() == 3);
+  if (steps.size() == 3) {
+    CHECK(steps[0].action == CYCLE_LOWER_SERVO);
+    CHECK(steps[1].action == CYCLE_SAMPLE && steps[1].at == 3000);
+    CHECK(steps[2].action == CYCLE_DONE && steps[2].at == 3001);   // reported on the next tick
+  }
+  CHECK(cycle.servoDown() && !cycle.busy() && cycle.lastCompletedJobId() == job);
+
+  cycle.begin(5000, true);
+  CHECK(cycle.phase() == PHASE_SETTLING);
+  steps = run(cycle, 5000, 10000, NULL);
+  CHECK(steps.size() == 3);
+  if (steps.size() == 3) {
+    CHECK(steps[0].action == CYCLE_SAMPLE && steps[0].at == 2000);
+    CHECK(steps[1].action == CYCLE_RAISE_SERVO && steps[1].at == 3000);
+    CHECK(steps[2].action == CYCLE_DONE && steps[2].at == 4000);
+  }
+  CHECK(!cycle.servoDown());
+}
+
+// The manual servo endpoints move the servo only while no check runs
+static void testManualServo() {
+  SensorCycle cycle(TIMING);
+  cycle.setServoDown(true);
+  CHECK(cycle.servoDown());
+  cycle.begin(0, true);
+  CHECK(cycle.phase() == PHASE_SETTLING);      // already down: no lowering
+  cycle.setServoDown(false);                   // ignored while busy
+  CHECK(cycle.servoDown());
+  run(cycle, 0, 10000, NULL);
+  CHECK(!cycle.servoDown());
+}
+
+// millis() wraps; the phases measure elapsed time, so a cycle across the wrap keeps
+// its timing. The host's unsigned long is 64 bits, so the wrap tested is that one; the
+// arithmetic is the same as the boards' 32-bit wrap after 49.7 days.
+static void testClockWrap() {
+  testFullCycle(ULONG_MAX - 2500);             // wraps while settling
+  testFullCycle(ULONG_MAX);                    // wraps right after begin()
+  testFullCycle((unsigned long)UINT_MAX - 2500);
+}
+
+// tick() must never hold up loop(): the slowest call of many whole cycles
+static void testLoopLatency() {
+  SensorCycle cycle(TIMING);
+  double slowestUs = 0;
+  unsigned long now = 0;
+  for (int i = 0; i < 200; i++) {
+    cycle.begin(now, i % 2 == 0);
+    std::vector<Step> steps = run(cycle, now, 10000, &slowestUs);
+    CHECK(!steps.empty() && steps.back().action == CYCLE_DONE);
+    now += 10000;
+  }
+  printf("slowest tick() %.1f us (loop budget %.0f us)\n", slowestUs, LOOP_BUDGET_US);
+  CHECK(slowestUs < LOOP_BUDGET_US);
+}
+
+int main() {
+  testFullCycle(0);
+  testPhaseBoundaries();
+  testJoin();
+  testStayDown();
+  testManualServo();
+  testClockWrap();
+  testLoopLatency();
+  printf("%d checks, %d failed\n", checks, failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+// Converts a board's /trace dump (tracering.h) to Chrome trace JSON and sums it up.
+//
+//   curl -s http://rover.local/trace > /tmp/rover.trace
+//   g++ -std=gnu++11 -O2 -o /tmp/tracejson host/tracejson.cpp
+//   /tmp/tracejson /tmp/rover.trace > /tmp/rover.json
+//
+// Open the JSON in ui.perfetto.dev or chrome://tracing: one track per core, the traced
+// sections as nested slices. The summary on stderr lists every section by self time
+// (its duration less the traced sections inside it, same core), the place to start
+// removing blocking work; sections below the board's min_us were never recorded, so
+// their time shows up in the self time of whatever encloses them.
+//
+// Timestamps are the board's 32-bit micros(), taken back from the dump's now= as ages,
+// so a dump is placed correctly as long as it covers less than ~71 minutes.
+
+#include <algorithm>
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct Slice {
+  int64_t start;
+  uint32_t duration;
+  unsigned tag;
+  unsigned core;
+  uint64_t childUs;
+};
+
+struct TagTotals {
+  uint32_t count;
+  uint64_t totalUs;
+  uint64_t selfUs;
+  uint32_t maxUs;
+};
+
+static bool before(const Slice& a, const Slice& b) {
+  if (a.core != b.core) return a.core < b.core;
+  if (a.start != b.start) return a.start < b.start;
+  return a.duration > b.duration;   // the enclosing slice first
+}
+
+static void printJsonString(const std::string& text) {
+  putchar('"');
+  for (size_t i = 0; i < text.size(); i++) {
+    char c = text[i];
+    if (c == '"' || c == '\\') putchar('\\');
+    if ((unsigned char)c >= 0x20) putchar(c);
+  }
+  putchar('"');
+}
+
+int main(int argc, char** argv) {
+  FILE* in = argc > 1 && strcmp(argv[1], "-") != 0 ? fopen(argv[1], "r") : stdin;
+  if (!in) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  std::map<unsigned, std::string> names;
+  std::vector<Slice> slices;
+  unsigned long now = 0, minUs = 0, recorded = 0, lost = 0, dropped = 0;
+  bool header = false;
+  char line[256];
+  while (fgets(line, sizeof(line), in)) {
+    unsigned tag, core;
+    unsigned long start, duration;
+    char name[128];
+    if (sscanf(line, "# trace v1 now=%lu min_us=%lu recorded=%lu lost=%lu dropped=%lu", &now, &minUs, &recorded,
+               &lost, &dropped) == 5) {
+      header = true;
+    } else if (sscanf(line, "name %u %127s", &tag, name) == 2) {
+      names[tag] = name;
+    } else if (sscanf(line, "%lu %lu %u %u", &start, &duration, &tag, &core) == 4) {
+      Slice s = {(int64_t)now - (int64_t)(uint32_t)(now - start), (uint32_t)duration, tag, core, 0};
+      slices.push_back(s);
+    }
+  }
+  if (in != stdin) fclose(in);
+  if (!header) {
+    fprintf(stderr, "not a /trace dump (no \"# trace v1\" line)\n");
+    return 1;
+  }
+
+  std::sort(slices.begin(), slices.end(), before);
+  int64_t origin = slices.empty() ? 0 : slices[0].start;
+  for (size_t i = 0; i < slices.size(); i++) origin = std::min(origin, slices[i].start);
+
+  // Self time: each slice charged to the innermost one on the same core that encloses it
+  std::vector<size_t> open;
+  for (size_t i = 0; i < slices.size(); i++) {
+    while (!open.empty()) {
+      const Slice& top = slices[open.back()];
+      if (top.core == slices[i].core && slices[i].start + slices[i].duration <= top.start + top.duration) break;
+      open.pop_back();
+    }
+    if (!open.empty()) slices[open.back()].childUs += slices[i].duration;
+    open.push_back(i);
+  }
+
+  printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  std::map<unsigned, bool> cores;
+  for (size_t i = 0; i < slices.size(); i++) {
+    const Slice& s = slices[i];
+    std::string name = names.count(s.tag) ? names[s.tag] : "tag " + std::to_string(s.tag);
+    printf("{\"name\":");
+    printJsonString(name);
+    printf(",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%u},\n", s.core, (long long)(s.start - origin),
+           s.duration);
+    cores[s.core] = true;
+  }
+  for (std::map<unsigned, bool>::const_iterator it = cores.begin(); it != cores.end(); ++it) {
+    printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"core %u\"}},\n", it->first,
+           it->first);
+  }
+  printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"board\"}}\n]}\n");
+
+  std::map<unsigned, TagTotals> totals;
+  for (size_t i = 0; i < slices.size(); i++) {
+    const Slice& s = slices[i];
+    TagTotals& t = totals[s.tag];
+    t.count++;
+    t.totalUs += s.duration;
+    t.selfUs += s.duration > s.childUs ? s.duration - s.childUs : 0;
+    t.maxUs = std::max(t.maxUs, s.duration);
+  }
+  std::vector<std::pair<uint64_t, unsigned> > order;
+  for (std::map<unsigned, TagTotals>::const_iterator it = totals.begin(); it != totals.end(); ++it) {
+    order.push_back(std::make_pair(it->second.selfUs, it->first));
+  }
+  std::sort(order.rbegin(), order.rend());
+
+  double spanMs = slices.empty() ? 0 : (double)((int64_t)now - origin) / 1000;
+  fprintf(stderr, "%zu sections of %lu us or more over the last %.1f ms (%lu recorded, %lu overwritten, %lu dropped)\n",
+          slices.size(), minUs, spanMs, recorded, lost, dropped);
+  fprintf(stderr, "%-16s %7s %11s %11s %9s %9s\n", "section", "count", "self ms", "total ms", "mean ms", "max ms");
+  for (size_t i = 0; i < order.size(); i++) {
+    unsigned tag = order[i].second;
+    const TagTotals& t = totals[tag];
+    std::string name = names.count(tag) ? names[tag] : "tag " + std::to_string(tag);
+    fprintf(stderr, "%-16s %7u %11.3f %11.3f %9.3f %9.3f\n", name.c_str(), t.count, t.selfUs / 1000.0,
+            t.totalUs / 1000.0, t.totalUs / 1000.0 / t.count, t.maxUs / 1000.0);
+  }
+  return 0;
+}
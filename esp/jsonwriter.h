@@ -0,0 +1,279 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <float.h>
+#include <stddef.h>
+#include <string.h>
+
+// Fixed-buffer JSON object writer shared by the ESP sketches.
+//
+// Builds a flat JSON object into a buffer owned by the writer (stack or static), so a
+// response costs no heap allocations. Keys are string literals whose length is known at
+// compile time. Numbers are formatted by hand because newlib's printf("%f") allocates.
+// If the buffer is too small the output is truncated and overflow() returns true;
+// sendJson() then answers 500 instead of sending the cut-off object.
+//
+//   JsonWriter<256> json;
+//   json.add("status", "online").add("uptime", millis()).add("temperature", t, 1);
+//   sendJson(server, 200, json);
+
+// Largest scaled value writeFixed() converts; a float just below 2^32
+const float JSON_FIXED_LIMIT = 4294967040.0f;
+
+template <size_t N>
+class JsonWriter {
+public:
+  JsonWriter() { reset(); }
+
+  void reset() {
+    buf_[0] = '{';
+    len_ = 1;
+    first_ = true;
+    firstElement_ = true;
+    closed_ = false;
+    overflow_ = false;
+  }
+
+  template <size_t K>
+  JsonWriter& add(const char (&key)[K], const char* value) {
+    writeKey(key, K - 1);
+    put('"');
+    writeEscaped(value);
+    put('"');
+    return *this;
+  }
+
+  template <size_t K>
+  JsonWriter& add(const char (&key)[K], bool value) {
+    writeKey(key, K - 1);
+    if (value) write("true", 4); else write("false", 5);
+    return *this;
+  }
+
+  template <size_t K>
+  JsonWriter& add(const char (&key)[K], int value) { return add(key, (long)value); }
+
+  template <size_t K>
+  JsonWriter& add(const char (&key)[K], unsigned int value) { return add(key, (unsigned long)value); }
+
+  template <size_t K>
+  JsonWriter& add(const char (&key)[K], long value) {
+    writeKey(key, K - 1);
+    writeSigned(value);
+    return *this;
+  }
+
+  template <size_t K>
+  JsonWriter& add(const char (&key)[K], unsigned long value) {
+    writeKey(key, K - 1);
+    writeUnsigned(value);
+    return *this;
+  }
+
+  // Fixed-point float with the given number of decimals (0-6).
+  template <size_t K>
+  JsonWriter& add(const char (&key)[K], float value, int decimals) {
+    writeKey(key, K - 1);
+    writeFixed(value, decimals);
+    return *this;
+  }
+
+  // Number written as a quoted string, for fields the dashboard already reads as text.
+  template <size_t K>
+  JsonWriter& addQuoted(const char (&key)[K], unsigned long value) {
+    writeKey(key, K - 1);
+    put('"');
+    writeUnsigned(value);
+    put('"');
+    return *this;
+  }
+
+  template <size_t K>
+  JsonWriter& addNull(const char (&key)[K]) {
+    writeKey(key, K - 1);
+    write("null", 4);
+    return *this;
+  }
+
+  // Already serialized JSON value (array or nested object), written as is.
+  template <size_t K>
+  JsonWriter& addRaw(const char (&key)[K], const char* json, size_t length) {
+    writeKey(key, K - 1);
+    write(json, length);
+    return *this;
+  }
+
+  // Array streamed into the object element by element, without a buffer of its own:
+  //   json.beginArray("plan").element(3).element(1).endArray();
+  template <size_t K>
+  JsonWriter& beginArray(const char (&key)[K]) {
+    writeKey(key, K - 1);
+    put('[');
+    firstElement_ = true;
+    return *this;
+  }
+
+  JsonWriter& element(long value) {
+    writeSeparator();
+    writeSigned(value);
+    return *this;
+  }
+
+  // A finished nested object; its overflow carries over to this writer
+  template <size_t M>
+  JsonWriter& element(JsonWriter<M>& object) {
+    writeSeparator();
+    if (object.overflow()) overflow_ = true;
+    size_t n = object.length();
+    write(object.c_str(), n);
+    return *this;
+  }
+
+  JsonWriter& endArray() {
+    put(']');
+    return *this;
+  }
+
+  // Closes the object and returns the NUL-terminated text.
+  const char* c_str() {
+    if (!closed_) {
+      buf_[len_++] = '}';
+      closed_ = true;
+    }
+    buf_[len_] = '\0';
+    return buf_;
+  }
+
+  size_t length() {
+    c_str();
+    return len_;
+  }
+
+  bool overflow() const { return overflow_; }
+
+private:
+  void writeSeparator() {
+    if (!firstElement_) put(',');
+    firstElement_ = false;
+  }
+
+  void writeKey(const char* key, size_t keyLen) {
+    if (!first_) put(',');
+    first_ = false;
+    put('"');
+    write(key, keyLen);
+    put('"');
+    put(':');
+  }
+
+  // Two bytes are always kept free for the closing brace and the terminating NUL
+  void put(char c) {
+    if (len_ + 2 < N) buf_[len_++] = c;
+    else overflow_ = true;
+  }
+
+  void write(const char* s, size_t n) {
+    if (len_ + n + 2 > N) {
+      overflow_ = true;
+      n = (len_ + 2 < N) ? N - 2 - len_ : 0;
+    }
+    memcpy(buf_ + len_, s, n);
+    len_ += n;
+  }
+
+  // Quotes, backslashes and control characters; other bytes (UTF-8) pass through
+  void writeEscaped(const char* s) {
+    if (!s) return;
+    static const char hex[] = "0123456789abcdef";
+    for (; *s; ++s) {
+      unsigned char c = (unsigned char)*s;
+      if (c == '"' || c == '\\') {
+        put('\\');
+        put((char)c);
+      } else if (c == '\n') {
+        write("\\n", 2);
+      } else if (c == '\r') {
+        write("\\r", 2);
+      } else if (c == '\t') {
+        write("\\t", 2);
+      } else if (c < 0x20) {
+        write("\\u00", 4);
+        put(hex[c >> 4]);
+        put(hex[c & 0x0f]);
+      } else {
+        put((char)c);
+      }
+    }
+  }
+
+  void writeUnsigned(unsigned long v) {
+    char tmp[20];
+    size_t n = 0;
+    do {
+      tmp[n++] = (char)('0' + (v % 10));
+      v /= 10;
+    } while (v);
+    while (n) put(tmp[--n]);
+  }
+
+  void writeSigned(long v) {
+    if (v < 0) {
+      put('-');
+      writeUnsigned(0UL - (unsigned long)v);
+    } else {
+      writeUnsigned((unsigned long)v);
+    }
+  }
+
+  void writeFixed(float value, int decimals) {
+    if (value != value || value > FLT_MAX || value < -FLT_MAX) {  // NaN and ±Inf have no JSON representation
+      write("null", 4);
+      return;
+    }
+    if (decimals < 0) decimals = 0;
+    if (decimals > 6) decimals = 6;
+    unsigned long scale = 1;
+    for (int i = 0; i < decimals; i++) scale *= 10;
+
+    if (value < 0) {
+      put('-');
+      value = -value;
+    }
+    // Converting a float beyond unsigned long is undefined; clamp to what 32 bits hold
+    float scaledValue = value * (float)scale + 0.5f;
+    unsigned long scaled = scaledValue < JSON_FIXED_LIMIT ? (unsigned long)scaledValue : (unsigned long)JSON_FIXED_LIMIT;
+    writeUnsigned(scaled / scale);
+    if (decimals == 0) return;
+    put('.');
+    unsigned long frac = scaled % scale;
+    for (unsigned long div = scale / 10; div > 0; div /= 10) {
+      put((char)('0' + (frac / div) % 10));
+    }
+  }
+
+  char buf_[N];
+  size_t len_;
+  bool first_;
+  bool firstElement_;
+  bool closed_;
+  bool overflow_;
+};
+
+// Sends the writer's buffer as the response body without copying it into a String.
+// A truncated object is not valid JSON, so an overflowed writer answers 500 instead.
+template <class Server, size_t N>
+void sendJson(Server& server, int code, JsonWriter<N>& json) {
+  if (json.overflow()) {
+    static const char tooLarge[] = "{\"status\":\"error\",\"message\":\"Response too large\"}";
+    server.setContentLength(sizeof(tooLarge) - 1);
+    server.send(500, "application/json", "");
+    server.sendContent(tooLarge, sizeof(tooLarge) - 1);
+    return;
+  }
+  size_t len = json.length();
+  server.setContentLength(len);
+  server.send(code, "application/json", "");
+  server.sendContent(json.c_str(), len);
+}
+
+#endif
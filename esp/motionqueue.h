@@ -0,0 +1,216 @@
+#ifndef MOTIONQUEUE_H
+#define MOTIONQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Queue of timed drive segments with soft-start/soft-stop PWM ramps.
+//
+// Each segment ramps the duty from where the wheels are to its speed over rampMs, then
+// cruises until durationMs (measured from the segment start) is over. When the next
+// segment keeps the direction, it takes over at the current duty; otherwise the motors
+// ramp down to 0 over rampMs first, so the H-bridge never reverses under load. A
+// duration of 0 cruises until another segment is queued or stop() is called, which is
+// what the manual drive buttons use.
+//
+// Like SensorCycle, the queue owns no pins: the sketch calls tick(millis()) from loop()
+// and, when it returns true, writes direction() and duty() to the bridge.
+
+enum MotionDirection {
+  MOTION_STOP = 0,
+  MOTION_FORWARD,
+  MOTION_BACKWARD,
+  MOTION_LEFT,
+  MOTION_RIGHT
+};
+
+struct MotionSegment {
+  uint8_t direction;        // MotionDirection
+  uint8_t speed;            // PWM duty, 0-255
+  uint16_t rampMs;          // time to reach speed, and to stop at the end
+  uint32_t durationMs;      // ramp up + cruise, 0 = until the next segment
+};
+
+const uint16_t MOTION_DEFAULT_RAMP = 300;
+
+template <size_t CAPACITY = 16>
+class MotionQueue {
+public:
+  MotionQueue()
+    : head_(0), count_(0), phase_(PHASE_IDLE), phaseStart_(0), fromDuty_(0), direction_(MOTION_STOP),
+      duty_(0), endNow_(false) {}
+
+  bool push(const MotionSegment& segment) {
+    if (count_ == CAPACITY) return false;
+    queue_[(head_ + count_) % CAPACITY] = segment;
+    count_++;
+    return true;
+  }
+
+  // Drops the queued segments; the running one carries on.
+  void clear() {
+    count_ = 0;
+  }
+
+  // Replaces everything with one open-ended segment (manual drive buttons)
+  void drive(uint8_t direction, uint8_t speed, uint16_t rampMs) {
+    clear();
+    MotionSegment segment = {direction, speed, rampMs, 0};
+    push(segment);
+    endNow_ = phase_ == PHASE_RUNNING;
+  }
+
+  // Ramps down from the running segment and drops the queue
+  void stop() {
+    clear();
+    endNow_ = phase_ == PHASE_RUNNING;
+  }
+
+  // Immediate stop, no ramp. The caller switches the bridge off itself.
+  void halt() {
+    clear();
+    phase_ = PHASE_IDLE;
+    direction_ = MOTION_STOP;
+    duty_ = 0;
+    endNow_ = false;
+  }
+
+  // Returns true when direction() or duty() changed and has to be written out
+  bool tick(unsigned long now) {
+    uint8_t lastDirection = direction_;
+    uint8_t lastDuty = duty_;
+
+    for (int guard = 0; guard < 4; guard++) {
+      unsigned long elapsed = now - phaseStart_;
+      if (phase_ == PHASE_IDLE) {
+        if (count_ == 0) break;
+        start(pop(), 0, now);
+        continue;
+      }
+      if (phase_ == PHASE_RUNNING) {
+        const MotionSegment& s = current_;
+        bool over = endNow_ || (s.durationMs ? elapsed >= s.durationMs : count_ > 0);
+        if (over) {
+          endNow_ = false;
+          if (count_ > 0 && queue_[head_].direction == s.direction && s.direction != MOTION_STOP) {
+            start(pop(), duty_, now);
+            continue;
+          }
+          phase_ = PHASE_BRAKING;
+          phaseStart_ = now;
+          fromDuty_ = duty_;
+          continue;
+        }
+        duty_ = ramp(fromDuty_, s.speed, elapsed, rampOf(s));
+        break;
+      }
+      // PHASE_BRAKING
+      unsigned long rampMs = rampOf(current_);
+      if (elapsed >= rampMs || duty_ == 0) {
+        duty_ = 0;
+        direction_ = MOTION_STOP;
+        phase_ = PHASE_IDLE;
+        continue;
+      }
+      duty_ = ramp(fromDuty_, 0, elapsed, rampMs);
+      break;
+    }
+    return direction_ != lastDirection || duty_ != lastDuty;
+  }
+
+  bool busy() const { return phase_ != PHASE_IDLE || count_ > 0; }
+  size_t queued() const { return count_; }
+  size_t capacity() const { return CAPACITY; }
+  uint8_t direction() const { return direction_; }
+  uint8_t duty() const { return duty_; }
+
+private:
+  enum Phase {
+    PHASE_IDLE = 0,
+    PHASE_RUNNING,    // ramping up or cruising
+    PHASE_BRAKING     // ramping down to 0
+  };
+
+  MotionSegment pop() {
+    MotionSegment segment = queue_[head_];
+    head_ = (head_ + 1) % CAPACITY;
+    count_--;
+    return segment;
+  }
+
+  void start(const MotionSegment& segment, uint8_t fromDuty, unsigned long now) {
+    current_ = segment;
+    if (segment.direction == MOTION_STOP) current_.speed = 0;
+    endNow_ = false;
+    phase_ = PHASE_RUNNING;
+    phaseStart_ = now;
+    fromDuty_ = segment.direction == MOTION_STOP ? 0 : fromDuty;
+    direction_ = segment.direction;
+    duty_ = fromDuty_;
+  }
+
+  // Ramps never take more than half of a timed segment
+  static unsigned long rampOf(const MotionSegment& s) {
+    if (s.durationMs && (unsigned long)s.rampMs * 2 > s.durationMs) return s.durationMs / 2;
+    return s.rampMs;
+  }
+
+  static uint8_t ramp(uint8_t from, uint8_t to, unsigned long elapsed, unsigned long rampMs) {
+    if (elapsed >= rampMs) return to;
+    long delta = (long)to - from;
+    return (uint8_t)(from + delta * (long)elapsed / (long)rampMs);
+  }
+
+  MotionSegment queue_[CAPACITY];
+  size_t head_;
+  size_t count_;
+  MotionSegment current_;
+  Phase phase_;
+  unsigned long phaseStart_;
+  uint8_t fromDuty_;
+  uint8_t direction_;
+  uint8_t duty_;
+  bool endNow_;
+};
+
+// Parses a batch like "f:200:1500:300,l:180:400,s::500" into segments: direction letter
+// (f, b, l, r, s = pause), speed 0-255, duration in ms, optional ramp in ms. Returns the
+// number of segments, or -1 with *errorAt set to the index of the first bad one.
+inline int parseMotionSegments(const char* text, MotionSegment* out, size_t maxOut, size_t* errorAt) {
+  size_t n = 0;
+  const char* p = text;
+  while (p && *p) {
+    *errorAt = n;
+    if (n == maxOut) return -1;
+    MotionSegment& s = out[n];
+    switch (*p) {
+      case 'f': s.direction = MOTION_FORWARD; break;
+      case 'b': s.direction = MOTION_BACKWARD; break;
+      case 'l': s.direction = MOTION_LEFT; break;
+      case 'r': s.direction = MOTION_RIGHT; break;
+      case 's': s.direction = MOTION_STOP; break;
+      default: return -1;
+    }
+    if (*++p != ':') return -1;
+    char* end;
+    long speed = strtol(p + 1, &end, 10);
+    if (*end != ':' || speed < 0 || speed > 255) return -1;
+    long duration = strtol(end + 1, &end, 10);
+    if (duration <= 0) return -1;
+    long rampMs = MOTION_DEFAULT_RAMP;
+    if (*end == ':') {
+      rampMs = strtol(end + 1, &end, 10);
+      if (rampMs < 0 || rampMs > 0xFFFF) return -1;
+    }
+    if (*end != ',' && *end != '\0') return -1;
+    s.speed = (uint8_t)speed;
+    s.durationMs = (uint32_t)duration;
+    s.rampMs = (uint16_t)rampMs;
+    n++;
+    p = *end ? end + 1 : end;
+  }
+  return (int)n;
+}
+
+#endif
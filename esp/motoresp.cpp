@@ -1,5 +1,11 @@
 #include <WiFi.h>
 #include <WebServer.h>
+#include <LittleFS.h>
+#include <WiFiUdp.h>
+#include "wifilink.h"
+#include "peerbeacon.h"
+#include "drivetrain.h"
+#include "telemetryserver.h"
 
 // WiFi credentials
 const char* ssid = "aryantak";
@@ -7,6 +13,10 @@ const char* password = "aryantak10";
 
 WebServer server(80);
 
+// Network join from the cached access point and lease, peers found by their beacons
+WiFiLink<fs::FS> wifi(LittleFS);
+PeerBeacon<WiFiUDP> beacon(PEER_ROLE_ROVER, "motoresp");
+
 // Motor pins
 const int ENA = 32;  // Motor A enable
 const int ENB = 33;  // Motor B enable
@@ -14,7 +24,7 @@ const int IN1 = 14;  // Motor A direction 1
 const int IN2 = 27;  // Motor A direction 2
 const int IN3 = 26;  // Motor B direction 1
 const int IN4 = 25;  // Motor B direction 2
-
+DriveTrain<ENA, ENB, IN1, IN2, IN3, IN4, DigitalEnable> drive;   // EN pins switched, full speed
 
 // Movement state
 bool isMoving = false;
@@ -25,50 +35,58 @@ bool automaticMode = false;
 unsigned long lastAutoMove = 0;
 const unsigned long AUTO_MOVE_INTERVAL = 10000; // 10 seconds
 
+// Forward declarations
+void handleRoot();
+void moveForward();
+void moveBackward();
+void turnLeft();
+void turnRight();
+void stopMotors();
+void handleForward();
+void handleBackward();
+void handleLeft();
+void handleRight();
+void handleStop();
+void handleAutomatic();
+void handleManual();
+void handleMetrics();
+String getMovementString(int direction);
+
+constexpr Route ROUTES[] = {
+  {"/", ROUTE_GET | ROUTE_POST, handleRoot},
+  {"/forward", ROUTE_GET, handleForward},
+  {"/backward", ROUTE_GET, handleBackward},
+  {"/left", ROUTE_GET, handleLeft},
+  {"/right", ROUTE_GET, handleRight},
+  {"/stop", ROUTE_GET, handleStop},
+  {"/automatic", ROUTE_GET, handleAutomatic},
+  {"/manual", ROUTE_GET, handleManual},
+  {"/metrics", ROUTE_GET, handleMetrics},
+};
+constexpr uint32_t ROUTE_SEED = routeSeed(ROUTES);
+TelemetryServer<WebServer, sizeof(ROUTES) / sizeof(ROUTES[0])> web(server, ROUTES, ROUTE_SEED);
+
 void setup() {
   Serial.begin(115200);
 
-  // Motor pins
-  pinMode(ENA, OUTPUT); digitalWrite(ENA, LOW);
-  pinMode(ENB, OUTPUT); digitalWrite(ENB, LOW);
-  pinMode(IN1, OUTPUT); digitalWrite(IN1, LOW);
-  pinMode(IN2, OUTPUT); digitalWrite(IN2, LOW);
-  pinMode(IN3, OUTPUT); digitalWrite(IN3, LOW);
-  pinMode(IN4, OUTPUT); digitalWrite(IN4, LOW);
+  // Motor pins, all low
+  drive.begin();
 
+  // Joins in the background from loop(), from the cached access point when there is one
+  LittleFS.begin(true);
+  wifi.begin(ssid, password);
+  beacon.begin();
 
-  stopMotors();
-
-  // WiFi connect
-  WiFi.begin(ssid, password);
-  Serial.print("Connecting WiFi..");
-  WiFi.setSleep(false);
-
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(250);
-    Serial.print(".");
-    
-  }
-  Serial.println("\nConnected!");
-  Serial.print("IP: "); Serial.println(WiFi.localIP());
-  
-
-  // Web Server endpoints
-  server.on("/", handleRoot);
-  server.on("/forward", HTTP_GET, handleForward);
-  server.on("/backward", HTTP_GET, handleBackward);
-  server.on("/left", HTTP_GET, handleLeft);
-  server.on("/right", HTTP_GET, handleRight);
-  server.on("/stop", HTTP_GET, handleStop);
-  server.on("/automatic", HTTP_GET, handleAutomatic);
-  server.on("/manual", HTTP_GET, handleManual);
-
-  server.begin();
+  // Web Server endpoints (ROUTES), CORS and preflight included
+  web.begin();
   Serial.println("HTTP server started");
 }
 
 void loop() {
-  server.handleClient();
+  web.metrics().tickLoop(micros());
+  web.handleClient();
+  wifi.tick(millis());
+  beacon.tick(millis(), wifi.connected());
 
   // Automatic mode: move forward every interval
   if (automaticMode) {
@@ -99,44 +117,38 @@ void handleRoot() {
   server.send(200, "text/html", html);
 }
 
+void handleMetrics() {
+  web.sendMetrics();
+}
+
 // --- MOVEMENT ---
 void moveForward() {
-  currentDirection = 1;
-  digitalWrite(IN1, HIGH); digitalWrite(IN2, LOW);
-  digitalWrite(IN3, HIGH); digitalWrite(IN4, LOW);
-  digitalWrite(ENA, HIGH); digitalWrite(ENB, HIGH);
+  currentDirection = MOTION_FORWARD;
+  drive.apply(MOTION_FORWARD, 255);
   isMoving = true;
   Serial.println("Moving forward");
 }
 void moveBackward() {
-  currentDirection = 2;
-  digitalWrite(IN1, LOW); digitalWrite(IN2, HIGH);
-  digitalWrite(IN3, LOW); digitalWrite(IN4, HIGH);
-  digitalWrite(ENA, HIGH); digitalWrite(ENB, HIGH);
+  currentDirection = MOTION_BACKWARD;
+  drive.apply(MOTION_BACKWARD, 255);
   isMoving = true;
   Serial.println("Moving backward");
 }
 void turnLeft() {
-  currentDirection = 3;
-  digitalWrite(IN1, LOW); digitalWrite(IN2, HIGH);
-  digitalWrite(IN3, HIGH); digitalWrite(IN4, LOW);
-  digitalWrite(ENA, HIGH); digitalWrite(ENB, HIGH);
+  currentDirection = MOTION_LEFT;
+  drive.apply(MOTION_LEFT, 255);
   isMoving = true;
   Serial.println("Turning left");
 }
 void turnRight() {
-  currentDirection = 4;
-  digitalWrite(IN1, HIGH); digitalWrite(IN2, LOW);
-  digitalWrite(IN3, LOW); digitalWrite(IN4, HIGH);
-  digitalWrite(ENA, HIGH); digitalWrite(ENB, HIGH);
+  currentDirection = MOTION_RIGHT;
+  drive.apply(MOTION_RIGHT, 255);
   isMoving = true;
   Serial.println("Turning right");
 }
 void stopMotors() {
-  currentDirection = 0;
-  digitalWrite(IN1, LOW); digitalWrite(IN2, LOW);
-  digitalWrite(IN3, LOW); digitalWrite(IN4, LOW);
-  digitalWrite(ENA, LOW); digitalWrite(ENB, LOW);
+  currentDirection = MOTION_STOP;
+  drive.stop();
   isMoving = false;
   Serial.println("Motors stopped");
 }
@@ -1,6 +1,14 @@
 #include <ESP8266WiFi.h>
 #include <ESP8266WebServer.h>
-#include <ESP8266HTTPClient.h>
+#include <LittleFS.h>
+#include <WiFiUdp.h>
+#include "peerlink.h"
+#include "motionqueue.h"
+#include "routeplanner.h"
+#include "wifilink.h"
+#include "peerbeacon.h"
+#include "drivetrain.h"
+#include "telemetryserver.h"
 
 // WiFi credentials
 const char* ssid = "SDP";
@@ -9,6 +17,10 @@ const char* password = "123456789";
 // Web server on port 80
 ESP8266WebServer server(80);
 
+// Network join from the cached access point and lease, peers found by their beacons
+WiFiLink<fs::FS> wifi(LittleFS);
+PeerBeacon<WiFiUDP> beacon(PEER_ROLE_ROVER, "newesp8266motor");
+
 // Motor control pins (adjust to your ESP8266 GPIOs)
 const int ENA = D1;
 const int ENB = D2;
@@ -16,79 +28,197 @@ const int IN1 = D5;
 const int IN2 = D6;
 const int IN3 = D7;
 const int IN4 = D8;
+DriveTrain<ENA, ENB, IN1, IN2, IN3, IN4, DigitalEnable> drive;   // EN pins switched, full speed
 
 bool automaticMode = false;
 unsigned long lastAutoMove = 0;
-const unsigned long AUTO_MOVE_INTERVAL = 15000; // 15 seconds
+const unsigned long AUTO_MOVE_INTERVAL = 15000; // pause between rounds
 
 String sensorEspIP = "";
 const int SOIL_THRESHOLD = 500; // Adjust as needed
 
+// Persistent connection to the sensor ESP; replies come back through callbacks
+PeerLink<WiFiClient> sensorLink;
+
+// Timed drive legs. ENA/ENB are switched, not PWM'd, so segments run at full speed
+// without ramps.
+MotionQueue<4> motion;
+const unsigned long MOTION_TICK_INTERVAL = 10;
+unsigned long lastMotionTick = 0;
+
+// Automatic cycle, once per plot in the planned order: drive there -> ask for soil value ->
+// pump if dry -> next plot. After the last plot the rover waits AUTO_MOVE_INTERVAL.
+enum AutoPhase { AUTO_WAITING, AUTO_MOVING, AUTO_AWAIT_SOIL, AUTO_PUMPING };
+AutoPhase autoPhase = AUTO_WAITING;
+unsigned long autoPhaseStart = 0;
+const unsigned long AUTO_PUMP_DURATION = 3000;
+const unsigned long AUTO_SOIL_TIMEOUT = 10000;   // no reading by then: skip the plot
+
+// Plots in mm from the dock (x ahead, y to the left); /route?plots= replaces them. The
+// rover's position is where the plan says it should be, and automatic mode starts from
+// the dock facing along x.
+const PlotPoint DEFAULT_PLOTS[] = {{1500, 0}, {3000, 1200}, {800, 1800}, {2500, -900}, {3800, 400}};
+RoutePlanner<16> route;
+// Measured with the motors full on: 300 mm/s straight, 120 deg/s turning on the spot
+const RouteDrive ROVER_DRIVE = {255, 255, 300, 120, 0};
+PlotPoint roverAt = {0, 0};
+int roverHeading = 0;    // degrees, counterclockwise from x
+int legHeading = 0;      // heading once the current leg is driven
+
+// Forward declarations
+void runAutomaticCycle();
+bool startRound();
+void driveToCurrentPlot();
+void nextPlot();
+void skipPlot();
+void handleRoot();
+void moveForward();
+void stopMotors();
+void handleForward();
+void handleBackward();
+void handleLeft();
+void handleRight();
+void handleStop();
+void handleAutomatic();
+void handleManual();
+void handleSetSensorIP();
+void useSensor(const char* host);
+void onPeerFound(const PeerInfo& peer, void* context);
+void handleRoute();
+void handleMetrics();
+void requestSoilValueFromSensorESP();
+void onSoilValue(int httpCode, const char* payload, void* context);
+void sendSensorCommand(const char* endpoint);
+
+constexpr Route ROUTES[] = {
+  {"/", ROUTE_GET | ROUTE_POST, handleRoot},
+  {"/forward", ROUTE_GET, handleForward},
+  {"/backward", ROUTE_GET, handleBackward},
+  {"/left", ROUTE_GET, handleLeft},
+  {"/right", ROUTE_GET, handleRight},
+  {"/stop", ROUTE_GET, handleStop},
+  {"/automatic", ROUTE_GET, handleAutomatic},
+  {"/manual", ROUTE_GET, handleManual},
+  {"/set_sensor_ip", ROUTE_GET, handleSetSensorIP},
+  {"/route", ROUTE_GET | ROUTE_POST, handleRoute},
+  {"/metrics", ROUTE_GET, handleMetrics},
+};
+constexpr uint32_t ROUTE_SEED = routeSeed(ROUTES);
+TelemetryServer<ESP8266WebServer, sizeof(ROUTES) / sizeof(ROUTES[0])> web(server, ROUTES, ROUTE_SEED);
+
 void setup() {
   Serial.begin(115200);
 
-  pinMode(ENA, OUTPUT); digitalWrite(ENA, LOW);
-  pinMode(ENB, OUTPUT); digitalWrite(ENB, LOW);
-  pinMode(IN1, OUTPUT); digitalWrite(IN1, LOW);
-  pinMode(IN2, OUTPUT); digitalWrite(IN2, LOW);
-  pinMode(IN3, OUTPUT); digitalWrite(IN3, LOW);
-  pinMode(IN4, OUTPUT); digitalWrite(IN4, LOW);
-
-  stopMotors();
+  drive.begin();   // all motor pins low
 
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, password);
-  Serial.print("Connecting to WiFi");
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
+  for (size_t i = 0; i < sizeof(DEFAULT_PLOTS) / sizeof(DEFAULT_PLOTS[0]); i++) {
+    route.addPlot(DEFAULT_PLOTS[i].xMm, DEFAULT_PLOTS[i].yMm);
   }
-  Serial.println("\nConnected!");
-  Serial.print("IP Address: ");
-  Serial.println(WiFi.localIP());
-
-  // Route definitions
-  server.on("/", handleRoot);
-  server.on("/forward", HTTP_GET, handleForward);
-  server.on("/backward", HTTP_GET, handleBackward);
-  server.on("/left", HTTP_GET, handleLeft);
-  server.on("/right", HTTP_GET, handleRight);
-  server.on("/stop", HTTP_GET, handleStop);
-  server.on("/automatic", HTTP_GET, handleAutomatic);
-  server.on("/manual", HTTP_GET, handleManual);
-  server.on("/set_sensor_ip", HTTP_GET, handleSetSensorIP);
-
-  server.begin();
+
+  // Joins in the background from loop(), from the cached access point when there is one
+  LittleFS.begin();
+  wifi.begin(ssid, password);
+  beacon.begin();
+  beacon.onPeer(onPeerFound);
+  sensorLink.measure(&web.metrics().peerRtt());
+
+  // Route definitions (ROUTES), CORS and preflight included
+  web.begin();
   Serial.println("HTTP server started");
 }
 
 void loop() {
-  server.handleClient();
+  web.metrics().tickLoop(micros());
+  web.handleClient();
+  wifi.tick(millis());
+  beacon.tick(millis(), wifi.connected());
+  sensorLink.tick(millis());
+
+  if (millis() - lastMotionTick >= MOTION_TICK_INTERVAL) {
+    lastMotionTick = millis();
+    if (motion.tick(lastMotionTick)) drive.apply(motion.direction(), motion.duty());
+  }
 
   if (automaticMode && sensorEspIP.length() > 0) {
-    if (millis() - lastAutoMove > AUTO_MOVE_INTERVAL) {
-      lastAutoMove = millis();
+    runAutomaticCycle();
+  }
+}
 
-      moveForward();
-      delay(2500);
-      stopMotors();
+void runAutomaticCycle() {
+  unsigned long now = millis();
+  switch (autoPhase) {
+    case AUTO_WAITING:
+      if (route.done()) {
+        if (now - lastAutoMove <= AUTO_MOVE_INTERVAL) break;
+        lastAutoMove = now;
+        if (!startRound()) break;
+      }
+      driveToCurrentPlot();
+      break;
 
-      int soilValue = getSoilValueFromSensorESP();
-      Serial.printf("Soil value from Sensor ESP: %d\n", soilValue);
+    case AUTO_MOVING:
+      if (!motion.busy()) {
+        roverAt = route.plot(route.current());
+        roverHeading = legHeading;
+        autoPhase = AUTO_AWAIT_SOIL;
+        autoPhaseStart = now;
+        requestSoilValueFromSensorESP();
+      }
+      break;
 
-      if (soilValue != -1 && soilValue < SOIL_THRESHOLD) {
-        Serial.println("Soil dry, starting pump...");
-        sendSensorCommand("/pump_start");
-        delay(3000);
+    case AUTO_AWAIT_SOIL:
+      // Waiting for onSoilValue()
+      if (now - autoPhaseStart >= AUTO_SOIL_TIMEOUT) {
+        Serial.println("No soil value from Sensor ESP.");
+        skipPlot();
+      }
+      break;
+
+    case AUTO_PUMPING:
+      if (now - autoPhaseStart >= AUTO_PUMP_DURATION) {
         sendSensorCommand("/pump_stop");
         Serial.println("Pump stopped.");
-      } else {
-        Serial.println("Soil OK, moving ahead.");
+        nextPlot();
       }
-    }
+      break;
+  }
+}
+
+bool startRound() {
+  if (route.plotCount() == 0) return false;
+  size_t moves = route.plan(roverAt.xMm, roverAt.yMm);
+  Serial.printf("Round of %u plots, %lu mm (%u 2-opt moves)\n", (unsigned int)route.tourSize(), route.tourLengthMm(),
+                (unsigned int)moves);
+  return true;
+}
+
+void driveToCurrentPlot() {
+  MotionSegment legs[2];
+  int plot = route.current();
+  size_t n = routeLegSegments(roverAt, roverHeading, route.plot(plot), ROVER_DRIVE, legs, &legHeading);
+  for (size_t i = 0; i < n; i++) motion.push(legs[i]);
+  Serial.printf("Driving to plot %d (%ld, %ld)\n", plot, (long)route.plot(plot).xMm, (long)route.plot(plot).yMm);
+  autoPhase = AUTO_MOVING;
+}
+
+// Plot sampled (and watered if it was dry)
+void nextPlot() {
+  route.advance();
+  autoPhase = AUTO_WAITING;
+  if (route.done()) {
+    Serial.println("Round done.");
+    lastAutoMove = millis();
   }
 }
 
+// No reading at this plot: leave it for the next round and re-plan the rest from here
+void skipPlot() {
+  Serial.printf("Skipping plot %d this round.\n", route.current());
+  route.skip(roverAt);
+  autoPhase = AUTO_WAITING;
+  if (route.done()) lastAutoMove = millis();
+}
+
 // ======= HANDLERS & UTILITIES =======
 
 void handleRoot() {
@@ -106,30 +236,36 @@ void handleRoot() {
   server.send(200, "text/html", html);
 }
 
+void handleMetrics() {
+  web.sendMetrics();
+}
+
 void moveForward() {
-  digitalWrite(IN1, HIGH); digitalWrite(IN2, LOW);
-  digitalWrite(IN3, HIGH); digitalWrite(IN4, LOW);
-  digitalWrite(ENA, HIGH); digitalWrite(ENB, HIGH);
+  motion.drive(MOTION_FORWARD, 255, 0);
   Serial.println("Moving forward");
 }
 
 void stopMotors() {
-  digitalWrite(IN1, LOW); digitalWrite(IN2, LOW);
-  digitalWrite(IN3, LOW); digitalWrite(IN4, LOW);
-  digitalWrite(ENA, LOW); digitalWrite(ENB, LOW);
+  motion.halt();
+  drive.stop();
   Serial.println("Motors stopped");
 }
 
 void handleForward()  { if (!automaticMode) moveForward(); server.send(200, "text/plain", "Forward"); }
-void handleBackward() { Serial.println("Backward"); server.send(200, "text/plain", "Backward"); }
-void handleLeft()     { Serial.println("Left"); server.send(200, "text/plain", "Left"); }
-void handleRight()    { Serial.println("Right"); server.send(200, "text/plain", "Right"); }
+void handleBackward() { if (!automaticMode) motion.drive(MOTION_BACKWARD, 255, 0); server.send(200, "text/plain", "Backward"); }
+void handleLeft()     { if (!automaticMode) motion.drive(MOTION_LEFT, 255, 0); server.send(200, "text/plain", "Left"); }
+void handleRight()    { if (!automaticMode) motion.drive(MOTION_RIGHT, 255, 0); server.send(200, "text/plain", "Right"); }
 void handleStop()     { stopMotors(); server.send(200, "text/plain", "Stopped"); }
 
 void handleAutomatic() {
   automaticMode = true;
   stopMotors();
+  autoPhase = AUTO_WAITING;
   lastAutoMove = millis();
+  route.cancelRound();
+  roverAt.xMm = 0;
+  roverAt.yMm = 0;
+  roverHeading = 0;
   server.send(200, "text/plain", "Automatic mode enabled");
   Serial.println("Automatic mode enabled");
 }
@@ -137,53 +273,93 @@ void handleAutomatic() {
 void handleManual() {
   automaticMode = false;
   stopMotors();
+  if (autoPhase == AUTO_PUMPING) sendSensorCommand("/pump_stop");
+  autoPhase = AUTO_WAITING;
   server.send(200, "text/plain", "Manual mode enabled");
   Serial.println("Manual mode enabled");
 }
 
 void handleSetSensorIP() {
   if (server.hasArg("ip")) {
-    sensorEspIP = server.arg("ip");
-    Serial.print("Sensor ESP IP set to: ");
-    Serial.println(sensorEspIP);
+    useSensor(server.arg("ip").c_str());
     server.send(200, "text/plain", "Sensor ESP IP set to " + sensorEspIP);
   } else {
     server.send(400, "text/plain", "Missing 'ip' parameter");
   }
 }
 
-int getSoilValueFromSensorESP() {
-  if (sensorEspIP.length() == 0) return -1;
+// Pump/probe board found by its beacon; /set_sensor_ip still overrides until it moves
+void onPeerFound(const PeerInfo& peer, void* /*context*/) {
+  if (peer.role == PEER_ROLE_PROBE_PUMP) useSensor(peer.host);
+}
+
+void useSensor(const char* host) {
+  sensorEspIP = host;
+  sensorLink.setHost(host);
+  Serial.print("Sensor ESP IP set to: ");
+  Serial.println(sensorEspIP);
+}
 
-  WiFiClient client;
-  HTTPClient http;
-  String url = "http://" + sensorEspIP + "/servo_start";
-  http.begin(client, url);  // ✅ Fixed API
+void requestSoilValueFromSensorESP() {
+  if (!sensorLink.send("/servo_start", onSoilValue)) {
+    Serial.println("Sensor ESP queue full, skipping this plot.");
+    skipPlot();
+  }
+}
 
-  int httpCode = http.GET();
+// Reply to /servo_start, e.g. {"servo_angle":30,"soil_value":1234}
+void onSoilValue(int httpCode, const char* payload, void* /*context*/) {
   int soilValue = -1;
 
   if (httpCode == 200) {
-    String payload = http.getString();
-    int idx = payload.indexOf("soil_value");
-    if (idx != -1) {
-      int start = payload.indexOf(":", idx) + 1;
-      int end = payload.indexOf("}", start);
-      soilValue = payload.substring(start, end).toInt();
+    const char* key = strstr(payload, "soil_value");
+    const char* colon = key ? strchr(key, ':') : NULL;
+    if (colon) soilValue = atoi(colon + 1);
+  }
+  Serial.printf("Soil value from Sensor ESP: %d\n", soilValue);
+
+  // Mode may have changed while the request was in flight
+  if (autoPhase != AUTO_AWAIT_SOIL) return;
+
+  if (soilValue == -1) {
+    skipPlot();
+  } else if (soilValue < SOIL_THRESHOLD) {
+    Serial.println("Soil dry, starting pump...");
+    sendSensorCommand("/pump_start");
+    autoPhase = AUTO_PUMPING;
+    autoPhaseStart = millis();
+  } else {
+    Serial.println("Soil OK, moving ahead.");
+    nextPlot();
+  }
+}
+
+// GET /route: planned round and progress. ?plots=x:y,x:y,... (mm) replaces the plots;
+// a round in progress is dropped and the next one uses the new plots.
+void handleRoute() {
+  if (server.hasArg("plots")) {
+    PlotPoint plots[16];
+    size_t errorAt = 0;
+    int n = parsePlotPoints(server.arg("plots").c_str(), plots, route.capacity(), &errorAt);
+    if (n < 0) {
+      server.send(400, "text/plain", "Bad plot " + String((unsigned long)errorAt));
+      return;
     }
+    if (autoPhase == AUTO_MOVING) motion.stop();
+    if (autoPhase == AUTO_MOVING || autoPhase == AUTO_AWAIT_SOIL) autoPhase = AUTO_WAITING;
+    route.clearPlots();
+    for (int i = 0; i < n; i++) route.addPlot(plots[i].xMm, plots[i].yMm);
+    Serial.printf("%d plots set\n", n);
   }
 
-  http.end();
-  return soilValue;
+  JsonWriter<640> json;
+  addRouteJson(json, route);
+  json.add("roverX", (long)roverAt.xMm).add("roverY", (long)roverAt.yMm).add("heading", roverHeading)
+      .add("automatic", automaticMode);
+  sendJson(server, 200, json);
 }
 
-void sendSensorCommand(const String& endpoint) {
+void sendSensorCommand(const char* endpoint) {
   if (sensorEspIP.length() == 0) return;
-
-  WiFiClient client;
-  HTTPClient http;
-  String url = "http://" + sensorEspIP + endpoint;
-  http.begin(client, url);  // ✅ Fixed API
-  http.GET();
-  http.end();
+  sensorLink.send(endpoint);
 }
\ No newline at end of file
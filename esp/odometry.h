@@ -0,0 +1,161 @@
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#include <stdint.h>
+
+// Dead reckoning from wheel encoder ticks, and per-wheel speed correction.
+//
+// Everything is integer arithmetic so update() is cheap enough for a 10 Hz control
+// loop: positions are millimetres * 256, the heading is a 32-bit binary angle (the
+// full range is one turn, so it wraps for free) and sin/cos come from a quarter-wave
+// table with linear interpolation. The caller passes signed tick deltas; with
+// single-channel encoders the sign comes from the direction the wheel was driven.
+
+struct OdometryGeometry {
+  uint16_t ticksPerRev;   // encoder ticks per wheel turn
+  uint16_t wheelDiameterMm;
+  uint16_t trackWidthMm;  // distance between the wheel contact points
+};
+
+// sin() of 0..90 degrees in 64 steps, Q14
+static const int16_t ODOMETRY_SIN_TABLE[65] = {
+  0, 402, 804, 1205, 1606, 2006, 2404, 2801, 3196, 3590, 3981, 4370, 4756, 5139, 5520, 5897,
+  6270, 6639, 7005, 7366, 7723, 8076, 8423, 8765, 9102, 9434, 9760, 10080, 10394, 10702, 11003, 11297,
+  11585, 11866, 12140, 12406, 12665, 12916, 13160, 13395, 13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978,
+  15137, 15286, 15426, 15557, 15679, 15791, 15893, 15986, 16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379,
+  16384
+};
+
+// sin of a 16-bit binary angle (65536 = one turn), Q14
+inline int32_t odometrySin(uint16_t angle) {
+  uint16_t quadrant = angle >> 14;
+  uint16_t offset = angle & 0x3FFF;
+  if (quadrant & 1) offset = 0x4000 - offset;
+  uint16_t index = offset >> 8;
+  int32_t a = ODOMETRY_SIN_TABLE[index];
+  int32_t b = index < 64 ? ODOMETRY_SIN_TABLE[index + 1] : a;
+  int32_t value = a + (((b - a) * (int32_t)(offset & 0xFF)) >> 8);
+  return quadrant & 2 ? -value : value;
+}
+
+inline int32_t odometryCos(uint16_t angle) {
+  return odometrySin((uint16_t)(angle + 0x4000));
+}
+
+class Odometry {
+public:
+  explicit Odometry(const OdometryGeometry& geometry) {
+    // mm per tick, Q16: pi * d / ticks
+    mmPerTickQ16_ = (int32_t)((int64_t)314159 * geometry.wheelDiameterMm * 65536 / (100000LL * geometry.ticksPerRev));
+    // heading (2^32 per turn) per mm*256 of wheel difference: 2^32 / (2 pi * track * 256)
+    headingPerMmQ8_ = (int64_t)(4294967296.0 / (6.283185307 * geometry.trackWidthMm * 256.0));
+    reset(0, 0, 0);
+  }
+
+  void reset(long xMm, long yMm, int headingDeg) {
+    x_ = (int32_t)xMm * 256;
+    y_ = (int32_t)yMm * 256;
+    heading_ = (uint32_t)((int64_t)headingDeg * 4294967296LL / 360);
+    distance_ = 0;
+  }
+
+  void update(long leftTicks, long rightTicks) {
+    if (leftTicks == 0 && rightTicks == 0) return;
+    int32_t left = (int32_t)(((int64_t)leftTicks * mmPerTickQ16_) >> 8);     // mm * 256
+    int32_t right = (int32_t)(((int64_t)rightTicks * mmPerTickQ16_) >> 8);
+    int32_t center = (left + right) / 2;
+    uint32_t turn = (uint32_t)((int64_t)(right - left) * headingPerMmQ8_);
+
+    // Integrate along the mid-point heading of this step
+    uint16_t mid = (uint16_t)((heading_ + (uint32_t)((int32_t)turn / 2)) >> 16);
+    x_ += (int32_t)(((int64_t)center * odometryCos(mid)) >> 14);
+    y_ += (int32_t)(((int64_t)center * odometrySin(mid)) >> 14);
+    heading_ += turn;
+    distance_ += (uint32_t)(center < 0 ? -center : center);
+  }
+
+  long xMm() const { return (long)(x_ / 256); }
+  long yMm() const { return (long)(y_ / 256); }
+  // 0-359, counterclockwise from the starting direction
+  int headingDeg() const { return (int)(((uint64_t)heading_ * 360) >> 32); }
+  unsigned long distanceMm() const { return distance_ / 256; }
+
+private:
+  int32_t mmPerTickQ16_;
+  int64_t headingPerMmQ8_;
+  int32_t x_;          // mm * 256
+  int32_t y_;
+  uint32_t heading_;   // binary angle, 2^32 = one turn
+  uint32_t distance_;  // mm * 256 driven, either direction
+};
+
+// Speed correction for one wheel, added to the open-loop duty.
+//
+// Gains are Q8 (256 = 1 duty step per tick/s of error). When the wheel is driven but
+// the encoder reports nothing for faultMs the encoder is assumed missing or broken:
+// fault() turns true and the correction stays 0, so the wheel falls back to open loop.
+struct WheelPidGains {
+  int16_t kp;
+  int16_t ki;
+  int16_t kd;
+  uint16_t faultMs;
+};
+
+class WheelPid {
+public:
+  explicit WheelPid(const WheelPidGains& gains)
+    : gains_(gains), integral_(0), lastError_(0), correction_(0), stalledMs_(0), fault_(false) {}
+
+  void reset() {
+    integral_ = 0;
+    lastError_ = 0;
+    correction_ = 0;
+  }
+
+  // Speeds in ticks per second, dtMs since the previous update
+  int update(long setpoint, long measured, unsigned long dtMs) {
+    if (setpoint <= 0) {
+      reset();
+      stalledMs_ = 0;
+      return 0;
+    }
+    if (measured > 0) {
+      stalledMs_ = 0;
+      fault_ = false;
+    } else if (stalledMs_ < gains_.faultMs) {
+      stalledMs_ += dtMs;
+      if (stalledMs_ >= gains_.faultMs) fault_ = true;
+    }
+    if (fault_) {
+      reset();
+      return 0;
+    }
+
+    long error = setpoint - measured;
+    integral_ += error * (long)dtMs;
+    long iLimit = 255L * 256 * 1000 / (gains_.ki > 0 ? gains_.ki : 1);
+    if (integral_ > iLimit) integral_ = iLimit;
+    if (integral_ < -iLimit) integral_ = -iLimit;
+    long derivative = dtMs ? (error - lastError_) * 1000 / (long)dtMs : 0;
+    lastError_ = error;
+
+    long out = (gains_.kp * error + gains_.ki * integral_ / 1000 + gains_.kd * derivative / 1000) / 256;
+    if (out > 255) out = 255;
+    if (out < -255) out = -255;
+    correction_ = (int)out;
+    return correction_;
+  }
+
+  int correction() const { return correction_; }
+  bool fault() const { return fault_; }
+
+private:
+  WheelPidGains gains_;
+  long integral_;      // ticks/s * ms
+  long lastError_;
+  int correction_;
+  unsigned long stalledMs_;
+  bool fault_;
+};
+
+#endif
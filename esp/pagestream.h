@@ -0,0 +1,141 @@
+#ifndef PAGESTREAM_H
+#define PAGESTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Chunked HTML page streaming for the dashboard pages served from handleRoot().
+//
+// The static parts of a page live in flash (PROGMEM) and are sent with sendContent_P();
+// only the dynamic values pass through a small stack buffer. Nothing is concatenated
+// into a String, so a page render needs a few hundred bytes instead of several KB.
+//
+// PageTag builds an ETag from the values a page shows. When the browser already has
+// that version (If-None-Match), the handler answers 304 and renders nothing. The
+// sketch must list "If-None-Match" in server.collectHeaders() for the check to work.
+
+// FNV-1a over the dynamic values of a page
+class PageTag {
+public:
+  explicit PageTag(uint32_t version) : hash_(2166136261UL) { mix((long)version); }
+
+  PageTag& mix(long value) {
+    for (int i = 0; i < 4; i++) {
+      step((uint8_t)(value & 0xFF));
+      value >>= 8;
+    }
+    return *this;
+  }
+
+  PageTag& mix(const char* text) {
+    if (text) {
+      for (; *text; ++text) step((uint8_t)*text);
+    }
+    step(0);
+    return *this;
+  }
+
+  // Quoted ETag value, e.g. "\"5f3a09c2\""
+  void format(char* out, size_t size) const {
+    snprintf(out, size, "\"%08lx\"", (unsigned long)hash_);
+  }
+
+private:
+  void step(uint8_t byte) {
+    hash_ ^= byte;
+    hash_ *= 16777619UL;
+  }
+
+  uint32_t hash_;
+};
+
+// Returns true (and answers 304) when the client already has this version of the page.
+// Otherwise attaches the ETag so the next request can be revalidated.
+template <class Server>
+bool pageNotModified(Server& server, const PageTag& tag) {
+  char etag[12];
+  tag.format(etag, sizeof(etag));
+  server.sendHeader("ETag", etag);
+  server.sendHeader("Cache-Control", "no-cache");
+  if (server.hasHeader("If-None-Match") && server.header("If-None-Match") == etag) {
+    server.send(304, "text/html", "");
+    return true;
+  }
+  return false;
+}
+
+template <class Server, size_t N = 96>
+class PageStream {
+public:
+  explicit PageStream(Server& server) : server_(server), len_(0) {}
+
+  void begin(int code = 200, const char* contentType = "text/html") {
+    server_.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server_.send(code, contentType, "");
+  }
+
+  // Static markup stored in flash
+  void progmem(PGM_P text) {
+    flush();
+    server_.sendContent_P(text);
+  }
+
+  void print(const char* text) {
+    if (text) write(text, strlen(text));
+  }
+
+  // Raw bytes, may contain zeros (binary answers)
+  void write(const char* data, size_t n) {
+    if (len_ + n > N) flush();
+    if (n > N) {
+      server_.sendContent(data, n);
+      return;
+    }
+    memcpy(buf_ + len_, data, n);
+    len_ += n;
+  }
+
+  void print(long value) {
+    char tmp[24];
+    snprintf(tmp, sizeof(tmp), "%ld", value);
+    print(tmp);
+  }
+
+  // Fixed-point float, avoids printf("%f") which allocates on newlib
+  void print(float value, int decimals) {
+    char tmp[24];
+    if (decimals < 0) decimals = 0;
+    if (decimals > 6) decimals = 6;
+    long scale = 1;
+    for (int i = 0; i < decimals; i++) scale *= 10;
+    bool negative = value < 0;
+    long scaled = (long)((negative ? -value : value) * (float)scale + 0.5f);
+    if (decimals > 0) {
+      snprintf(tmp, sizeof(tmp), "%s%ld.%0*ld", negative ? "-" : "", scaled / scale, decimals, scaled % scale);
+    } else {
+      snprintf(tmp, sizeof(tmp), "%s%ld", negative ? "-" : "", scaled);
+    }
+    print(tmp);
+  }
+
+  // Flushes the buffer and terminates the chunked response.
+  void end() {
+    flush();
+    server_.sendContent(buf_, 0);
+  }
+
+private:
+  void flush() {
+    if (len_ == 0) return;
+    server_.sendContent(buf_, len_);
+    len_ = 0;
+  }
+
+  Server& server_;
+  char buf_[N];
+  size_t len_;
+};
+
+#endif
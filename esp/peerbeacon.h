@@ -0,0 +1,171 @@
+#ifndef PEERBEACON_H
+#define PEERBEACON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "peerproto.h"
+
+// Peer discovery on the local network, instead of board addresses typed into sketches.
+//
+// Every board broadcasts a small beacon on PEER_BEACON_PORT: its role, HTTP port and
+// name. Boards that need a peer watch for its role and get the sender's address through
+// the onPeer() callback, again whenever it changes (new DHCP lease, board swapped).
+// Beacons go out every PEER_BEACON_INTERVAL_MS, in a quick burst when the board comes
+// online, and once more when a board not seen before shows up, so a rebooted board
+// finds its peers within a few hundred ms instead of waiting for the next round.
+//
+// Wire format:
+//
+//   0  magic   0xA6
+//   1  version PEER_PROTO_VERSION
+//   2  role    PeerRole
+//   3  http    uint16 HTTP port
+//   5  length  name bytes, at most PEER_BEACON_NAME
+//   6  name
+//   .  check   CRC-8 over everything before it
+//
+// peerBeaconEncode() and peerBeaconDecode() (peerproto.h) read and write it. UdpT is
+// the board's WiFiUDP; the beacon uses its own socket.
+
+const unsigned long PEER_BEACON_INTERVAL_MS = 5000;
+const unsigned long PEER_BEACON_BURST_MS = 250;     // spacing of the burst after coming online
+const uint8_t PEER_BEACON_BURST = 3;
+const unsigned long PEER_BEACON_REPLY_MS = 200;     // earliest answer to a newcomer
+const unsigned long PEER_BEACON_EXPIRE_MS = 4 * PEER_BEACON_INTERVAL_MS;
+
+struct PeerInfo {
+  uint8_t role;
+  char host[16];
+  uint16_t httpPort;
+  char name[PEER_BEACON_NAME + 1];
+  unsigned long lastSeen;
+};
+
+typedef void (*PeerFoundHandler)(const PeerInfo& peer, void* context);
+
+template <class UdpT, size_t SLOTS = 4>
+class PeerBeacon {
+public:
+  PeerBeacon(uint8_t role, const char* name, uint16_t httpPort = 80)
+    : role_(role), httpPort_(httpPort), port_(PEER_BEACON_PORT), online_(false), burst_(0), nextSend_(0), handler_(NULL), context_(NULL) {
+    strncpy(name_, name, PEER_BEACON_NAME);
+    name_[PEER_BEACON_NAME] = '\0';
+    memset(peers_, 0, sizeof(peers_));
+  }
+
+  void begin(uint16_t port = PEER_BEACON_PORT) {
+    port_ = port;
+    udp_.begin(port);
+  }
+
+  void onPeer(PeerFoundHandler handler, void* context = NULL) {
+    handler_ = handler;
+    context_ = context;
+  }
+
+  // online: the board has a network connection (WiFiLink::connected())
+  void tick(unsigned long now, bool online) {
+    if (online && !online_) {
+      burst_ = PEER_BEACON_BURST;
+      nextSend_ = now;
+    }
+    online_ = online;
+    receive(now);
+    if (online_ && (long)(now - nextSend_) >= 0) {
+      send();
+      if (burst_ > 0) burst_--;
+      nextSend_ = now + (burst_ > 0 ? PEER_BEACON_BURST_MS : PEER_BEACON_INTERVAL_MS);
+    }
+  }
+
+  // Freshest live peer with this role, NULL if none has been heard lately
+  const PeerInfo* find(uint8_t role, unsigned long now) const {
+    const PeerInfo* best = NULL;
+    for (size_t i = 0; i < SLOTS; i++) {
+      const PeerInfo& peer = peers_[i];
+      if (peer.role != role || now - peer.lastSeen > PEER_BEACON_EXPIRE_MS) continue;
+      if (!best || (long)(peer.lastSeen - best->lastSeen) > 0) best = &peer;
+    }
+    return best;
+  }
+
+  size_t count(unsigned long now) const {
+    size_t n = 0;
+    for (size_t i = 0; i < SLOTS; i++) {
+      if (peers_[i].role != PEER_ROLE_NONE && now - peers_[i].lastSeen <= PEER_BEACON_EXPIRE_MS) n++;
+    }
+    return n;
+  }
+
+  const PeerInfo& peer(size_t i) const { return peers_[i]; }
+  static size_t capacity() { return SLOTS; }
+
+private:
+  void send() {
+    uint8_t out[PEER_BEACON_MAX];
+    size_t len = peerBeaconEncode(role_, httpPort_, name_, out);
+    if (!udp_.beginPacket("255.255.255.255", port_)) return;
+    udp_.write(out, len);
+    udp_.endPacket();
+  }
+
+  void receive(unsigned long now) {
+    uint8_t in[PEER_BEACON_MAX];
+    int size;
+    while ((size = udp_.parsePacket()) > 0) {
+      int len = udp_.read(in, sizeof(in));
+      uint8_t role;
+      uint16_t httpPort;
+      char name[PEER_BEACON_NAME + 1];
+      if (len < 0 || !peerBeaconDecode(in, (size_t)len, &role, &httpPort, name)) continue;
+
+      char host[16];
+      snprintf(host, sizeof(host), "%u.%u.%u.%u", udp_.remoteIP()[0], udp_.remoteIP()[1],
+               udp_.remoteIP()[2], udp_.remoteIP()[3]);
+      if (role == role_ && strcmp(name, name_) == 0) continue;   // our own broadcast
+
+      PeerInfo* slot = slotFor(name, now);
+      bool changed = slot->role != role || strcmp(slot->host, host) != 0 || strcmp(slot->name, name) != 0 ||
+                     now - slot->lastSeen > PEER_BEACON_EXPIRE_MS;
+      slot->role = role;
+      strcpy(slot->host, host);
+      strcpy(slot->name, name);
+      slot->httpPort = httpPort;
+      slot->lastSeen = now;
+      if (!changed) continue;
+      Serial.printf("Peer %s (role %u) at %s:%u\n", slot->name, slot->role, slot->host, slot->httpPort);
+      if (handler_) handler_(*slot, context_);
+      // Answer a newcomer soon, so it does not wait a full interval to find us
+      if (online_ && (long)(nextSend_ - (now + PEER_BEACON_REPLY_MS)) > 0) nextSend_ = now + PEER_BEACON_REPLY_MS;
+    }
+  }
+
+  // Slot of this board, else a free or expired one, else the longest silent
+  PeerInfo* slotFor(const char* name, unsigned long now) {
+    PeerInfo* oldest = &peers_[0];
+    for (size_t i = 0; i < SLOTS; i++) {
+      if (peers_[i].role != PEER_ROLE_NONE && strcmp(peers_[i].name, name) == 0) return &peers_[i];
+    }
+    for (size_t i = 0; i < SLOTS; i++) {
+      if (peers_[i].role == PEER_ROLE_NONE || now - peers_[i].lastSeen > PEER_BEACON_EXPIRE_MS) return &peers_[i];
+      if ((long)(peers_[i].lastSeen - oldest->lastSeen) < 0) oldest = &peers_[i];
+    }
+    return oldest;
+  }
+
+  UdpT udp_;
+  uint8_t role_;
+  char name_[PEER_BEACON_NAME + 1];
+  uint16_t httpPort_;
+  uint16_t port_;
+  bool online_;
+  uint8_t burst_;
+  unsigned long nextSend_;
+  PeerFoundHandler handler_;
+  void* context_;
+  PeerInfo peers_[SLOTS];
+};
+
+#endif
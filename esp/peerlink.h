@@ -0,0 +1,261 @@
+#ifndef PEERLINK_H
+#define PEERLINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "boardmetrics.h"
+
+// Persistent HTTP link to one peer board.
+//
+// Replaces the "new HTTPClient per message" pattern. The link keeps one keep-alive TCP
+// connection to the peer, pipelines queued GET requests over it and parses replies as
+// they arrive. Callers never wait: send() queues the request and returns, the reply (or
+// a failure) is delivered later through the completion callback. tick() must be called
+// from loop(); it reconnects in the background with exponential backoff.
+//
+// Peers that answer with "Connection: close" still work, the link simply reconnects
+// and replays the requests that were pipelined behind the closed one.
+//
+// measure() records the time from writing each request to its reply into a histogram
+// (the board's BoardMetrics::peerRtt()); failed requests are not recorded.
+//
+// ClientT is the board's WiFiClient (or any Arduino Client with the same interface).
+
+#define PEER_ERROR_TIMEOUT  -1   // no reply within PEER_RESPONSE_TIMEOUT_MS
+#define PEER_ERROR_DROPPED  -2   // request given up after PEER_MAX_ATTEMPTS connections
+
+const unsigned long PEER_CONNECT_TIMEOUT_MS = 150;
+const unsigned long PEER_RESPONSE_TIMEOUT_MS = 3000;
+const unsigned long PEER_BACKOFF_MIN_MS = 100;
+const unsigned long PEER_BACKOFF_MAX_MS = 5000;
+const uint8_t PEER_MAX_ATTEMPTS = 3;
+
+// status is the HTTP status code or a PEER_ERROR_* value, body is NUL-terminated
+// (possibly truncated to the link's body buffer) and only valid during the call.
+typedef void (*PeerCallback)(int status, const char* body, void* context);
+
+template <class ClientT, size_t QUEUE = 4, size_t BODY = 192>
+class PeerLink {
+public:
+  PeerLink() : port_(80), head_(0), count_(0), backoff_(PEER_BACKOFF_MIN_MS), nextConnect_(0), keepAlive_(true), rtt_(NULL) {
+    host_[0] = '\0';
+    resetParser();
+  }
+
+  void setHost(const char* host, uint16_t port = 80) {
+    if (strcmp(host, host_) == 0 && port == port_) return;
+    snprintf(host_, sizeof(host_), "%s", host);
+    port_ = port;
+    client_.stop();
+    requeueSent();
+    backoff_ = PEER_BACKOFF_MIN_MS;
+    nextConnect_ = 0;
+  }
+
+  const char* host() const { return host_; }
+
+  void measure(LatencyHistogram* rtt) { rtt_ = rtt; }
+
+  // Queues a GET for path. Returns false if the queue is full or no host is set.
+  bool send(const char* path, PeerCallback callback = NULL, void* context = NULL) {
+    if (host_[0] == '\0' || count_ == QUEUE) return false;
+    Request& req = queue_[(head_ + count_) % QUEUE];
+    snprintf(req.path, sizeof(req.path), "%s", path);
+    req.callback = callback;
+    req.context = context;
+    req.sent = false;
+    req.attempts = 0;
+    req.sentAt = 0;
+    req.sentUs = 0;
+    count_++;
+    return true;
+  }
+
+  void tick(unsigned long now) {
+    if (host_[0] == '\0') return;
+
+    if (!client_.connected()) {
+      if (count_ == 0 || (long)(now - nextConnect_) < 0) return;
+      requeueSent();
+      if (!connect()) {
+        nextConnect_ = now + backoff_;
+        backoff_ = backoff_ * 2 > PEER_BACKOFF_MAX_MS ? PEER_BACKOFF_MAX_MS : backoff_ * 2;
+        return;
+      }
+      backoff_ = PEER_BACKOFF_MIN_MS;
+      resetParser();
+    }
+
+    writeQueued(now);
+    readReplies();
+
+    // Oldest in-flight request timed out: fail it and start over on a fresh connection
+    if (count_ > 0 && queue_[head_].sent && now - queue_[head_].sentAt > PEER_RESPONSE_TIMEOUT_MS) {
+      client_.stop();
+      complete(PEER_ERROR_TIMEOUT);
+      requeueSent();
+    }
+  }
+
+  bool connected() { return client_.connected(); }
+  size_t pending() const { return count_; }
+
+private:
+  struct Request {
+    char path[64];
+    PeerCallback callback;
+    void* context;
+    unsigned long sentAt;
+    unsigned long sentUs;
+    uint8_t attempts;
+    bool sent;
+  };
+
+  enum ParseState { PARSE_STATUS, PARSE_HEADERS, PARSE_BODY };
+
+  bool connect() {
+#if defined(ESP32)
+    bool ok = client_.connect(host_, port_, PEER_CONNECT_TIMEOUT_MS);
+#else
+    client_.setTimeout(PEER_CONNECT_TIMEOUT_MS);
+    bool ok = client_.connect(host_, port_);
+#endif
+    if (ok) client_.setNoDelay(true);
+    return ok;
+  }
+
+  // Pipelines every request that has not been written on this connection yet. Peers
+  // that close after each reply get one request per connection instead.
+  void writeQueued(unsigned long now) {
+    while (count_ > 0 && !queue_[head_].sent && queue_[head_].attempts >= PEER_MAX_ATTEMPTS) {
+      complete(PEER_ERROR_DROPPED);
+    }
+    size_t window = keepAlive_ ? count_ : (count_ > 0 ? 1 : 0);
+    for (size_t i = 0; i < window; i++) {
+      Request& req = queue_[(head_ + i) % QUEUE];
+      if (req.sent || req.attempts >= PEER_MAX_ATTEMPTS) continue;
+      char line[160];
+      int len = snprintf(line, sizeof(line),
+                         "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n",
+                         req.path, host_);
+      if (len <= 0 || (size_t)len >= sizeof(line)) len = (int)sizeof(line) - 1;
+      client_.write((const uint8_t*)line, (size_t)len);
+      req.sent = true;
+      req.sentAt = now;
+      req.sentUs = micros();
+      req.attempts++;
+    }
+  }
+
+  void readReplies() {
+    while (client_.available() > 0) {
+      int c = client_.read();
+      if (c < 0) break;
+      if (state_ == PARSE_BODY) {
+        if (bodyLen_ + 1 < BODY) body_[bodyLen_++] = (char)c;
+        if (contentLength_ >= 0 && --contentLength_ == 0) finishReply();
+        continue;
+      }
+      if (c == '\r') continue;
+      if (c != '\n') {
+        if (lineLen_ + 1 < sizeof(line_)) line_[lineLen_++] = (char)c;
+        continue;
+      }
+      line_[lineLen_] = '\0';
+      parseLine();
+      lineLen_ = 0;
+    }
+
+    // Reply without Content-Length ends when the peer closes the connection
+    if (state_ == PARSE_BODY && contentLength_ < 0 && !client_.connected()) finishReply();
+  }
+
+  void parseLine() {
+    if (state_ == PARSE_STATUS) {
+      const char* space = strchr(line_, ' ');
+      status_ = space ? atoi(space + 1) : 0;
+      state_ = PARSE_HEADERS;
+    } else if (lineLen_ == 0) {
+      state_ = PARSE_BODY;
+      if (contentLength_ == 0) finishReply();
+    } else if (startsWith(line_, "content-length:")) {
+      contentLength_ = atol(line_ + 15);
+    } else if (startsWith(line_, "connection:") && strstr(line_ + 11, "close")) {
+      closeAfter_ = true;
+    }
+  }
+
+  void finishReply() {
+    body_[bodyLen_] = '\0';
+    bool close = closeAfter_;
+    keepAlive_ = !close;
+    if (count_ > 0 && queue_[head_].sent) complete(status_);
+    resetParser();
+    if (close) {
+      client_.stop();
+      requeueSent();
+    }
+  }
+
+  void complete(int status) {
+    Request& req = queue_[head_];
+    PeerCallback callback = req.callback;
+    void* context = req.context;
+    if (rtt_ && status > 0) rtt_->record((uint32_t)(micros() - req.sentUs));
+    head_ = (head_ + 1) % QUEUE;
+    count_--;
+    if (status < 0) body_[0] = '\0';
+    if (callback) callback(status, body_, context);
+  }
+
+  // Requests written to a connection that is gone have to be written again
+  void requeueSent() {
+    for (size_t i = 0; i < count_; i++) queue_[(head_ + i) % QUEUE].sent = false;
+    resetParser();
+  }
+
+  void resetParser() {
+    state_ = PARSE_STATUS;
+    lineLen_ = 0;
+    bodyLen_ = 0;
+    body_[0] = '\0';
+    contentLength_ = -1;
+    status_ = 0;
+    closeAfter_ = false;
+  }
+
+  static bool startsWith(const char* text, const char* lowerPrefix) {
+    for (; *lowerPrefix; ++text, ++lowerPrefix) {
+      char c = *text;
+      if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+      if (c != *lowerPrefix) return false;
+    }
+    return true;
+  }
+
+  ClientT client_;
+  char host_[40];
+  uint16_t port_;
+
+  Request queue_[QUEUE];
+  size_t head_;
+  size_t count_;
+  unsigned long backoff_;
+  unsigned long nextConnect_;
+  bool keepAlive_;   // peer honoured keep-alive on its last reply
+  LatencyHistogram* rtt_;
+
+  ParseState state_;
+  char line_[96];
+  size_t lineLen_;
+  char body_[BODY];
+  size_t bodyLen_;
+  long contentLength_;
+  int status_;
+  bool closeAfter_;
+};
+
+#endif
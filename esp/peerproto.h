@@ -0,0 +1,326 @@
+#ifndef PEERPROTO_H
+#define PEERPROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Compact binary datagram protocol between the motor and sensor boards.
+//
+// Runs next to the HTTP API: the dashboard keeps using HTTP, board-to-board traffic
+// (soil readings, pump commands, mode changes) goes over UDP in packets of 10-20 bytes.
+//
+// Wire format, little-endian:
+//
+//   0  magic   0xA5
+//   1  version PEER_PROTO_VERSION
+//   2  type    PeerMessageType
+//   3  flags   PEER_FLAG_*
+//   4  seq     uint16, per sender
+//   6  ack     uint16, seq being acknowledged (PEER_FLAG_ACK)
+//   8  length  payload bytes, at most PEER_MAX_PAYLOAD
+//   9  check   CRC-8 over bytes 0-8 and the payload
+//   10 payload
+//
+// Packets sent with PEER_FLAG_RELIABLE are acknowledged by the receiver and
+// retransmitted by PeerChannel until acked or PEER_MAX_RETRIES is reached. Duplicates
+// caused by lost acks are filtered on the receiving side.
+
+#define PEER_PROTO_MAGIC     0xA5
+#define PEER_PROTO_VERSION   1
+#define PEER_HEADER_SIZE     10
+#define PEER_MAX_PAYLOAD     24
+#define PEER_UDP_PORT        4210
+
+#define PEER_FLAG_RELIABLE   0x01   // receiver must acknowledge
+#define PEER_FLAG_ACK        0x02   // this packet acknowledges `ack`
+
+const unsigned long PEER_RETRY_MS = 40;     // first retransmit, doubled per retry
+const uint8_t PEER_MAX_RETRIES = 5;
+
+enum PeerMessageType {
+  MSG_ACK = 0,          // no payload
+  MSG_SOIL_REQUEST,     // no payload, answered with MSG_SOIL_READING
+  MSG_SOIL_READING,     // int16 soil, int16 water level (-1 if not fitted)
+  MSG_PUMP_COMMAND,     // uint8 on, uint32 run time in ms (receiver stops the pump itself)
+  MSG_MODE_CHANGE       // uint8 mode (0 = manual, 1 = automatic)
+};
+
+struct PeerPacket {
+  uint8_t type;
+  uint8_t flags;
+  uint16_t seq;
+  uint16_t ack;
+  uint8_t length;
+  uint8_t payload[PEER_MAX_PAYLOAD];
+};
+
+// --- Payload helpers ---
+
+inline void peerPut16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+inline void peerPut32(uint8_t* p, uint32_t v) { peerPut16(p, (uint16_t)v); peerPut16(p + 2, (uint16_t)(v >> 16)); }
+inline uint16_t peerGet16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+inline uint32_t peerGet32(const uint8_t* p) { return peerGet16(p) | ((uint32_t)peerGet16(p + 2) << 16); }
+
+inline uint8_t peerCrc8(const uint8_t* data, size_t len, uint8_t crc = 0) {
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// Returns the encoded size, or 0 if the packet does not fit.
+inline size_t peerEncode(const PeerPacket& pkt, uint8_t* out, size_t capacity) {
+  if (pkt.length > PEER_MAX_PAYLOAD || capacity < (size_t)PEER_HEADER_SIZE + pkt.length) return 0;
+  out[0] = PEER_PROTO_MAGIC;
+  out[1] = PEER_PROTO_VERSION;
+  out[2] = pkt.type;
+  out[3] = pkt.flags;
+  peerPut16(out + 4, pkt.seq);
+  peerPut16(out + 6, pkt.ack);
+  out[8] = pkt.length;
+  memcpy(out + PEER_HEADER_SIZE, pkt.payload, pkt.length);
+  out[9] = peerCrc8(out + PEER_HEADER_SIZE, pkt.length, peerCrc8(out, 9));
+  return PEER_HEADER_SIZE + pkt.length;
+}
+
+inline bool peerDecode(const uint8_t* in, size_t len, PeerPacket& pkt) {
+  if (len < PEER_HEADER_SIZE || in[0] != PEER_PROTO_MAGIC || in[1] != PEER_PROTO_VERSION) return false;
+  if (in[8] > PEER_MAX_PAYLOAD || len != (size_t)PEER_HEADER_SIZE + in[8]) return false;
+  if (peerCrc8(in + PEER_HEADER_SIZE, in[8], peerCrc8(in, 9)) != in[9]) return false;
+  pkt.type = in[2];
+  pkt.flags = in[3];
+  pkt.seq = peerGet16(in + 4);
+  pkt.ack = peerGet16(in + 6);
+  pkt.length = in[8];
+  memcpy(pkt.payload, in + PEER_HEADER_SIZE, pkt.length);
+  return true;
+}
+
+// --- Discovery beacon (peerbeacon.h), also read by the fleet gateway ---
+
+#define PEER_BEACON_MAGIC  0xA6
+#define PEER_BEACON_PORT   4212
+#define PEER_BEACON_NAME   16
+#define PEER_BEACON_MAX    (7 + PEER_BEACON_NAME)
+
+enum PeerRole {
+  PEER_ROLE_NONE = 0,
+  PEER_ROLE_STATION,      // sensoresp: sensors, probe arm and pump
+  PEER_ROLE_ROVER,        // motor boards
+  PEER_ROLE_PROBE_PUMP,   // pump boards with /servo_start and /pump_start
+  PEER_ROLE_PUMP          // pump only
+};
+
+// Returns the beacon size; out holds PEER_BEACON_MAX bytes
+inline size_t peerBeaconEncode(uint8_t role, uint16_t httpPort, const char* name, uint8_t* out) {
+  size_t nameLen = strlen(name);
+  if (nameLen > PEER_BEACON_NAME) nameLen = PEER_BEACON_NAME;
+  out[0] = PEER_BEACON_MAGIC;
+  out[1] = PEER_PROTO_VERSION;
+  out[2] = role;
+  peerPut16(out + 3, httpPort);
+  out[5] = (uint8_t)nameLen;
+  memcpy(out + 6, name, nameLen);
+  out[6 + nameLen] = peerCrc8(out, 6 + nameLen);
+  return 7 + nameLen;
+}
+
+// name holds PEER_BEACON_NAME + 1 bytes
+inline bool peerBeaconDecode(const uint8_t* in, size_t len, uint8_t* role, uint16_t* httpPort, char* name) {
+  if (len < 7 || in[0] != PEER_BEACON_MAGIC || in[1] != PEER_PROTO_VERSION) return false;
+  size_t nameLen = in[5];
+  if (nameLen > PEER_BEACON_NAME || len != 7 + nameLen || in[6 + nameLen] != peerCrc8(in, 6 + nameLen)) return false;
+  *role = in[2];
+  *httpPort = peerGet16(in + 3);
+  memcpy(name, in + 6, nameLen);
+  name[nameLen] = '\0';
+  return true;
+}
+
+// Called for every new (non-duplicate, non-ack) packet from the peer.
+typedef void (*PeerMessageHandler)(const PeerPacket& pkt, void* context);
+// Called once a reliable packet is acknowledged (delivered = true) or given up.
+typedef void (*PeerDeliveryCallback)(uint16_t seq, bool delivered, void* context);
+
+// Reliable datagram channel to a single peer over an Arduino UDP object (WiFiUDP,
+// or LoopbackUdp from host/loopbackudp.h when running on Linux).
+template <class UdpT, size_t SLOTS = 4>
+class PeerChannel {
+public:
+  PeerChannel() : port_(PEER_UDP_PORT), peerPort_(PEER_UDP_PORT), nextSeq_(1), recentHead_(0),
+                  handler_(NULL), handlerContext_(NULL) {
+    peerHost_[0] = '\0';
+    memset(slots_, 0, sizeof(slots_));
+    memset(recent_, 0, sizeof(recent_));
+  }
+
+  // seqSeed should differ between boots (esp_random(), RANDOM_REG32 on the ESP8266), so
+  // that a rebooted board's first packets are not mistaken for duplicates by the peer.
+  bool begin(uint16_t localPort = PEER_UDP_PORT, uint16_t seqSeed = 1) {
+    port_ = localPort;
+    nextSeq_ = seqSeed ? seqSeed : 1;
+    return udp_.begin(localPort);
+  }
+
+  // Fixes the peer address. A board without a configured peer adopts the sender of
+  // the first valid packet it receives.
+  void setPeer(const char* host, uint16_t port = PEER_UDP_PORT) {
+    strncpy(peerHost_, host, sizeof(peerHost_) - 1);
+    peerHost_[sizeof(peerHost_) - 1] = '\0';
+    peerPort_ = port;
+  }
+
+  bool hasPeer() const { return peerHost_[0] != '\0'; }
+
+  void onMessage(PeerMessageHandler handler, void* context = NULL) {
+    handler_ = handler;
+    handlerContext_ = context;
+  }
+
+  // Fire-and-forget datagram. Returns the sequence number used (0 on failure).
+  uint16_t send(uint8_t type, const uint8_t* payload = NULL, uint8_t length = 0) {
+    PeerPacket pkt;
+    if (!fill(pkt, type, 0, payload, length)) return 0;
+    return transmit(pkt) ? pkt.seq : 0;
+  }
+
+  // Acknowledged datagram, retransmitted from tick() until acked.
+  // Returns the sequence number, or 0 if all retransmit slots are busy.
+  uint16_t sendReliable(unsigned long now, uint8_t type, const uint8_t* payload = NULL, uint8_t length = 0,
+                        PeerDeliveryCallback callback = NULL, void* context = NULL) {
+    Slot* slot = NULL;
+    for (size_t i = 0; i < SLOTS && !slot; i++) {
+      if (!slots_[i].busy) slot = &slots_[i];
+    }
+    if (!slot || !fill(slot->pkt, type, PEER_FLAG_RELIABLE, payload, length)) return 0;
+    slot->busy = true;
+    slot->retries = 0;
+    slot->nextSend = now + PEER_RETRY_MS;
+    slot->callback = callback;
+    slot->context = context;
+    transmit(slot->pkt);
+    return slot->pkt.seq;
+  }
+
+  // Receives pending packets and retransmits unacknowledged ones. Call from loop().
+  void tick(unsigned long now) {
+    uint8_t buf[PEER_HEADER_SIZE + PEER_MAX_PAYLOAD];
+    int size;
+    while ((size = udp_.parsePacket()) > 0) {
+      int len = udp_.read(buf, sizeof(buf));
+      PeerPacket pkt;
+      if (len != size || !peerDecode(buf, (size_t)len, pkt)) continue;
+      if (!hasPeer()) learnPeer();
+      receive(pkt);
+    }
+
+    for (size_t i = 0; i < SLOTS; i++) {
+      Slot& slot = slots_[i];
+      if (!slot.busy || (long)(now - slot.nextSend) < 0) continue;
+      if (slot.retries >= PEER_MAX_RETRIES) {
+        finish(slot, false);
+        continue;
+      }
+      slot.retries++;
+      slot.nextSend = now + (PEER_RETRY_MS << slot.retries);
+      transmit(slot.pkt);
+    }
+  }
+
+  size_t inFlight() const {
+    size_t n = 0;
+    for (size_t i = 0; i < SLOTS; i++) n += slots_[i].busy ? 1 : 0;
+    return n;
+  }
+
+private:
+  struct Slot {
+    PeerPacket pkt;
+    unsigned long nextSend;
+    PeerDeliveryCallback callback;
+    void* context;
+    uint8_t retries;
+    bool busy;
+  };
+
+  bool fill(PeerPacket& pkt, uint8_t type, uint8_t flags, const uint8_t* payload, uint8_t length) {
+    if (length > PEER_MAX_PAYLOAD) return false;
+    pkt.type = type;
+    pkt.flags = flags;
+    pkt.seq = nextSeq_++;
+    if (nextSeq_ == 0) nextSeq_ = 1;
+    pkt.ack = 0;
+    pkt.length = length;
+    if (length) memcpy(pkt.payload, payload, length);
+    return true;
+  }
+
+  bool transmit(const PeerPacket& pkt) {
+    if (!hasPeer()) return false;
+    uint8_t buf[PEER_HEADER_SIZE + PEER_MAX_PAYLOAD];
+    size_t len = peerEncode(pkt, buf, sizeof(buf));
+    if (!len || !udp_.beginPacket(peerHost_, peerPort_)) return false;
+    udp_.write(buf, len);
+    return udp_.endPacket();
+  }
+
+  void receive(const PeerPacket& pkt) {
+    if (pkt.flags & PEER_FLAG_ACK) {
+      for (size_t i = 0; i < SLOTS; i++) {
+        if (slots_[i].busy && slots_[i].pkt.seq == pkt.ack) finish(slots_[i], true);
+      }
+      return;
+    }
+
+    if (pkt.flags & PEER_FLAG_RELIABLE) {
+      PeerPacket ack;
+      fill(ack, MSG_ACK, PEER_FLAG_ACK, NULL, 0);
+      ack.ack = pkt.seq;
+      transmit(ack);
+      if (seenRecently(pkt.seq)) return;   // retransmit of something already handled
+    }
+
+    if (handler_) handler_(pkt, handlerContext_);
+  }
+
+  bool seenRecently(uint16_t seq) {
+    for (size_t i = 0; i < RECENT; i++) {
+      if (recent_[i] == seq) return true;
+    }
+    recent_[recentHead_] = seq;
+    recentHead_ = (recentHead_ + 1) % RECENT;
+    return false;
+  }
+
+  void finish(Slot& slot, bool delivered) {
+    slot.busy = false;
+    if (slot.callback) slot.callback(slot.pkt.seq, delivered, slot.context);
+  }
+
+  void learnPeer() {
+    char host[16];
+    snprintf(host, sizeof(host), "%u.%u.%u.%u", udp_.remoteIP()[0], udp_.remoteIP()[1],
+             udp_.remoteIP()[2], udp_.remoteIP()[3]);
+    setPeer(host, udp_.remotePort());
+  }
+
+  static const size_t RECENT = 8;
+
+  UdpT udp_;
+  uint16_t port_;
+  char peerHost_[40];
+  uint16_t peerPort_;
+  uint16_t nextSeq_;
+  Slot slots_[SLOTS];
+  uint16_t recent_[RECENT];
+  size_t recentHead_;
+  PeerMessageHandler handler_;
+  void* handlerContext_;
+};
+
+#endif
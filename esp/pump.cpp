@@ -1,5 +1,12 @@
 #include <WiFi.h>
 #include <WebServer.h>
+#include <LittleFS.h>
+#include <WiFiUdp.h>
+#include "wifilink.h"
+#include "peerbeacon.h"
+#include "pumpactuator.h"
+#include "soilprobe.h"
+#include "telemetryserver.h"
 
 // WiFi credentials
 const char* ssid = "SDP";
@@ -11,33 +18,56 @@ const int SOIL_PIN = 13;
 
 WebServer server(80);
 
+// Network join from the cached access point and lease, peers found by their beacons
+WiFiLink<fs::FS> wifi(LittleFS);
+PeerBeacon<WiFiUDP> beacon(PEER_ROLE_PROBE_PUMP, "pump");
+
+PumpActuator<RELAY_PIN, true> pump;   // active LOW relay
+SoilProbe<SOIL_PIN> probe;
+
+// Forward declarations
+void handleRoot();
+void handlePumpStart();
+void handlePumpStop();
+void handleServoStart();
+void handleMetrics();
+
+constexpr Route ROUTES[] = {
+  {"/", ROUTE_GET, handleRoot},
+  {"/pump_start", ROUTE_GET, handlePumpStart},
+  {"/pump_stop", ROUTE_GET, handlePumpStop},
+  {"/servo_start", ROUTE_GET, handleServoStart},
+  {"/metrics", ROUTE_GET, handleMetrics},
+};
+constexpr uint32_t ROUTE_SEED = routeSeed(ROUTES);
+TelemetryServer<WebServer, sizeof(ROUTES) / sizeof(ROUTES[0])> web(server, ROUTES, ROUTE_SEED);
+
 void setup() {
   Serial.begin(115200);
-  pinMode(RELAY_PIN, OUTPUT);
-  digitalWrite(RELAY_PIN, HIGH); // Pump OFF at startup
-  pinMode(SOIL_PIN, INPUT);
-
-  WiFi.begin(ssid, password);
-  Serial.print("Connecting to WiFi...");
-  WiFi.setSleep(false);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(250);
-    Serial.print(".");
-  }
-  Serial.println("\nConnected!");
-  Serial.print("IP: "); Serial.println(WiFi.localIP());
+  pump.begin();   // Pump OFF at startup
+  probe.begin();
 
-  server.on("/", HTTP_GET, handleRoot);
-  server.on("/pump_start", HTTP_GET, handlePumpStart);
-  server.on("/pump_stop", HTTP_GET, handlePumpStop);
-  server.on("/servo_start", HTTP_GET, handleServoStart);
+  // Joins in the background from loop(), from the cached access point when there is one
+  LittleFS.begin(true);
+  wifi.begin(ssid, password);
+  beacon.begin();
 
-  server.begin();
+  web.begin();   // ROUTES, CORS and preflight included
   Serial.println("HTTP server started");
+  enableLoopWatchdog();
 }
 
 void loop() {
-  server.handleClient();
+  web.metrics().tickLoop(micros());
+  web.handleClient();
+  wifi.tick(millis());
+  beacon.tick(millis(), wifi.connected());
+
+  // The timer interrupt has already switched the relay off
+  if (pump.due(millis())) {
+    pump.stop(millis());
+    Serial.println("Pump stopped (longest run reached)");
+  }
 }
 
 void handleRoot() {
@@ -49,28 +79,29 @@ void handleRoot() {
   server.send(200, "text/html", html);
 }
 
+void handleMetrics() {
+  web.sendMetrics();
+}
+
 void handlePumpStart() {
-  digitalWrite(RELAY_PIN, LOW); // Turn ON relay (pump ON)
+  pump.start(millis());   // runs until /pump_stop, PUMP_MAX_RUN_MS at most
   Serial.println("Pump started");
-  server.sendHeader("Access-Control-Allow-Origin", "*");
   server.send(200, "application/json", "{\"pump\":\"ON\"}");
 }
 
 void handlePumpStop() {
-  digitalWrite(RELAY_PIN, HIGH); // Turn OFF relay (pump OFF)
+  pump.stop(millis());
   Serial.println("Pump stopped");
-  server.sendHeader("Access-Control-Allow-Origin", "*");
   server.send(200, "application/json", "{\"pump\":\"OFF\"}");
 }
 
 void handleServoStart() {
 
 
-  int soilValue = analogRead(SOIL_PIN); // Read soil sensor on G13
+  int soilValue = probe.read(); // Read soil sensor on G13
 
   Serial.printf("Soil sensor reading (G13): %d\n", soilValue);
 
-  server.sendHeader("Access-Control-Allow-Origin", "*");
   server.send(200, "application/json", 
     String("{\"soil_value\":") + soilValue + "}"
   );
@@ -0,0 +1,179 @@
+#ifndef PUMPACTUATOR_H
+#define PUMPACTUATOR_H
+
+// Pump relay with a hard run-time interlock, shared by every board that switches a pump.
+//
+// The relay modules differ: the pump boards use active-LOW modules (LOW = pump on), the
+// sensor and rover boards drive the relay input active-HIGH. ACTIVE_LOW is fixed per
+// board at compile time so the polarity lives in one place instead of in every
+// digitalWrite(). begin() writes the off level before the pin becomes an output, so the
+// pump never blips on at boot.
+//
+// start(now, runMs) runs the pump for runMs, at most maxRunMs (PUMP_MAX_RUN_MS unless
+// begin() says otherwise); runMs 0 runs until stop() or maxRunMs. The off time is not left
+// to loop(): start() arms a one-shot hardware timer whose interrupt switches the relay
+// off, so a run ends on time even while loop() is stuck in a slow request, a flash write
+// or a bug. loop() still checks due(now), which turns true at the same time, and stops
+// the pump through the sketch's own stop path so the run gets booked.
+//
+// setLowWater(true) is the dry-run interlock: the relay goes off at once and start()
+// refuses until the level is back. Boards with a reservoir sensor call it with every
+// water sample.
+//
+// enableLoopWatchdog() puts loop() itself under the task watchdog, so a loop that stops
+// coming round resets the board, which leaves the relay off.
+
+const unsigned long PUMP_MAX_RUN_MS = 60000;   // no run is longer, timed or not
+const uint8_t PUMP_TIMER = 3;                  // ESP32 hardware timer, clear of the libraries' 0
+
+#if defined(ESP8266)
+const uint32_t PUMP_TIMER1_MAX = 0x7FFFFF;     // timer1 is 23 bits: 26.8 s at 312.5 kHz
+#endif
+
+// On the ESP32 the loop task feeds the watchdog each time loop() returns; the ESP8266's
+// SDK watchdogs are always on and fed the same way
+inline void enableLoopWatchdog() {
+#if !defined(ESP8266)
+  enableLoopWDT();
+#endif
+}
+
+template <int PIN, bool ACTIVE_LOW>
+class PumpActuator {
+public:
+  PumpActuator() : running_(false), lowWater_(false), startedAt_(0), runMs_(0), maxRunMs_(PUMP_MAX_RUN_MS) {}
+
+  void begin(unsigned long maxRunMs = PUMP_MAX_RUN_MS) {
+    write(false);
+    pinMode(PIN, OUTPUT);
+    write(false);
+    running_ = false;
+    maxRunMs_ = maxRunMs;
+    beginTimer();
+  }
+
+  // Restarts the run time when the pump is already on; false while the water is low
+  bool start(unsigned long now, unsigned long runMs = 0) {
+    if (lowWater_) return false;
+    if (runMs == 0 || runMs > maxRunMs_) runMs = maxRunMs_;
+    tripped_ = false;
+    arm(runMs);
+    write(true);
+    running_ = true;
+    startedAt_ = now;
+    runMs_ = runMs;
+    return true;
+  }
+
+  // Returns how long the pump ran, 0 when it was off
+  unsigned long stop(unsigned long now) {
+    disarm();
+    write(false);
+    if (!running_) return 0;
+    running_ = false;
+    return now - startedAt_;
+  }
+
+  void setLowWater(bool low) {
+    if (low && !lowWater_ && running_) {
+      write(false);
+      tripped_ = true;
+    }
+    lowWater_ = low;
+  }
+
+  // True when the run is over: its time is up, or the interlock has switched the relay off
+  bool due(unsigned long now) const { return running_ && (tripped_ || now - startedAt_ >= runMs_); }
+
+  bool running() const { return running_; }
+  bool tripped() const { return tripped_; }
+  bool lowWater() const { return lowWater_; }
+  unsigned long startedAt() const { return startedAt_; }
+  unsigned long runMs() const { return runMs_; }
+
+private:
+  static void write(bool on) { digitalWrite(PIN, on != ACTIVE_LOW ? HIGH : LOW); }
+
+#if defined(ESP8266)
+  // timer1 at 80 MHz / 256; runs longer than its 23 bits are counted down in pieces. The
+  // core's analogWrite() and Servo use timer1 too; the ESP8266 pump board uses neither
+  static void beginTimer() { timer1_attachInterrupt(onTimer); }
+
+  static void arm(unsigned long ms) {
+    timer1_disable();
+    remaining_ = (uint64_t)ms * 625 / 2;
+    timer1_enable(TIM_DIV256, TIM_EDGE, TIM_SINGLE);
+    next();
+  }
+
+  static void disarm() {
+    timer1_disable();
+    remaining_ = 0;
+  }
+
+  static void IRAM_ATTR next() {
+    uint32_t ticks = remaining_ > PUMP_TIMER1_MAX ? PUMP_TIMER1_MAX : (uint32_t)remaining_;
+    remaining_ -= ticks;
+    timer1_write(ticks);
+  }
+
+  static void IRAM_ATTR onTimer() {
+    if (remaining_) {
+      next();
+      return;
+    }
+    digitalWrite(PIN, ACTIVE_LOW ? HIGH : LOW);
+    tripped_ = true;
+    timer1_disable();
+  }
+
+  static volatile uint64_t remaining_;
+#else
+  // 80 MHz / 80: the alarm is in microseconds
+  static void beginTimer() {
+    if (timer_) return;
+    timer_ = timerBegin(PUMP_TIMER, 80, true);
+    timerAttachInterrupt(timer_, onTimer, true);
+  }
+
+  static void arm(unsigned long ms) {
+    if (!timer_) return;
+    timerAlarmDisable(timer_);
+    timerWrite(timer_, 0);
+    timerAlarmWrite(timer_, (uint64_t)ms * 1000, false);
+    timerAlarmEnable(timer_);
+  }
+
+  static void disarm() {
+    if (timer_) timerAlarmDisable(timer_);
+  }
+
+  static void IRAM_ATTR onTimer() {
+    digitalWrite(PIN, ACTIVE_LOW ? HIGH : LOW);
+    tripped_ = true;
+  }
+
+  static hw_timer_t* timer_;
+#endif
+
+  static volatile bool tripped_;   // set by the interrupt
+
+  bool running_;
+  bool lowWater_;
+  unsigned long startedAt_;
+  unsigned long runMs_;
+  unsigned long maxRunMs_;
+};
+
+template <int PIN, bool ACTIVE_LOW>
+volatile bool PumpActuator<PIN, ACTIVE_LOW>::tripped_ = false;
+
+#if defined(ESP8266)
+template <int PIN, bool ACTIVE_LOW>
+volatile uint64_t PumpActuator<PIN, ACTIVE_LOW>::remaining_ = 0;
+#else
+template <int PIN, bool ACTIVE_LOW>
+hw_timer_t* PumpActuator<PIN, ACTIVE_LOW>::timer_ = NULL;
+#endif
+
+#endif
@@ -1,6 +1,14 @@
 #include <WiFi.h>
 #include <WebServer.h>
 #include <ESP32Servo.h> 
+#include <WiFiUdp.h>
+#include <LittleFS.h>
+#include "peerproto.h"
+#include "wifilink.h"
+#include "peerbeacon.h"
+#include "pumpactuator.h"
+#include "soilprobe.h"
+#include "telemetryserver.h"
 
 const char* ssid = "SDP";
 const char* password = "123456789";
@@ -9,39 +17,112 @@ const int RELAY_PIN = 15; // Pump relay
 const int SERVO_PIN = 12; // Servo signal
 const int SOIL_PIN = 13;  // Soil sensor
 
+const int SERVO_UP_ANGLE = 0;
+const int SERVO_DOWN_ANGLE = 30;
+const unsigned long SERVO_SETTLE_MS = 500;
+
 WebServer server(80);
-Servo soilServo;
+
+// Network join from the cached access point and lease, peers found by their beacons
+WiFiLink<fs::FS> wifi(LittleFS);
+PeerBeacon<WiFiUDP> beacon(PEER_ROLE_PROBE_PUMP, "pumpandservo");
+
+PumpActuator<RELAY_PIN, true> pump;   // active LOW relay
+SoilProbe<SOIL_PIN, SERVO_PIN, Servo> probe(SERVO_UP_ANGLE, SERVO_DOWN_ANGLE);
+
+// Binary datagram channel to the motor board (peer learned from its first packet)
+PeerChannel<WiFiUDP> motorChannel;
+bool soilReplyPending = false;
+unsigned long soilReplyAt = 0;
+
+// Forward declarations
+void onMotorMessage(const PeerPacket& pkt, void* context);
+void handleRoot();
+void handlePumpStart();
+void handlePumpStop();
+void handleServoStart();
+void handleServoStop();
+void handleMetrics();
+
+constexpr Route ROUTES[] = {
+  {"/", ROUTE_GET, handleRoot},
+  {"/pump_start", ROUTE_GET, handlePumpStart},
+  {"/pump_stop", ROUTE_GET, handlePumpStop},
+  {"/servo_start", ROUTE_GET, handleServoStart},
+  {"/servo_stop", ROUTE_GET, handleServoStop},
+  {"/metrics", ROUTE_GET, handleMetrics},
+};
+constexpr uint32_t ROUTE_SEED = routeSeed(ROUTES);
+TelemetryServer<WebServer, sizeof(ROUTES) / sizeof(ROUTES[0])> web(server, ROUTES, ROUTE_SEED);
 
 void setup() {
   Serial.begin(115200);
-  pinMode(RELAY_PIN, OUTPUT);
-  digitalWrite(RELAY_PIN, HIGH); // Pump OFF at startup
-
-  soilServo.attach(SERVO_PIN);
-  pinMode(SOIL_PIN, INPUT);
-
-  WiFi.begin(ssid, password);
-  Serial.print("Connecting to WiFi...");
-  WiFi.setSleep(false);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(250);
-    Serial.print(".");
-  }
-  Serial.println("\nConnected!");
-  Serial.print("IP: "); Serial.println(WiFi.localIP());
+  pump.begin();   // Pump OFF at startup
+  probe.begin(false);
 
-  server.on("/", HTTP_GET, handleRoot);
-  server.on("/pump_start", HTTP_GET, handlePumpStart);
-  server.on("/pump_stop", HTTP_GET, handlePumpStop);
-  server.on("/servo_start", HTTP_GET, handleServoStart);
-  server.on("/servo_stop", HTTP_GET, handleServoStop);
+  // Joins in the background from loop(), from the cached access point when there is one
+  LittleFS.begin(true);
+  wifi.begin(ssid, password);
+  beacon.begin();
 
-  server.begin();
+  web.begin();   // ROUTES, CORS and preflight included
   Serial.println("HTTP server started");
+  enableLoopWatchdog();
+
+  motorChannel.begin(PEER_UDP_PORT, (uint16_t)esp_random());
+  motorChannel.onMessage(onMotorMessage);
 }
 
 void loop() {
-  server.handleClient();
+  web.metrics().tickLoop(micros());
+  web.handleClient();
+  wifi.tick(millis());
+  beacon.tick(millis(), wifi.connected());
+  motorChannel.tick(millis());
+
+  // Servo had time to move: answer the pending soil request
+  if (soilReplyPending && (long)(millis() - soilReplyAt) >= 0) {
+    soilReplyPending = false;
+    int soilValue = probe.read();
+    uint8_t payload[4];
+    peerPut16(payload, (uint16_t)soilValue);
+    peerPut16(payload + 2, (uint16_t)-1); // no water level sensor on this board
+    motorChannel.sendReliable(millis(), MSG_SOIL_READING, payload, sizeof(payload));
+    Serial.printf("Soil reading sent to motor board: %d\n", soilValue);
+  }
+
+  // Run over: timed by the motor board, or PUMP_MAX_RUN_MS (the timer interrupt has
+  // already switched the relay off)
+  if (pump.due(millis())) {
+    pump.stop(millis());
+    Serial.println("Pump stopped (run time elapsed)");
+  }
+}
+
+void onMotorMessage(const PeerPacket& pkt, void* /*context*/) {
+  switch (pkt.type) {
+    case MSG_SOIL_REQUEST:
+      probe.lower(); // reading is taken from loop() once the servo has moved
+      soilReplyPending = true;
+      soilReplyAt = millis() + SERVO_SETTLE_MS;
+      break;
+
+    case MSG_PUMP_COMMAND:
+      if (pkt.length < 5) break;
+      if (pkt.payload[0]) {
+        uint32_t runTime = peerGet32(pkt.payload + 1);
+        pump.start(millis(), runTime);
+        Serial.printf("Pump started by motor board for %lu ms\n", (unsigned long)runTime);
+      } else {
+        pump.stop(millis());
+        Serial.println("Pump stopped by motor board");
+      }
+      break;
+
+    case MSG_MODE_CHANGE:
+      if (pkt.length >= 1) Serial.printf("Motor board mode: %s\n", pkt.payload[0] ? "automatic" : "manual");
+      break;
+  }
 }
 
 void handleRoot() {
@@ -54,38 +135,37 @@ void handleRoot() {
   server.send(200, "text/html", html);
 }
 
+void handleMetrics() {
+  web.sendMetrics();
+}
+
 void handlePumpStart() {
-  digitalWrite(RELAY_PIN, LOW); // Turn ON relay (pump ON)
+  pump.start(millis());   // runs until /pump_stop, PUMP_MAX_RUN_MS at most
   Serial.println("Pump started");
-  server.sendHeader("Access-Control-Allow-Origin", "*");
   server.send(200, "application/json", "{\"pump\":\"ON\"}");
 }
 
 void handlePumpStop() {
-  digitalWrite(RELAY_PIN, HIGH); // Turn OFF relay (pump OFF)
+  pump.stop(millis());
   Serial.println("Pump stopped");
-  server.sendHeader("Access-Control-Allow-Origin", "*");
   server.send(200, "application/json", "{\"pump\":\"OFF\"}");
 }
 
 void handleServoStart() {
-  soilServo.write(30); // Move servo to 30°
-  delay(500); // Wait for servo to move
+  if (probe.lower()) delay(SERVO_SETTLE_MS); // Wait for servo to move
 
-  int soilValue = analogRead(SOIL_PIN); // Read soil sensor
+  int soilValue = probe.read();
 
   Serial.printf("Servo moved to 30°, Soil sensor reading: %d\n", soilValue);
 
-  server.sendHeader("Access-Control-Allow-Origin", "*");
   server.send(200, "application/json", 
     String("{\"servo_angle\":30,\"soil_value\":") + soilValue + "}"
   );
 }
 
 void handleServoStop() {
-  soilServo.write(0); // Move servo to 0° (stop position)
-  delay(500);
+  probe.park(); // Move servo to 0° (stop position)
+  delay(SERVO_SETTLE_MS);
   Serial.println("Servo stopped (moved to 0°)");
-  server.sendHeader("Access-Control-Allow-Origin", "*");
   server.send(200, "application/json", "{\"servo\":\"stopped\",\"angle\":0}");
 }
\ No newline at end of file
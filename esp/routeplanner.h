@@ -0,0 +1,306 @@
+#ifndef ROUTEPLANNER_H
+#define ROUTEPLANNER_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jsonwriter.h"
+#include "motionqueue.h"
+
+// Visiting order for the plots the rover samples in one round.
+//
+// plan() builds a tour from the rover's position with nearest neighbour, then shortens it
+// with 2-opt: whenever reversing a stretch of the tour makes the two legs at its ends
+// shorter (typically two legs that cross), the stretch is reversed, until a full pass
+// finds nothing or the pass limit is reached. The tour is open: a round ends at its last
+// plot and the next one is planned from there.
+//
+// Distances are whole millimetres from an integer square root, so the ESP8266 needs no
+// soft-float in the inner loop. Leg lengths along the tour are cached, and a 2-opt move
+// is only measured exactly when the cheap max(|dx|, |dy|) lower bound says it could help.
+//
+// The sketch walks the tour with current()/advance(). When a plot cannot be sampled,
+// skip() drops it from the round and runs 2-opt again on the plots still ahead only,
+// starting from where the rover stands, instead of planning the whole round again.
+//
+// Coordinates are millimetres in the Odometry frame: x ahead of the dock, y to the left,
+// headings in degrees counterclockwise from x.
+
+struct PlotPoint {
+  int32_t xMm;
+  int32_t yMm;
+};
+
+// Open-loop drive calibration, measured on the rover: how far it gets per second at
+// driveSpeed, and how fast it spins on the spot at turnSpeed.
+struct RouteDrive {
+  uint8_t driveSpeed;
+  uint8_t turnSpeed;
+  uint16_t mmPerSec;
+  uint16_t degPerSec;
+  uint16_t rampMs;
+};
+
+const unsigned int ROUTE_MAX_PASSES = 8;
+const int ROUTE_MIN_TURN_DEG = 3;          // smaller heading errors are not worth a turn
+const unsigned long ROUTE_ARRIVED_MM = 50; // closer than this counts as being there
+
+inline uint32_t routeIsqrt(uint64_t value) {
+  uint64_t root = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+  while (bit > value) bit >>= 2;
+  while (bit) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)root;
+}
+
+inline unsigned long routeDistanceMm(const PlotPoint& a, const PlotPoint& b) {
+  int64_t dx = (int64_t)a.xMm - b.xMm;
+  int64_t dy = (int64_t)a.yMm - b.yMm;
+  return routeIsqrt((uint64_t)(dx * dx + dy * dy));
+}
+
+template <size_t MAX_PLOTS = 16>
+class RoutePlanner {
+public:
+  RoutePlanner() : count_(0), tourSize_(0), position_(0) {
+    anchor_.xMm = 0;
+    anchor_.yMm = 0;
+  }
+
+  // Returns the plot id, or -1 when the table is full.
+  int addPlot(long xMm, long yMm) {
+    if (count_ == MAX_PLOTS) return -1;
+    plots_[count_].xMm = (int32_t)xMm;
+    plots_[count_].yMm = (int32_t)yMm;
+    return (int)count_++;
+  }
+
+  // Forgets the plots and the current round.
+  void clearPlots() {
+    count_ = 0;
+    tourSize_ = 0;
+    position_ = 0;
+  }
+
+  // Abandons the current round; the plots stay.
+  void cancelRound() {
+    tourSize_ = 0;
+    position_ = 0;
+  }
+
+  size_t plotCount() const { return count_; }
+  size_t capacity() const { return MAX_PLOTS; }
+  const PlotPoint& plot(int id) const { return plots_[id]; }
+
+  // Plans a round over all plots starting at (xMm, yMm). Returns the number of 2-opt moves.
+  size_t plan(long xMm, long yMm, unsigned int maxPasses = ROUTE_MAX_PASSES) {
+    anchor_.xMm = (int32_t)xMm;
+    anchor_.yMm = (int32_t)yMm;
+    position_ = 0;
+    nearestNeighbour();
+    return improve(maxPasses);
+  }
+
+  // Plot to drive to next, -1 when the round is over
+  int current() const { return position_ < tourSize_ ? (int)tour_[position_] : -1; }
+  bool done() const { return position_ >= tourSize_; }
+
+  // current() was reached and sampled
+  void advance() {
+    if (done()) return;
+    anchor_ = plots_[tour_[position_]];
+    position_++;
+  }
+
+  // Drops current() from this round and re-plans the plots still ahead from where the
+  // rover stands. Returns the number of 2-opt moves.
+  size_t skip(const PlotPoint& from, unsigned int maxPasses = ROUTE_MAX_PASSES) {
+    if (done()) return 0;
+    memmove(tour_ + position_, tour_ + position_ + 1, (tourSize_ - position_ - 1) * sizeof(tour_[0]));
+    tourSize_--;
+    anchor_ = from;
+    refreshLegs(position_, tourSize_);
+    return improve(maxPasses);
+  }
+
+  size_t tourSize() const { return tourSize_; }
+  size_t position() const { return position_; }
+  int tourAt(size_t i) const { return (int)tour_[i]; }
+
+  unsigned long tourLengthMm() const { return sumLegs(0); }
+  unsigned long remainingMm() const { return sumLegs(position_); }
+
+private:
+  // Where the leg to tour position p starts
+  const PlotPoint& from(size_t p) const { return p == position_ ? anchor_ : plots_[tour_[p - 1]]; }
+
+  static unsigned long lowerBoundMm(const PlotPoint& a, const PlotPoint& b) {
+    int64_t dx = (int64_t)a.xMm - b.xMm;
+    int64_t dy = (int64_t)a.yMm - b.yMm;
+    if (dx < 0) dx = -dx;
+    if (dy < 0) dy = -dy;
+    return (unsigned long)(dx > dy ? dx : dy);
+  }
+
+  void nearestNeighbour() {
+    bool used[MAX_PLOTS];
+    for (size_t i = 0; i < count_; i++) used[i] = false;
+    PlotPoint here = anchor_;
+    for (size_t n = 0; n < count_; n++) {
+      size_t best = 0;
+      uint64_t bestSq = UINT64_MAX;
+      for (size_t i = 0; i < count_; i++) {
+        if (used[i]) continue;
+        int64_t dx = (int64_t)plots_[i].xMm - here.xMm;
+        int64_t dy = (int64_t)plots_[i].yMm - here.yMm;
+        uint64_t sq = (uint64_t)(dx * dx + dy * dy);
+        if (sq < bestSq) {
+          bestSq = sq;
+          best = i;
+        }
+      }
+      used[best] = true;
+      tour_[n] = (uint16_t)best;
+      here = plots_[best];
+    }
+    tourSize_ = count_;
+    refreshLegs(0, tourSize_);
+  }
+
+  // leg_[p] is the distance driven to reach tour position p
+  void refreshLegs(size_t first, size_t last) {
+    for (size_t p = first; p < last; p++) leg_[p] = routeDistanceMm(from(p), plots_[tour_[p]]);
+  }
+
+  // 2-opt over the unvisited part of the tour. Reversing positions i..j replaces the legs
+  // before->i and j->after by before->j and i->after, where before is the plot (or the
+  // anchor) ahead of i. Past the last plot there is no leg, the tour is open.
+  size_t improve(unsigned int maxPasses) {
+    size_t moves = 0;
+    if (tourSize_ < position_ + 2) return 0;
+    for (unsigned int pass = 0; pass < maxPasses; pass++) {
+      bool improved = false;
+      for (size_t i = position_; i + 1 < tourSize_; i++) {
+        for (size_t j = i + 1; j < tourSize_; j++) {
+          const PlotPoint& before = from(i);
+          const PlotPoint& first = plots_[tour_[i]];
+          const PlotPoint& last = plots_[tour_[j]];
+          bool open = j + 1 == tourSize_;
+          long removed = (long)leg_[i] + (open ? 0 : (long)leg_[j + 1]);
+          const PlotPoint* after = open ? NULL : &plots_[tour_[j + 1]];
+          long bound = (long)lowerBoundMm(before, last) + (after ? (long)lowerBoundMm(first, *after) : 0);
+          if (bound >= removed) continue;
+          long added = (long)routeDistanceMm(before, last) + (after ? (long)routeDistanceMm(first, *after) : 0);
+          if (added >= removed) continue;
+          reverse(i, j);
+          refreshLegs(i, open ? j + 1 : j + 2);
+          moves++;
+          improved = true;
+        }
+      }
+      if (!improved) break;
+    }
+    return moves;
+  }
+
+  void reverse(size_t i, size_t j) {
+    while (i < j) {
+      uint16_t tmp = tour_[i];
+      tour_[i++] = tour_[j];
+      tour_[j--] = tmp;
+    }
+  }
+
+  unsigned long sumLegs(size_t first) const {
+    unsigned long total = 0;
+    for (size_t p = first; p < tourSize_; p++) total += leg_[p];
+    return total;
+  }
+
+  PlotPoint plots_[MAX_PLOTS];
+  uint16_t tour_[MAX_PLOTS];
+  uint32_t leg_[MAX_PLOTS];
+  PlotPoint anchor_;   // where the rover stands before tour_[position_]
+  size_t count_;
+  size_t tourSize_;
+  size_t position_;
+};
+
+// Turn on the spot towards `to`, then drive straight to it, from `from` facing headingDeg.
+// Writes up to two segments into out and returns how many; *headingOut is the heading
+// after the turn. The motion queue brakes over rampMs after each segment, which gives
+// back what the ramp up lost, so a segment covers speed * durationMs.
+inline size_t routeLegSegments(const PlotPoint& from, int headingDeg, const PlotPoint& to, const RouteDrive& drive,
+                               MotionSegment* out, int* headingOut) {
+  *headingOut = headingDeg;
+  unsigned long distance = routeDistanceMm(from, to);
+  if (distance < ROUTE_ARRIVED_MM) return 0;
+
+  size_t n = 0;
+  double radians = atan2((double)to.yMm - from.yMm, (double)to.xMm - from.xMm);
+  int bearing = ((int)lround(radians * 57.29577951) + 360) % 360;
+  int turn = ((bearing - headingDeg) % 360 + 540) % 360 - 180;   // -180..179, positive = left
+  if (abs(turn) >= ROUTE_MIN_TURN_DEG) {
+    MotionSegment spin = {(uint8_t)(turn > 0 ? MOTION_LEFT : MOTION_RIGHT), drive.turnSpeed, drive.rampMs,
+                          (uint32_t)((unsigned long)abs(turn) * 1000UL / drive.degPerSec)};
+    out[n++] = spin;
+    *headingOut = bearing;
+  }
+  MotionSegment run = {MOTION_FORWARD, drive.driveSpeed, drive.rampMs, (uint32_t)(distance * 1000UL / drive.mmPerSec)};
+  out[n++] = run;
+  return n;
+}
+
+// Parses "1500:0,3000:1200,600:-1800" (x:y in mm per plot). Returns the number of
+// plots, or -1 with *errorAt set to the index of the first bad one.
+inline int parsePlotPoints(const char* text, PlotPoint* out, size_t maxOut, size_t* errorAt) {
+  size_t n = 0;
+  const char* p = text;
+  while (p && *p) {
+    *errorAt = n;
+    if (n == maxOut) return -1;
+    char* end;
+    long x = strtol(p, &end, 10);
+    if (end == p || *end != ':') return -1;
+    p = end + 1;
+    long y = strtol(p, &end, 10);
+    if (end == p || (*end != ',' && *end != '\0')) return -1;
+    out[n].xMm = (int32_t)x;
+    out[n].yMm = (int32_t)y;
+    n++;
+    p = *end ? end + 1 : end;
+  }
+  return (int)n;
+}
+
+// Adds "tour" (plot ids in visiting order), "position" and the remaining distance to a
+// response, shared by the rovers' /route handlers.
+template <size_t N, size_t P>
+void addRouteJson(JsonWriter<N>& json, const RoutePlanner<P>& route) {
+  char list[P * 36 + 2];
+  size_t len = 0;
+  list[len++] = '[';
+  for (size_t i = 0; i < route.tourSize(); i++) {
+    const PlotPoint& p = route.plot(route.tourAt(i));
+    if (len + 36 > sizeof(list) - 1) break;
+    len += (size_t)snprintf(list + len, sizeof(list) - len, i ? ",[%d,%ld,%ld]" : "[%d,%ld,%ld]", route.tourAt(i),
+                            (long)p.xMm, (long)p.yMm);
+  }
+  list[len++] = ']';
+  json.add("plots", (unsigned long)route.plotCount()).addRaw("tour", list, len)
+      .add("position", (unsigned long)route.position()).add("current", route.current())
+      .add("tourMm", route.tourLengthMm()).add("remainingMm", route.remainingMm());
+}
+
+#endif
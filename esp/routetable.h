@@ -0,0 +1,181 @@
+#ifndef ROUTETABLE_H
+#define ROUTETABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "jsonwriter.h"
+
+// Request dispatch from one route table per sketch, declared once:
+//
+//   constexpr Route ROUTES[] = {
+//     {"/", ROUTE_GET, handleRoot},
+//     {"/trajectory", ROUTE_GET | ROUTE_POST, handleTrajectory},
+//   };
+//   constexpr uint32_t ROUTE_SEED = routeSeed(ROUTES);
+//   RouteTable<WebServer, sizeof(ROUTES) / sizeof(ROUTES[0])> routes(server, ROUTES, ROUTE_SEED);
+//
+// and routes.begin() in setup() instead of the server.on() calls (the sketches hold the
+// table through TelemetryServer, telemetryserver.h, which does this). Every route answers
+// the CORS preflight (OPTIONS) and gets the CORS header on its answers, so handlers
+// send no CORS headers themselves. Other methods get a 405, unknown paths a 404.
+//
+// Nothing is registered with server.on(): the table takes every request from the
+// server's not-found hook, so the server's handler list (a linear scan of String
+// compares per request) stays empty. Paths are found through a perfect hash instead:
+// routeSeed() searches at compile time for a seed under which every path lands in a
+// slot of its own (four slots per route, rounded up to a power of two), so a lookup is
+// one hash of the request path and one strcmp. A table listing a path twice has no such
+// seed and does not compile.
+//
+// The preflight answer is the same for every route and is written to the client as one
+// pre-serialized block. onServed() hands the time each handler took to an observer
+// (BoardMetrics, boardmetrics.h). Include this after the board's WebServer header.
+
+const uint8_t ROUTE_GET = 0x01;
+const uint8_t ROUTE_POST = 0x02;
+const uint8_t ROUTE_EMPTY = 0xFF;
+const uint32_t ROUTE_MAX_SEED = 1024;
+
+const char ROUTE_PREFLIGHT[] =
+    "HTTP/1.1 204 No Content\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
+    "Access-Control-Allow-Headers: Content-Type, Accept, X-Requested-With\r\n"
+    "Access-Control-Max-Age: 7200\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+struct Route {
+  const char* path;
+  uint8_t methods;   // ROUTE_GET and/or ROUTE_POST
+  void (*handler)();
+};
+
+// Route index and handler time in microseconds
+typedef void (*RouteServedHandler)(size_t route, uint32_t us, void* context);
+
+// FNV-1a from a seeded basis, high half folded into the low bits the slot is taken from
+constexpr uint32_t routeHashFrom(const char* path, uint32_t hash) {
+  return *path ? routeHashFrom(path + 1, (hash ^ (uint8_t)*path) * 16777619UL) : hash ^ (hash >> 16);
+}
+
+constexpr uint32_t routeHash(const char* path, uint32_t seed) {
+  return routeHashFrom(path, 2166136261UL ^ (seed * 2654435761UL));
+}
+
+// The same hash for request paths, iterative so a long URL cannot run the stack down
+inline uint32_t routePathHash(const char* path, uint32_t seed) {
+  uint32_t hash = 2166136261UL ^ (seed * 2654435761UL);
+  for (; *path; ++path) hash = (hash ^ (uint8_t)*path) * 16777619UL;
+  return hash ^ (hash >> 16);
+}
+
+constexpr size_t routeSlotCount(size_t routes, size_t slots = 1) {
+  return slots >= 4 * routes ? slots : routeSlotCount(routes, slots * 2);
+}
+
+template <size_t N>
+constexpr bool routeClashesWith(const Route (&routes)[N], uint32_t seed, size_t i, size_t j) {
+  return j < N && (((routeHash(routes[i].path, seed) ^ routeHash(routes[j].path, seed)) & (routeSlotCount(N) - 1)) == 0 ||
+                   routeClashesWith(routes, seed, i, j + 1));
+}
+
+template <size_t N>
+constexpr bool routeClashes(const Route (&routes)[N], uint32_t seed, size_t i = 0) {
+  return i < N && (routeClashesWith(routes, seed, i, i + 1) || routeClashes(routes, seed, i + 1));
+}
+
+// Not constexpr: reaching it stops the compile with its name in the error
+inline uint32_t routeTableHasDuplicatePaths() { return ROUTE_MAX_SEED; }
+
+// First collision-free seed in [from, to); halving keeps the constexpr recursion shallow
+template <size_t N>
+constexpr uint32_t routeSeedIn(const Route (&routes)[N], uint32_t from, uint32_t to);
+
+template <size_t N>
+constexpr uint32_t routeSeedOr(const Route (&routes)[N], uint32_t found, uint32_t from, uint32_t to) {
+  return found != ROUTE_MAX_SEED ? found : routeSeedIn(routes, from, to);
+}
+
+template <size_t N>
+constexpr uint32_t routeSeedIn(const Route (&routes)[N], uint32_t from, uint32_t to) {
+  return to - from == 1 ? (routeClashes(routes, from) ? ROUTE_MAX_SEED : from)
+                        : routeSeedOr(routes, routeSeedIn(routes, from, from + (to - from) / 2), from + (to - from) / 2, to);
+}
+
+template <size_t N>
+constexpr uint32_t routeSeed(const Route (&routes)[N]) {
+  return routeSeedIn(routes, 0, ROUTE_MAX_SEED) != ROUTE_MAX_SEED ? routeSeedIn(routes, 0, ROUTE_MAX_SEED)
+                                                                  : routeTableHasDuplicatePaths();
+}
+
+template <class Server, size_t N>
+class RouteTable {
+public:
+  static const size_t SLOTS = routeSlotCount(N);
+
+  RouteTable(Server& server, const Route (&routes)[N], uint32_t seed)
+    : server_(server), routes_(routes), seed_(seed), served_(NULL), servedContext_(NULL) {
+    static_assert(N < ROUTE_EMPTY, "too many routes for one table");
+    memset(slots_, ROUTE_EMPTY, sizeof(slots_));
+    for (size_t i = 0; i < N; i++) slots_[routePathHash(routes[i].path, seed) & (SLOTS - 1)] = (uint8_t)i;
+  }
+
+  // Call in setup(), before server.begin()
+  void begin() {
+    server_.enableCORS(true);
+    server_.onNotFound([this]() { dispatch(); });
+  }
+
+  void onServed(RouteServedHandler handler, void* context = NULL) {
+    served_ = handler;
+    servedContext_ = context;
+  }
+
+  const char* path(size_t i) const { return routes_[i].path; }
+
+  // Index of the route for path, -1 when there is none
+  int find(const char* path) const {
+    uint8_t i = slots_[routePathHash(path, seed_) & (SLOTS - 1)];
+    return i != ROUTE_EMPTY && strcmp(routes_[i].path, path) == 0 ? (int)i : -1;
+  }
+
+private:
+  void dispatch() {
+    String uri = server_.uri();
+    int i = find(uri.c_str());
+    if (i < 0) {
+      sendRouteError(404, "Not found");
+      return;
+    }
+    if (server_.method() == HTTP_OPTIONS) {
+      server_.client().write((const uint8_t*)ROUTE_PREFLIGHT, sizeof(ROUTE_PREFLIGHT) - 1);
+      return;
+    }
+    uint8_t method = server_.method() == HTTP_GET ? ROUTE_GET : server_.method() == HTTP_POST ? ROUTE_POST : 0;
+    if (!(routes_[i].methods & method)) {
+      sendRouteError(405, "Method not allowed");
+      return;
+    }
+    unsigned long start = micros();
+    routes_[i].handler();
+    if (served_) served_((size_t)i, (uint32_t)(micros() - start), servedContext_);
+  }
+
+  void sendRouteError(int code, const char* message) {
+    JsonWriter<96> json;
+    json.add("status", "error").add("message", message);
+    sendJson(server_, code, json);
+  }
+
+  Server& server_;
+  const Route (&routes_)[N];
+  uint32_t seed_;
+  RouteServedHandler served_;
+  void* servedContext_;
+  uint8_t slots_[SLOTS];
+};
+
+#endif
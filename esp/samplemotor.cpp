@@ -1,13 +1,40 @@
 #include <WiFi.h>
 #include <WebServer.h>
 #include <ESP32Servo.h>
+#include <LittleFS.h>
+#include <WiFiUdp.h>
+#include "jsonwriter.h"
+#include "pagestream.h"
+#include "telemetrypush.h"
+#include "adcfilter.h"
+#include "zonescheduler.h"
+#include "dosecontroller.h"
+#include "motionqueue.h"
+#include "odometry.h"
+#include "historystore.h"
+#include "wifilink.h"
+#include "peerbeacon.h"
+#include "drivetrain.h"
+#include "pumpactuator.h"
+#include "soilprobe.h"
+#include "telemetryserver.h"
+#include "sensorcycle.h"
+#include "coretasks.h"
+#include "tracering.h"
 
 // WiFi credentials
 const char* ssid = "SDP";
 const char* password = "123456789";
 
+// The web server, WiFi, peers, /events and history run in the network task on core 0,
+// motors, servo and pump in loop() on core 1 (coretasks.h)
+
 WebServer server(80);
 
+// Network join from the cached access point and lease, peers found by their beacons
+WiFiLink<fs::FS> wifi(LittleFS);
+PeerBeacon<WiFiUDP> beacon(PEER_ROLE_ROVER, "samplemotor");
+
 // Motor pins
 const int ENA = 32; // PWM pin for motor A (GPIO32)
 const int ENB = 33; // PWM pin for motor B (GPIO33)
@@ -19,6 +46,7 @@ const int IN4 = 25; // Motor B direction pin 2 (GPIO25)
 // PWM channels for ESP32 (must be unique, 0-15)
 #define ENA_CHANNEL 0
 #define ENB_CHANNEL 1
+DriveTrain<ENA, ENB, IN1, IN2, IN3, IN4, LedcEnable<ENA_CHANNEL, ENB_CHANNEL>> drive;
 
 // Sensor and servo pins
 #define SOIL_MOISTURE_PIN 34   // GPIO34 - Soil moisture sensor (analog)
@@ -26,205 +54,688 @@ const int IN4 = 25; // Motor B direction pin 2 (GPIO25)
 #define PUMP_RELAY_PIN    19   // GPIO19 - Pump relay control
 #define LED_PIN            2   // GPIO2 - Status LED
 
-Servo soilServo;
+// Wheel encoders (single-channel slotted discs), motor A drives the left wheel
+#define ENCODER_LEFT_PIN  35   // GPIO35 - Left wheel encoder (input only)
+#define ENCODER_RIGHT_PIN 39   // GPIO39 - Right wheel encoder (input only)
 
 // Servo setup
 const int SERVO_UP_ANGLE = 60;
 const int SERVO_DOWN_ANGLE = 90;
+SoilProbe<SOIL_MOISTURE_PIN, SERVO_PIN, Servo> probe(SERVO_UP_ANGLE, SERVO_DOWN_ANGLE);
 bool servoInitialized = false;
 
 // Soil and pump settings
 const int DRY_SOIL_THRESHOLD = 2800;
-const unsigned long PUMP_DURATION = 5000; // ms
+const unsigned long PUMP_DURATION = 5000; // ms, longest single run
+const unsigned long MIN_PUMP_RUN = 1000;  // ms, shorter allowances are skipped
 
 // State variables
 bool automaticMode = false;
-bool pumpRunning = false;
-bool servoDown = false;
-unsigned long pumpStartTime = 0;
-unsigned long lastSensorCheck = 0;
-const unsigned long SENSOR_CHECK_INTERVAL = 30000; // ms
+PumpActuator<PUMP_RELAY_PIN, false> pump;   // active HIGH relay
+
+// Irrigation zones: a plot is probed when the scheduler says it is due, not on a fixed interval
+const ZoneConfig ZONES[] = {
+  {"plot-1", DRY_SOIL_THRESHOLD, 2200, 30000, 600000, 120000},
+  {"plot-2", DRY_SOIL_THRESHOLD, 2200, 30000, 600000, 120000},
+  {"plot-3", 3000,               2400, 60000, 900000,  90000},
+};
+// Pump duty: 60 s on per 10 min. No reservoir sensor on this board, so no level limits.
+const PumpLimits PUMP_LIMITS = {600000, 60000, 0, 0};
+ZoneScheduler<8> zones(PUMP_LIMITS);
+int currentZone = 0;
+int pumpZone = 0;
+
+// Water in pulses towards the zone's target, re-reading the soil 3 s after each pulse.
+// The probe stays down until the dose is over; 150 units/s is the guess for a new zone.
+DoseController<8> dose(DoseTiming{MIN_PUMP_RUN, PUMP_DURATION, 3000, 40}, true, 150);
 
 // Movement state
 bool isMoving = false;
 int currentDirection = 0; // 0=stop, 1=forward, 2=backward, 3=left, 4=right
 
+// Drive segments with soft start/stop, run from loop(); /trajectory queues a whole route
+MotionQueue<16> motion;
+const uint8_t DRIVE_SPEED = 200;
+const unsigned long MOTION_TICK_INTERVAL = 10; // ms between ramp steps
+unsigned long lastMotionTick = 0;
+
+// Encoder odometry and per-wheel speed correction, updated every 100 ms
+volatile uint32_t leftTicks = 0;   // counted in the encoder interrupts
+volatile uint32_t rightTicks = 0;
+uint32_t lastLeftTicks = 0;
+uint32_t lastRightTicks = 0;
+const OdometryGeometry WHEELS = {20, 65, 150};   // 20-slot discs, 65 mm wheels, 150 mm track
+const long MAX_WHEEL_SPEED = 60;                  // ticks/s at full duty on a charged battery
+const WheelPidGains WHEEL_GAINS = {512, 4096, 0, 1000};
+Odometry odometry(WHEELS);
+WheelPid leftPid(WHEEL_GAINS);
+WheelPid rightPid(WHEEL_GAINS);
+const unsigned long WHEEL_CONTROL_INTERVAL = 100;
+unsigned long lastWheelControl = 0;
+int odometryDirection = 0;  // direction the wheels last turned in, for coasting ticks
+
 // Sensor state
 int lastSoilReading = 0;
-String lastSoilStatus = "unknown";
+const char* lastSoilStatus = "unknown";
+
+// Probe check without blocking the loop: 0.5 s servo travel, 1 s settle, raised right after
+SensorCycle sensorCycle(SensorCycleTiming{500, 1000, 0});
+const int CHECK_MANUAL = 0;   // /start_sensor
+const int CHECK_AUTO = 1;     // automatic mode, zone due
+
+// Result of the most recent sensor check
+struct CheckResult {
+  unsigned long jobId;
+  int soil;
+  const char* status;
+  bool needsIrrigation;
+  bool dosing;
+};
+CheckResult lastCheck = {0, 0, "unknown", false, false};
+
+// Soil readings and pump runs for /history, full blocks logged to LittleFS
+HistoryStore<16> history;
+HistoryLog<fs::LittleFSFS> historyLog(LittleFS);
+
+// Soil samples taken in loop(): median over 15 samples + EMA
+AdcFilter<15> soilFilter;
+const unsigned long ADC_SAMPLE_INTERVAL = 20; // ms
+unsigned long lastAdcSample = 0;
+
+// Live state for /events subscribers, pushed at most every 100 ms
+TelemetryPush<WiFiClient> telemetry(100);
+int FIELD_MODE, FIELD_MOVEMENT, FIELD_PUMP, FIELD_SERVO, FIELD_SERVO_INIT, FIELD_SOIL, FIELD_SOIL_STATUS;
+
+// Requests from the web handlers to the control loop
+enum RoverCommandType {
+  CMD_MOVE,           // args: direction, 0 stops
+  CMD_SEGMENT,        // segment; args: 1 replaces the running route
+  CMD_POSE_RESET,     // args: x, y, heading
+  CMD_INIT_SERVO,
+  CMD_SERVO_DOWN,
+  CMD_SERVO_UP,
+  CMD_START_PUMP,
+  CMD_STOP_PUMP,
+  CMD_READ_SOIL,
+  CMD_CHECK,
+  CMD_AUTOMATIC,
+  CMD_MANUAL,
+  CMD_SELECT_ZONE     // args: zone id
+};
+
+struct RoverCommand {
+  uint32_t seq;
+  uint8_t type;
+  long args[3];
+  MotionSegment segment;
+};
+
+// What the handlers and /events know of the control loop
+struct RoverState {
+  bool automaticMode;
+  int direction;
+  bool pumpRunning;
+  bool servoDown;
+  bool servoInitialized;
+  int soilReading;
+  const char* soilStatus;
+  uint8_t motorDuty;
+  size_t queuedSegments;
+  size_t motionCapacity;
+  long x, y;
+  int heading;
+  unsigned long odometerMm;
+  uint32_t leftTicks, rightTicks;
+  int leftCorrection, rightCorrection;
+  bool encoders;
+  unsigned long checkJobId;       // running sensor check
+  CheckResult lastCheck;
+  int currentZone;
+  ZoneScheduler<8> zones;
+  DoseController<8> dose;
+
+  RoverState(const ZoneScheduler<8>& zones, const DoseController<8>& dose)
+    : automaticMode(false), direction(0), pumpRunning(false), servoDown(false), servoInitialized(false),
+      soilReading(0), soilStatus("unknown"), motorDuty(0), queuedSegments(0), motionCapacity(0), x(0), y(0),
+      heading(0), odometerMm(0), leftTicks(0), rightTicks(0), leftCorrection(0), rightCorrection(0), encoders(true),
+      checkJobId(0), lastCheck(), currentZone(0), zones(zones), dose(dose) {}
+};
+
+ControlLink<RoverCommand, RoverState, 32> control(RoverState(zones, dose));
+const unsigned long STATE_PUBLISH_INTERVAL = 50;
+unsigned long lastStatePublish = 0;
+
+// Soil and pump records from the control loop, written to the history by the network task
+struct HistoryEvent {
+  uint8_t kind;
+  int32_t values[HISTORY_CHANNELS];
+};
+SpscQueue<HistoryEvent, 16> historyEvents;
+
+// Sections timed into the trace ring, dumped on /trace (tracering.h)
+enum TraceTag {
+  TRACE_LOOP = 1, TRACE_COMMANDS, TRACE_MOTION, TRACE_WHEELS, TRACE_ADC, TRACE_SENSOR_CYCLE, TRACE_AUTOMATIC,
+  TRACE_DOSE, TRACE_PUBLISH, TRACE_NETWORK, TRACE_HTTP, TRACE_HISTORY, TRACE_TELEMETRY
+};
+const char* const TRACE_NAMES[] = {
+  "", "loop", "commands", "motion", "wheels", "adc", "sensor_cycle", "automatic",
+  "dose", "publish", "network", "http", "history", "telemetry"
+};
+TraceRing<TRACE_RING> tracer(TRACE_NAMES, sizeof(TRACE_NAMES) / sizeof(TRACE_NAMES[0]));
+
+// Forward declarations
+void networkTask(void* param);
+void serviceCommands();
+void applyCommand(const RoverCommand& command);
+void publishState();
+bool runCommand(uint8_t type, long a = 0, long b = 0, long c = 0);
+void sendControlBusy(const char* cmd);
+void serviceSensorCycle();
+void sampleSoil();
+void recordHistory(uint8_t kind, int32_t a, int32_t b);
+void handleRoot();
+void moveMotors(int dir);
+void sendMove(int dir, const char* cmd, const char* msg);
+void applyMotorOutput(int dir, uint8_t duty);
+void onLeftEncoder();
+void onRightEncoder();
+void updateOdometry(long* leftDelta, long* rightDelta);
+void serviceWheels();
+uint8_t wheelDuty(uint8_t duty, int correction);
+void handlePose();
+void stopMotors();
+void handleTrajectory();
+void handleForward();
+void handleBackward();
+void handleLeft();
+void handleRight();
+void handleStop();
+void sendMovementResponse(const char* cmd, const char* msg);
+const char* getMovementString(int dir);
+void lowerServo();
+void raiseServo();
+void handleInitServo();
+void handleServoDown();
+void handleServoUp();
+void startPump(unsigned long runMs);
+void stopPump();
+bool irrigateCurrentZone(int soilValue);
+void serviceDose();
+void cancelDose();
+void handleZones();
+void handleSelectZone();
+void handleHistory();
+void recordSoil(int zone, int soilValue);
+void onHistorySealed(const uint8_t* block, void* context);
+void handleStartPump();
+void handleStopPump();
+const char* getSoilStatus(int value);
+int readSoilFiltered();
+void handleReadSoil();
+void handleStartSensor();
+void sendSensorPending(unsigned long jobId);
+void sendSensorResult(const CheckResult& check);
+void handleAutomatic();
+void handleManual();
+void handleAutomaticIrrigation();
+void handleStatus();
+void handleEvents();
+void pushTelemetry();
+void handlePing();
+void handleMetrics();
+void handleTrace();
+void sendErrorResponse(const char* cmd, const char* msg);
+void sendCommandResponse(int code, const char* cmd, const char* status, const char* msg);
+
+constexpr Route ROUTES[] = {
+  {"/", ROUTE_GET | ROUTE_POST, handleRoot},
+  {"/forward", ROUTE_GET, handleForward},
+  {"/backward", ROUTE_GET, handleBackward},
+  {"/left", ROUTE_GET, handleLeft},
+  {"/right", ROUTE_GET, handleRight},
+  {"/stop", ROUTE_GET, handleStop},
+
+  {"/start", ROUTE_GET, handleStartPump},
+  {"/stop_pump", ROUTE_GET, handleStopPump},
+
+  {"/start_sensor", ROUTE_GET, handleStartSensor},
+  {"/read_soil", ROUTE_GET, handleReadSoil},
+  {"/servo_down", ROUTE_GET, handleServoDown},
+  {"/servo_up", ROUTE_GET, handleServoUp},
+  {"/init_servo", ROUTE_GET, handleInitServo},
+
+  {"/automatic", ROUTE_GET, handleAutomatic},
+  {"/manual", ROUTE_GET, handleManual},
+
+  {"/status", ROUTE_GET, handleStatus},
+  {"/ping", ROUTE_GET, handlePing},
+  {"/events", ROUTE_GET, handleEvents},
+  {"/trajectory", ROUTE_GET | ROUTE_POST, handleTrajectory},
+  {"/pose", ROUTE_GET, handlePose},
+  {"/zones", ROUTE_GET, handleZones},
+  {"/zone", ROUTE_GET, handleSelectZone},
+  {"/history", ROUTE_GET, handleHistory},
+  {"/metrics", ROUTE_GET, handleMetrics},
+  {"/trace", ROUTE_GET, handleTrace},
+};
+constexpr uint32_t ROUTE_SEED = routeSeed(ROUTES);
+TelemetryServer<WebServer, sizeof(ROUTES) / sizeof(ROUTES[0])> web(server, ROUTES, ROUTE_SEED);
 
 // ======= SETUP =======
 void setup() {
   Serial.begin(115200);
 
-  // Motor control pins
-  pinMode(IN1, OUTPUT); digitalWrite(IN1, LOW);
-  pinMode(IN2, OUTPUT); digitalWrite(IN2, LOW);
-  pinMode(IN3, OUTPUT); digitalWrite(IN3, LOW);
-  pinMode(IN4, OUTPUT); digitalWrite(IN4, LOW);
-
-  // PWM setup
-  ledcSetup(ENA_CHANNEL, 1000, 8); // 1kHz, 8-bit
-  ledcAttachPin(ENA, ENA_CHANNEL);
-  ledcSetup(ENB_CHANNEL, 1000, 8);
-  ledcAttachPin(ENB, ENB_CHANNEL);
+  // Motor bridge (1kHz, 8-bit PWM on the enables), all pins low
+  drive.begin();
 
-  // Output pins
-  pinMode(PUMP_RELAY_PIN, OUTPUT); digitalWrite(PUMP_RELAY_PIN, LOW);
+  // Output pins; no pump run outlasts PUMP_DURATION
+  pump.begin(PUMP_DURATION);
   pinMode(LED_PIN, OUTPUT); digitalWrite(LED_PIN, LOW);
 
+  // Wheel encoders
+  pinMode(ENCODER_LEFT_PIN, INPUT);
+  pinMode(ENCODER_RIGHT_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(ENCODER_LEFT_PIN), onLeftEncoder, RISING);
+  attachInterrupt(digitalPinToInterrupt(ENCODER_RIGHT_PIN), onRightEncoder, RISING);
+
   // Servo setup, DO NOT move at boot
-  soilServo.attach(SERVO_PIN);
-  servoDown = false; servoInitialized = false;
-
-  stopMotors();
-
-  // WiFi connect
-  WiFi.begin(ssid, password);
-  Serial.print("Connecting WiFi..");
-  
-  for (int i = 0; i < 40 && WiFi.status() != WL_CONNECTED; ++i) {
-    delay(250);
-    Serial.print(".");
-    digitalWrite(LED_PIN, i%2==0);
-  }
-  digitalWrite(LED_PIN, WiFi.status()==WL_CONNECTED ? HIGH : LOW);
-  Serial.println(WiFi.status()==WL_CONNECTED ? "\nConnected!" : "\nWiFi FAIL");
-
-  // Web Server endpoints
-  server.on("/", handleRoot);
-  server.on("/forward", HTTP_GET, handleForward);
-  server.on("/backward", HTTP_GET, handleBackward);
-  server.on("/left", HTTP_GET, handleLeft);
-  server.on("/right", HTTP_GET, handleRight);
-  server.on("/stop", HTTP_GET, handleStop);
-
-  server.on("/start", HTTP_GET, handleStartPump);
-  server.on("/stop_pump", HTTP_GET, handleStopPump);
-
-  server.on("/start_sensor", HTTP_GET, handleStartSensor);
-  server.on("/read_soil", HTTP_GET, handleReadSoil);
-  server.on("/servo_down", HTTP_GET, handleServoDown);
-  server.on("/servo_up", HTTP_GET, handleServoUp);
-  server.on("/init_servo", HTTP_GET, handleInitServo);
-
-  server.on("/automatic", HTTP_GET, handleAutomatic);
-  server.on("/manual", HTTP_GET, handleManual);
-
-  server.on("/status", HTTP_GET, handleStatus);
-  server.on("/ping", HTTP_GET, handlePing);
-
-  // OPTIONS for CORS
-  String corsEndpoints[] = {"/forward", "/backward", "/left", "/right", "/stop",
-      "/start", "/stop_pump", "/start_sensor", "/read_soil",
-      "/servo_down", "/servo_up", "/init_servo",
-      "/automatic", "/manual", "/status", "/ping"};
-  for(auto &ep : corsEndpoints) server.on(ep.c_str(), HTTP_OPTIONS, handleOptions);
-
-  server.enableCORS(true);
-  server.begin();
+  probe.begin(false);
+  servoInitialized = false;
+
+  for (size_t i = 0; i < sizeof(ZONES) / sizeof(ZONES[0]); i++) zones.addZone(ZONES[i]);
+
+  // Earlier boots stay queryable from the flash log; without it only RAM is kept
+  uint16_t boot = 1;
+  if (LittleFS.begin(true)) boot = historyLog.begin();
+  else Serial.println("⚠️ LittleFS mount failed - history kept in RAM only");
+  history.begin(boot, millis());
+  history.onSeal(onHistorySealed);
+
+  // WiFi joins in the background from loop() (cache on LittleFS); the LED is the heartbeat's
+  wifi.begin(ssid, password);
+  beacon.begin();
+
+  // Web Server endpoints (ROUTES), CORS and preflight included
+  web.begin();
+
+  // Same keys as /status, so clients can merge events into their status object
+  FIELD_MODE = telemetry.addField("mode");
+  FIELD_MOVEMENT = telemetry.addField("movement");
+  FIELD_PUMP = telemetry.addField("pumpStatus");
+  FIELD_SERVO = telemetry.addField("servoPosition");
+  FIELD_SERVO_INIT = telemetry.addField("servoInitialized");
+  FIELD_SOIL = telemetry.addField("soilMoisture");
+  FIELD_SOIL_STATUS = telemetry.addField("soilStatus");
+  publishState();
+  pushTelemetry();
 
   Serial.println("HTTP server started");
+  enableLoopWatchdog();
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, NULL, NETWORK_TASK_PRIORITY, NULL, NETWORK_CORE);
 }
 
 // ======= LOOP =======
+// Control only: commands and the pump timer first, then motion, wheels, probe and dose.
+// Nothing in here waits, so the pump stops and the ramps step on time whatever the
+// network task is doing.
 void loop() {
-  server.handleClient();
+  web.metrics().tickLoop(micros());
+  TRACE_SCOPE(TRACE_LOOP);
+  serviceCommands();
+  if (pump.due(millis())) stopPump();
+  if (millis() - lastMotionTick >= MOTION_TICK_INTERVAL) {
+    TRACE_SCOPE(TRACE_MOTION);
+    lastMotionTick = millis();
+    if (motion.tick(lastMotionTick)) applyMotorOutput(motion.direction(), motion.duty());
+  }
+  serviceWheels();
+  if (millis() - lastAdcSample >= ADC_SAMPLE_INTERVAL) {
+    TRACE_SCOPE(TRACE_ADC);
+    lastAdcSample = millis();
+    soilFilter.push(probe.read());
+  }
+  serviceSensorCycle();
   if (automaticMode) handleAutomaticIrrigation();
-  if (pumpRunning && (millis() - pumpStartTime >= PUMP_DURATION)) stopPump();
+  serviceDose();
+  if (millis() - lastStatePublish >= STATE_PUBLISH_INTERVAL) publishState();
 
   // LED heartbeat
   static unsigned long lastBlink = 0;
-  if (pumpRunning || isMoving || servoDown)
+  if (pump.running() || isMoving || probe.isDown()) {
     if (millis()-lastBlink > 250) { digitalWrite(LED_PIN, !digitalRead(LED_PIN)); lastBlink=millis(); }
-  else digitalWrite(LED_PIN, HIGH); // idle=solid
+  } else digitalWrite(LED_PIN, HIGH); // idle=solid
+}
+
+// ======= NETWORK TASK =======
+void networkTask(void* /*param*/) {
+  for (;;) {
+    {
+      TRACE_SCOPE(TRACE_NETWORK);
+      {
+        TRACE_SCOPE(TRACE_HTTP);
+        web.handleClient();
+      }
+      wifi.tick(millis());
+      beacon.tick(millis(), wifi.connected());
+      {
+        TRACE_SCOPE(TRACE_HISTORY);
+        HistoryEvent event;
+        while (historyEvents.pop(&event)) history.record(event.kind, event.values, millis());
+        history.tick(millis());
+      }
+      {
+        TRACE_SCOPE(TRACE_TELEMETRY);
+        pushTelemetry();
+        telemetry.tick(millis());
+      }
+    }
+    vTaskDelay(1);
+  }
+}
+
+// ======= CONTROL LINK =======
+void serviceCommands() {
+  TRACE_SCOPE(TRACE_COMMANDS);
+  RoverCommand command;
+  bool applied = false;
+  while (control.next(&command)) { applyCommand(command); applied = true; }
+  if (applied) publishState();
+}
+
+void applyCommand(const RoverCommand& command) {
+  switch (command.type) {
+    case CMD_MOVE: if (command.args[0] == 0 || !automaticMode) moveMotors((int)command.args[0]); break;
+    case CMD_SEGMENT:
+      if (automaticMode) break;
+      if (command.args[0]) motion.stop();
+      motion.push(command.segment);
+      break;
+    case CMD_POSE_RESET: odometry.reset(command.args[0], command.args[1], (int)command.args[2]); break;
+    case CMD_INIT_SERVO: probe.park(); servoInitialized = true; break;
+    case CMD_SERVO_DOWN: if (!sensorCycle.busy()) lowerServo(); break;
+    case CMD_SERVO_UP: if (!sensorCycle.busy()) raiseServo(); break;
+    case CMD_START_PUMP: if (!pump.running()) startPump(PUMP_DURATION); break;
+    case CMD_STOP_PUMP: cancelDose(); stopPump(); break;
+    case CMD_READ_SOIL: sampleSoil(); break;
+    case CMD_CHECK: if (servoInitialized) sensorCycle.begin(millis(), true, CHECK_MANUAL); break;
+    case CMD_AUTOMATIC: if (servoInitialized) automaticMode = true; break;
+    case CMD_MANUAL:
+      automaticMode = false; stopMotors(); cancelDose();
+      if (probe.isDown() && servoInitialized && !sensorCycle.busy()) raiseServo();
+      break;
+    case CMD_SELECT_ZONE:
+      if (!zones.valid((int)command.args[0])) break;
+      if (command.args[0] != currentZone) cancelDose();
+      currentZone = (int)command.args[0];
+      break;
+    default: break;
+  }
+}
+
+void publishState() {
+  TRACE_SCOPE(TRACE_PUBLISH);
+  RoverState& state = control.edit();
+  state.automaticMode = automaticMode;
+  state.direction = currentDirection;
+  state.pumpRunning = pump.running();
+  state.servoDown = probe.isDown();
+  state.servoInitialized = servoInitialized;
+  state.soilReading = lastSoilReading;
+  state.soilStatus = lastSoilStatus;
+  state.motorDuty = motion.duty();
+  state.queuedSegments = motion.queued();
+  state.motionCapacity = motion.capacity();
+  state.x = odometry.xMm(); state.y = odometry.yMm(); state.heading = odometry.headingDeg();
+  state.odometerMm = odometry.distanceMm();
+  state.leftTicks = leftTicks; state.rightTicks = rightTicks;
+  state.leftCorrection = leftPid.correction(); state.rightCorrection = rightPid.correction();
+  state.encoders = !leftPid.fault() && !rightPid.fault();
+  state.checkJobId = sensorCycle.activeJobId();
+  state.lastCheck = lastCheck;
+  state.currentZone = currentZone;
+  state.zones = zones;
+  state.dose = dose;
+  control.publish();
+  lastStatePublish = millis();
+}
+
+// Hands a command to the control loop and waits until it is applied
+bool runCommand(uint8_t type, long a, long b, long c) {
+  RoverCommand command = {0, type, {a, b, c}, MotionSegment()};
+  return control.run(command);
+}
+
+// Command queue full, or the control loop did not get to it in time
+void sendControlBusy(const char* cmd) {
+  sendCommandResponse(503, cmd, "error", "Controller busy - try again");
 }
 
 // ======= HANDLERS & UTILITIES =======
 
+// Dashboard page: static markup in flash, only the status values are written inline
+const uint32_t ROOT_PAGE_VERSION = 2;
+
+static const char ROOT_HEAD[] PROGMEM =
+  "<!DOCTYPE html><html><head><title>ESP32 Robot Controller</title>"
+  "<meta name='viewport' content='width=device-width, initial-scale=1'>"
+  "<style>body{font-family:Arial;margin:20px;background:#f0f8ff;text-align:center;}</style></head><body>"
+  "<div style='background:#fff;padding:20px;border-radius:15px;max-width:800px;margin:0 auto;'>"
+  "<h1>🤖 ESP32 Robot Controller</h1>";
+static const char ROOT_SERVO_WARNING[] PROGMEM =
+  "<div id='servoWarning' style='background:#fff3cd;color:#856404;padding:10px;margin-bottom:10px;'>⚠️ <b>SERVO NOT INITIALIZED</b><br><button onclick=\"fetch('/init_servo')\">🔧 Initialize Servo</button></div>";
+static const char ROOT_MODE[] PROGMEM = "<h3>Status</h3><b>Mode:</b> <span id='mode'>";
+static const char ROOT_MOVE[] PROGMEM = "</span><br><b>Move:</b> <span id='movement'>";
+static const char ROOT_PUMP[] PROGMEM = "</span><br><b>Pump:</b> <span id='pumpStatus'>";
+static const char ROOT_SERVO[] PROGMEM = "</span><br><b>Servo:</b> <span id='servoPosition'>";
+static const char ROOT_SERVO_INIT[] PROGMEM = "</span>/<span id='servoInitialized'>";
+static const char ROOT_SOIL[] PROGMEM = "</span><br><b>Soil:</b> <span id='soilMoisture'>";
+static const char ROOT_SOIL_STATUS[] PROGMEM = "</span> (<span id='soilStatus'>";
+static const char ROOT_CONTROLS[] PROGMEM =
+  "</span>)<br><hr>"
+  "<b>Movement:</b> <button onclick=\"fetch('/forward')\">↑</button> "
+  "<button onclick=\"fetch('/left')\">←</button> "
+  "<button onclick=\"fetch('/stop')\">⏹</button> "
+  "<button onclick=\"fetch('/right')\">→</button> "
+  "<button onclick=\"fetch('/backward')\">↓</button><br><br>"
+  "<b>Sensors:</b> <button onclick=\"fetch('/start_sensor')\">🔍 Check</button> "
+  "<button onclick=\"fetch('/read_soil')\">🌱 Soil</button> "
+  "<button onclick=\"fetch('/servo_down')\">⬇️</button> "
+  "<button onclick=\"fetch('/servo_up')\">⬆️</button><br>"
+  "<b>Pump:</b> <button onclick=\"fetch('/start')\">💧 ON</button> "
+  "<button onclick=\"fetch('/stop_pump')\">🛑 OFF</button><br>"
+  "<b>Mode:</b> <button onclick=\"fetch('/automatic')\">AUTO</button> "
+  "<button onclick=\"fetch('/manual')\">MANUAL</button>"
+  "<br><small>IP: ";
+static const char ROOT_TAIL[] PROGMEM =
+  " | Live updates</small></div>"
+  "<script>new EventSource('/events').onmessage=function(e){var d=JSON.parse(e.data);"
+  "for(var k in d){var el=document.getElementById(k);if(el)el.textContent=d[k];}"
+  "if(d.servoInitialized){var w=document.getElementById('servoWarning');if(w)w.style.display='none';}};</script>"
+  "</body></html>";
+
 void handleRoot() {
-  String html = "<!DOCTYPE html><html><head><title>ESP32 Robot Controller</title>";
-  html += "<meta http-equiv='refresh' content='5'>";
-  html += "<meta name='viewport' content='width=device-width, initial-scale=1'>";
-  html += "<style>body{font-family:Arial;margin:20px;background:#f0f8ff;text-align:center;}</style></head><body>";
-  html += "<div style='background:#fff;padding:20px;border-radius:15px;max-width:800px;margin:0 auto;'>";
-  html += "<h1>🤖 ESP32 Robot Controller</h1>";
-  if (!servoInitialized) html += "<div style='background:#fff3cd;color:#856404;padding:10px;margin-bottom:10px;'>⚠️ <b>SERVO NOT INITIALIZED</b><br><button onclick=\"fetch('/init_servo')\">🔧 Initialize Servo</button></div>";
-  html += "<h3>Status</h3><b>Mode:</b> "+String(automaticMode?"Auto":"Manual")+"<br>";
-  html += "<b>Move:</b> "+getMovementString(currentDirection)+"<br>";
-  html += "<b>Pump:</b> "+String(pumpRunning?"ON":"OFF")+"<br>";
-  html += "<b>Servo:</b> "+String(servoDown?"DOWN":"UP")+"/"+(servoInitialized?"Ready":"NotInit")+"<br>";
-  html += "<b>Soil:</b> "+String(lastSoilReading)+" ("+lastSoilStatus+")<br>";
-  html += "<hr>";
-  html += "<b>Movement:</b> <button onclick=\"fetch('/forward')\">↑</button> ";
-  html += "<button onclick=\"fetch('/left')\">←</button> ";
-  html += "<button onclick=\"fetch('/stop')\">⏹</button> ";
-  html += "<button onclick=\"fetch('/right')\">→</button> ";
-  html += "<button onclick=\"fetch('/backward')\">↓</button><br><br>";
-  html += "<b>Sensors:</b> <button onclick=\"fetch('/start_sensor')\">🔍 Check</button> ";
-  html += "<button onclick=\"fetch('/read_soil')\">🌱 Soil</button> ";
-  html += "<button onclick=\"fetch('/servo_down')\">⬇️</button> ";
-  html += "<button onclick=\"fetch('/servo_up')\">⬆️</button><br>";
-  html += "<b>Pump:</b> <button onclick=\"fetch('/start')\">💧 ON</button> ";
-  html += "<button onclick=\"fetch('/stop_pump')\">🛑 OFF</button><br>";
-  html += "<b>Mode:</b> <button onclick=\"fetch('/automatic')\">AUTO</button> ";
-  html += "<button onclick=\"fetch('/manual')\">MANUAL</button>";
-  html += "<br><small>IP: "+WiFi.localIP().toString()+" | Page refresh: 5s</small></div></body></html>";
-
-  addCORSHeaders();
-  server.send(200, "text/html", html);
+  char ip[16];
+  IPAddress localIP = WiFi.localIP();
+  snprintf(ip, sizeof(ip), "%u.%u.%u.%u", localIP[0], localIP[1], localIP[2], localIP[3]);
+
+  // Values are kept current by /events; a reload of unchanged state is answered with 304
+  const RoverState& state = control.state();
+  PageTag tag(ROOT_PAGE_VERSION);
+  tag.mix(state.servoInitialized).mix(state.automaticMode).mix(state.direction).mix(state.pumpRunning).mix(state.servoDown);
+  tag.mix(state.soilReading).mix(state.soilStatus).mix(ip);
+  if (pageNotModified(server, tag)) return;
+
+  PageStream<WebServer> page(server);
+  page.begin();
+  page.progmem(ROOT_HEAD);
+  if (!state.servoInitialized) page.progmem(ROOT_SERVO_WARNING);
+  page.progmem(ROOT_MODE);
+  page.print(state.automaticMode?"automatic":"manual");
+  page.progmem(ROOT_MOVE);
+  page.print(getMovementString(state.direction));
+  page.progmem(ROOT_PUMP);
+  page.print(state.pumpRunning?"running":"stopped");
+  page.progmem(ROOT_SERVO);
+  page.print(state.servoDown?"down":"up");
+  page.progmem(ROOT_SERVO_INIT);
+  page.print(state.servoInitialized?"true":"false");
+  page.progmem(ROOT_SOIL);
+  page.print((long)state.soilReading);
+  page.progmem(ROOT_SOIL_STATUS);
+  page.print(state.soilStatus);
+  page.progmem(ROOT_CONTROLS);
+  page.print(ip);
+  page.progmem(ROOT_TAIL);
+  page.end();
+}
+
+void handleMetrics() {
+  web.sendMetrics();
+}
+
+void handleTrace() {
+  sendTrace(server, tracer);
 }
 
 // --- MOVEMENT ---
+// Manual drive: ramps up and keeps going until the next command
 void moveMotors(int dir) {
+  if (dir == 0) motion.stop();
+  else motion.drive(dir, DRIVE_SPEED, MOTION_DEFAULT_RAMP);
+}
+
+// Writes the motion queue output to the bridge, direction pins only when they change.
+// Each wheel gets the queue's duty plus its speed correction.
+void applyMotorOutput(int dir, uint8_t duty) {
   // dir: 0=stop, 1=forward, 2=backward, 3=left, 4=right
-  switch(dir) {
-    case 1: // forward
-      digitalWrite(IN1,HIGH); digitalWrite(IN2,LOW);
-      digitalWrite(IN3,HIGH); digitalWrite(IN4,LOW);
-      ledcWrite(ENA_CHANNEL, 200); ledcWrite(ENB_CHANNEL, 200);
-      break;
-    case 2: // backward
-      digitalWrite(IN1,LOW); digitalWrite(IN2,HIGH);
-      digitalWrite(IN3,LOW); digitalWrite(IN4,HIGH);
-      ledcWrite(ENA_CHANNEL, 200); ledcWrite(ENB_CHANNEL, 200);
-      break;
-    case 3: // left
-      digitalWrite(IN1,LOW); digitalWrite(IN2,HIGH);
-      digitalWrite(IN3,HIGH); digitalWrite(IN4,LOW);
-      ledcWrite(ENA_CHANNEL, 200); ledcWrite(ENB_CHANNEL, 200);
-      break;
-    case 4: // right
-      digitalWrite(IN1,HIGH); digitalWrite(IN2,LOW);
-      digitalWrite(IN3,LOW); digitalWrite(IN4,HIGH);
-      ledcWrite(ENA_CHANNEL, 200); ledcWrite(ENB_CHANNEL, 200);
-      break;
-    default: // stop
-      stopMotors();
-      break;
+  if (dir != currentDirection) {
+    updateOdometry(NULL, NULL);  // ticks so far belong to the old direction
+    if (dir != 0) odometryDirection = dir;
+    leftPid.reset(); rightPid.reset();
   }
+  drive.apply(dir, wheelDuty(duty, leftPid.correction()), wheelDuty(duty, rightPid.correction()));
   isMoving = (dir!=0);
   currentDirection = dir;
 }
 
+uint8_t wheelDuty(uint8_t duty, int correction) {
+  if (duty == 0) return 0;
+  int value = duty + correction;
+  return value < 0 ? 0 : value > 255 ? 255 : (uint8_t)value;
+}
+
+// --- ODOMETRY ---
+void IRAM_ATTR onLeftEncoder()  { leftTicks++; }
+void IRAM_ATTR onRightEncoder() { rightTicks++; }
+
+// Feeds the ticks since the last call into the pose; the encoders cannot tell the
+// direction, so it comes from the bridge (left turn = left wheel backwards)
+void updateOdometry(long* leftDelta, long* rightDelta) {
+  uint32_t left = leftTicks, right = rightTicks;   // 32-bit reads are atomic
+  long dl = (long)(left - lastLeftTicks), dr = (long)(right - lastRightTicks);
+  lastLeftTicks = left; lastRightTicks = right;
+  int ls = 1, rs = 1;
+  switch (odometryDirection) {
+    case 2: ls = -1; rs = -1; break;
+    case 3: ls = -1; break;
+    case 4: rs = -1; break;
+  }
+  odometry.update(ls * dl, rs * dr);
+  if (leftDelta) *leftDelta = dl;
+  if (rightDelta) *rightDelta = dr;
+}
+
+// Holds both wheels at the speed the commanded duty stands for, so a sagging battery
+// or soft ground does not shorten the distance driven
+void serviceWheels() {
+  TRACE_SCOPE(TRACE_WHEELS);
+  unsigned long now = millis();
+  unsigned long dt = now - lastWheelControl;
+  if (dt < WHEEL_CONTROL_INTERVAL) return;
+  lastWheelControl = now;
+  long dl, dr;
+  updateOdometry(&dl, &dr);
+  long setpoint = (long)motion.duty() * MAX_WHEEL_SPEED / 255;
+  leftPid.update(setpoint, dl * 1000 / (long)dt, dt);
+  rightPid.update(setpoint, dr * 1000 / (long)dt, dt);
+  if (motion.duty()) applyMotorOutput(currentDirection, motion.duty());
+}
+
+void handlePose() {
+  if (server.arg("reset") == "1" &&
+      !runCommand(CMD_POSE_RESET, server.arg("x").toInt(), server.arg("y").toInt(), server.arg("heading").toInt())) {
+    sendControlBusy("pose");
+    return;
+  }
+  const RoverState& state = control.state();
+  JsonWriter<256> json;
+  json.add("status", "success").add("x", state.x).add("y", state.y).add("heading", state.heading)
+      .add("odometerMm", state.odometerMm).add("leftTicks", (unsigned long)state.leftTicks)
+      .add("rightTicks", (unsigned long)state.rightTicks).add("leftCorrection", state.leftCorrection)
+      .add("rightCorrection", state.rightCorrection).add("encoders", state.encoders)
+      .add("timestamp", millis());
+  sendJson(server, 200, json);
+}
+
+// Immediate stop without ramp (boot, mode changes)
 void stopMotors() {
-  digitalWrite(IN1,LOW); digitalWrite(IN2,LOW);
-  digitalWrite(IN3,LOW); digitalWrite(IN4,LOW);
-  ledcWrite(ENA_CHANNEL,0); ledcWrite(ENB_CHANNEL,0);
+  motion.halt();
+  drive.stop();
   isMoving = false; currentDirection = 0;
 }
 
-void handleForward()  { if(!automaticMode){ moveMotors(1); }   sendMovementResponse("forward", "Moving forward"); }
-void handleBackward() { if(!automaticMode){ moveMotors(2); }   sendMovementResponse("backward", "Moving backward"); }
-void handleLeft()     { if(!automaticMode){ moveMotors(3); }   sendMovementResponse("left", "Turning left"); }
-void handleRight()    { if(!automaticMode){ moveMotors(4); }   sendMovementResponse("right", "Turning right"); }
-void handleStop()     { stopMotors(); sendMovementResponse("stop", "Motors stopped"); }
-void sendMovementResponse(String cmd, String msg) {
-  addCORSHeaders();
-  server.send(200, "application/json", "{\"command\":\""+cmd+"\",\"status\":\"ok\",\"message\":\""+msg+"\",\"timestamp\":"+String(millis())+"}");
+// Ignored in automatic mode, except stop
+void handleForward()  { sendMove(1, "forward", "Moving forward"); }
+void handleBackward() { sendMove(2, "backward", "Moving backward"); }
+void handleLeft()     { sendMove(3, "left", "Turning left"); }
+void handleRight()    { sendMove(4, "right", "Turning right"); }
+void handleStop()     { sendMove(0, "stop", "Motors stopped"); }
+void sendMove(int dir, const char* cmd, const char* msg) {
+  if (runCommand(CMD_MOVE, dir)) sendMovementResponse(cmd, msg);
+  else sendControlBusy(cmd);
+}
+void sendMovementResponse(const char* cmd, const char* msg) {
+  sendCommandResponse(200, cmd, "ok", msg);
+}
+
+// Queues a route in one request: ?segments=f:200:1500:300,l:180:400 (or the same as POST
+// body), see parseMotionSegments(). append=1 adds to the running route instead of replacing it.
+void handleTrajectory() {
+  const RoverState& state = control.state();
+  if (state.automaticMode) { sendErrorResponse("trajectory", "Not available in automatic mode"); return; }
+  String text = server.hasArg("segments") ? server.arg("segments") : server.arg("plain");
+  MotionSegment segments[16];
+  size_t errorAt = 0;
+  int count = parseMotionSegments(text.c_str(), segments, state.motionCapacity, &errorAt);
+  if (count <= 0) {
+    JsonWriter<192> json;
+    json.add("command", "trajectory").add("status", "error")
+        .add("message", count == 0 ? "No segments" : "Bad segment").add("segment", (unsigned long)errorAt)
+        .add("timestamp", millis());
+    sendJson(server, 400, json);
+    return;
+  }
+  bool append = server.arg("append") == "1";
+  if (append && state.queuedSegments + count > state.motionCapacity) {
+    sendCommandResponse(409, "trajectory", "error", "Queue full");
+    return;
+  }
+  // One command per segment, the first replaces the running route unless appending
+  if (control.room() < (size_t)count) { sendControlBusy("trajectory"); return; }
+  unsigned long totalMs = 0;
+  for (int i = 0; i < count; i++) {
+    RoverCommand command = {0, CMD_SEGMENT, {i == 0 && !append, 0, 0}, segments[i]};
+    if (i < count - 1) control.post(command);
+    else if (!control.run(command)) { sendControlBusy("trajectory"); return; }
+    totalMs += segments[i].durationMs;
+  }
+  JsonWriter<192> json;
+  json.add("command", "trajectory").add("status", "success").add("segments", count)
+      .add("queued", (unsigned long)control.state().queuedSegments).add("durationMs", totalMs).add("timestamp", millis());
+  sendJson(server, 200, json);
 }
 
-String getMovementString(int dir) {
+const char* getMovementString(int dir) {
   switch(dir) {
     case 1: return "Forward";
     case 2: return "Backward";
@@ -235,121 +746,293 @@ String getMovementString(int dir) {
 }
 
 // --- SERVO ---
-void lowerServo() { if (servoInitialized) { soilServo.write(SERVO_DOWN_ANGLE); servoDown = true; delay(500); } }
-void raiseServo() { if (servoInitialized) { soilServo.write(SERVO_UP_ANGLE);   servoDown = false; delay(500); } }
+// The servo travels on its own; the sensor cycle waits for it where that matters
+void lowerServo() { if (servoInitialized && probe.lower()) soilFilter.reset(); }
+void raiseServo() { if (servoInitialized) probe.raise(); }
 
 void handleInitServo() {
-  addCORSHeaders();
-  soilServo.write(SERVO_UP_ANGLE);
-  servoInitialized = true; servoDown = false;
-  server.send(200, "application/json","{\"command\":\"init_servo\",\"status\":\"success\",\"message\":\"Servo initialized\",\"timestamp\":"+String(millis())+"}");
+  if (!runCommand(CMD_INIT_SERVO)) { sendControlBusy("init_servo"); return; }
+  sendCommandResponse(200, "init_servo", "success", "Servo initialized");
 }
 void handleServoDown() {
-  addCORSHeaders();
-  if(!servoInitialized){ sendErrorResponse("servo_down","Servo not initialized"); return; }
-  lowerServo();
-  server.send(200, "application/json","{\"command\":\"servo_down\",\"status\":\"success\",\"message\":\"Servo lowered\",\"timestamp\":"+String(millis())+"}");
+  if(!control.state().servoInitialized){ sendErrorResponse("servo_down","Servo not initialized"); return; }
+  if (!runCommand(CMD_SERVO_DOWN)) { sendControlBusy("servo_down"); return; }
+  if (control.state().checkJobId) { sendCommandResponse(409, "servo_down", "error", "Sensor check in progress"); return; }
+  sendCommandResponse(200, "servo_down", "success", "Servo lowered");
 }
 void handleServoUp() {
-  addCORSHeaders();
-  if(!servoInitialized){ sendErrorResponse("servo_up","Servo not initialized"); return; }
-  raiseServo();
-  server.send(200, "application/json","{\"command\":\"servo_up\",\"status\":\"success\",\"message\":\"Servo raised\",\"timestamp\":"+String(millis())+"}");
+  if(!control.state().servoInitialized){ sendErrorResponse("servo_up","Servo not initialized"); return; }
+  if (!runCommand(CMD_SERVO_UP)) { sendControlBusy("servo_up"); return; }
+  if (control.state().checkJobId) { sendCommandResponse(409, "servo_up", "error", "Sensor check in progress"); return; }
+  sendCommandResponse(200, "servo_up", "success", "Servo raised");
 }
 
 // --- PUMP ---
-void startPump() { digitalWrite(PUMP_RELAY_PIN, HIGH); pumpRunning = true; pumpStartTime = millis(); }
-void stopPump()  { digitalWrite(PUMP_RELAY_PIN, LOW);  pumpRunning = false; }
+void startPump(unsigned long runMs) {
+  pump.start(millis(), runMs); pumpZone = currentZone;
+}
+void stopPump() {
+  unsigned long runTime = pump.stop(millis());
+  if (runTime) {
+    zones.recordPumpRun(pumpZone, runTime, millis());
+    recordHistory(HISTORY_PUMP, (int32_t)(runTime / 100), pumpZone);
+  }
+}
+// Dose for the current zone, limited by its daily budget and the pump duty cycle
+bool irrigateCurrentZone(int soilValue) {
+  unsigned long allowance = zones.pumpAllowance(currentZone, millis(), 0);
+  if (!dose.begin(currentZone, soilValue, zones.config(currentZone).targetMoisture, allowance, millis())) {
+    Serial.println("⏳ Pump budget used up for this zone");
+    return false;
+  }
+  return true;
+}
+void serviceDose() {
+  TRACE_SCOPE(TRACE_DOSE);
+  switch (dose.tick(millis())) {
+    case DOSE_PUMP_ON: startPump(dose.pulseMs()); break;
+    case DOSE_PUMP_OFF: stopPump(); soilFilter.reset(); break;
+    case DOSE_SAMPLE: {
+      int soilValue = readSoilFiltered();
+      lastSoilReading = soilValue; lastSoilStatus = getSoilStatus(soilValue);
+      recordSoil(dose.zone(), soilValue);
+      dose.sample(soilValue, millis());
+      break;
+    }
+    case DOSE_DONE:
+      Serial.printf("Dose %s: %u pulses, %lu ms, gain %ld/s\n", DoseController<8>::resultName(dose.result()),
+                    dose.pulses(), dose.pumpedMs(), dose.gain(dose.zone()));
+      zones.recordReading(dose.zone(), dose.lastReading(), millis());
+      if (!sensorCycle.busy()) raiseServo();
+      break;
+    default: break;
+  }
+}
+void cancelDose() {
+  if (!dose.active()) return;
+  if (dose.cancel(millis())) stopPump();
+  if (!sensorCycle.busy()) raiseServo();
+}
 
 void handleStartPump() {
-  addCORSHeaders();
-  if (pumpRunning) server.send(200, "application/json", "{\"command\":\"start_pump\",\"status\":\"already_running\",\"message\":\"Pump already running\",\"timestamp\":"+String(millis())+"}");
-  else { startPump(); server.send(200, "application/json", "{\"command\":\"start_pump\",\"status\":\"success\",\"message\":\"Pump started\",\"timestamp\":"+String(millis())+"}"); }
+  if (control.state().pumpRunning) sendCommandResponse(200, "start_pump", "already_running", "Pump already running");
+  else if (!runCommand(CMD_START_PUMP)) sendControlBusy("start_pump");
+  else sendCommandResponse(200, "start_pump", "success", "Pump started");
 }
 void handleStopPump() {
-  addCORSHeaders();
-  stopPump();
-  server.send(200, "application/json", "{\"command\":\"stop_pump\",\"status\":\"success\",\"message\":\"Pump stopped\",\"timestamp\":"+String(millis())+"}");
+  if (!runCommand(CMD_STOP_PUMP)) { sendControlBusy("stop_pump"); return; }
+  sendCommandResponse(200, "stop_pump", "success", "Pump stopped");
 }
 
 // --- SOIL SENSOR ---
-String getSoilStatus(int value) {
+const char* getSoilStatus(int value) {
   if (value < 1500) return "wet";
-  else if (value < DRY_SOIL_THRESHOLD) return "moist";
+  else if (value <= zones.config(currentZone).dryThreshold) return "moist";
   else return "dry";
 }
+// Filtered soil value; refills the window right away after a reset (probe just lowered)
+int readSoilFiltered() {
+  while (!soilFilter.ready()) soilFilter.push(probe.read());
+  return soilFilter.value();
+}
+void sampleSoil() {
+  int soilValue = readSoilFiltered();
+  lastSoilReading = soilValue; lastSoilStatus = getSoilStatus(soilValue);
+  if (probe.isDown()) recordSoil(currentZone, soilValue);   // readings with the probe up are not soil
+}
 void handleReadSoil() {
-  addCORSHeaders();
-  int soilValue = analogRead(SOIL_MOISTURE_PIN);
-  String status = getSoilStatus(soilValue);
-  lastSoilReading = soilValue; lastSoilStatus=status;
-  server.send(200, "application/json", "{\"command\":\"read_soil\",\"status\":\"success\",\"soilMoisture\":"+String(soilValue)+",\"soilStatus\":\""+status+"\",\"message\":\"Soil reading completed\",\"timestamp\":"+String(millis())+"}");
+  if (!runCommand(CMD_READ_SOIL)) { sendControlBusy("read_soil"); return; }
+  const RoverState& state = control.state();
+  JsonWriter<192> json;
+  json.add("command", "read_soil").add("status", "success").add("soilMoisture", state.soilReading)
+      .add("soilStatus", state.soilStatus).add("message", "Soil reading completed").add("timestamp", millis());
+  sendJson(server, 200, json);
 }
+// Starts a check (or joins the running one) and answers 202 with its job at once; the
+// reading, ~1.5 s later, is picked up with /start_sensor?job=<id>. The network task never
+// waits for the probe, so /events and the other clients keep going meanwhile.
 void handleStartSensor() {
-  addCORSHeaders();
-  if(!servoInitialized){ sendErrorResponse("start_sensor","Servo not initialized"); return; }
-  lowerServo(); delay(1000);
-  int soilValue = analogRead(SOIL_MOISTURE_PIN);
-  String status = getSoilStatus(soilValue);
-  lastSoilReading = soilValue; lastSoilStatus = status;
-  raiseServo(); delay(500);
-  bool needsIrrigation = (soilValue > DRY_SOIL_THRESHOLD);
-  server.send(200, "application/json",
-    "{\"command\":\"start_sensor\",\"status\":\"success\",\"soilMoisture\":"+String(soilValue)+
-    ",\"soilStatus\":\""+status+"\",\"needsIrrigation\":"+(needsIrrigation?"true":"false")+
-    ",\"message\":\"Sensor check completed\",\"timestamp\":"+String(millis())+"}");
-  if (needsIrrigation && !pumpRunning) startPump();
+  if (server.hasArg("job")) {
+    unsigned long jobId = strtoul(server.arg("job").c_str(), NULL, 10);
+    const RoverState& state = control.state();
+    if (jobId != 0 && jobId == state.lastCheck.jobId) {
+      sendSensorResult(state.lastCheck);
+    } else if (jobId != 0 && jobId == state.checkJobId) {
+      sendSensorPending(jobId);
+    } else {
+      JsonWriter<192> json;
+      json.add("command", "start_sensor").add("status", "error").add("message", "Unknown sensor check job")
+          .add("jobId", jobId).add("timestamp", millis());
+      sendJson(server, 404, json);
+    }
+    return;
+  }
+  if(!control.state().servoInitialized){ sendErrorResponse("start_sensor","Servo not initialized"); return; }
+  if (!runCommand(CMD_CHECK)) { sendControlBusy("start_sensor"); return; }
+  unsigned long jobId = control.state().checkJobId;
+  if (!jobId) { sendErrorResponse("start_sensor","Servo not initialized"); return; }
+  sendSensorPending(jobId);
+}
+
+void sendSensorPending(unsigned long jobId) {
+  char poll[40];
+  snprintf(poll, sizeof(poll), "/start_sensor?job=%lu", jobId);
+  JsonWriter<192> json;
+  json.add("command", "start_sensor").add("status", "pending").add("jobId", jobId).add("poll", poll)
+      .add("timestamp", millis());
+  sendJson(server, 202, json);
+}
+
+void sendSensorResult(const CheckResult& check) {
+  JsonWriter<256> json;
+  json.add("command", "start_sensor").add("status", "success").add("soilMoisture", check.soil)
+      .add("soilStatus", check.status).add("needsIrrigation", check.needsIrrigation).add("dosing", check.dosing)
+      .add("jobId", check.jobId).add("message", "Sensor check completed").add("timestamp", millis());
+  sendJson(server, 200, json);
+}
+
+// Probe sequence for /start_sensor and automatic mode. A dose started from the reading
+// keeps the probe in the soil, it is raised when the dose is done.
+void serviceSensorCycle() {
+  TRACE_SCOPE(TRACE_SENSOR_CYCLE);
+  switch (sensorCycle.tick(millis())) {
+    case CYCLE_LOWER_SERVO: lowerServo(); break;
+    case CYCLE_SAMPLE: {
+      int soilValue = readSoilFiltered();
+      lastSoilReading = soilValue; lastSoilStatus = getSoilStatus(soilValue);
+      zones.recordReading(currentZone, soilValue, millis());
+      recordSoil(currentZone, soilValue);
+      bool needsIrrigation = zones.needsWater(currentZone, soilValue);
+      bool dosing = needsIrrigation && !pump.running() && !dose.active() && irrigateCurrentZone(soilValue);
+      CheckResult result = {sensorCycle.activeJobId(), soilValue, lastSoilStatus, needsIrrigation, dosing};
+      lastCheck = result;
+      break;
+    }
+    case CYCLE_RAISE_SERVO: if (!dose.active()) raiseServo(); break;
+    default: break;
+  }
 }
 
 // --- MODE ---
 void handleAutomatic() {
-  addCORSHeaders();
-  if(!servoInitialized) { sendErrorResponse("automatic","Servo not initialized"); return; }
-  automaticMode = true; lastSensorCheck = 0;
-  server.send(200,"application/json", "{\"command\":\"automatic\",\"status\":\"success\",\"mode\":\"automatic\",\"message\":\"Automatic mode enabled\",\"timestamp\":"+String(millis())+"}" );
+  if(!control.state().servoInitialized) { sendErrorResponse("automatic","Servo not initialized"); return; }
+  if (!runCommand(CMD_AUTOMATIC)) { sendControlBusy("automatic"); return; }
+  JsonWriter<192> json;
+  json.add("command", "automatic").add("status", "success").add("mode", "automatic")
+      .add("message", "Automatic mode enabled").add("timestamp", millis());
+  sendJson(server, 200, json);
 }
 void handleManual() {
-  addCORSHeaders();
-  automaticMode = false; stopMotors();
-  if(servoDown && servoInitialized) raiseServo();
-  server.send(200,"application/json", "{\"command\":\"manual\",\"status\":\"success\",\"mode\":\"manual\",\"message\":\"Manual mode enabled\",\"timestamp\":"+String(millis())+"}" );
+  if (!runCommand(CMD_MANUAL)) { sendControlBusy("manual"); return; }
+  JsonWriter<192> json;
+  json.add("command", "manual").add("status", "success").add("mode", "manual")
+      .add("message", "Manual mode enabled").add("timestamp", millis());
+  sendJson(server, 200, json);
 }
 
 // --- AUTO-IRRIGATION ---
 void handleAutomaticIrrigation() {
-  if (millis() - lastSensorCheck < SENSOR_CHECK_INTERVAL) return;
-  lastSensorCheck = millis();
-  lowerServo(); delay(1000);
-  int soilValue = analogRead(SOIL_MOISTURE_PIN);
-  lastSoilReading = soilValue; lastSoilStatus=getSoilStatus(soilValue);
-  bool needsIrrigation = (soilValue > DRY_SOIL_THRESHOLD);
-  raiseServo(); delay(500);
-  if (needsIrrigation && !pumpRunning) startPump();
+  TRACE_SCOPE(TRACE_AUTOMATIC);
+  if (dose.active() || sensorCycle.busy() || !zones.due(currentZone, millis())) return;
+  sensorCycle.begin(millis(), true, CHECK_AUTO);
+}
+
+// --- ZONES ---
+void handleZones() {
+  const RoverState& state = control.state();
+  const ZoneScheduler<8>& zones = state.zones;
+  const DoseController<8>& dose = state.dose;
+  JsonWriter<256 + zonesJsonBytes(8)> json;
+  json.add("status", "success").add("currentZone", state.currentZone).add("dutyUsedMs", zones.dutyUsedMs())
+      .add("dutyLimitMs", zones.limits().maxOnMs);
+  json.add("dosing", dose.active()).add("doseGain", dose.gain(state.currentZone)).add("dosePulses", dose.pulses())
+      .add("dosePumpedMs", dose.pumpedMs()).add("doseResult", DoseController<8>::resultName(dose.result()));
+  addZonesJson(json, zones, millis());
+  json.add("timestamp", millis());
+  sendJson(server, 200, json);
+}
+// The rover reports the plot it is parked at
+void handleSelectZone() {
+  int zone = server.hasArg("id") ? server.arg("id").toInt() : -1;
+  if (!control.state().zones.valid(zone)) { sendErrorResponse("zone", "Unknown zone id"); return; }
+  if (!runCommand(CMD_SELECT_ZONE, zone)) { sendControlBusy("zone"); return; }
+  const ZoneScheduler<8>& zones = control.state().zones;
+  JsonWriter<192> json;
+  json.add("command", "zone").add("status", "success").add("zone", zone).add("name", zones.config(zone).name)
+      .add("due", zones.due(zone, millis())).add("timestamp", millis());
+  sendJson(server, 200, json);
+}
+
+// --- HISTORY ---
+// GET /history?from=&to=&step=&zone=&boot= - seconds since boot, negative = back from now
+void handleHistory() {
+  uint32_t now = history.seconds(millis());
+  uint32_t from = historyTime(server.hasArg("from") ? server.arg("from").toInt() : -3600, now);
+  uint32_t to = server.hasArg("to") ? historyTime(server.arg("to").toInt(), now) : now + 1;
+  if (to <= from) { sendErrorResponse("history", "Empty time range"); return; }
+  long step = server.hasArg("step") ? server.arg("step").toInt() : 0;
+  int zone = server.hasArg("zone") ? server.arg("zone").toInt() : -1;
+  uint16_t boot = server.hasArg("boot") ? (uint16_t)server.arg("boot").toInt() : history.boot();
+  static HistoryQuery<60> query;   // ~2 KB of buckets, kept off the stack
+  query.begin(from, to, step > 0 ? (uint32_t)step : 0, zone);
+  collectHistory(history, historyLog, boot, query);
+  if (wantsBinary(server)) sendHistoryBinary(server, query, boot, now);
+  else sendHistoryJson(server, query, boot, now);
+}
+void recordSoil(int zone, int soilValue) {
+  recordHistory(HISTORY_SOIL, soilValue, zone);
+}
+// Control loop side: the network task writes the record
+void recordHistory(uint8_t kind, int32_t a, int32_t b) {
+  HistoryEvent event = {kind, {a, b, 0}};
+  if (!historyEvents.push(event)) Serial.println("⚠️ History queue full - record dropped");
+}
+void onHistorySealed(const uint8_t* block, void* /*context*/) {
+  if (historyLog.ready() && !historyLog.append(block)) Serial.println("⚠️ History block not written to flash");
 }
 
 // --- STATUS ---
 void handleStatus() {
-  addCORSHeaders();
-  String json="{\"status\":\"success\",\"mode\":\""+String(automaticMode?"automatic":"manual")+"\",\"movement\":\""+
-    getMovementString(currentDirection)+"\",\"pumpStatus\":\""+String(pumpRunning?"running":"stopped")+"\",\"servoPosition\":\""+String(servoDown?"down":"up")+"\",\"servoInitialized\":"+
-    String(servoInitialized?"true":"false")+",\"soilMoisture\":"+String(lastSoilReading)+",\"soilStatus\":\""+lastSoilStatus+"\",\"timestamp\":"+String(millis())+"}";
-  server.send(200, "application/json", json);
+  const RoverState& state = control.state();
+  JsonWriter<384> json;
+  json.add("status", "success").add("mode", state.automaticMode?"automatic":"manual").add("movement", getMovementString(state.direction))
+      .add("pumpStatus", state.pumpRunning?"running":"stopped").add("servoPosition", state.servoDown?"down":"up")
+      .add("servoInitialized", state.servoInitialized).add("soilMoisture", state.soilReading).add("soilStatus", state.soilStatus)
+      .add("motorDuty", (unsigned int)state.motorDuty).add("queuedSegments", (unsigned long)state.queuedSegments)
+      .add("poseX", state.x).add("poseY", state.y).add("poseHeading", state.heading)
+      .add("encoders", state.encoders)
+      .add("timestamp", millis());
+  sendJson(server, 200, json);
+}
+// Server-Sent Events stream of state changes, replaces polling /status
+void handleEvents() {
+  if (!telemetry.subscribe(server.client(), millis())) Serial.println("⚠️ /events: no free subscriber slot");
 }
+
+// Only fields that differ from the last published value are sent
+void pushTelemetry() {
+  const RoverState& state = control.state();
+  telemetry.set(FIELD_MODE, state.automaticMode?"automatic":"manual");
+  telemetry.set(FIELD_MOVEMENT, getMovementString(state.direction));
+  telemetry.set(FIELD_PUMP, state.pumpRunning?"running":"stopped");
+  telemetry.set(FIELD_SERVO, state.servoDown?"down":"up");
+  telemetry.setBool(FIELD_SERVO_INIT, state.servoInitialized);
+  telemetry.set(FIELD_SOIL, (long)state.soilReading);
+  telemetry.set(FIELD_SOIL_STATUS, state.soilStatus);
+}
+
 void handlePing() {
-  addCORSHeaders();
-  server.send(200,"application/json", "{\"status\":\"online\",\"device\":\"ESP32 Robot Controller\",\"message\":\"System operational\",\"timestamp\":"+String(millis())+"}");
+  JsonWriter<160> json;
+  json.add("status", "online").add("device", "ESP32 Robot Controller").add("message", "System operational").add("timestamp", millis());
+  sendJson(server, 200, json);
 }
 
-// --- ERROR and CORS ---
-void sendErrorResponse(String cmd, String msg) {
-  addCORSHeaders();
-  server.send(400,"application/json","{\"command\":\""+cmd+"\",\"status\":\"error\",\"message\":\""+msg+"\",\"timestamp\":"+String(millis())+"}");
+// --- ERROR ---
+void sendErrorResponse(const char* cmd, const char* msg) {
+  sendCommandResponse(400, cmd, "error", msg);
 }
-void addCORSHeaders() {
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "GET,POST,OPTIONS");
-  server.sendHeader("Access-Control-Allow-Headers", "Origin, X-Requested-With, Content-Type, Accept");
+void sendCommandResponse(int code, const char* cmd, const char* status, const char* msg) {
+  JsonWriter<192> json;
+  json.add("command", cmd).add("status", status).add("message", msg).add("timestamp", millis());
+  sendJson(server, code, json);
 }
-void handleOptions() {
-  addCORSHeaders(); server.send(204,"text/plain","");
-}
\ No newline at end of file
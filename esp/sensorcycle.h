@@ -0,0 +1,128 @@
+#ifndef SENSORCYCLE_H
+#define SENSORCYCLE_H
+
+// Non-blocking lower -> settle -> sample -> raise sequence for the soil probe servo.
+//
+// The sketch calls begin() to queue a check and tick(millis()) from loop(). tick() never
+// waits; it returns the one action the sketch has to perform right now (move the servo,
+// read the sensors) or CYCLE_IDLE when there is nothing to do yet. The clock is passed in,
+// so the same code runs unchanged on a Linux host against a fake clock.
+
+enum SensorCycleAction {
+  CYCLE_IDLE = 0,      // nothing to do this tick
+  CYCLE_LOWER_SERVO,   // write SERVO_DOWN_ANGLE
+  CYCLE_SAMPLE,        // read the sensors and store the result
+  CYCLE_RAISE_SERVO,   // write SERVO_UP_ANGLE
+  CYCLE_DONE           // sequence finished, result can be published
+};
+
+enum SensorCyclePhase {
+  PHASE_IDLE = 0,
+  PHASE_LOWERING,      // servo is travelling down
+  PHASE_SETTLING,      // probe is in the soil, waiting for the reading to stabilise
+  PHASE_HOLDING,       // sample taken, waiting before the servo goes back up
+  PHASE_RAISING        // servo is travelling up
+};
+
+struct SensorCycleTiming {
+  unsigned long servoTravelMs;   // time the servo needs to reach its position
+  unsigned long settleMs;        // probe stabilisation time before sampling
+  unsigned long holdMs;          // pause after sampling before raising
+};
+
+class SensorCycle {
+public:
+  explicit SensorCycle(const SensorCycleTiming& timing)
+    : timing_(timing), phase_(PHASE_IDLE), pending_(CYCLE_IDLE), phaseStart_(0), servoDown_(false),
+      raiseAfter_(true), tag_(0), nextJobId_(1), activeJobId_(0), lastJobId_(0) {}
+
+  // Queues a new check. Returns the job id, or the id of the job already running
+  // (checks are not stacked, a second request simply joins the running one).
+  unsigned long begin(unsigned long now, bool raiseAfter, int tag = 0) {
+    if (busy()) return activeJobId_;
+    activeJobId_ = nextJobId_++;
+    if (nextJobId_ == 0) nextJobId_ = 1;
+    raiseAfter_ = raiseAfter;
+    tag_ = tag;
+    phaseStart_ = now;
+    phase_ = servoDown_ ? PHASE_SETTLING : PHASE_LOWERING;
+    pending_ = servoDown_ ? CYCLE_IDLE : CYCLE_LOWER_SERVO;
+    return activeJobId_;
+  }
+
+  SensorCycleAction tick(unsigned long now) {
+    if (pending_ != CYCLE_IDLE) {
+      SensorCycleAction action = pending_;
+      pending_ = CYCLE_IDLE;
+      if (action == CYCLE_LOWER_SERVO) servoDown_ = true;
+      if (action == CYCLE_RAISE_SERVO) servoDown_ = false;
+      return action;
+    }
+
+    unsigned long elapsed = now - phaseStart_;
+    switch (phase_) {
+      case PHASE_LOWERING:
+        if (elapsed < timing_.servoTravelMs) return CYCLE_IDLE;
+        enter(PHASE_SETTLING, now);
+        return CYCLE_IDLE;
+
+      case PHASE_SETTLING:
+        if (elapsed < timing_.settleMs) return CYCLE_IDLE;
+        if (raiseAfter_) {
+          enter(PHASE_HOLDING, now);
+        } else {
+          finish();
+          pending_ = CYCLE_DONE;
+        }
+        return CYCLE_SAMPLE;
+
+      case PHASE_HOLDING:
+        if (elapsed < timing_.holdMs) return CYCLE_IDLE;
+        enter(PHASE_RAISING, now);
+        servoDown_ = false;
+        return CYCLE_RAISE_SERVO;
+
+      case PHASE_RAISING:
+        if (elapsed < timing_.servoTravelMs) return CYCLE_IDLE;
+        finish();
+        return CYCLE_DONE;
+
+      default:
+        return CYCLE_IDLE;
+    }
+  }
+
+  // Keeps the cycle in sync when the servo is moved by a manual endpoint.
+  void setServoDown(bool down) { if (!busy()) servoDown_ = down; }
+
+  bool busy() const { return phase_ != PHASE_IDLE || pending_ != CYCLE_IDLE; }
+  bool servoDown() const { return servoDown_; }
+  SensorCyclePhase phase() const { return phase_; }
+  int tag() const { return tag_; }
+  unsigned long activeJobId() const { return busy() ? activeJobId_ : 0; }
+  unsigned long lastCompletedJobId() const { return lastJobId_; }
+
+private:
+  void enter(SensorCyclePhase phase, unsigned long now) {
+    phase_ = phase;
+    phaseStart_ = now;
+  }
+
+  void finish() {
+    phase_ = PHASE_IDLE;
+    lastJobId_ = activeJobId_;
+  }
+
+  SensorCycleTiming timing_;
+  SensorCyclePhase phase_;
+  SensorCycleAction pending_;
+  unsigned long phaseStart_;
+  bool servoDown_;
+  bool raiseAfter_;
+  int tag_;
+  unsigned long nextJobId_;
+  unsigned long activeJobId_;
+  unsigned long lastJobId_;
+};
+
+#endif
@@ -1,18 +1,47 @@
 #include <WiFi.h>
 #include <WebServer.h>
-#include <HTTPClient.h>
 #include <ESP32Servo.h>
 #include <DHT.h>
+#include <LittleFS.h>
+#include <WiFiUdp.h>
+#include <driver/gpio.h>
+#include "sensorcycle.h"
+#include "jsonwriter.h"
+#include "pagestream.h"
+#include "peerlink.h"
+#include "adcfilter.h"
+#include "dhtcache.h"
+#include "zonescheduler.h"
+#include "dosecontroller.h"
+#include "historystore.h"
+#include "binframe.h"
+#include "wifilink.h"
+#include "peerbeacon.h"
+#include "pumpactuator.h"
+#include "soilprobe.h"
+#include "telemetryserver.h"
+#include "sleepcycle.h"
+#include "coretasks.h"
+#include "tracering.h"
 
 // WiFi credentials
 const char* ssid = "SDP";
 const char* password = "123456789";
 
-// Motor ESP32 IP address
-const char* motor_esp32_ip = "10.109.46.244";
+// The web server, WiFi, peers, motor link and history run in the network task on core 0,
+// sensors, servo and pump in loop() on core 1 (coretasks.h)
+
+// Motor ESP32 address, learned from its discovery beacon
+char motorHost[16] = "";
 
 WebServer server(80);
-WiFiClient wifiClient;
+
+// Network join from the cached access point and lease, peers found by their beacons
+WiFiLink<fs::FS> wifi(LittleFS);
+PeerBeacon<WiFiUDP> beacon(PEER_ROLE_STATION, "sensoresp");
+
+// Persistent connection to the motor ESP32 for status notifications
+PeerLink<WiFiClient> motorLink;
 
 // Sensor pins
 #define SOIL_MOISTURE_PIN A0    // GPIO36 - Capacitive soil moisture sensor (analog)
@@ -26,8 +55,20 @@ WiFiClient wifiClient;
 #define DHT_TYPE DHT22
 DHT dht(DHT_PIN, DHT_TYPE);
 
-// Servo setup
-Servo soilServo;
+// Read from loop() every 5 s, handlers only see the published values
+DhtCache<DHT> climate(dht, 5000);
+
+// Sensor history for /history: 4 KB of compressed records in RAM, full blocks logged to LittleFS
+HistoryStore<16> history;
+HistoryLog<fs::LittleFSFS> historyLog(LittleFS);
+const unsigned long HISTORY_SAMPLE_INTERVAL = 60000;   // water level and climate once a minute
+unsigned long lastHistorySample = 0;
+
+// Background ADC sampling: median over 15 samples + EMA, a full window every 300 ms
+AdcFilter<15> soilFilter;
+AdcFilter<15> waterFilter;
+const unsigned long ADC_SAMPLE_INTERVAL = 20;
+unsigned long lastAdcSample = 0;
 
 // Sensor thresholds
 const int DRY_SOIL_THRESHOLD = 2800;    // Higher value = drier soil (adjust based on your sensor)
@@ -35,83 +76,266 @@ const int MIN_WATER_LEVEL = 100;        // Minimum water level to allow pumping
 const int SERVO_DOWN_ANGLE = 90;        // Servo angle to lower sensor into soil
 const int SERVO_UP_ANGLE = 0;           // Servo angle to lift sensor from soil
 
+// Probe on the servo arm, relay active HIGH
+SoilProbe<SOIL_MOISTURE_PIN, SERVO_PIN, Servo> probe(SERVO_UP_ANGLE, SERVO_DOWN_ANGLE);
+PumpActuator<RELAY_PIN, false> pump;
+
 // System states
 bool automaticMode = false;
-bool pumpRunning = false;
-bool servoDown = false;
-unsigned long lastSensorCheck = 0;
-unsigned long pumpStartTime = 0;
-const unsigned long PUMP_DURATION = 5000;      // Pump for 5 seconds when irrigating
-const unsigned long SENSOR_CHECK_INTERVAL = 30000; // Check sensors every 30 seconds in auto mode
+const unsigned long PUMP_DURATION = 5000;      // Longest single pump run
+const unsigned long MIN_PUMP_RUN = 1000;       // Shorter allowances are not worth starting the pump
+const unsigned long DOSE_SOAK_TIME = 3000;     // Wait after a pulse before re-reading the soil
+const int DOSE_MIN_RESPONSE = 40;              // Smaller soil changes are sensor noise
+
+// Irrigation zones (plots the rover visits), checked when due instead of on a fixed interval
+const ZoneConfig ZONES[] = {
+  // name    dry threshold       target  min revisit  max revisit  pump budget per day
+  {"plot-1", DRY_SOIL_THRESHOLD, 2200,   30000,       600000,      120000},
+  {"plot-2", DRY_SOIL_THRESHOLD, 2200,   30000,       600000,      120000},
+  {"plot-3", 3000,               2400,   60000,       900000,       90000},
+};
+// Pump duty: at most 60 s on per 10 min, half of that when the reservoir runs low
+const PumpLimits PUMP_LIMITS = {600000, 60000, MIN_WATER_LEVEL, 2 * MIN_WATER_LEVEL};
+ZoneScheduler<8> zones(PUMP_LIMITS);
+int currentZone = 0;   // plot the rover is parked at, set with /zone?id=
+int pumpZone = 0;      // zone the running pump is charged to
+
+// Irrigation is dosed in pulses towards the zone's target moisture, the probe stays in the
+// soil in between. 150 ADC units per second of pumping is the guess until a zone is learned.
+DoseController<8> dose(DoseTiming{MIN_PUMP_RUN, PUMP_DURATION, DOSE_SOAK_TIME, DOSE_MIN_RESPONSE}, true, 150);
+
+// Servo sequence timing: 1s servo travel, 2s probe settle, 1s hold before raising
+SensorCycle sensorCycle(SensorCycleTiming{1000, 2000, 1000});
+const int CHECK_MANUAL = 0;   // started from /check_sensors
+const int CHECK_AUTO = 1;     // started by automatic mode
 
 // Sensor data structure
 struct SensorData {
   int soilMoisture;
   float temperature;
   float humidity;
+  unsigned long climateAge;   // ms since temperature/humidity were read
   int waterLevel;
   bool needsIrrigation;
-  String status;
+  const char* status;
+};
+
+// Result of the most recent completed sensor check
+SensorData lastCheckData;
+unsigned long lastCheckJobId = 0;
+
+// Requests from the web handlers to the control loop
+enum StationCommandType {
+  CMD_START_PUMP,     // arg: run time in ms
+  CMD_STOP_PUMP,
+  CMD_CHECK,
+  CMD_SERVO_DOWN,
+  CMD_SERVO_UP,
+  CMD_AUTOMATIC,
+  CMD_MANUAL,
+  CMD_SELECT_ZONE     // arg: zone id
+};
+
+struct StationCommand {
+  uint32_t seq;
+  uint8_t type;
+  long arg;
+};
+
+// What the handlers know of the control loop, published after every batch of commands
+// and every STATE_PUBLISH_INTERVAL
+struct StationState {
+  SensorData data;
+  bool climateValid;
+  bool automaticMode;
+  bool pumpRunning;
+  bool servoDown;
+  bool checkBusy;
+  unsigned long checkJobId;       // running sensor check
+  unsigned long lastCheckJobId;
+  SensorData lastCheck;
+  int currentZone;
+  ZoneScheduler<8> zones;
+  DoseController<8> dose;
+
+  StationState(const ZoneScheduler<8>& zones, const DoseController<8>& dose)
+    : data(), climateValid(false), automaticMode(false), pumpRunning(false), servoDown(false), checkBusy(false),
+      checkJobId(0), lastCheckJobId(0), lastCheck(), currentZone(0), zones(zones), dose(dose) {
+    data.status = lastCheck.status = "Starting";
+  }
+
+  int dryThreshold() const { return zones.config(currentZone).dryThreshold; }
+};
+
+ControlLink<StationCommand, StationState> control(StationState(zones, dose));
+const unsigned long STATE_PUBLISH_INTERVAL = 50;
+unsigned long lastStatePublish = 0;
+
+// Work the control loop hands to the network task: history records and motor notifications
+enum StationEventType {
+  EVENT_HISTORY,
+  EVENT_NOTIFY
+};
+
+struct StationEvent {
+  uint8_t type;
+  uint8_t kind;                          // HISTORY_SOIL, ...
+  int32_t values[HISTORY_CHANNELS];
+  const char* message;                   // string literal
+};
+
+SpscQueue<StationEvent, 16> events;
+
+// Sections timed into the trace ring, dumped on /trace (tracering.h)
+enum TraceTag {
+  TRACE_LOOP = 1, TRACE_COMMANDS, TRACE_ADC, TRACE_DHT, TRACE_SENSOR_CYCLE, TRACE_DOSE, TRACE_AUTOMATIC,
+  TRACE_READ_SENSORS, TRACE_PUBLISH, TRACE_NETWORK, TRACE_HTTP, TRACE_NOTIFY, TRACE_HISTORY, TRACE_MOTOR_LINK
+};
+const char* const TRACE_NAMES[] = {
+  "", "loop", "commands", "adc", "dht", "sensor_cycle", "dose", "automatic",
+  "read_sensors", "publish", "network", "http", "notify", "history", "motor_link"
+};
+TraceRing<TRACE_RING> tracer(TRACE_NAMES, sizeof(TRACE_NAMES) / sizeof(TRACE_NAMES[0]));
+
+// Battery mode for solar nodes (sleepcycle.h): wake every 30 s, log a sample, broadcast the
+// batch every 4th wake or when the soil turns dry, deep-sleep in between. No web server or
+// pump (the relay is held off); the probe is lowered once at the cold boot and stays in the
+// soil. Build with -DBATTERY_MODE=1.
+#ifndef BATTERY_MODE
+#define BATTERY_MODE 0
+#endif
+const unsigned long BATTERY_SETTLE_MS = 3000;   // servo travel and probe settle after the cold boot
+
+// Kept in RTC memory through deep sleep
+struct BatteryRetained {
+  AdcFilterState<15> soil;
+  AdcFilterState<15> water;
+  HistoryRetained history;
+  bool dry;   // last sample needed water
+};
+RTC_DATA_ATTR SleepCycle<SLEEP_BATCH> sleepCycle;
+RTC_DATA_ATTR BatteryRetained retained;
+
+// Progress of the current wake
+WiFiUDP reportUdp;
+bool batteryRadio = false;            // joining the network to report
+unsigned long batterySettleUntil = 0;
+uint8_t batterySamples = 0;           // fresh ADC samples this wake
+bool batteryClimateRead = false;
+bool batteryLogged = false;
+bool batteryReported = false;
+unsigned long batteryReportedAt = 0;
+
+// Forward declarations
+void networkTask(void* param);
+void serviceEvents();
+void serviceCommands();
+void applyCommand(const StationCommand& command);
+void publishState();
+bool runCommand(uint8_t type, long arg = 0);
+void sendControlBusy(const char* command);
+void handleRoot();
+void handleStartPump();
+void handleStopPump();
+void handleCheckSensors();
+void sendCheckPending(unsigned long jobId);
+void sendCheckResult(unsigned long jobId, const SensorData& data, int threshold);
+void handleServoDown();
+void handleServoUp();
+void sendServoBusy(const char* command, unsigned long jobId);
+void handleAutomatic();
+void handleManual();
+void handlePing();
+void sendPingBinary(const StationState& state);
+void handleAutomaticIrrigation();
+void serviceSensorCycle();
+void handleManualReading(const SensorData& data);
+void handleAutomaticReading(const SensorData& data);
+SensorData readAllSensors();
+bool sampleAnalogSensors();
+int filteredReading(AdcFilter<15>& filter, int pin);
+const char* getSoilStatus(int moistureValue, int threshold);
+void handleZones();
+void handleSelectZone();
+void handleHistory();
+void handleMetrics();
+void handleTrace();
+void sampleHistory();
+void onHistorySealed(const uint8_t* block, void* context);
+void recordHistory(uint8_t kind, int32_t a, int32_t b, int32_t c = 0);
+bool irrigateCurrentZone(const SensorData& data);
+void serviceDose();
+void cancelDose(const char* reason);
+int dryThreshold();
+void startPump(unsigned long runMs);
+void stopPump();
+void lowerServo();
+void raiseServo();
+void notifyMotorESP(const char* message);
+void sendMotorNotification(const char* message);
+void onPeerFound(const PeerInfo& peer, void* context);
+void onMotorReply(int httpResponseCode, const char* response, void* context);
+void batterySetup();
+void batteryLoop();
+void logBatterySample();
+void startBatteryRadio();
+void enterDeepSleep();
+
+constexpr Route ROUTES[] = {
+  {"/", ROUTE_GET | ROUTE_POST, handleRoot},
+  {"/start", ROUTE_GET, handleStartPump},           // Manual pump start
+  {"/stop", ROUTE_GET, handleStopPump},             // Manual pump stop
+  {"/check_sensors", ROUTE_GET, handleCheckSensors},// Check all sensors
+  {"/automatic", ROUTE_GET, handleAutomatic},       // Enable automatic mode
+  {"/manual", ROUTE_GET, handleManual},             // Disable automatic mode
+  {"/ping", ROUTE_GET, handlePing},                 // Status ping
+  {"/servo_down", ROUTE_GET, handleServoDown},      // Lower servo manually
+  {"/servo_up", ROUTE_GET, handleServoUp},          // Raise servo manually
+  {"/zones", ROUTE_GET, handleZones},               // Zone table and visit plan
+  {"/zone", ROUTE_GET, handleSelectZone},           // Rover arrived at zone ?id=
+  {"/history", ROUTE_GET, handleHistory},           // Downsampled sensor history
+  {"/metrics", ROUTE_GET, handleMetrics},           // Prometheus text: latency, loop, heap
+  {"/trace", ROUTE_GET, handleTrace},               // Slow sections, ?min_us= ?clear=1
 };
+constexpr uint32_t ROUTE_SEED = routeSeed(ROUTES);
+TelemetryServer<WebServer, sizeof(ROUTES) / sizeof(ROUTES[0])> web(server, ROUTES, ROUTE_SEED);
 
 void setup() {
   Serial.begin(115200);
   
+  if (BATTERY_MODE) {
+    batterySetup();
+    return;
+  }
+  
   // Initialize pins
-  pinMode(RELAY_PIN, OUTPUT);
-  pinMode(LED_PIN, OUTPUT);
-  digitalWrite(RELAY_PIN, LOW);  // Ensure pump is off
-  digitalWrite(LED_PIN, LOW);
+  pump.begin(PUMP_DURATION);  // Ensure pump is off; no run outlasts PUMP_DURATION
   
-  // Initialize servo
-  soilServo.attach(SERVO_PIN);
-  soilServo.write(SERVO_UP_ANGLE);  // Start with servo up
-  servoDown = false;
+  // Initialize servo, start with it up
+  probe.begin();
   
   // Initialize DHT sensor
   dht.begin();
   
-  // Connect to WiFi
-  WiFi.begin(ssid, password);
-  Serial.print("Connecting to WiFi");
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
-    digitalWrite(LED_PIN, !digitalRead(LED_PIN)); // Blink LED while connecting
-  }
-  Serial.println(" connected!");
-  Serial.print("Sensor ESP32 IP address: ");
-  Serial.println(WiFi.localIP());
-  digitalWrite(LED_PIN, HIGH); // Solid LED when connected
-  
-  // Disable WiFi sleep mode for faster response
-  WiFi.setSleep(false);
-  Serial.println("WiFi sleep mode disabled for faster response");
-  
-  // Setup web server routes
-  server.on("/", handleRoot);
-  server.on("/start", HTTP_GET, handleStartPump);           // Manual pump start
-  server.on("/stop", HTTP_GET, handleStopPump);             // Manual pump stop
-  server.on("/check_sensors", HTTP_GET, handleCheckSensors);// Check all sensors
-  server.on("/automatic", HTTP_GET, handleAutomatic);       // Enable automatic mode
-  server.on("/manual", HTTP_GET, handleManual);             // Disable automatic mode
-  server.on("/ping", HTTP_GET, handlePing);                 // Status ping
-  server.on("/servo_down", HTTP_GET, handleServoDown);      // Lower servo manually
-  server.on("/servo_up", HTTP_GET, handleServoUp);          // Raise servo manually
-  
-  // Add OPTIONS handler for CORS preflight requests
-  server.on("/start", HTTP_OPTIONS, handleOptions);
-  server.on("/stop", HTTP_OPTIONS, handleOptions);
-  server.on("/check_sensors", HTTP_OPTIONS, handleOptions);
-  server.on("/automatic", HTTP_OPTIONS, handleOptions);
-  server.on("/manual", HTTP_OPTIONS, handleOptions);
-  server.on("/ping", HTTP_OPTIONS, handleOptions);
-  
-  // Enable CORS for all routes
-  server.enableCORS(true);
-  
-  server.begin();
+  for (size_t i = 0; i < sizeof(ZONES) / sizeof(ZONES[0]); i++) zones.addZone(ZONES[i]);
+  
+  // History of earlier boots stays in the flash log; without it only RAM is kept
+  uint16_t boot = 1;
+  if (LittleFS.begin(true)) boot = historyLog.begin();
+  else Serial.println("⚠️ LittleFS mount failed - sensor history kept in RAM only");
+  history.begin(boot, millis());
+  history.onSeal(onHistorySealed);
+  
+  // WiFi joins in the background from loop() (cache on LittleFS); LED blinks until connected
+  wifi.begin(ssid, password, LED_PIN);
+  beacon.begin();
+  beacon.onPeer(onPeerFound);
+  motorLink.measure(&web.metrics().peerRtt());
+  
+  // Web server routes (ROUTES), with CORS and preflight for all of them
+  web.begin();
   Serial.println("HTTP server started with CORS support");
+  
   Serial.println("\n=== ESP32 Sensor System Ready ===");
   Serial.println("Sensors: Soil Moisture, DHT22, Water Level");
   Serial.println("Actuators: Servo, Pump Relay");
@@ -123,377 +347,761 @@ void setup() {
   Serial.println("- Relay: GPIO19");
   Serial.println("- LED: GPIO2");
   Serial.println("=====================================\n");
+  
+  // The handlers see a valid state from their first request on
+  publishState();
+  enableLoopWatchdog();
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, NULL, NETWORK_TASK_PRIORITY, NULL, NETWORK_CORE);
 }
 
+// Control loop: every pass takes the queued commands and checks the pump timer first, so
+// the pump stops on time however busy the network is; the slowest pass is a DHT22 read
+// (~5 ms, every 5 s)
+
 void loop() {
-  server.handleClient();
+  if (BATTERY_MODE) {
+    batteryLoop();
+    return;
+  }
+  
+  web.metrics().tickLoop(micros());
+  TRACE_SCOPE(TRACE_LOOP);
+  
+  // Commands from the web handlers
+  serviceCommands();
+  
+  // Book the pump run the interlock ended (timer interrupt or low water)
+  if (pump.due(millis())) {
+    stopPump();
+    if (pump.lowWater()) Serial.println("🛑 Pump stopped - water level too low");
+    else Serial.printf("🛑 Pump auto-stopped after %lu ms\n", pump.runMs());
+  }
+  
+  // Keep the filtered soil/water values current
+  sampleAnalogSensors();
+  
+  // Refresh the cached DHT22 reading when it is due
+  {
+    TRACE_SCOPE(TRACE_DHT);
+    if (climate.tick(millis()) && climate.failures() > 0) {
+      Serial.printf("⚠️ DHT22 read failed (%u in a row) - keeping last good values\n", climate.failures());
+    }
+  }
+  
+  // Advance the servo/sensor sequence without blocking
+  serviceSensorCycle();
+  
+  // Pulse the pump and re-sample while a dose is running
+  serviceDose();
   
   // Handle automatic mode logic
   if (automaticMode) {
     handleAutomaticIrrigation();
   }
   
-  // Handle pump timer (auto stop after duration)
-  if (pumpRunning && (millis() - pumpStartTime >= PUMP_DURATION)) {
-    stopPump();
-    Serial.println("🛑 Pump auto-stopped after " + String(PUMP_DURATION/1000) + " seconds");
+  if (millis() - lastStatePublish >= STATE_PUBLISH_INTERVAL) publishState();
+}
+
+// Network task on core 0: web requests, WiFi, peers, and the history records and motor
+// notifications queued by the control loop
+void networkTask(void* /*param*/) {
+  for (;;) {
+    {
+      TRACE_SCOPE(TRACE_NETWORK);
+      {
+        TRACE_SCOPE(TRACE_HTTP);
+        web.handleClient();
+      }
+      wifi.tick(millis());
+      beacon.tick(millis(), wifi.connected());
+      serviceEvents();
+      
+      // Log a climate sample when due and seal old history blocks
+      sampleHistory();
+      
+      // Send queued motor notifications and collect replies
+      {
+        TRACE_SCOPE(TRACE_MOTOR_LINK);
+        motorLink.tick(millis());
+      }
+    }
+    vTaskDelay(1);
+  }
+}
+
+void serviceEvents() {
+  TRACE_SCOPE(TRACE_NOTIFY);
+  StationEvent event;
+  while (events.pop(&event)) {
+    if (event.type == EVENT_HISTORY) history.record(event.kind, event.values, millis());
+    else sendMotorNotification(event.message);
+  }
+}
+
+void serviceCommands() {
+  TRACE_SCOPE(TRACE_COMMANDS);
+  StationCommand command;
+  bool applied = false;
+  while (control.next(&command)) {
+    applyCommand(command);
+    applied = true;
+  }
+  if (applied) publishState();
+}
+
+void applyCommand(const StationCommand& command) {
+  switch (command.type) {
+    case CMD_START_PUMP:
+      startPump((unsigned long)command.arg);
+      break;
+      
+    case CMD_STOP_PUMP:
+      cancelDose("pump stopped manually");
+      stopPump();
+      break;
+      
+    case CMD_CHECK: {
+      bool alreadyRunning = sensorCycle.busy();
+      unsigned long jobId = sensorCycle.begin(millis(), !automaticMode, CHECK_MANUAL);
+      if (!alreadyRunning) {
+        Serial.println("🔍 Sensor check requested - Starting servo sequence (job " + String(jobId) + ")");
+      }
+      break;
+    }
+      
+    // The running sensor check owns the servo; the handler sees checkBusy and says so
+    case CMD_SERVO_DOWN:
+      if (!sensorCycle.busy()) lowerServo();
+      break;
+      
+    case CMD_SERVO_UP:
+      if (!sensorCycle.busy()) raiseServo();
+      break;
+      
+    case CMD_AUTOMATIC:
+      automaticMode = true;
+      break;
+      
+    case CMD_MANUAL:
+      automaticMode = false;
+      cancelDose("manual mode");
+      // Raise servo if it's down (a running check raises it on its own)
+      if (probe.isDown() && !sensorCycle.busy()) {
+        raiseServo();
+        Serial.println("⬆️ Servo raised when switching to manual mode");
+      }
+      break;
+      
+    case CMD_SELECT_ZONE:
+      if (!zones.valid((int)command.arg)) break;
+      if (command.arg != currentZone) cancelDose("rover moved to another zone");
+      currentZone = (int)command.arg;
+      break;
+      
+    default:
+      break;
   }
 }
 
+void publishState() {
+  TRACE_SCOPE(TRACE_PUBLISH);
+  StationState& state = control.edit();
+  state.data = readAllSensors();
+  state.climateValid = climate.valid();
+  state.automaticMode = automaticMode;
+  state.pumpRunning = pump.running();
+  state.servoDown = probe.isDown();
+  state.checkBusy = sensorCycle.busy();
+  state.checkJobId = sensorCycle.activeJobId();
+  state.lastCheckJobId = lastCheckJobId;
+  state.lastCheck = lastCheckData;
+  state.currentZone = currentZone;
+  state.zones = zones;
+  state.dose = dose;
+  control.publish();
+  lastStatePublish = millis();
+}
+
+// Hands a command to the control loop and waits until it is applied
+bool runCommand(uint8_t type, long arg) {
+  StationCommand command = {0, type, arg};
+  return control.run(command);
+}
+
+// Command queue full, or the control loop did not get to it in time
+void sendControlBusy(const char* command) {
+  JsonWriter<192> response;
+  response.add("command", command);
+  response.add("status", "error");
+  response.add("message", "Controller busy - try again");
+  response.addQuoted("timestamp", millis());
+  
+  sendJson(server, 503, response);
+}
+
+// Dashboard page, static parts kept in flash and streamed around the live values. The
+// ETag covers state only, so an unchanged page is a 304; the browser stamps the time it
+// loaded the page itself.
+const uint32_t ROOT_PAGE_VERSION = 2;
+
+static const char ROOT_HEAD[] PROGMEM =
+  "<html><head><title>ESP32 Sensor Control</title>"
+  "<style>body{font-family:Arial;margin:40px;} h1{color:#2E8B57;} p{margin:10px 0;} a{color:#1E90FF;text-decoration:none;margin:5px;} a:hover{text-decoration:underline;}</style>"
+  "</head><body>"
+  "<h1>🌱 ESP32 Irrigation Sensor System</h1>"
+  "<h2>Current Sensor Readings:</h2>"
+  "<p>🌡️ Temperature: <b>";
+static const char ROOT_HUMIDITY[] PROGMEM = "°C</b></p><p>💧 Humidity: <b>";
+static const char ROOT_SOIL[] PROGMEM = "%</b></p><p>🌱 Soil Moisture: <b>";
+static const char ROOT_WATER[] PROGMEM = ")</p><p>🚰 Water Level: <b>";
+static const char ROOT_MODE[] PROGMEM = "</b></p><p>⚙️ Mode: <b>";
+static const char ROOT_PUMP[] PROGMEM = "</b></p><p>💦 Pump: <b>";
+static const char ROOT_SERVO[] PROGMEM = "</b></p><p>🔧 Servo: <b>";
+static const char ROOT_MOTOR[] PROGMEM = "</b></p><p>📡 Motor ESP32: <b>";
+static const char ROOT_CONTROLS[] PROGMEM =
+  "</b></p>"
+  "<h2>Manual Controls:</h2>"
+  "<p><a href='/start' style='background:#28a745;color:white;padding:10px;border-radius:5px;'>🟢 Start Pump</a>"
+  " <a href='/stop' style='background:#dc3545;color:white;padding:10px;border-radius:5px;'>🔴 Stop Pump</a></p>"
+  "<p><a href='/servo_down'>⬇️ Servo Down</a> | <a href='/servo_up'>⬆️ Servo Up</a></p>"
+  "<p><a href='/check_sensors'>🔍 Check Sensors</a></p>"
+  "<p><a href='/automatic'>🤖 Auto Mode</a> | <a href='/manual'>👤 Manual Mode</a></p>"
+  "<h2>System Thresholds:</h2>"
+  "<p>Dry Soil Threshold: <b>";
+static const char ROOT_MIN_WATER[] PROGMEM = "</b></p><p>Min Water Level: <b>";
+static const char ROOT_DURATION[] PROGMEM = "</b></p><p>Pump Duration: <b>";
+static const char ROOT_STATUS[] PROGMEM = " seconds</b></p><h2>Status Messages:</h2><p><b>";
+static const char ROOT_TAIL[] PROGMEM =
+  "</b></p><p><small>Last updated: <span id='loaded'></span></small></p>"
+  "<script>document.getElementById('loaded').textContent=new Date().toLocaleTimeString();</script>"
+  "</body></html>";
+
 void handleRoot() {
-  SensorData data = readAllSensors();
+  const StationState& state = control.state();
+  const SensorData& data = state.data;
+  
+  PageTag tag(ROOT_PAGE_VERSION);
+  if (state.climateValid) tag.mix((long)(data.temperature * 10)).mix((long)(data.humidity * 10));
+  tag.mix(data.soilMoisture).mix(data.waterLevel);
+  tag.mix(state.automaticMode).mix(state.pumpRunning).mix(state.servoDown);
+  tag.mix(state.currentZone).mix(motorHost).mix(data.status);
+  if (pageNotModified(server, tag)) return;
   
-  String html = "<html><head><title>ESP32 Sensor Control</title>";
-  html += "<style>body{font-family:Arial;margin:40px;} h1{color:#2E8B57;} p{margin:10px 0;} a{color:#1E90FF;text-decoration:none;margin:5px;} a:hover{text-decoration:underline;}</style>";
-  html += "</head><body>";
-  html += "<h1>🌱 ESP32 Irrigation Sensor System</h1>";
-  html += "<h2>Current Sensor Readings:</h2>";
-  html += "<p>🌡️ Temperature: <b>" + String(data.temperature, 1) + "°C</b></p>";
-  html += "<p>💧 Humidity: <b>" + String(data.humidity, 1) + "%</b></p>";
-  html += "<p>🌱 Soil Moisture: <b>" + String(data.soilMoisture) + "</b> (" + getSoilStatus(data.soilMoisture) + ")</p>";
-  html += "<p>🚰 Water Level: <b>" + String(data.waterLevel) + "</b></p>";
-  html += "<p>⚙️ Mode: <b>" + String(automaticMode ? "Automatic" : "Manual") + "</b></p>";
-  html += "<p>💦 Pump: <b>" + String(pumpRunning ? "Running" : "Stopped") + "</b></p>";
-  html += "<p>🔧 Servo: <b>" + String(servoDown ? "Down (sensing)" : "Up (idle)") + "</b></p>";
-  html += "<p>📡 Motor ESP32: <b>" + String(motor_esp32_ip) + "</b></p>";
-  
-  html += "<h2>Manual Controls:</h2>";
-  html += "<p><a href='/start' style='background:#28a745;color:white;padding:10px;border-radius:5px;'>🟢 Start Pump</a>";
-  html += " <a href='/stop' style='background:#dc3545;color:white;padding:10px;border-radius:5px;'>🔴 Stop Pump</a></p>";
-  html += "<p><a href='/servo_down'>⬇️ Servo Down</a> | <a href='/servo_up'>⬆️ Servo Up</a></p>";
-  html += "<p><a href='/check_sensors'>🔍 Check Sensors</a></p>";
-  html += "<p><a href='/automatic'>🤖 Auto Mode</a> | <a href='/manual'>👤 Manual Mode</a></p>";
-  
-  html += "<h2>System Thresholds:</h2>";
-  html += "<p>Dry Soil Threshold: <b>" + String(DRY_SOIL_THRESHOLD) + "</b></p>";
-  html += "<p>Min Water Level: <b>" + String(MIN_WATER_LEVEL) + "</b></p>";
-  html += "<p>Pump Duration: <b>" + String(PUMP_DURATION/1000) + " seconds</b></p>";
-  
-  html += "<h2>Status Messages:</h2>";
-  html += "<p><b>" + data.status + "</b></p>";
-  
-  html += "<p><small>Last updated: " + String(millis()/1000) + " seconds since boot</small></p>";
-  html += "</body></html>";
-  
-  // Add CORS headers
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-  server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-  
-  server.send(200, "text/html", html);
+  PageStream<WebServer> page(server);
+  page.begin();
+  page.progmem(ROOT_HEAD);
+  if (state.climateValid) page.print(data.temperature, 1); else page.print("--");
+  page.progmem(ROOT_HUMIDITY);
+  if (state.climateValid) page.print(data.humidity, 1); else page.print("--");
+  page.progmem(ROOT_SOIL);
+  page.print((long)data.soilMoisture);
+  page.print("</b> (");
+  page.print(getSoilStatus(data.soilMoisture, state.dryThreshold()));
+  page.progmem(ROOT_WATER);
+  page.print((long)data.waterLevel);
+  page.progmem(ROOT_MODE);
+  page.print(state.automaticMode ? "Automatic" : "Manual");
+  page.progmem(ROOT_PUMP);
+  page.print(state.pumpRunning ? "Running" : "Stopped");
+  page.progmem(ROOT_SERVO);
+  page.print(state.servoDown ? "Down (sensing)" : "Up (idle)");
+  page.progmem(ROOT_MOTOR);
+  page.print(motorHost[0] ? motorHost : "searching...");
+  page.progmem(ROOT_CONTROLS);
+  page.print((long)state.dryThreshold());
+  page.progmem(ROOT_MIN_WATER);
+  page.print((long)MIN_WATER_LEVEL);
+  page.progmem(ROOT_DURATION);
+  page.print((long)(PUMP_DURATION/1000));
+  page.progmem(ROOT_STATUS);
+  page.print(data.status);
+  page.progmem(ROOT_TAIL);
+  page.end();
+}
+
+void handleMetrics() {
+  web.sendMetrics();
+}
+
+void handleTrace() {
+  sendTrace(server, tracer);
 }
 
 void handleStartPump() {
-  // Add CORS headers
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-  server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-  
-  SensorData data = readAllSensors();
+  int waterLevel = control.state().data.waterLevel;
   
-  if (data.waterLevel < MIN_WATER_LEVEL) {
-    String response = "{";
-    response += "\"command\":\"start_pump\",";
-    response += "\"status\":\"error\",";
-    response += "\"message\":\"Water level too low for pumping\",";
-    response += "\"waterLevel\":" + String(data.waterLevel) + ",";
-    response += "\"requiredLevel\":" + String(MIN_WATER_LEVEL) + ",";
-    response += "\"timestamp\":\"" + String(millis()) + "\"";
-    response += "}";
+  if (waterLevel < MIN_WATER_LEVEL) {
+    JsonWriter<256> response;
+    response.add("command", "start_pump");
+    response.add("status", "error");
+    response.add("message", "Water level too low for pumping");
+    response.add("waterLevel", waterLevel);
+    response.add("requiredLevel", MIN_WATER_LEVEL);
+    response.addQuoted("timestamp", millis());
     
-    server.send(400, "application/json", response);
-    Serial.println("❌ Pump start denied - Low water level: " + String(data.waterLevel) + " (min: " + String(MIN_WATER_LEVEL) + ")");
+    sendJson(server, 400, response);
+    Serial.println("❌ Pump start denied - Low water level: " + String(waterLevel) + " (min: " + String(MIN_WATER_LEVEL) + ")");
     return;
   }
   
-  startPump();
+  if (!runCommand(CMD_START_PUMP, PUMP_DURATION)) {
+    sendControlBusy("start_pump");
+    return;
+  }
   
-  String response = "{";
-  response += "\"command\":\"start_pump\",";
-  response += "\"status\":\"success\",";
-  response += "\"pumpStatus\":\"running\",";
-  response += "\"waterLevel\":" + String(data.waterLevel) + ",";
-  response += "\"duration\":" + String(PUMP_DURATION) + ",";
-  response += "\"timestamp\":\"" + String(millis()) + "\"";
-  response += "}";
+  JsonWriter<256> response;
+  response.add("command", "start_pump");
+  response.add("status", "success");
+  response.add("pumpStatus", "running");
+  response.add("waterLevel", waterLevel);
+  response.add("duration", PUMP_DURATION);
+  response.addQuoted("timestamp", millis());
   
-  server.send(200, "application/json", response);
-  Serial.println("✅ Manual pump start - Water level OK: " + String(data.waterLevel));
+  sendJson(server, 200, response);
+  Serial.println("✅ Manual pump start - Water level OK: " + String(waterLevel));
 }
 
 void handleStopPump() {
-  // Add CORS headers
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-  server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-  
-  stopPump();
-  
-  String response = "{";
-  response += "\"command\":\"stop_pump\",";
-  response += "\"status\":\"success\",";
-  response += "\"pumpStatus\":\"stopped\",";
-  response += "\"message\":\"Pump manually stopped\",";
-  response += "\"timestamp\":\"" + String(millis()) + "\"";
-  response += "}";
-  
-  server.send(200, "application/json", response);
+  if (!runCommand(CMD_STOP_PUMP)) {
+    sendControlBusy("stop_pump");
+    return;
+  }
+  
+  JsonWriter<256> response;
+  response.add("command", "stop_pump");
+  response.add("status", "success");
+  response.add("pumpStatus", "stopped");
+  response.add("message", "Pump manually stopped");
+  response.addQuoted("timestamp", millis());
+  
+  sendJson(server, 200, response);
   Serial.println("✅ Manual pump stop");
 }
 
 void handleCheckSensors() {
-  // Add CORS headers
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-  server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-  
-  Serial.println("🔍 Sensor check requested - Starting servo sequence");
-  
-  // Step 1: Lower servo to check soil
-  if (!servoDown) {
-    lowerServo();
-    delay(2000); // Wait for servo to reach position and soil sensor to stabilize
+  // Poll for the result of a running or finished check
+  if (server.hasArg("job")) {
+    unsigned long jobId = strtoul(server.arg("job").c_str(), NULL, 10);
+    const StationState& state = control.state();
+    if (jobId != 0 && jobId == state.lastCheckJobId) {
+      sendCheckResult(jobId, state.lastCheck, state.dryThreshold());
+    } else if (jobId != 0 && jobId == state.checkJobId) {
+      sendCheckPending(jobId);
+    } else {
+      JsonWriter<256> response;
+      response.add("command", "check_sensors");
+      response.add("status", "error");
+      response.add("message", "Unknown sensor check job");
+      response.add("jobId", jobId);
+      response.addQuoted("timestamp", millis());
+      sendJson(server, 404, response);
+    }
+    return;
   }
   
-  // Step 2: Read all sensors
-  SensorData data = readAllSensors();
-  Serial.println("📊 Sensor reading complete - Soil: " + String(data.soilMoisture) + 
-                 " (" + getSoilStatus(data.soilMoisture) + "), Water: " + String(data.waterLevel));
-  
-  // Step 3: Raise servo after reading (unless in automatic mode)
-  if (servoDown && !automaticMode) {
-    delay(1000);
-    raiseServo();
-    Serial.println("⬆️ Servo raised after manual sensor check");
+  // Start the servo sequence; the result is picked up with /check_sensors?job=<id>
+  if (!runCommand(CMD_CHECK)) {
+    sendControlBusy("check_sensors");
+    return;
   }
+  sendCheckPending(control.state().checkJobId);
+}
+
+void sendCheckPending(unsigned long jobId) {
+  char poll[40];
+  snprintf(poll, sizeof(poll), "/check_sensors?job=%lu", jobId);
   
-  String response = "{";
-  response += "\"command\":\"check_sensors\",";
-  response += "\"status\":\"success\",";
-  response += "\"soilMoisture\":" + String(data.soilMoisture) + ",";
-  response += "\"soilStatus\":\"" + getSoilStatus(data.soilMoisture) + "\",";
-  response += "\"temperature\":" + String(data.temperature, 1) + ",";
-  response += "\"humidity\":" + String(data.humidity, 1) + ",";
-  response += "\"waterLevel\":" + String(data.waterLevel) + ",";
-  response += "\"needsIrrigation\":" + String(data.needsIrrigation ? "true" : "false") + ",";
-  response += "\"irrigated\":" + String(data.needsIrrigation ? "true" : "false") + ",";
-  response += "\"message\":\"" + data.status + "\",";
-  response += "\"servoMoved\":\"true\",";
-  response += "\"timestamp\":\"" + String(millis()) + "\"";
-  response += "}";
+  JsonWriter<256> response;
+  response.add("command", "check_sensors");
+  response.add("status", "pending");
+  response.add("jobId", jobId);
+  response.add("poll", poll);
+  response.addQuoted("timestamp", millis());
   
-  server.send(200, "application/json", response);
-  Serial.println("📊 Sensor check completed: " + data.status);
+  sendJson(server, 202, response);
+}
+
+void sendCheckResult(unsigned long jobId, const SensorData& data, int threshold) {
+  JsonWriter<384> response;
+  response.add("command", "check_sensors");
+  response.add("status", "success");
+  response.add("jobId", jobId);
+  response.add("soilMoisture", data.soilMoisture);
+  response.add("soilStatus", getSoilStatus(data.soilMoisture, threshold));
+  response.add("temperature", data.temperature, 1);
+  response.add("humidity", data.humidity, 1);
+  response.add("climateAgeMs", data.climateAge);
+  response.add("waterLevel", data.waterLevel);
+  response.add("needsIrrigation", data.needsIrrigation);
+  response.add("irrigated", data.needsIrrigation);
+  response.add("message", data.status);
+  response.add("servoMoved", "true");
+  response.addQuoted("timestamp", millis());
   
-  // Step 4: If irrigation needed and water available, start pump
-  if (data.needsIrrigation && data.waterLevel >= MIN_WATER_LEVEL && !pumpRunning) {
-    startPump();
-    Serial.println("💧 Auto-irrigation started based on sensor reading");
-  }
+  sendJson(server, 200, response);
 }
 
 void handleServoDown() {
-  // Add CORS headers
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-  server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-  
-  lowerServo();
-  
-  String response = "{";
-  response += "\"command\":\"servo_down\",";
-  response += "\"status\":\"success\",";
-  response += "\"servoPosition\":\"down\",";
-  response += "\"angle\":" + String(SERVO_DOWN_ANGLE) + ",";
-  response += "\"timestamp\":\"" + String(millis()) + "\"";
-  response += "}";
-  
-  server.send(200, "application/json", response);
+  if (!runCommand(CMD_SERVO_DOWN)) {
+    sendControlBusy("servo_down");
+    return;
+  }
+  const StationState& state = control.state();
+  if (state.checkBusy) {
+    sendServoBusy("servo_down", state.checkJobId);
+    return;
+  }
+  
+  JsonWriter<256> response;
+  response.add("command", "servo_down");
+  response.add("status", "success");
+  response.add("servoPosition", "down");
+  response.add("angle", SERVO_DOWN_ANGLE);
+  response.addQuoted("timestamp", millis());
+  
+  sendJson(server, 200, response);
   Serial.println("⬇️ Servo manually lowered to " + String(SERVO_DOWN_ANGLE) + "°");
 }
 
 void handleServoUp() {
-  // Add CORS headers
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-  server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-  
-  raiseServo();
-  
-  String response = "{";
-  response += "\"command\":\"servo_up\",";
-  response += "\"status\":\"success\",";
-  response += "\"servoPosition\":\"up\",";
-  response += "\"angle\":" + String(SERVO_UP_ANGLE) + ",";
-  response += "\"timestamp\":\"" + String(millis()) + "\"";
-  response += "}";
-  
-  server.send(200, "application/json", response);
+  if (!runCommand(CMD_SERVO_UP)) {
+    sendControlBusy("servo_up");
+    return;
+  }
+  const StationState& state = control.state();
+  if (state.checkBusy) {
+    sendServoBusy("servo_up", state.checkJobId);
+    return;
+  }
+  
+  JsonWriter<256> response;
+  response.add("command", "servo_up");
+  response.add("status", "success");
+  response.add("servoPosition", "up");
+  response.add("angle", SERVO_UP_ANGLE);
+  response.addQuoted("timestamp", millis());
+  
+  sendJson(server, 200, response);
   Serial.println("⬆️ Servo manually raised to " + String(SERVO_UP_ANGLE) + "°");
 }
 
+void sendServoBusy(const char* command, unsigned long jobId) {
+  JsonWriter<256> response;
+  response.add("command", command);
+  response.add("status", "error");
+  response.add("message", "Sensor check in progress");
+  response.add("jobId", jobId);
+  response.addQuoted("timestamp", millis());
+  
+  sendJson(server, 409, response);
+}
+
 void handleAutomatic() {
-  // Add CORS headers
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-  server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-  
-  automaticMode = true;
-  lastSensorCheck = 0; // Force immediate sensor check
-  
-  String response = "{";
-  response += "\"command\":\"automatic\",";
-  response += "\"status\":\"success\",";
-  response += "\"mode\":\"automatic\",";
-  response += "\"message\":\"Automatic irrigation mode enabled\",";
-  response += "\"checkInterval\":" + String(SENSOR_CHECK_INTERVAL/1000) + ",";
-  response += "\"timestamp\":\"" + String(millis()) + "\"";
-  response += "}";
-  
-  server.send(200, "application/json", response);
-  Serial.println("🤖 Automatic irrigation mode enabled - Check interval: " + String(SENSOR_CHECK_INTERVAL/1000) + "s");
+  if (!runCommand(CMD_AUTOMATIC)) {
+    sendControlBusy("automatic");
+    return;
+  }
+  const StationState& state = control.state();
+  const ZoneConfig& zone = state.zones.config(state.currentZone);
+  
+  JsonWriter<256> response;
+  response.add("command", "automatic");
+  response.add("status", "success");
+  response.add("mode", "automatic");
+  response.add("message", "Automatic irrigation mode enabled");
+  response.add("checkInterval", zone.minRevisitMs/1000);
+  response.add("zone", zone.name);
+  response.addQuoted("timestamp", millis());
+  
+  sendJson(server, 200, response);
+  Serial.printf("🤖 Automatic irrigation mode enabled - Zone: %s\n", zone.name);
   
   // Notify motor ESP32 that we're in automatic mode
-  notifyMotorESP("sensor_ready");
+  sendMotorNotification("sensor_ready");
 }
 
 void handleManual() {
-  // Add CORS headers
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-  server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-  
-  automaticMode = false;
-  
-  // Raise servo if it's down
-  if (servoDown) {
-    raiseServo();
-    Serial.println("⬆️ Servo raised when switching to manual mode");
+  if (!runCommand(CMD_MANUAL)) {
+    sendControlBusy("manual");
+    return;
   }
   
-  String response = "{";
-  response += "\"command\":\"manual\",";
-  response += "\"status\":\"success\",";
-  response += "\"mode\":\"manual\",";
-  response += "\"message\":\"Manual control mode enabled\",";
-  response += "\"timestamp\":\"" + String(millis()) + "\"";
-  response += "}";
+  JsonWriter<256> response;
+  response.add("command", "manual");
+  response.add("status", "success");
+  response.add("mode", "manual");
+  response.add("message", "Manual control mode enabled");
+  response.addQuoted("timestamp", millis());
   
-  server.send(200, "application/json", response);
+  sendJson(server, 200, response);
   Serial.println("👤 Manual control mode enabled");
   
   // Notify motor ESP32 that we're in manual mode
-  notifyMotorESP("manual_mode");
+  sendMotorNotification("manual_mode");
+}
+
+void handleZones() {
+  const StationState& state = control.state();
+  JsonWriter<256 + zonesJsonBytes(8)> response;
+  response.add("status", "success");
+  response.add("currentZone", state.currentZone);
+  response.add("dutyUsedMs", state.zones.dutyUsedMs());
+  response.add("dutyLimitMs", state.zones.limits().maxOnMs);
+  response.add("dosing", state.dose.active());
+  response.add("doseGain", state.dose.gain(state.currentZone));
+  response.add("dosePulses", state.dose.pulses());
+  response.add("dosePumpedMs", state.dose.pumpedMs());
+  response.add("doseResult", DoseController<8>::resultName(state.dose.result()));
+  addZonesJson(response, state.zones, millis());
+  response.addQuoted("timestamp", millis());
+  
+  sendJson(server, 200, response);
+}
+
+void handleSelectZone() {
+  int zone = server.hasArg("id") ? server.arg("id").toInt() : -1;
+  if (!control.state().zones.valid(zone)) {
+    JsonWriter<128> response;
+    response.add("command", "zone");
+    response.add("status", "error");
+    response.add("message", "Unknown zone id");
+    sendJson(server, 400, response);
+    return;
+  }
+  
+  if (!runCommand(CMD_SELECT_ZONE, zone)) {
+    sendControlBusy("zone");
+    return;
+  }
+  const ZoneScheduler<8>& zones = control.state().zones;
+  JsonWriter<192> response;
+  response.add("command", "zone");
+  response.add("status", "success");
+  response.add("zone", zone);
+  response.add("name", zones.config(zone).name);
+  response.add("due", zones.due(zone, millis()));
+  response.addQuoted("timestamp", millis());
+  sendJson(server, 200, response);
+  Serial.printf("📍 Rover at zone %s\n", zones.config(zone).name);
+}
+
+// GET /history?from=&to=&step=&zone=&boot= - times in seconds since boot, negative ones
+// relative to now (default: the last hour). At most 60 points per series come back.
+void handleHistory() {
+  uint32_t now = history.seconds(millis());
+  uint32_t from = historyTime(server.hasArg("from") ? server.arg("from").toInt() : -3600, now);
+  uint32_t to = server.hasArg("to") ? historyTime(server.arg("to").toInt(), now) : now + 1;
+  if (to <= from) {
+    JsonWriter<128> response;
+    response.add("command", "history");
+    response.add("status", "error");
+    response.add("message", "Empty time range");
+    sendJson(server, 400, response);
+    return;
+  }
+  long step = server.hasArg("step") ? server.arg("step").toInt() : 0;
+  int zone = server.hasArg("zone") ? server.arg("zone").toInt() : -1;
+  uint16_t boot = server.hasArg("boot") ? (uint16_t)server.arg("boot").toInt() : history.boot();
+  
+  // Static: the buckets take about 2 KB
+  static HistoryQuery<60> query;
+  query.begin(from, to, step > 0 ? (uint32_t)step : 0, zone);
+  collectHistory(history, historyLog, boot, query);
+  if (wantsBinary(server)) sendHistoryBinary(server, query, boot, now);
+  else sendHistoryJson(server, query, boot, now);
+}
+
+void sampleHistory() {
+  TRACE_SCOPE(TRACE_HISTORY);
+  history.tick(millis());
+  if (millis() - lastHistorySample < HISTORY_SAMPLE_INTERVAL) return;
+  lastHistorySample = millis();
+  
+  // The soil is logged by the sensor checks only, with the probe in the ground
+  const SensorData& data = control.state().data;
+  float temperature = data.temperature;
+  float humidity = data.humidity;
+  history.record(HISTORY_CLIMATE, data.waterLevel,
+                 isnan(temperature) ? HISTORY_MISSING : (int32_t)lroundf(temperature * 10),
+                 isnan(humidity) ? HISTORY_MISSING : (int32_t)lroundf(humidity * 10), millis());
+}
+
+void onHistorySealed(const uint8_t* block, void* /*context*/) {
+  if (historyLog.ready() && !historyLog.append(block)) {
+    Serial.println("⚠️ History block could not be written to flash");
+  }
+}
+
+// Control loop side: the network task writes the record
+void recordHistory(uint8_t kind, int32_t a, int32_t b, int32_t c) {
+  StationEvent event = {EVENT_HISTORY, kind, {a, b, c}, NULL};
+  if (!events.push(event)) Serial.println("⚠️ Event queue full - history record dropped");
 }
 
 void handlePing() {
-  // Add CORS headers
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-  server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
+  const StationState& state = control.state();
+  const SensorData& data = state.data;
   
-  SensorData data = readAllSensors();
+  if (wantsBinary(server)) {
+    sendPingBinary(state);
+    return;
+  }
   
-  String response = "{";
-  response += "\"status\":\"online\",";
-  response += "\"device\":\"ESP32 Sensor Controller\",";
-  response += "\"mode\":\"" + String(automaticMode ? "automatic" : "manual") + "\",";
-  response += "\"pumpStatus\":\"" + String(pumpRunning ? "running" : "stopped") + "\",";
-  response += "\"servoPosition\":\"" + String(servoDown ? "down" : "up") + "\",";
-  response += "\"soilMoisture\":" + String(data.soilMoisture) + ",";
-  response += "\"temperature\":" + String(data.temperature, 1) + ",";
-  response += "\"humidity\":" + String(data.humidity, 1) + ",";
-  response += "\"waterLevel\":" + String(data.waterLevel) + ",";
-  response += "\"uptime\":" + String(millis()) + ",";
-  response += "\"freeHeap\":" + String(ESP.getFreeHeap()) + ",";
-  response += "\"timestamp\":\"" + String(millis()) + "\"";
-  response += "}";
-  
-  server.send(200, "application/json", response);
-  Serial.println("📡 Ping received - Status: " + String(automaticMode ? "Auto" : "Manual") + 
-                 ", Pump: " + String(pumpRunning ? "ON" : "OFF") + 
-                 ", Servo: " + String(servoDown ? "DOWN" : "UP"));
-}
-
-void handleOptions() {
-  // Handle CORS preflight requests
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-  server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-  server.send(200, "text/plain", "");
+  JsonWriter<384> response;
+  response.add("status", "online");
+  response.add("device", "ESP32 Sensor Controller");
+  response.add("mode", state.automaticMode ? "automatic" : "manual");
+  response.add("pumpStatus", state.pumpRunning ? "running" : "stopped");
+  response.add("dosing", state.dose.active());
+  response.add("servoPosition", state.servoDown ? "down" : "up");
+  response.add("soilMoisture", data.soilMoisture);
+  response.add("temperature", data.temperature, 1);
+  response.add("humidity", data.humidity, 1);
+  response.add("climateAgeMs", data.climateAge);
+  response.add("waterLevel", data.waterLevel);
+  response.add("uptime", millis());
+  response.add("freeHeap", ESP.getFreeHeap());
+  response.addQuoted("timestamp", millis());
+  
+  sendJson(server, 200, response);
+  Serial.printf("📡 Ping received - Status: %s, Pump: %s, Servo: %s\n",
+                state.automaticMode ? "Auto" : "Manual",
+                state.pumpRunning ? "ON" : "OFF",
+                state.servoDown ? "DOWN" : "UP");
+}
+
+// Same fields as the JSON ping in about 20 bytes (see binframe.h): flags, soil, then
+// temperature and humidity in tenths when the DHT has a reading, climate age, water
+// level, uptime and free heap
+void sendPingBinary(const StationState& state) {
+  const SensorData& data = state.data;
+  bool climate = !isnan(data.temperature) && !isnan(data.humidity);
+  uint8_t flags = (state.automaticMode ? PING_AUTOMATIC : 0) | (state.pumpRunning ? PING_PUMP : 0) |
+                  (state.dose.active() ? PING_DOSING : 0) | (state.servoDown ? PING_SERVO_DOWN : 0) | (climate ? PING_CLIMATE : 0);
+  BinFrame<48> frame(BIN_PING);
+  frame.byte(flags).put((uint32_t)data.soilMoisture);
+  if (climate) frame.putSigned((int32_t)lroundf(data.temperature * 10)).putSigned((int32_t)lroundf(data.humidity * 10));
+  frame.put(data.climateAge).put((uint32_t)data.waterLevel).put(millis()).put(ESP.getFreeHeap());
+  sendBinary(server, 200, frame);
 }
 
 void handleAutomaticIrrigation() {
-  // Check if it's time for sensor reading
-  if (millis() - lastSensorCheck >= SENSOR_CHECK_INTERVAL) {
-    lastSensorCheck = millis();
-    
-    Serial.println("🤖 Automatic mode: Starting sensor check cycle");
-    
-    // Step 1: Lower servo
-    if (!servoDown) {
+  TRACE_SCOPE(TRACE_AUTOMATIC);
+  // Check the zone the rover is parked at once the scheduler says it is due
+  if (!sensorCycle.busy() && zones.due(currentZone, millis())) {
+    Serial.printf("🤖 Automatic mode: Starting sensor check cycle for %s\n", zones.config(currentZone).name);
+    sensorCycle.begin(millis(), true, CHECK_AUTO);
+  }
+}
+
+void serviceSensorCycle() {
+  TRACE_SCOPE(TRACE_SENSOR_CYCLE);
+  switch (sensorCycle.tick(millis())) {
+    case CYCLE_LOWER_SERVO:
       lowerServo();
-      delay(2000); // Wait for servo and sensor stabilization
+      break;
+      
+    case CYCLE_SAMPLE: {
+      SensorData data = readAllSensors();
+      lastCheckData = data;
+      lastCheckJobId = sensorCycle.activeJobId();
+      
+      if (sensorCycle.tag() == CHECK_AUTO) {
+        handleAutomaticReading(data);
+      } else {
+        handleManualReading(data);
+      }
+      break;
     }
     
-    // Step 2: Read sensors
-    SensorData data = readAllSensors();
-    Serial.println("📊 Auto sensor reading - Soil: " + String(data.soilMoisture) + 
-                   " (" + getSoilStatus(data.soilMoisture) + "), Water: " + String(data.waterLevel));
-    
-    // Step 3: Decide on irrigation
-    if (data.needsIrrigation && data.waterLevel >= MIN_WATER_LEVEL && !pumpRunning) {
-      Serial.println("💧 Soil is dry (" + String(data.soilMoisture) + " > " + String(DRY_SOIL_THRESHOLD) + ") - Starting irrigation");
-      startPump();
+    case CYCLE_RAISE_SERVO:
+      // The probe stays in the soil while a dose re-samples it
+      if (dose.active()) sensorCycle.setServoDown(true);
+      else raiseServo();
+      break;
+      
+    case CYCLE_DONE:
+      if (sensorCycle.tag() == CHECK_AUTO) {
+        int nextZone = zones.next(millis());
+        Serial.printf("🔄 Automatic sensor cycle completed - Most urgent zone now: %s\n",
+                      nextZone >= 0 ? zones.config(nextZone).name : "none due");
+      } else {
+        Serial.printf("📊 Sensor check completed: %s\n", lastCheckData.status);
+      }
+      break;
+      
+    default:
+      break;
+  }
+}
+
+void handleManualReading(const SensorData& data) {
+  Serial.println("📊 Sensor reading complete - Soil: " + String(data.soilMoisture) + 
+                 " (" + getSoilStatus(data.soilMoisture, dryThreshold()) + "), Water: " + String(data.waterLevel));
+  
+  zones.recordReading(currentZone, data.soilMoisture, millis());
+  recordHistory(HISTORY_SOIL, data.soilMoisture, currentZone);
+  
+  // If irrigation needed and water available, start pump
+  if (data.needsIrrigation && data.waterLevel >= MIN_WATER_LEVEL && !pump.running() && !dose.active()) {
+    if (irrigateCurrentZone(data)) {
+      Serial.println("💧 Auto-irrigation started based on sensor reading");
+    } else {
+      Serial.println("⏳ Pump budget for this zone used up - not irrigating");
+    }
+  }
+}
+
+void handleAutomaticReading(const SensorData& data) {
+  Serial.println("📊 Auto sensor reading - Soil: " + String(data.soilMoisture) + 
+                 " (" + getSoilStatus(data.soilMoisture, dryThreshold()) + "), Water: " + String(data.waterLevel));
+  
+  zones.recordReading(currentZone, data.soilMoisture, millis());
+  recordHistory(HISTORY_SOIL, data.soilMoisture, currentZone);
+  
+  // Decide on irrigation
+  if (data.needsIrrigation && data.waterLevel >= MIN_WATER_LEVEL && !pump.running() && !dose.active()) {
+    if (irrigateCurrentZone(data)) {
+      Serial.println("💧 Soil is dry (" + String(data.soilMoisture) + " > " + String(dryThreshold()) + ") - Starting irrigation");
       
       // Notify motor ESP32 that irrigation is happening
       notifyMotorESP("irrigating");
-    } else if (!data.needsIrrigation) {
-      Serial.println("✅ Soil moisture OK (" + String(data.soilMoisture) + " <= " + String(DRY_SOIL_THRESHOLD) + ") - No irrigation needed");
-      
-      // Notify motor ESP32 to continue moving
+    } else {
+      Serial.println("⏳ Soil is dry but the pump budget is used up - moving on");
       notifyMotorESP("continue_movement");
-    } else if (data.waterLevel < MIN_WATER_LEVEL) {
-      Serial.println("⚠️ Water level too low (" + String(data.waterLevel) + " < " + String(MIN_WATER_LEVEL) + ") for irrigation");
-      
-      // Notify motor ESP32 about low water
-      notifyMotorESP("low_water");
-    } else if (pumpRunning) {
-      Serial.println("💦 Pump already running - waiting for completion");
     }
+  } else if (!data.needsIrrigation) {
+    Serial.println("✅ Soil moisture OK (" + String(data.soilMoisture) + " <= " + String(dryThreshold()) + ") - No irrigation needed");
+    
+    // Notify motor ESP32 to continue moving
+    notifyMotorESP("continue_movement");
+  } else if (data.waterLevel < MIN_WATER_LEVEL) {
+    Serial.println("⚠️ Water level too low (" + String(data.waterLevel) + " < " + String(MIN_WATER_LEVEL) + ") for irrigation");
     
-    // Step 4: Raise servo after check
-    delay(1000);
-    raiseServo();
-    Serial.println("🔄 Automatic sensor cycle completed - Next check in " + String(SENSOR_CHECK_INTERVAL/1000) + " seconds");
+    // Notify motor ESP32 about low water
+    notifyMotorESP("low_water");
+  } else if (pump.running() || dose.active()) {
+    Serial.println("💦 Pump already running - waiting for completion");
   }
 }
 
 SensorData readAllSensors() {
+  TRACE_SCOPE(TRACE_READ_SENSORS);
   SensorData data;
   
   // Read soil moisture (higher value = drier soil for capacitive sensor)
-  data.soilMoisture = analogRead(SOIL_MOISTURE_PIN);
+  data.soilMoisture = filteredReading(soilFilter, SOIL_MOISTURE_PIN);
   
-  // Read DHT22
-  data.temperature = dht.readTemperature();
-  data.humidity = dht.readHumidity();
-  
-  // Handle DHT reading errors
-  if (isnan(data.temperature)) {
-    data.temperature = 0.0;
-    Serial.println("⚠️ DHT22 temperature reading failed");
-  }
-  if (isnan(data.humidity)) {
-    data.humidity = 0.0;
-    Serial.println("⚠️ DHT22 humidity reading failed");
-  }
+  // Last good DHT22 reading (NaN until the first one succeeds)
+  data.temperature = climate.temperature();
+  data.humidity = climate.humidity();
+  data.climateAge = climate.age(millis());
   
   // Read water level
-  data.waterLevel = analogRead(WATER_LEVEL_PIN);
+  data.waterLevel = filteredReading(waterFilter, WATER_LEVEL_PIN);
   
   // Determine if irrigation is needed
-  data.needsIrrigation = (data.soilMoisture > DRY_SOIL_THRESHOLD);
+  data.needsIrrigation = zones.needsWater(currentZone, data.soilMoisture);
   
   // Set status message
   if (data.needsIrrigation) {
@@ -509,71 +1117,266 @@ SensorData readAllSensors() {
   return data;
 }
 
-String getSoilStatus(int moistureValue) {
-  if (moistureValue > DRY_SOIL_THRESHOLD) {
+// Returns true when a sample was taken
+bool sampleAnalogSensors() {
+  if (millis() - lastAdcSample < ADC_SAMPLE_INTERVAL) return false;
+  lastAdcSample = millis();
+  TRACE_SCOPE(TRACE_ADC);
+  soilFilter.push(probe.read());
+  waterFilter.push(analogRead(WATER_LEVEL_PIN));
+  // Dry-run interlock: the relay goes off with the first low sample, not at the next check
+  if (waterFilter.ready()) pump.setLowWater(waterFilter.value() < MIN_WATER_LEVEL);
+  return true;
+}
+
+// Latest filtered value; a window emptied by reset() is refilled on the spot
+int filteredReading(AdcFilter<15>& filter, int pin) {
+  while (!filter.ready()) filter.push(analogRead(pin));
+  return filter.value();
+}
+
+const char* getSoilStatus(int moistureValue, int threshold) {
+  if (moistureValue > threshold) {
     return "DRY";
-  } else if (moistureValue > DRY_SOIL_THRESHOLD - 500) {
+  } else if (moistureValue > threshold - 500) {
     return "MOIST";
   } else {
     return "WET";
   }
 }
 
-void startPump() {
-  if (!pumpRunning) {
-    digitalWrite(RELAY_PIN, HIGH);
-    pumpRunning = true;
-    pumpStartTime = millis();
-    Serial.println("💦 Pump started - Will run for " + String(PUMP_DURATION/1000) + " seconds");
+int dryThreshold() {
+  return zones.config(currentZone).dryThreshold;
+}
+
+// Starts a dose for the current zone within its daily budget and the pump duty limit
+bool irrigateCurrentZone(const SensorData& data) {
+  unsigned long allowance = zones.pumpAllowance(currentZone, millis(), data.waterLevel);
+  int target = zones.config(currentZone).targetMoisture;
+  if (!dose.begin(currentZone, data.soilMoisture, target, allowance, millis())) return false;
+  Serial.printf("💧 Dosing %s: %d -> %d, estimated %lu ms\n", zones.config(currentZone).name,
+                data.soilMoisture, target, dose.estimateMs(currentZone, data.soilMoisture, target));
+  return true;
+}
+
+void serviceDose() {
+  TRACE_SCOPE(TRACE_DOSE);
+  switch (dose.tick(millis())) {
+    case DOSE_PUMP_ON:
+      startPump(dose.pulseMs());
+      break;
+      
+    case DOSE_PUMP_OFF:
+      stopPump();
+      soilFilter.reset();  // only samples taken after the soak count
+      break;
+      
+    case DOSE_SAMPLE: {
+      SensorData data = readAllSensors();
+      if (data.waterLevel < MIN_WATER_LEVEL) {
+        cancelDose("water level too low");
+        notifyMotorESP("low_water");
+        break;
+      }
+      Serial.printf("🔁 Dose pulse %u: soil %d (target %d)\n", dose.pulses(), data.soilMoisture,
+                    zones.config(dose.zone()).targetMoisture);
+      recordHistory(HISTORY_SOIL, data.soilMoisture, dose.zone());
+      dose.sample(data.soilMoisture, millis());
+      break;
+    }
+      
+    case DOSE_DONE:
+      Serial.printf("✅ Dose finished (%s) after %u pulses, %lu ms - %s now learns %ld/s\n",
+                    DoseController<8>::resultName(dose.result()), dose.pulses(), dose.pumpedMs(),
+                    zones.config(dose.zone()).name, dose.gain(dose.zone()));
+      zones.recordReading(dose.zone(), dose.lastReading(), millis());
+      if (!sensorCycle.busy()) raiseServo();
+      if (automaticMode) notifyMotorESP("continue_movement");
+      break;
+      
+    default:
+      break;
+  }
+}
+
+void cancelDose(const char* reason) {
+  if (!dose.active()) return;
+  if (dose.cancel(millis())) stopPump();
+  if (!sensorCycle.busy()) raiseServo();
+  Serial.printf("🛑 Dose cancelled: %s\n", reason);
+}
+
+void startPump(unsigned long runMs) {
+  if (pump.running()) return;
+  if (!pump.start(millis(), runMs)) {
+    Serial.println("🚫 Pump locked out - water level too low");
+    return;
   }
+  pumpZone = currentZone;
+  Serial.printf("💦 Pump started - Will run for %lu ms\n", pump.runMs());
 }
 
 void stopPump() {
-  if (pumpRunning) {
-    digitalWrite(RELAY_PIN, LOW);
-    pumpRunning = false;
-    unsigned long runTime = millis() - pumpStartTime;
+  unsigned long runTime = pump.stop(millis());
+  if (runTime) {
+    zones.recordPumpRun(pumpZone, runTime, millis());
+    recordHistory(HISTORY_PUMP, (int32_t)(runTime / 100), pumpZone);
     Serial.println("🛑 Pump stopped after " + String(runTime/1000) + " seconds");
   }
 }
 
 void lowerServo() {
-  if (!servoDown) {
-    Serial.println("⬇️ Lowering servo to position " + String(SERVO_DOWN_ANGLE) + "°");
-    soilServo.write(SERVO_DOWN_ANGLE);
-    servoDown = true;
-    delay(1000); // Give servo time to move
-    Serial.println("✅ Servo positioned for soil sensing");
+  if (probe.lower()) {
+    Serial.println("⬇️ Lowered servo to position " + String(SERVO_DOWN_ANGLE) + "°");
+    soilFilter.reset();  // samples taken above the soil are no longer valid
+    sensorCycle.setServoDown(true);
   }
 }
 
 void raiseServo() {
-  if (servoDown) {
-    Serial.println("⬆️ Raising servo to position " + String(SERVO_UP_ANGLE) + "°");
-    soilServo.write(SERVO_UP_ANGLE);
-    servoDown = false;
-    delay(1000); // Give servo time to move
-    Serial.println("✅ Servo raised from soil");
+  if (probe.raise()) {
+    Serial.println("⬆️ Raised servo to position " + String(SERVO_UP_ANGLE) + "°");
+    sensorCycle.setServoDown(false);
   }
 }
 
-void notifyMotorESP(String message) {
-  HTTPClient http;
-  String url = String("http://") + motor_esp32_ip + "/sensor_update?status=" + message;
-  http.begin(url);
-  http.setTimeout(5000); // Increased timeout
-  
-  Serial.println("📡 Notifying Motor ESP32: " + message + " at " + url);
+// The motor board announces itself; a new address also reconnects the link
+void onPeerFound(const PeerInfo& peer, void* /*context*/) {
+  if (peer.role != PEER_ROLE_ROVER) return;
+  snprintf(motorHost, sizeof(motorHost), "%s", peer.host);
+  motorLink.setHost(motorHost, peer.httpPort);
+}
+
+// Control loop side: the network task sends it
+void notifyMotorESP(const char* message) {
+  StationEvent event = {EVENT_NOTIFY, 0, {0, 0, 0}, message};
+  if (!events.push(event)) Serial.println("❌ Event queue full - notification dropped: " + String(message));
+}
+
+void sendMotorNotification(const char* message) {
+  char path[64];
+  snprintf(path, sizeof(path), "/sensor_update?status=%s", message);
   
-  int httpResponseCode = http.GET();
+  if (!motorHost[0]) {
+    Serial.println("⚠️ No motor ESP32 found yet - notification dropped: " + String(message));
+    return;
+  }
+  Serial.printf("📡 Notifying Motor ESP32: %s at http://%s%s\n", message, motorHost, path);
   
+  // Queued on the persistent motor link; the reply arrives in onMotorReply()
+  if (!motorLink.send(path, onMotorReply)) {
+    Serial.println("❌ Motor ESP32 queue full - notification dropped: " + String(message));
+  }
+}
+
+void onMotorReply(int httpResponseCode, const char* response, void* /*context*/) {
   if (httpResponseCode > 0) {
-    String response = http.getString();
-    Serial.println("✅ Motor ESP32 response (" + String(httpResponseCode) + "): " + response);
+    Serial.printf("✅ Motor ESP32 response (%d): %s\n", httpResponseCode, response);
   } else {
     Serial.println("❌ Failed to notify Motor ESP32 - Error: " + String(httpResponseCode));
-    Serial.println("❌ Check if Motor ESP32 is running at " + String(motor_esp32_ip));
+    Serial.println("❌ Check if Motor ESP32 is running at " + String(motorHost));
+  }
+}
+
+// Every wake of battery mode runs setup() again; the RTC memory tells it from a cold boot
+void batterySetup() {
+  pump.begin();
+  gpio_hold_dis((gpio_num_t)RELAY_PIN);
+  dht.begin();
+  for (size_t i = 0; i < sizeof(ZONES) / sizeof(ZONES[0]); i++) zones.addZone(ZONES[i]);
+  
+  bool warm = sleepCycle.begin(esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER);
+  uint16_t boot = 1;
+  if (LittleFS.begin(true)) boot = historyLog.begin();
+  if (warm) {
+    soilFilter.restore(retained.soil);
+    waterFilter.restore(retained.water);
+    history.resume(retained.history, sleepCycle.seconds(millis()), millis());
+  } else {
+    probe.begin(false);
+    probe.lower();
+    batterySettleUntil = BATTERY_SETTLE_MS;
+    history.begin(boot, millis());
+    retained.dry = false;
+    Serial.printf("🔋 Battery mode: sample every %lu s, report every %u wakes\n",
+                  SLEEP_INTERVAL_MS / 1000, SLEEP_REPORT_EVERY);
+  }
+  history.onSeal(onHistorySealed);
+  
+  if (sleepCycle.reportDue()) startBatteryRadio();
+}
+
+// Sample, log, report when due, then sleep; the radio join runs alongside the sampling
+void batteryLoop() {
+  unsigned long now = millis();
+  if (batteryRadio) wifi.tick(now);
+  
+  if (!batteryLogged) {
+    if (now < batterySettleUntil) return;
+    if (sampleAnalogSensors()) batterySamples++;
+    if (climate.tick(now)) batteryClimateRead = true;
+    if (batterySamples < SLEEP_ADC_SAMPLES || !soilFilter.ready() || !batteryClimateRead) return;
+    logBatterySample();
+    batteryLogged = true;
+  }
+  
+  if (batteryRadio && !batteryReported) {
+    if (wifi.connected()) {
+      reportUdp.begin(0);
+      size_t samples = sleepCycle.pending();
+      if (sleepCycle.report(reportUdp, now)) {
+        Serial.printf("📡 Reported %u samples (report %lu)\n", (unsigned)samples, (unsigned long)sleepCycle.reports());
+      } else {
+        Serial.println("⚠️ Report could not be sent - keeping the samples");
+      }
+      batteryReported = true;
+      batteryReportedAt = now;
+    } else if (now < batterySettleUntil + SLEEP_AWAKE_BUDGET_MS) {
+      return;
+    } else {
+      Serial.printf("⚠️ No network - %u samples kept for the next report\n", (unsigned)sleepCycle.pending());
+    }
   }
   
-  http.end();
-}
\ No newline at end of file
+  if (batteryReported && now - batteryReportedAt < SLEEP_FLUSH_MS) return;
+  enterDeepSleep();
+}
+
+void logBatterySample() {
+  history.tick(millis());
+  SensorData data = readAllSensors();
+  int32_t temperature = isnan(data.temperature) ? HISTORY_MISSING : (int32_t)lroundf(data.temperature * 10);
+  int32_t humidity = isnan(data.humidity) ? HISTORY_MISSING : (int32_t)lroundf(data.humidity * 10);
+  history.record(HISTORY_SOIL, data.soilMoisture, currentZone, millis());
+  history.record(HISTORY_CLIMATE, data.waterLevel, temperature, humidity, millis());
+  
+  SleepSample sample = {sleepCycle.seconds(millis()), (int16_t)data.soilMoisture, (int16_t)data.waterLevel,
+                        (int16_t)temperature, (int16_t)humidity};
+  sleepCycle.add(sample);
+  Serial.printf("🔋 Wake %lu - Soil: %d (%s), Water: %d, %u samples pending\n", (unsigned long)sleepCycle.wakes(),
+                data.soilMoisture, getSoilStatus(data.soilMoisture, dryThreshold()), data.waterLevel, (unsigned)sleepCycle.pending());
+  
+  // Soil that just turned dry is reported at once, so the rover can come and water it
+  if (data.needsIrrigation && !retained.dry && !batteryRadio) startBatteryRadio();
+  retained.dry = data.needsIrrigation;
+}
+
+void startBatteryRadio() {
+  batteryRadio = true;
+  wifi.begin(ssid, password);
+}
+
+void enterDeepSleep() {
+  soilFilter.save(&retained.soil);
+  waterFilter.save(&retained.water);
+  history.retain(&retained.history);
+  uint64_t sleepUs = sleepCycle.sleep(millis());
+  Serial.printf("💤 Awake %lu ms, sleeping %lu ms (awake %.1f%% of the time)\n", (unsigned long)sleepCycle.lastAwakeMs(),
+                (unsigned long)(sleepUs / 1000), sleepCycle.dutyPermille(0) / 10.0);
+  
+  // Without the hold the relay input floats while the board sleeps
+  gpio_hold_en((gpio_num_t)RELAY_PIN);
+  gpio_deep_sleep_hold_en();
+  esp_sleep_enable_timer_wakeup(sleepUs);
+  esp_deep_sleep_start();
+}
@@ -0,0 +1,169 @@
+#ifndef SLEEPCYCLE_H
+#define SLEEPCYCLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "binframe.h"
+
+// Battery mode for a sensor board: wake, sample, report now and then, deep-sleep.
+//
+// A board on a small solar panel cannot spin loop() around the clock with the radio on.
+// In battery mode the board wakes every SLEEP_INTERVAL_MS from the RTC timer, pushes a
+// few fresh ADC samples into its filters, reads the DHT once, logs one sample, and goes
+// back to deep sleep, with the radio never switched on. Every SLEEP_REPORT_EVERY wakes
+// (or at once when the soil turns dry or the batch is nearly full) it also joins the
+// network (fast join from the cache, wifilink.h) and broadcasts everything logged since
+// the last report in one datagram on SLEEP_REPORT_PORT. A wake without the radio takes
+// ~150 ms, one with it ~500 ms; host/energymodel.cpp turns those into a duty cycle and
+// an average current.
+//
+// Deep sleep is a reset: RAM is lost, setup() runs again. What has to survive lives in
+// RTC memory (RTC_DATA_ATTR, 8 KB on the ESP32): this object, the filter windows
+// (AdcFilterState) and the open history block (HistoryRetained). None of them has a
+// constructor, which would wipe them at every wake. begin() tells a timer wake with
+// valid state from a cold boot.
+//
+// Wakes are kept on a fixed grid (slot n at n * interval since the cold boot), so time
+// spent awake does not make the schedule drift; a wake that overruns its slot sleeps to
+// the next one. The clock is the RTC timer's, good to a few percent.
+//
+// Report datagram: a BinFrame (binframe.h) of kind BIN_BATCH:
+//
+//   wake     this wake's number since the cold boot
+//   report   report number, so a collector can tell lost reports from repeats
+//   duty     measured awake share of the time since the cold boot, in 0.1 %
+//   dropped  samples lost to a full batch since the last report
+//   count    samples that follow, oldest first
+//   samples  seconds since the cold boot (change from the previous sample), then
+//            soil, water level, temperature * 10 and humidity * 10 (zig-zag changes
+//            from the previous sample; SLEEP_MISSING when the DHT had no reading)
+
+#define SLEEP_REPORT_PORT 4213
+
+const unsigned long SLEEP_INTERVAL_MS = 30000;
+const uint8_t SLEEP_REPORT_EVERY = 4;            // radio on every 4th wake (2 min)
+const unsigned long SLEEP_AWAKE_BUDGET_MS = 3000; // give up on the network and sleep
+const unsigned long SLEEP_FLUSH_MS = 20;          // let the radio send the report
+const unsigned long SLEEP_MIN_MS = 1000;          // shorter sleeps skip to the next slot
+const uint8_t SLEEP_ADC_SAMPLES = 5;              // fresh samples per wake
+const size_t SLEEP_BATCH = 32;
+const int16_t SLEEP_MISSING = -32768;             // same as HISTORY_MISSING
+const uint32_t SLEEP_STATE_MAGIC = 0x534C5031;
+
+struct SleepSample {
+  uint32_t sec;
+  int16_t soil;
+  int16_t water;
+  int16_t temperature;   // 0.1 C
+  int16_t humidity;      // 0.1 %
+};
+
+// Lives in RTC memory: keep it free of constructors and pointers
+template <size_t BATCH = SLEEP_BATCH>
+class SleepCycle {
+public:
+  // Returns true for a timer wake with state from the previous one, false after a cold
+  // boot (state reset, wake 0)
+  bool begin(bool timerWake, unsigned long intervalMs = SLEEP_INTERVAL_MS, uint8_t reportEvery = SLEEP_REPORT_EVERY) {
+    interval_ = intervalMs;
+    reportEvery_ = reportEvery ? reportEvery : 1;
+    if (timerWake && magic_ == SLEEP_STATE_MAGIC) {
+      wakes_++;
+      return true;
+    }
+    magic_ = SLEEP_STATE_MAGIC;
+    wakes_ = 0;
+    reports_ = 0;
+    dropped_ = 0;
+    count_ = 0;
+    clockBase_ = 0;
+    nextWake_ = 0;
+    awakeMs_ = 0;
+    lastAwakeMs_ = 0;
+    return false;
+  }
+
+  // Milliseconds since the cold boot, sleep included; now is millis() since this wake
+  uint64_t clockMs(unsigned long now) const { return clockBase_ + now; }
+  uint32_t seconds(unsigned long now) const { return (uint32_t)(clockMs(now) / 1000); }
+
+  // The cold boot reports at once so the collector hears about the node
+  bool reportDue() const { return wakes_ % reportEvery_ == 0 || count_ + 1 >= BATCH; }
+
+  // Drops the oldest sample when the batch is full
+  void add(const SleepSample& sample) {
+    if (count_ == BATCH) {
+      for (size_t i = 1; i < BATCH; i++) batch_[i - 1] = batch_[i];
+      count_--;
+      dropped_++;
+    }
+    batch_[count_++] = sample;
+  }
+
+  template <size_t N>
+  void encode(BinFrame<N>& frame, unsigned long now) const {
+    frame.reset(BIN_BATCH);
+    frame.put(wakes_).put(reports_).put(dutyPermille(now)).put(dropped_).put((uint32_t)count_);
+    SleepSample last = {0, 0, 0, 0, 0};
+    for (size_t i = 0; i < count_; i++) {
+      const SleepSample& s = batch_[i];
+      frame.put(s.sec - last.sec).putSigned(s.soil - last.soil).putSigned(s.water - last.water);
+      frame.putSigned(s.temperature - last.temperature).putSigned(s.humidity - last.humidity);
+      last = s;
+    }
+  }
+
+  // Broadcasts the batch; it is only cleared when the datagram went out
+  template <class UdpT>
+  bool report(UdpT& udp, unsigned long now) {
+    BinFrame<32 + 20 * BATCH> frame(BIN_BATCH);
+    encode(frame, now);
+    if (frame.overflow() || !udp.beginPacket("255.255.255.255", SLEEP_REPORT_PORT)) return false;
+    udp.write((const uint8_t*)frame.data(), frame.length());
+    if (!udp.endPacket()) return false;
+    reports_++;
+    dropped_ = 0;
+    count_ = 0;
+    return true;
+  }
+
+  // Books this wake and returns the microseconds to sleep until the next slot
+  uint64_t sleep(unsigned long now) {
+    uint64_t clock = clockMs(now);
+    lastAwakeMs_ = now;
+    awakeMs_ += now;
+    do {
+      nextWake_ += interval_;
+    } while (nextWake_ < clock + SLEEP_MIN_MS);
+    clockBase_ = nextWake_;
+    return (nextWake_ - clock) * 1000;
+  }
+
+  // Awake share of the time since the cold boot, in 0.1 %
+  uint32_t dutyPermille(unsigned long now) const {
+    uint64_t clock = clockMs(now);
+    return clock ? (uint32_t)((awakeMs_ + now) * 1000 / clock) : 1000;
+  }
+
+  uint32_t wakes() const { return wakes_; }
+  uint32_t reports() const { return reports_; }
+  size_t pending() const { return count_; }
+  uint32_t lastAwakeMs() const { return lastAwakeMs_; }
+  unsigned long intervalMs() const { return interval_; }
+
+private:
+  uint32_t magic_;
+  uint32_t wakes_;
+  uint32_t reports_;
+  uint32_t dropped_;
+  unsigned long interval_;
+  uint8_t reportEvery_;
+  size_t count_;
+  uint64_t clockBase_;    // clock at millis() 0 of this wake
+  uint64_t nextWake_;     // clock of the slot this wake belongs to
+  uint64_t awakeMs_;      // total of the earlier wakes
+  uint32_t lastAwakeMs_;
+  SleepSample batch_[BATCH];
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef SOILPROBE_H
+#define SOILPROBE_H
+
+// Soil moisture probe, optionally on a servo arm that lowers it into the soil.
+//
+// ServoT is the board's servo class (Servo from ESP32Servo.h) and SERVO_PIN its signal
+// pin. Boards with a fixed probe leave both out; the arm is then NoServo and every
+// servo call compiles to nothing, so they do not link a servo library. The angles
+// differ per rig and are given to the constructor.
+//
+// lower() and raise() only move the arm when it is elsewhere and return whether they
+// did, so the caller knows when to wait for it to settle or restart its filtering.
+
+struct NoServo {
+  int attach(int pin) { (void)pin; return 0; }
+  void write(int angle) { (void)angle; }
+};
+
+template <int SOIL_PIN, int SERVO_PIN = -1, class ServoT = NoServo>
+class SoilProbe {
+public:
+  SoilProbe(int upAngle = 0, int downAngle = 0) : upAngle_(upAngle), downAngle_(downAngle), down_(false) {}
+
+  // park = false attaches the servo without moving it (arm position unknown at boot)
+  void begin(bool park = true) {
+    pinMode(SOIL_PIN, INPUT);
+    if (SERVO_PIN >= 0) servo_.attach(SERVO_PIN);
+    if (park) this->park();
+    down_ = false;
+  }
+
+  // Moves the arm up whatever state it was in
+  void park() {
+    if (SERVO_PIN >= 0) servo_.write(upAngle_);
+    down_ = false;
+  }
+
+  bool lower() {
+    if (down_) return false;
+    if (SERVO_PIN >= 0) servo_.write(downAngle_);
+    down_ = true;
+    return true;
+  }
+
+  bool raise() {
+    if (!down_) return false;
+    if (SERVO_PIN >= 0) servo_.write(upAngle_);
+    down_ = false;
+    return true;
+  }
+
+  int read() const { return analogRead(SOIL_PIN); }
+  bool isDown() const { return down_; }
+  int upAngle() const { return upAngle_; }
+  int downAngle() const { return downAngle_; }
+
+private:
+  ServoT servo_;
+  int upAngle_;
+  int downAngle_;
+  bool down_;
+};
+
+#endif
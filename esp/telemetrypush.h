@@ -0,0 +1,192 @@
+#ifndef TELEMETRYPUSH_H
+#define TELEMETRYPUSH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Server-Sent Events push of board state to dashboards.
+//
+// The sketch registers the fields it publishes once (addField), updates them whenever
+// the state changes (set), and calls tick() from loop(). Only fields that changed since
+// the last event are sent, and events are rate limited to one per minIntervalMs: a burst
+// of changes inside the window is coalesced into a single event. A new subscriber gets
+// the full state first. Idle connections get a comment line every 15 s so dead clients
+// are noticed.
+//
+// Subscribing (from a WebServer handler):
+//
+//   void handleEvents() { telemetry.subscribe(server.client(), millis()); }
+//
+// The WebServer keeps its own reference to the connection for a short while after the
+// handler returns; that happens once per subscription, not per event.
+
+const unsigned long TELEMETRY_KEEPALIVE_MS = 15000;
+
+template <class ClientT, size_t FIELDS = 10, size_t CLIENTS = 3>
+class TelemetryPush {
+public:
+  explicit TelemetryPush(unsigned long minIntervalMs = 100)
+    : minInterval_(minIntervalMs), fieldCount_(0), dirty_(0), lastEvent_(0), lastWrite_(0) {
+    for (size_t i = 0; i < CLIENTS; i++) active_[i] = false;
+  }
+
+  // Registers a field; key must be a string literal. Returns the field id.
+  int addField(const char* key) {
+    if (fieldCount_ == FIELDS) return -1;
+    Field& f = fields_[fieldCount_];
+    f.key = key;
+    f.kind = KIND_NONE;
+    f.number = 0;
+    f.text = "";
+    return (int)fieldCount_++;
+  }
+
+  void set(int id, long value) {
+    if (!valid(id)) return;
+    Field& f = fields_[id];
+    if (f.kind == KIND_NUMBER && f.number == value) return;
+    f.kind = KIND_NUMBER;
+    f.number = value;
+    markDirty(id);
+  }
+
+  // value must stay valid (string literal or static buffer)
+  void set(int id, const char* value) {
+    if (!valid(id)) return;
+    Field& f = fields_[id];
+    if (f.kind == KIND_TEXT && (f.text == value || strcmp(f.text, value) == 0)) return;
+    f.kind = KIND_TEXT;
+    f.text = value;
+    markDirty(id);
+  }
+
+  void setBool(int id, bool value) {
+    if (!valid(id)) return;
+    Field& f = fields_[id];
+    if (f.kind == KIND_BOOL && (f.number != 0) == value) return;
+    f.kind = KIND_BOOL;
+    f.number = value ? 1 : 0;
+    markDirty(id);
+  }
+
+  // Takes over the connection, sends the SSE headers and the full current state.
+  bool subscribe(ClientT client, unsigned long now) {
+    int slot = -1;
+    for (size_t i = 0; i < CLIENTS && slot < 0; i++) {
+      if (!active_[i] || !clients_[i].connected()) slot = (int)i;
+    }
+    if (slot < 0) {
+      static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nAccess-Control-Allow-Origin: *\r\n"
+                                 "Content-Length: 0\r\nConnection: close\r\n\r\n";
+      client.write((const uint8_t*)busy, sizeof(busy) - 1);
+      return false;
+    }
+
+    static const char headers[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+                                  "Cache-Control: no-cache\r\nConnection: keep-alive\r\n"
+                                  "Access-Control-Allow-Origin: *\r\n\r\n";
+    clients_[slot] = client;
+    active_[slot] = true;
+    clients_[slot].setNoDelay(true);
+    clients_[slot].write((const uint8_t*)headers, sizeof(headers) - 1);
+
+    char event[EVENT_SIZE];
+    size_t len = format(event, ~(uint32_t)0);
+    writeTo((size_t)slot, event, len);
+    lastWrite_ = now;
+    return true;
+  }
+
+  void tick(unsigned long now) {
+    for (size_t i = 0; i < CLIENTS; i++) {
+      if (active_[i] && !clients_[i].connected()) drop(i);
+    }
+
+    if (dirty_ && now - lastEvent_ >= minInterval_) {
+      char event[EVENT_SIZE];
+      size_t len = format(event, dirty_);
+      dirty_ = 0;
+      lastEvent_ = now;
+      lastWrite_ = now;
+      broadcast(event, len);
+    } else if (now - lastWrite_ >= TELEMETRY_KEEPALIVE_MS) {
+      static const char keepalive[] = ": ping\n\n";
+      lastWrite_ = now;
+      broadcast(keepalive, sizeof(keepalive) - 1);
+    }
+  }
+
+  size_t subscribers() const {
+    size_t n = 0;
+    for (size_t i = 0; i < CLIENTS; i++) n += active_[i] ? 1 : 0;
+    return n;
+  }
+
+private:
+  enum FieldKind { KIND_NONE, KIND_NUMBER, KIND_TEXT, KIND_BOOL };
+
+  struct Field {
+    const char* key;
+    FieldKind kind;
+    long number;
+    const char* text;
+  };
+
+  static const size_t EVENT_SIZE = 320;
+
+  bool valid(int id) const { return id >= 0 && (size_t)id < fieldCount_; }
+
+  void markDirty(int id) { dirty_ |= (uint32_t)1 << id; }
+
+  // "data: {...}\n\n" with the fields selected by mask
+  size_t format(char* out, uint32_t mask) const {
+    size_t len = (size_t)snprintf(out, EVENT_SIZE, "data: {");
+    bool first = true;
+    for (size_t i = 0; i < fieldCount_ && len < EVENT_SIZE; i++) {
+      const Field& f = fields_[i];
+      if (!(mask & ((uint32_t)1 << i)) || f.kind == KIND_NONE) continue;
+      int n;
+      if (f.kind == KIND_TEXT) {
+        n = snprintf(out + len, EVENT_SIZE - len, "%s\"%s\":\"%s\"", first ? "" : ",", f.key, f.text);
+      } else if (f.kind == KIND_BOOL) {
+        n = snprintf(out + len, EVENT_SIZE - len, "%s\"%s\":%s", first ? "" : ",", f.key, f.number ? "true" : "false");
+      } else {
+        n = snprintf(out + len, EVENT_SIZE - len, "%s\"%s\":%ld", first ? "" : ",", f.key, f.number);
+      }
+      if (n > 0) len += (size_t)n;
+      first = false;
+    }
+    if (len + 4 > EVENT_SIZE) len = EVENT_SIZE - 4;
+    memcpy(out + len, "}\n\n", 4);
+    return len + 3;
+  }
+
+  void broadcast(const char* data, size_t len) {
+    for (size_t i = 0; i < CLIENTS; i++) {
+      if (active_[i]) writeTo(i, data, len);
+    }
+  }
+
+  // A client that cannot take a whole event is too slow and gets dropped
+  void writeTo(size_t i, const char* data, size_t len) {
+    if (clients_[i].write((const uint8_t*)data, len) != len) drop(i);
+  }
+
+  void drop(size_t i) {
+    clients_[i].stop();
+    active_[i] = false;
+  }
+
+  unsigned long minInterval_;
+  Field fields_[FIELDS];
+  size_t fieldCount_;
+  uint32_t dirty_;
+  unsigned long lastEvent_;
+  unsigned long lastWrite_;
+  ClientT clients_[CLIENTS];
+  bool active_[CLIENTS];
+};
+
+#endif
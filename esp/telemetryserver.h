@@ -0,0 +1,59 @@
+#ifndef TELEMETRYSERVER_H
+#define TELEMETRYSERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "routetable.h"
+#include "pagestream.h"
+#include "boardmetrics.h"
+
+// The board's HTTP server set up the same way everywhere: requests dispatched from the
+// sketch's route table (routetable.h), the request headers the shared handlers look at
+// collected (If-None-Match for the ETag'd pages, Accept for binary answers), then the
+// server started.
+//
+//   TelemetryServer<WebServer, sizeof(ROUTES) / sizeof(ROUTES[0])> web(server, ROUTES, ROUTE_SEED);
+//
+// web.begin() in setup() once WiFi is up, web.handleClient() from loop(). Handlers keep
+// using the server object directly. Every route is timed into metrics() (boardmetrics.h);
+// the sketch lists {"/metrics", ROUTE_GET, handleMetrics} with a handler that calls
+// web.sendMetrics(), and calls web.metrics().tickLoop(micros()) at the top of loop().
+// Include this after the board's WebServer header.
+
+template <class Server, size_t N>
+class TelemetryServer {
+public:
+  TelemetryServer(Server& server, const Route (&routes)[N], uint32_t seed) : server_(server), routes_(server, routes, seed) {}
+
+  void begin() {
+    static const char* headers[] = {"If-None-Match", "Accept"};
+    routes_.begin();
+    routes_.onServed(onServed, this);
+    server_.collectHeaders(headers, 2);
+    server_.begin();
+  }
+
+  void handleClient() { server_.handleClient(); }
+
+  // Prometheus text, streamed in chunks
+  void sendMetrics() {
+    PageStream<Server, 256> out(server_);
+    out.begin(200, "text/plain; version=0.0.4");
+    metrics_.write(out, routes_);
+    out.end();
+  }
+
+  const RouteTable<Server, N>& routes() const { return routes_; }
+  BoardMetrics<N>& metrics() { return metrics_; }
+
+private:
+  static void onServed(size_t route, uint32_t us, void* context) {
+    static_cast<TelemetryServer*>(context)->metrics_.routeServed(route, us);
+  }
+
+  Server& server_;
+  RouteTable<Server, N> routes_;
+  BoardMetrics<N> metrics_;
+};
+
+#endif
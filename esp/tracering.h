@@ -0,0 +1,168 @@
+#ifndef TRACERING_H
+#define TRACERING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "pagestream.h"
+
+// Scope trace for finding what holds up a loop.
+//
+// The sketch numbers the sections it wants to see and names them, then marks each with
+// TRACE_SCOPE() at the top of its block:
+//
+//   enum TraceTag { TRACE_LOOP = 1, TRACE_DHT, ... };
+//   const char* const TRACE_NAMES[] = {"", "loop", "dht", ...};   // by tag
+//   TraceRing<TRACE_RING> tracer(TRACE_NAMES, sizeof(TRACE_NAMES) / sizeof(TRACE_NAMES[0]));
+//
+//   void readClimate() {
+//     TRACE_SCOPE(TRACE_DHT);
+//     ...
+//
+// Leaving the block records one event: tag, core, start and duration in microseconds,
+// which is the begin/end pair in one slot. Only scopes that ran at least minUs() are
+// kept (TRACE_MIN_US, /trace?min_us= changes it), so the ring holds the last few hundred
+// slow sections rather than the last few milliseconds of idle passes; a scope below the
+// threshold costs two micros() calls. Events go into a ring of TRACE_RING 12-byte slots,
+// oldest overwritten, claimed with one atomic add from either core; no lock, no
+// allocation.
+//
+// sendTrace() answers /trace with the ring as text, recording paused meanwhile;
+// ?clear=1 empties it afterwards:
+//
+//   # trace v1 now=<us> min_us=<threshold> recorded=<events> lost=<overwritten> dropped=<paused>
+//   name <tag> <name>
+//   <start us> <duration us> <tag> <core>
+//
+// host/tracejson.cpp turns that into Chrome trace JSON for chrome://tracing or
+// ui.perfetto.dev, and sums up where the time went. Build with -DTRACE_ENABLED=0 and the
+// scopes compile to nothing. Include this after the board's Arduino core (micros()).
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+#ifndef TRACE_RING
+#if defined(ESP8266)
+#define TRACE_RING 256
+#else
+#define TRACE_RING 1024
+#endif
+#endif
+
+const uint32_t TRACE_MIN_US = 100;
+
+struct TraceEvent {
+  uint32_t startUs;
+  uint32_t durationUs;
+  uint16_t tag;
+  uint8_t core;
+};
+
+template <size_t N>
+class TraceRing {
+public:
+  static_assert(N > 0 && (N & (N - 1)) == 0, "trace ring size must be a power of two");
+
+  TraceRing(const char* const* names, size_t count)
+    : names_(names), count_(count), head_(0), dropped_(0), minUs_(TRACE_MIN_US), paused_(false) {}
+
+  uint32_t minUs() const { return minUs_.load(std::memory_order_relaxed); }
+  void setMinUs(uint32_t us) { minUs_.store(us, std::memory_order_relaxed); }
+
+  void record(uint16_t tag, uint32_t startUs, uint32_t durationUs) {
+    if (paused_.load(std::memory_order_relaxed)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    uint32_t i = head_.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent& event = events_[i & (N - 1)];
+    event.startUs = startUs;
+    event.durationUs = durationUs;
+    event.tag = tag;
+    event.core = core();
+  }
+
+  // Out has print(const char*) (PageStream). Events come in the order they ended.
+  template <class Out>
+  void write(Out& out, bool clear) {
+    paused_.store(true, std::memory_order_relaxed);
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    uint32_t first = head > N ? head - N : 0;
+    char line[96];
+    snprintf(line, sizeof(line), "# trace v1 now=%lu min_us=%lu recorded=%lu lost=%lu dropped=%lu\n",
+             (unsigned long)micros(), (unsigned long)minUs(), (unsigned long)head, (unsigned long)first,
+             (unsigned long)dropped_.load(std::memory_order_relaxed));
+    out.print(line);
+    for (size_t tag = 1; tag < count_; tag++) {
+      snprintf(line, sizeof(line), "name %u %s\n", (unsigned)tag, names_[tag]);
+      out.print(line);
+    }
+    for (uint32_t i = first; i != head; i++) {
+      const TraceEvent& event = events_[i & (N - 1)];
+      snprintf(line, sizeof(line), "%lu %lu %u %u\n", (unsigned long)event.startUs, (unsigned long)event.durationUs,
+               (unsigned)event.tag, (unsigned)event.core);
+      out.print(line);
+    }
+    if (clear) {
+      head_.store(0, std::memory_order_relaxed);
+      dropped_.store(0, std::memory_order_relaxed);
+    }
+    paused_.store(false, std::memory_order_relaxed);
+  }
+
+private:
+  static uint8_t core() {
+#if defined(ESP8266)
+    return 0;
+#else
+    return (uint8_t)xPortGetCoreID();
+#endif
+  }
+
+  const char* const* names_;
+  size_t count_;
+  TraceEvent events_[N];
+  std::atomic<uint32_t> head_;      // events recorded since boot or the last clear
+  std::atomic<uint32_t> dropped_;   // while paused for a dump
+  std::atomic<uint32_t> minUs_;
+  std::atomic<bool> paused_;
+};
+
+template <class Ring>
+class TraceScope {
+public:
+  TraceScope(Ring& ring, uint16_t tag) : ring_(ring), tag_(tag), start_((uint32_t)micros()) {}
+
+  ~TraceScope() {
+    uint32_t duration = (uint32_t)micros() - start_;
+    if (duration >= ring_.minUs()) ring_.record(tag_, start_, duration);
+  }
+
+private:
+  Ring& ring_;
+  uint16_t tag_;
+  uint32_t start_;
+};
+
+// The sketch's ring is the global named tracer
+#if TRACE_ENABLED
+#define TRACE_SCOPE(tag) TraceScope<decltype(tracer)> traceScope_(tracer, tag)
+#else
+#define TRACE_SCOPE(tag) do {} while (0)
+#endif
+
+// /trace: ?min_us= sets the threshold for what is recorded from now on, ?clear=1
+// empties the ring after the dump
+template <class Server, size_t N>
+void sendTrace(Server& server, TraceRing<N>& ring) {
+  if (server.hasArg("min_us")) ring.setMinUs((uint32_t)strtoul(server.arg("min_us").c_str(), NULL, 10));
+  PageStream<Server, 256> out(server);
+  out.begin(200, "text/plain");
+  ring.write(out, server.hasArg("clear") && server.arg("clear") == "1");
+  out.end();
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Variable-length integers for the compact history and telemetry encodings.
+//
+// Unsigned values use LEB128: 7 bits per byte, low bits first, high bit set on every
+// byte but the last, so 0-127 take one byte. Signed values (deltas) are zig-zag mapped
+// first (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...) so small negative numbers stay short too.
+
+const size_t VARINT_MAX_BYTES = 5;   // a 32-bit value never needs more
+
+inline uint32_t zigzagEncode(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+inline int32_t zigzagDecode(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Writes value at out; returns the number of bytes, 0 when it does not fit in room.
+inline size_t putVarint(uint8_t* out, size_t room, uint32_t value) {
+  size_t n = 0;
+  do {
+    if (n == room) return 0;
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    out[n++] = value ? (uint8_t)(byte | 0x80) : byte;
+  } while (value);
+  return n;
+}
+
+// Change from previous to value, and back. The arithmetic wraps modulo 2^32, so every
+// pair of 32-bit values round-trips (INT32_MAX to INT32_MIN is a delta of 1) where a plain
+// int32_t subtraction would overflow.
+inline int32_t deltaEncode(int32_t value, int32_t previous) {
+  return (int32_t)((uint32_t)value - (uint32_t)previous);
+}
+
+inline int32_t deltaDecode(int32_t previous, int32_t delta) {
+  return (int32_t)((uint32_t)previous + (uint32_t)delta);
+}
+
+inline size_t putSignedVarint(uint8_t* out, size_t room, int32_t value) {
+  return putVarint(out, room, zigzagEncode(value));
+}
+
+// Reads a value from in; returns the number of bytes used, 0 when the input is
+// truncated or longer than VARINT_MAX_BYTES.
+inline size_t getVarint(const uint8_t* in, size_t available, uint32_t* value) {
+  uint32_t result = 0;
+  for (size_t n = 0; n < available && n < VARINT_MAX_BYTES; n++) {
+    result |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+    if (!(in[n] & 0x80)) {
+      *value = result;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+inline size_t getSignedVarint(const uint8_t* in, size_t available, int32_t* value) {
+  uint32_t raw;
+  size_t n = getVarint(in, available, &raw);
+  if (n) *value = zigzagDecode(raw);
+  return n;
+}
+
+#endif
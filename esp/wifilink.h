@@ -0,0 +1,337 @@
+#ifndef WIFILINK_H
+#define WIFILINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// Station connection shared by all boards, run from loop() instead of blocking setup().
+//
+// A scan-and-DHCP join takes the boards 2-5 s, longer on a busy channel. After every
+// successful join the link keeps the access point's channel and BSSID and the DHCP
+// lease (address, gateway, mask, DNS, when it was obtained and for how long) in a small
+// file on the board's flash (LittleFS, survives brown-outs and power loss). The next
+// join is pinned to the cached channel and BSSID, which skips the scan, and while the
+// lease is still valid it also skips DHCP: WiFi.config() with the cached lease, back up
+// in a few hundred ms. If the fast join has not connected after WIFI_FAST_JOIN_MS
+// (router replaced, channel moved) the link falls back to a normal scan with DHCP and
+// caches the new values. The file is only rewritten when something changed.
+//
+// A lease is only reused until it runs out, so the router cannot have handed the
+// address to another client in the meantime. The cores do not report the server's lease
+// time, so WIFI_LEASE_SEC is assumed (routers give at least that). The lease start is
+// stamped in wall-clock time, which the link sets with SNTP once connected; the ESP32
+// keeps it across resets and deep sleep, but after power loss (and any ESP8266 reset) the
+// clock starts from 0 and the lease counts as run out, so that join asks DHCP (still
+// pinned to the cached access point). A cached lease that runs out while the board is
+// connected is renewed in the background by switching the station back to DHCP.
+//
+// A lost connection is rejoined the same way, with a growing pause between failed
+// attempts. The status LED blinks while the board is offline and is solid when it is
+// connected; pass ledPin -1 when the sketch drives the LED itself.
+//
+// Include this after the board's WiFi header.
+
+const unsigned long WIFI_FAST_JOIN_MS = 1500;
+const unsigned long WIFI_SCAN_JOIN_MS = 15000;
+const unsigned long WIFI_RETRY_MIN_MS = 1000;
+const unsigned long WIFI_RETRY_MAX_MS = 30000;
+const unsigned long WIFI_BLINK_MS = 250;
+const unsigned long WIFI_RENEW_MS = 10000;        // DHCP after a lease ran out while connected
+const uint32_t WIFI_LEASE_SEC = 3600;
+const uint32_t WIFI_CLOCK_SET = 1600000000;       // time() below this has not been set
+const uint8_t WIFI_CACHE_VERSION = 2;
+const size_t WIFI_CACHE_SIZE = 37;
+
+// Last good join, as stored in the cache file
+struct WiFiCache {
+  uint32_t ssidHash;     // cache is for this network only
+  uint8_t channel;
+  uint8_t bssid[6];
+  uint8_t ip[4];
+  uint8_t gateway[4];
+  uint8_t subnet[4];
+  uint8_t dns[4];
+  uint32_t leaseStart;   // time() when the lease was obtained, 0 if the clock was not set
+  uint32_t leaseSec;     // lease length
+};
+
+inline uint32_t wifiClockSec() { return (uint32_t)time(NULL); }
+
+// Lease still held at nowSec; without a set clock nobody knows how long the board was off
+inline bool wifiLeaseValid(const WiFiCache& cache, uint32_t nowSec) {
+  return cache.leaseStart >= WIFI_CLOCK_SET && nowSec >= cache.leaseStart &&
+         nowSec - cache.leaseStart < cache.leaseSec;
+}
+
+inline uint32_t wifiSsidHash(const char* ssid) {
+  uint32_t hash = 2166136261UL;
+  for (; *ssid; ++ssid) hash = (hash ^ (uint8_t)*ssid) * 16777619UL;
+  return hash;
+}
+
+inline uint8_t wifiCacheCheck(const uint8_t* data, size_t len) {
+  uint8_t check = 0x5A;
+  for (size_t i = 0; i < len; i++) check = (uint8_t)((check << 1 | check >> 7) ^ data[i]);
+  return check;
+}
+
+// Layout: version, ssid hash (LE), channel, bssid, ip, gateway, subnet, dns, lease start
+// (LE), lease length (LE), check
+inline void wifiCacheEncode(const WiFiCache& cache, uint8_t* out) {
+  out[0] = WIFI_CACHE_VERSION;
+  for (int i = 0; i < 4; i++) out[1 + i] = (uint8_t)(cache.ssidHash >> (8 * i));
+  out[5] = cache.channel;
+  memcpy(out + 6, cache.bssid, 6);
+  memcpy(out + 12, cache.ip, 4);
+  memcpy(out + 16, cache.gateway, 4);
+  memcpy(out + 20, cache.subnet, 4);
+  memcpy(out + 24, cache.dns, 4);
+  for (int i = 0; i < 4; i++) out[28 + i] = (uint8_t)(cache.leaseStart >> (8 * i));
+  for (int i = 0; i < 4; i++) out[32 + i] = (uint8_t)(cache.leaseSec >> (8 * i));
+  out[WIFI_CACHE_SIZE - 1] = wifiCacheCheck(out, WIFI_CACHE_SIZE - 1);
+}
+
+inline bool wifiCacheDecode(const uint8_t* in, WiFiCache* cache) {
+  if (in[0] != WIFI_CACHE_VERSION || in[WIFI_CACHE_SIZE - 1] != wifiCacheCheck(in, WIFI_CACHE_SIZE - 1)) return false;
+  cache->ssidHash = 0;
+  for (int i = 0; i < 4; i++) cache->ssidHash |= (uint32_t)in[1 + i] << (8 * i);
+  cache->channel = in[5];
+  memcpy(cache->bssid, in + 6, 6);
+  memcpy(cache->ip, in + 12, 4);
+  memcpy(cache->gateway, in + 16, 4);
+  memcpy(cache->subnet, in + 20, 4);
+  memcpy(cache->dns, in + 24, 4);
+  cache->leaseStart = 0;
+  cache->leaseSec = 0;
+  for (int i = 0; i < 4; i++) cache->leaseStart |= (uint32_t)in[28 + i] << (8 * i);
+  for (int i = 0; i < 4; i++) cache->leaseSec |= (uint32_t)in[32 + i] << (8 * i);
+  return cache->channel != 0;
+}
+
+enum WiFiLinkState {
+  WIFI_LINK_IDLE = 0,
+  WIFI_LINK_FAST,       // joining with the cached channel and BSSID (and lease, while valid)
+  WIFI_LINK_SCAN,       // joining with a scan and DHCP
+  WIFI_LINK_WAIT,       // pause before the next attempt
+  WIFI_LINK_UP,
+  WIFI_LINK_RENEW       // connected, the cached lease ran out: waiting for DHCP
+};
+
+// FsT is fs::FS (LittleFS on both boards), mounted by the sketch before begin()
+template <class FsT>
+class WiFiLink {
+public:
+  explicit WiFiLink(FsT& fs, const char* cachePath = "/wifi.bin")
+    : fs_(fs), cachePath_(cachePath), ssid_(NULL), password_(NULL), ledPin_(-1), state_(WIFI_LINK_IDLE),
+      cached_(false), fastJoin_(false), staticLease_(false), leaseStamped_(false), clockStarted_(false),
+      leaseAt_(0), stateSince_(0), joinStart_(0), joinMs_(0), retryMs_(WIFI_RETRY_MIN_MS), lastBlink_(0),
+      led_(false), joins_(0) {}
+
+  // Starts joining and returns at once; tick() finishes the job
+  void begin(const char* ssid, const char* password, int ledPin = -1) {
+    ssid_ = ssid;
+    password_ = password;
+    ledPin_ = ledPin;
+    if (ledPin_ >= 0) {
+      pinMode(ledPin_, OUTPUT);
+      digitalWrite(ledPin_, LOW);
+    }
+    cached_ = load();
+    WiFi.persistent(false);        // the SDK's own flash copy of the config is not needed
+    WiFi.mode(WIFI_STA);
+    WiFi.setSleep(false);          // a sleeping radio adds 100+ ms to every request
+    WiFi.setAutoReconnect(false);  // rejoins are done here, with the cache
+    join(millis());
+  }
+
+  void tick(unsigned long now) {
+    bool up = WiFi.status() == WL_CONNECTED;
+    switch (state_) {
+      case WIFI_LINK_FAST:
+      case WIFI_LINK_SCAN:
+        if (up) {
+          connected(now);
+        } else if (state_ == WIFI_LINK_FAST && now - stateSince_ >= WIFI_FAST_JOIN_MS) {
+          Serial.println("WiFi: cached access point not answering, scanning");
+          scan(now);
+        } else if (state_ == WIFI_LINK_SCAN && now - stateSince_ >= WIFI_SCAN_JOIN_MS) {
+          Serial.printf("WiFi: join failed, next try in %lu ms\n", retryMs_);
+          WiFi.disconnect();
+          setState(WIFI_LINK_WAIT, now);
+        }
+        break;
+      case WIFI_LINK_WAIT:
+        if (now - stateSince_ >= retryMs_) {
+          retryMs_ = retryMs_ * 2 > WIFI_RETRY_MAX_MS ? WIFI_RETRY_MAX_MS : retryMs_ * 2;
+          join(now);
+        }
+        break;
+      case WIFI_LINK_UP:
+        if (!up) {
+          Serial.println("WiFi: connection lost, rejoining");
+          join(now);
+        } else if (!leaseStamped_ && wifiClockSec() >= WIFI_CLOCK_SET) {
+          leaseStamped_ = true;   // SNTP answered: date the DHCP lease, once
+          save(now);
+        } else if (staticLease_ && !wifiLeaseValid(cache_, wifiClockSec())) {
+          Serial.println("WiFi: cached lease ran out, renewing with DHCP");
+          staticLease_ = false;
+          WiFi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0));   // back to DHCP
+          setState(WIFI_LINK_RENEW, now);
+        }
+        break;
+      case WIFI_LINK_RENEW:
+        if (!up) {
+          join(now);
+        } else if (!(WiFi.localIP() == IPAddress(0, 0, 0, 0))) {
+          setState(WIFI_LINK_UP, now);
+          Serial.print("WiFi: lease renewed, IP ");
+          Serial.println(WiFi.localIP());
+          leaseAt_ = now;
+          leaseStamped_ = false;
+          save(now);
+        } else if (now - stateSince_ >= WIFI_RENEW_MS) {
+          Serial.println("WiFi: no DHCP answer, rejoining");
+          scan(now);
+        }
+        break;
+      default:
+        break;
+    }
+    if (state_ != WIFI_LINK_UP && ledPin_ >= 0 && now - lastBlink_ >= WIFI_BLINK_MS) {
+      lastBlink_ = now;
+      led_ = !led_;
+      digitalWrite(ledPin_, led_ ? HIGH : LOW);
+    }
+  }
+
+  bool connected() const { return state_ == WIFI_LINK_UP; }
+  uint8_t state() const { return state_; }
+  bool fastJoin() const { return fastJoin_; }       // last join used the cache
+  unsigned long joinMs() const { return joinMs_; }  // how long the last join took
+  unsigned long joins() const { return joins_; }
+
+private:
+  void setState(uint8_t state, unsigned long now) {
+    state_ = state;
+    stateSince_ = now;
+  }
+
+  void join(unsigned long now) {
+    joinStart_ = now;
+    if (!cached_) {
+      scan(now);
+      return;
+    }
+    staticLease_ = wifiLeaseValid(cache_, wifiClockSec());
+    if (staticLease_) {
+      WiFi.config(IPAddress(cache_.ip[0], cache_.ip[1], cache_.ip[2], cache_.ip[3]),
+                  IPAddress(cache_.gateway[0], cache_.gateway[1], cache_.gateway[2], cache_.gateway[3]),
+                  IPAddress(cache_.subnet[0], cache_.subnet[1], cache_.subnet[2], cache_.subnet[3]),
+                  IPAddress(cache_.dns[0], cache_.dns[1], cache_.dns[2], cache_.dns[3]));
+    } else {
+      WiFi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0));   // lease ran out: DHCP
+    }
+    WiFi.begin(ssid_, password_, cache_.channel, cache_.bssid, true);
+    fastJoin_ = true;
+    setState(WIFI_LINK_FAST, now);
+  }
+
+  void scan(unsigned long now) {
+    WiFi.disconnect();
+    WiFi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0));   // back to DHCP
+    WiFi.begin(ssid_, password_);
+    fastJoin_ = false;
+    staticLease_ = false;
+    setState(WIFI_LINK_SCAN, now);
+  }
+
+  void connected(unsigned long now) {
+    joinMs_ = now - joinStart_;
+    joins_++;
+    retryMs_ = WIFI_RETRY_MIN_MS;
+    setState(WIFI_LINK_UP, now);
+    if (ledPin_ >= 0) digitalWrite(ledPin_, HIGH);
+    Serial.print("WiFi: connected, IP ");
+    Serial.print(WiFi.localIP());
+    Serial.printf(" in %lu ms (%s)\n", joinMs_, staticLease_ ? "cached lease" : fastJoin_ ? "cached AP, DHCP" : "scan");
+    if (!clockStarted_) {
+      clockStarted_ = true;
+      configTime(0, 0, "pool.ntp.org");   // wall clock for dating leases
+    }
+    leaseAt_ = now;
+    leaseStamped_ = staticLease_;
+    save(now);
+  }
+
+  bool load() {
+    uint8_t data[WIFI_CACHE_SIZE];
+    File file = fs_.open(cachePath_, "r");
+    if (!file || file.read(data, sizeof(data)) != sizeof(data)) return false;
+    return wifiCacheDecode(data, &cache_) && cache_.ssidHash == wifiSsidHash(ssid_);
+  }
+
+  void save(unsigned long now) {
+    WiFiCache fresh;
+    const uint8_t* bssid = WiFi.BSSID();
+    if (!bssid) return;
+    fresh.ssidHash = wifiSsidHash(ssid_);
+    fresh.channel = (uint8_t)WiFi.channel();
+    memcpy(fresh.bssid, bssid, 6);
+    copyAddress(fresh.ip, WiFi.localIP());
+    copyAddress(fresh.gateway, WiFi.gatewayIP());
+    copyAddress(fresh.subnet, WiFi.subnetMask());
+    copyAddress(fresh.dns, WiFi.dnsIP());
+    if (staticLease_) {
+      fresh.leaseStart = cache_.leaseStart;   // same lease, still running
+      fresh.leaseSec = cache_.leaseSec;
+    } else {
+      uint32_t clock = wifiClockSec();
+      fresh.leaseStart = clock >= WIFI_CLOCK_SET ? clock - (uint32_t)((now - leaseAt_) / 1000) : 0;
+      fresh.leaseSec = WIFI_LEASE_SEC;
+    }
+    uint8_t data[WIFI_CACHE_SIZE];
+    wifiCacheEncode(fresh, data);
+    if (cached_) {
+      uint8_t old[WIFI_CACHE_SIZE];
+      wifiCacheEncode(cache_, old);
+      if (memcmp(old, data, sizeof(data)) == 0) return;   // unchanged, spare the flash
+    }
+    File file = fs_.open(cachePath_, "w");
+    if (!file || file.write(data, sizeof(data)) != sizeof(data)) {
+      Serial.println("WiFi: could not write the join cache");
+      return;
+    }
+    cache_ = fresh;
+    cached_ = true;
+  }
+
+  static void copyAddress(uint8_t* out, const IPAddress& ip) {
+    for (int i = 0; i < 4; i++) out[i] = ip[i];
+  }
+
+  FsT& fs_;
+  const char* cachePath_;
+  const char* ssid_;
+  const char* password_;
+  int ledPin_;
+  uint8_t state_;
+  WiFiCache cache_;
+  bool cached_;
+  bool fastJoin_;
+  bool staticLease_;      // joined with the cached lease, not DHCP
+  bool leaseStamped_;     // cache holds the lease's wall-clock start
+  bool clockStarted_;
+  unsigned long leaseAt_; // millis() when the lease was obtained
+  unsigned long stateSince_;
+  unsigned long joinStart_;
+  unsigned long joinMs_;
+  unsigned long retryMs_;
+  unsigned long lastBlink_;
+  bool led_;
+  unsigned long joins_;
+};
+
+#endif
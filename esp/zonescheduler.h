@@ -0,0 +1,270 @@
+#ifndef ZONESCHEDULER_H
+#define ZONESCHEDULER_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "jsonwriter.h"
+
+// Irrigation scheduling across the plots (zones) the rover visits.
+//
+// Each zone has its own dry threshold, target moisture, revisit limits and daily pump
+// budget. The scheduler learns how fast every zone dries out (ADC units per hour, from
+// consecutive readings without watering in between), predicts its current moisture and
+// orders the zones that are due by urgency with a small binary heap:
+//
+//   - a zone is never probed again before minRevisitMs,
+//   - it is due once its predicted reading crosses dryThreshold or maxRevisitMs passed,
+//   - never-visited zones come first, then overdue ones, then the driest predicted.
+//
+// Pump run time is limited twice: per zone by dailyBudgetMs, and for the pump as a whole
+// by a duty cycle (maxOnMs per windowMs). Reservoir levels below minReservoir allow no
+// pumping at all, below lowReservoir only half the allowance.
+//
+// Readings follow the sensors' convention: higher value = drier soil.
+
+struct ZoneConfig {
+  const char* name;
+  int dryThreshold;             // water when the reading is above this
+  int targetMoisture;           // reading to bring the soil back to
+  unsigned long minRevisitMs;
+  unsigned long maxRevisitMs;
+  unsigned long dailyBudgetMs;  // pump run time per 24 h
+};
+
+struct PumpLimits {
+  unsigned long windowMs;
+  unsigned long maxOnMs;        // pump on-time allowed per window
+  int minReservoir;
+  int lowReservoir;
+};
+
+struct ZoneState {
+  int lastReading;              // -1 until the first visit
+  unsigned long lastVisit;
+  unsigned long lastWatered;
+  long dryingRate;              // ADC units per hour, >= 0
+  unsigned long budgetUsedMs;
+  unsigned long budgetDayStart;
+  bool wateredSinceVisit;
+  uint16_t visits;
+};
+
+const unsigned long ZONE_DAY_MS = 86400000UL;
+const long ZONE_OVERDUE_BONUS = 100000L;
+const long ZONE_UNVISITED_SCORE = LONG_MAX / 2;
+
+template <size_t MAX_ZONES = 8>
+class ZoneScheduler {
+public:
+  explicit ZoneScheduler(const PumpLimits& limits) : limits_(limits), count_(0), windowStart_(0), windowUsedMs_(0) {}
+
+  // Returns the zone id, or -1 when the table is full.
+  int addZone(const ZoneConfig& config) {
+    if (count_ == MAX_ZONES) return -1;
+    configs_[count_] = config;
+    ZoneState& s = states_[count_];
+    s.lastReading = -1;
+    s.lastVisit = 0;
+    s.lastWatered = 0;
+    s.dryingRate = 0;
+    s.budgetUsedMs = 0;
+    s.budgetDayStart = 0;
+    s.wateredSinceVisit = false;
+    s.visits = 0;
+    return (int)count_++;
+  }
+
+  size_t zoneCount() const { return count_; }
+  bool valid(int zone) const { return zone >= 0 && (size_t)zone < count_; }
+  const ZoneConfig& config(int zone) const { return configs_[zone]; }
+  const ZoneState& state(int zone) const { return states_[zone]; }
+
+  // Expected reading now, extrapolated with the learned drying rate (-1 if unknown)
+  int predicted(int zone, unsigned long now) const {
+    const ZoneState& s = states_[zone];
+    if (s.lastReading < 0) return -1;
+    unsigned long elapsed = now - s.lastVisit;
+    long drift = (long)((double)s.dryingRate * elapsed / 3600000.0);
+    long value = s.lastReading + drift;
+    return value > 4095 ? 4095 : (int)value;
+  }
+
+  bool due(int zone, unsigned long now) const {
+    if (!valid(zone)) return false;
+    const ZoneState& s = states_[zone];
+    const ZoneConfig& c = configs_[zone];
+    if (s.visits == 0) return true;
+    unsigned long elapsed = now - s.lastVisit;
+    if (elapsed < c.minRevisitMs) return false;
+    return elapsed >= c.maxRevisitMs || predicted(zone, now) > c.dryThreshold;
+  }
+
+  // Higher = visit sooner. Only meaningful for zones that are due.
+  long urgency(int zone, unsigned long now) const {
+    const ZoneState& s = states_[zone];
+    const ZoneConfig& c = configs_[zone];
+    if (s.visits == 0) return ZONE_UNVISITED_SCORE - zone;
+    long score = (long)predicted(zone, now) - c.dryThreshold;
+    if (now - s.lastVisit >= c.maxRevisitMs) score += ZONE_OVERDUE_BONUS;
+    return score;
+  }
+
+  // Writes the due zones into out, most urgent first. Returns how many were written.
+  size_t plan(unsigned long now, int* out, size_t maxOut) const {
+    Entry heap[MAX_ZONES];
+    size_t n = 0;
+    for (size_t i = 0; i < count_; i++) {
+      if (!due((int)i, now)) continue;
+      heap[n].score = urgency((int)i, now);
+      heap[n].zone = (int)i;
+      siftUp(heap, n++);
+    }
+    size_t written = 0;
+    while (n > 0 && written < maxOut) {
+      out[written++] = heap[0].zone;
+      heap[0] = heap[--n];
+      siftDown(heap, n, 0);
+    }
+    return written;
+  }
+
+  // Most urgent due zone, -1 when nothing is due
+  int next(unsigned long now) const {
+    int zone;
+    return plan(now, &zone, 1) ? zone : -1;
+  }
+
+  void recordReading(int zone, int reading, unsigned long now) {
+    if (!valid(zone)) return;
+    ZoneState& s = states_[zone];
+    unsigned long elapsed = now - s.lastVisit;
+    // Learn the drying rate only from intervals without watering (or rain) in between
+    if (s.lastReading >= 0 && !s.wateredSinceVisit && elapsed > 0 && reading >= s.lastReading) {
+      long rate = (long)((double)(reading - s.lastReading) * 3600000.0 / elapsed);
+      s.dryingRate = s.visits > 1 ? (3 * s.dryingRate + rate) / 4 : rate;
+    }
+    s.lastReading = reading;
+    s.lastVisit = now;
+    s.wateredSinceVisit = false;
+    if (s.visits < 0xFFFF) s.visits++;
+  }
+
+  bool needsWater(int zone, int reading) const {
+    return valid(zone) && reading > configs_[zone].dryThreshold;
+  }
+
+  // Pump run time (ms) allowed for this zone right now
+  unsigned long pumpAllowance(int zone, unsigned long now, int reservoirLevel) {
+    if (!valid(zone) || reservoirLevel < limits_.minReservoir) return 0;
+    rollWindows(zone, now);
+    const ZoneConfig& c = configs_[zone];
+    const ZoneState& s = states_[zone];
+    unsigned long duty = limits_.maxOnMs > windowUsedMs_ ? limits_.maxOnMs - windowUsedMs_ : 0;
+    unsigned long budget = c.dailyBudgetMs > s.budgetUsedMs ? c.dailyBudgetMs - s.budgetUsedMs : 0;
+    unsigned long allowed = duty < budget ? duty : budget;
+    return reservoirLevel < limits_.lowReservoir ? allowed / 2 : allowed;
+  }
+
+  void recordPumpRun(int zone, unsigned long runMs, unsigned long now) {
+    rollWindows(zone, now);
+    windowUsedMs_ += runMs;
+    if (!valid(zone)) return;
+    ZoneState& s = states_[zone];
+    s.budgetUsedMs += runMs;
+    s.lastWatered = now;
+    s.wateredSinceVisit = true;
+  }
+
+  unsigned long dutyUsedMs() const { return windowUsedMs_; }
+  const PumpLimits& limits() const { return limits_; }
+
+private:
+  struct Entry {
+    long score;
+    int zone;
+  };
+
+  void rollWindows(int zone, unsigned long now) {
+    if (now - windowStart_ >= limits_.windowMs) {
+      windowStart_ = now;
+      windowUsedMs_ = 0;
+    }
+    if (!valid(zone)) return;
+    ZoneState& s = states_[zone];
+    if (now - s.budgetDayStart >= ZONE_DAY_MS) {
+      s.budgetDayStart = now;
+      s.budgetUsedMs = 0;
+    }
+  }
+
+  static void siftUp(Entry* heap, size_t i) {
+    while (i > 0) {
+      size_t parent = (i - 1) / 2;
+      if (heap[parent].score >= heap[i].score) break;
+      Entry tmp = heap[parent];
+      heap[parent] = heap[i];
+      heap[i] = tmp;
+      i = parent;
+    }
+  }
+
+  static void siftDown(Entry* heap, size_t n, size_t i) {
+    for (;;) {
+      size_t largest = i;
+      size_t left = 2 * i + 1, right = left + 1;
+      if (left < n && heap[left].score > heap[largest].score) largest = left;
+      if (right < n && heap[right].score > heap[largest].score) largest = right;
+      if (largest == i) return;
+      Entry tmp = heap[largest];
+      heap[largest] = heap[i];
+      heap[i] = tmp;
+      i = largest;
+    }
+  }
+
+  PumpLimits limits_;
+  ZoneConfig configs_[MAX_ZONES];
+  ZoneState states_[MAX_ZONES];
+  size_t count_;
+  unsigned long windowStart_;
+  unsigned long windowUsedMs_;
+};
+
+// One zone's object in addZonesJson() with every number at full width and a name of up
+// to 32 characters
+const size_t ZONE_JSON_MAX = 320;
+
+// Bytes addZonesJson() adds for a scheduler of the given size, for sizing the response:
+//   JsonWriter<256 + zonesJsonBytes(8)> json;
+constexpr size_t zonesJsonBytes(size_t maxZones) {
+  return 32 + maxZones * 4 + maxZones * (ZONE_JSON_MAX + 1);
+}
+
+// Adds "plan" (due zone ids, most urgent first) and "zones" (per-zone state) to a
+// response, shared by the sketches' /zones handlers. Both arrays are written straight
+// into the response, so it needs zonesJsonBytes(Z) on top of its other fields.
+template <size_t N, size_t Z>
+void addZonesJson(JsonWriter<N>& json, const ZoneScheduler<Z>& zones, unsigned long now) {
+  int due[Z];
+  size_t dueCount = zones.plan(now, due, Z);
+  json.beginArray("plan");
+  for (size_t i = 0; i < dueCount; i++) json.element((long)due[i]);
+  json.endArray();
+
+  json.beginArray("zones");
+  for (size_t i = 0; i < zones.zoneCount(); i++) {
+    const ZoneConfig& c = zones.config((int)i);
+    const ZoneState& s = zones.state((int)i);
+    JsonWriter<ZONE_JSON_MAX> zone;
+    zone.add("id", (int)i).add("name", c.name).add("dryThreshold", c.dryThreshold).add("target", c.targetMoisture)
+        .add("lastReading", s.lastReading).add("predicted", zones.predicted((int)i, now))
+        .add("dryingRate", s.dryingRate).add("visits", (unsigned int)s.visits)
+        .add("sinceVisitMs", s.visits ? now - s.lastVisit : 0UL)
+        .add("budgetUsedMs", s.budgetUsedMs).add("budgetMs", c.dailyBudgetMs).add("due", zones.due((int)i, now));
+    json.element(zone);
+  }
+  json.endArray();
+}
+
+#endif
@@ -0,0 +1,341 @@
+#ifndef GATEWAY_BOARDLINK_H
+#define GATEWAY_BOARDLINK_H
+
+#include <arpa/inet.h>
+#include <deque>
+#include <errno.h>
+#include <functional>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+#include "eventloop.h"
+#include "httpmessage.h"
+
+// The gateway's only connection to one board.
+//
+// A board's WebServer handles one client at a time, in loop() (or its network task), so
+// every extra consumer costs it loop time. BoardLink is the single consumer: one request
+// in flight at most, the rest queued in order. A request identical (method, path and
+// query, body) to the last one queued is sent once, and its reply goes to every waiter:
+// ten dashboards pressing "stop" are one /stop to the board. Only the last one: merging
+// with an older entry would move the command ahead of those queued after it.
+//
+// The connection is kept open when the board answers with keep-alive, otherwise opened
+// per request; a kept connection the board has closed in the meantime is retried once on
+// a fresh one. A board that cannot be reached fails everything queued at once (the
+// operators get a 502 right away instead of a queue that drains into timeouts) and is
+// left alone for a backoff that doubles up to BOARD_BACKOFF_MAX_MS.
+
+const size_t BOARD_QUEUE_MAX = 32;
+const unsigned long BOARD_CONNECT_MS = 2000;
+const unsigned long BOARD_REPLY_MS = 8000;          // boards answer at once; a slow one is lost
+const unsigned long BOARD_IDLE_MS = 30000;           // a kept connection nobody used
+const unsigned long BOARD_BACKOFF_MS = 500;
+const unsigned long BOARD_BACKOFF_MAX_MS = 10000;
+
+// reply is NULL when the board could not be reached or did not answer in time
+typedef std::function<void(const HttpResponse* reply)> BoardReplyFn;
+
+class BoardLink : public EventHandler {
+public:
+  BoardLink(EventLoop& loop, const std::string& name)
+    : loop_(loop), name_(name), port_(0), hasAddress_(false), fd_(-1), state_(CLOSED), reused_(false), attempts_(0),
+      stateSince_(0), retryAt_(0), failures_(0), sent_(0), coalesced_(0), connects_(0), rttMs_(0) {}
+
+  ~BoardLink() { closeSocket(); }
+
+  // Again whenever the board's beacon shows a new address; a request in flight to the
+  // old one is sent again to the new
+  bool setAddress(const std::string& host, uint16_t port) {
+    if (hasAddress_ && host == host_ && port == port_) return true;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 && !resolve(host, &addr.sin_addr)) return false;
+    host_ = host;
+    port_ = port;
+    addr_ = addr;
+    hasAddress_ = true;
+    failures_ = 0;
+    retryAt_ = 0;
+    if (state_ != CLOSED && state_ != OPEN) queue_.push_front(inflight_);
+    closeSocket();
+    startNext();
+    return true;
+  }
+
+  const std::string& host() const { return host_; }
+  uint16_t port() const { return port_; }
+
+  // False when the queue is full or the board is backing off after failures
+  bool request(const std::string& method, const std::string& target, const std::string& body,
+               const std::string& contentType, BoardReplyFn reply) {
+    if (!queue_.empty()) {
+      Pending& last = queue_.back();
+      if (last.method == method && last.target == target && last.body == body) {
+        last.waiters.push_back(reply);
+        coalesced_++;
+        return true;
+      }
+    }
+    if (queue_.size() >= BOARD_QUEUE_MAX || !hasAddress_ || monotonicMs() < retryAt_) return false;
+    Pending p;
+    p.method = method;
+    p.target = target;
+    p.body = body;
+    p.contentType = contentType;
+    p.waiters.push_back(reply);
+    queue_.push_back(p);
+    startNext();
+    return true;
+  }
+
+  // Nothing in flight and nothing queued
+  bool idle() const { return queue_.empty() && (state_ == CLOSED || state_ == OPEN); }
+  bool backingOff(uint64_t now) const { return now < retryAt_; }
+  size_t queued() const { return queue_.size(); }
+  uint32_t failures() const { return failures_; }
+  uint32_t sent() const { return sent_; }
+  uint32_t coalesced() const { return coalesced_; }
+  uint32_t connects() const { return connects_; }
+  unsigned long rttMs() const { return rttMs_; }
+
+  // Timeouts, idle connections, the next request after a backoff
+  void tick(uint64_t now) {
+    if (state_ == CONNECTING && now - stateSince_ > BOARD_CONNECT_MS) {
+      fail("connect timeout");
+    } else if ((state_ == SENDING || state_ == WAITING) && now - stateSince_ > BOARD_REPLY_MS) {
+      fail("no reply");
+    } else if (state_ == OPEN && now - stateSince_ > BOARD_IDLE_MS) {
+      closeSocket();
+    }
+    startNext();
+  }
+
+  virtual void onEvent(uint32_t events) {
+    switch (state_) {
+      case CONNECTING: {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0) {
+          fail(strerror(error ? error : errno));
+          return;
+        }
+        connects_++;
+        send();
+        break;
+      }
+      case SENDING:
+        if (events & (EPOLLERR | EPOLLHUP)) fail("connection lost");
+        else flush();
+        break;
+      case WAITING:
+        receive();
+        break;
+      case OPEN:
+        closeSocket();   // the board closed a kept connection, or sent something unasked
+        break;
+      case CLOSED:
+        break;
+    }
+  }
+
+private:
+  enum State { CLOSED, CONNECTING, SENDING, WAITING, OPEN };
+
+  struct Pending {
+    std::string method;
+    std::string target;
+    std::string body;
+    std::string contentType;
+    std::vector<BoardReplyFn> waiters;
+  };
+
+  static bool resolve(const std::string& host, in_addr* out) {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = NULL;
+    if (getaddrinfo(host.c_str(), NULL, &hints, &result) != 0 || !result) return false;
+    *out = ((sockaddr_in*)result->ai_addr)->sin_addr;
+    freeaddrinfo(result);
+    return true;
+  }
+
+  void setState(State state) {
+    state_ = state;
+    stateSince_ = monotonicMs();
+  }
+
+  void startNext() {
+    if (queue_.empty() || (state_ != CLOSED && state_ != OPEN) || monotonicMs() < retryAt_) return;
+    inflight_ = queue_.front();
+    queue_.pop_front();
+    attempts_ = 0;
+    begin();
+  }
+
+  void begin() {
+    attempts_++;
+    parser_.reset();
+    sentAt_ = monotonicMs();
+    if (fd_ >= 0) {
+      reused_ = true;
+      send();
+      return;
+    }
+    reused_ = false;
+    fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+      fail(strerror(errno));
+      return;
+    }
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd_, (const sockaddr*)&addr_, sizeof(addr_)) != 0 && errno != EINPROGRESS) {
+      fail(strerror(errno));
+      return;
+    }
+    setState(CONNECTING);
+    loop_.add(fd_, EPOLLOUT, this);
+  }
+
+  void send() {
+    out_ = inflight_.method + " " + inflight_.target + " HTTP/1.1\r\nHost: " + host_ +
+           "\r\nConnection: keep-alive\r\nUser-Agent: fleet-gateway\r\n";
+    if (!inflight_.body.empty() || inflight_.method == "POST") {
+      if (!inflight_.contentType.empty()) out_ += "Content-Type: " + inflight_.contentType + "\r\n";
+      out_ += "Content-Length: " + std::to_string(inflight_.body.size()) + "\r\n";
+    }
+    out_ += "\r\n" + inflight_.body;
+    sent_++;
+    setState(SENDING);
+    loop_.modify(fd_, EPOLLOUT, this);
+    flush();
+  }
+
+  void flush() {
+    while (!out_.empty()) {
+      ssize_t n = ::send(fd_, out_.data(), out_.size(), MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+        fail(strerror(errno));
+        return;
+      }
+      out_.erase(0, (size_t)n);
+    }
+    setState(WAITING);
+    loop_.modify(fd_, EPOLLIN, this);
+  }
+
+  void receive() {
+    char buf[4096];
+    for (;;) {
+      ssize_t n = recv(fd_, buf, sizeof(buf), 0);
+      HttpParse result;
+      if (n > 0) {
+        result = parser_.feed(buf, (size_t)n);
+      } else if (n == 0) {
+        result = parser_.closed();
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      } else {
+        fail(strerror(errno));
+        return;
+      }
+      if (result == HTTP_DONE) {
+        complete();
+        return;
+      }
+      if (result == HTTP_ERROR) {
+        fail(n == 0 ? "closed early" : "bad reply");
+        return;
+      }
+    }
+  }
+
+  void complete() {
+    rttMs_ = (unsigned long)(monotonicMs() - sentAt_);
+    failures_ = 0;
+    if (parser_.response().keepAlive) {
+      setState(OPEN);
+      loop_.modify(fd_, EPOLLIN, this);
+    } else {
+      closeSocket();
+    }
+    // Waiters may queue the next request, so take them out first
+    std::vector<BoardReplyFn> waiters;
+    waiters.swap(inflight_.waiters);
+    HttpResponse reply = parser_.response();
+    for (size_t i = 0; i < waiters.size(); i++) waiters[i](&reply);
+    startNext();
+  }
+
+  void fail(const char* reason) {
+    bool stale = reused_ && !parser_.started() && attempts_ < 2;
+    closeSocket();
+    if (stale) {
+      begin();   // the board had dropped the kept connection: once more on a new one
+      return;
+    }
+    failures_++;
+    unsigned long backoff = BOARD_BACKOFF_MS << (failures_ < 6 ? failures_ - 1 : 5);
+    retryAt_ = monotonicMs() + (backoff < BOARD_BACKOFF_MAX_MS ? backoff : BOARD_BACKOFF_MAX_MS);
+    fprintf(stderr, "%s (%s:%u): %s %s failed: %s\n", name_.c_str(), host_.c_str(), port_, inflight_.method.c_str(),
+            inflight_.target.c_str(), reason);
+    queue_.push_front(inflight_);
+    inflight_.waiters.clear();
+    failAll();
+  }
+
+  void failAll() {
+    std::deque<Pending> failed;
+    failed.swap(queue_);
+    for (size_t i = 0; i < failed.size(); i++) {
+      for (size_t j = 0; j < failed[i].waiters.size(); j++) failed[i].waiters[j](NULL);
+    }
+  }
+
+  void closeSocket() {
+    if (fd_ >= 0) {
+      loop_.remove(fd_);
+      close(fd_);
+      fd_ = -1;
+    }
+    setState(CLOSED);
+  }
+
+  EventLoop& loop_;
+  std::string name_;
+  std::string host_;
+  uint16_t port_;
+  sockaddr_in addr_;
+  bool hasAddress_;
+  int fd_;
+  State state_;
+  bool reused_;           // request went out on a kept connection
+  uint8_t attempts_;
+  uint64_t stateSince_;
+  uint64_t sentAt_;
+  uint64_t retryAt_;
+  std::deque<Pending> queue_;
+  Pending inflight_;
+  std::string out_;
+  HttpResponseParser parser_;
+  uint32_t failures_;     // in a row
+  uint32_t sent_;
+  uint32_t coalesced_;
+  uint32_t connects_;
+  unsigned long rttMs_;
+};
+
+#endif
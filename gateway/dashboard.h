@@ -0,0 +1,455 @@
+#ifndef GATEWAY_DASHBOARD_H
+#define GATEWAY_DASHBOARD_H
+
+#include <errno.h>
+#include <map>
+#include <netinet/in.h>
+#include <set>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "eventloop.h"
+#include "fleet.h"
+#include "httpmessage.h"
+
+// The HTTP side the dashboards talk to, any number of them.
+//
+//   GET /boards              every board: name, role, address, online, state age, link numbers
+//   GET /events              SSE: {"board":..., "online":..., "state":{...}} whenever any board changes
+//   GET /metrics             the gateway's own numbers, Prometheus text
+//   /b/<name>/events         SSE: the board's state JSON whenever it changes
+//   /b/<name>/<path>         the board's own API
+//
+// /b/<name> is a drop-in base address for a board: the dashboard's board address set to
+// "gateway:8090/b/samplemotor" keeps working unchanged. Its /status or /ping (whichever
+// the gateway polls) is answered from the cached state while that is fresh, its /events
+// is served by the gateway, everything else goes to the board through its BoardLink,
+// where a command identical to the one queued last is merged. Every answer carries
+// Access-Control-Allow-Origin: *, like the boards' own.
+//
+// A stream whose client does not keep up (more than DASH_OUT_MAX unsent) is dropped
+// rather than buffered without end; EventSource reconnects by itself.
+
+const size_t DASH_OUT_MAX = 1 << 20;
+const unsigned long DASH_KEEPALIVE_MS = 15000;      // SSE comment line, keeps proxies from timing out
+const unsigned long DASH_IDLE_MS = 60000;           // a connection with no request in flight
+
+class Dashboard;
+
+class DashConn : public EventHandler {
+public:
+  enum State { READING, WAITING, STREAM, CLOSING };
+
+  DashConn(Dashboard& dash, int fd, uint64_t id)
+    : dash_(dash), fd_(fd), id_(id), state_(READING), lastActive_(monotonicMs()), writing_(false) {}
+
+  virtual ~DashConn() {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  int fd() const { return fd_; }
+  uint64_t id() const { return id_; }
+  State state() const { return state_; }
+  uint64_t lastActive() const { return lastActive_; }
+  const std::string& stream() const { return stream_; }
+
+  virtual void onEvent(uint32_t events);
+
+  void respond(int status, const char* contentType, const std::string& body, const char* extraHeaders = "",
+               bool closing = false);
+  void startStream(const std::string& board);
+  void send(const std::string& data);
+  void waitForBoard() { state_ = WAITING; }
+  void shutdown();
+
+private:
+  void readRequests();
+  void flush();
+  void watchWrites(bool on);
+
+  Dashboard& dash_;
+  int fd_;
+  uint64_t id_;
+  State state_;
+  uint64_t lastActive_;
+  HttpRequestParser parser_;
+  std::string out_;
+  std::string stream_;   // SSE: board name, "*" for every board
+  bool writing_;         // EPOLLOUT wanted
+};
+
+class Dashboard : public EventHandler {
+public:
+  Dashboard(EventLoop& loop, Fleet& fleet) : loop_(loop), fleet_(fleet), fd_(-1), nextId_(1), nextKeepAlive_(0) {
+    fleet_.onChange([this](Board& board) { broadcast(board); });
+  }
+
+  ~Dashboard() {
+    for (std::map<uint64_t, DashConn*>::iterator it = conns_.begin(); it != conns_.end(); ++it) delete it->second;
+    if (fd_ >= 0) close(fd_);
+  }
+
+  bool listen(uint16_t port) {
+    fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) return false;
+    int one = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd_, (const sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(fd_, 128) != 0) {
+      perror("dashboard listen");
+      return false;
+    }
+    return loop_.add(fd_, EPOLLIN, this);
+  }
+
+  EventLoop& loop() { return loop_; }
+
+  // New connections
+  virtual void onEvent(uint32_t) {
+    for (;;) {
+      int fd = accept4(fd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("accept");
+        return;
+      }
+      DashConn* conn = new DashConn(*this, fd, nextId_++);
+      conns_[conn->id()] = conn;
+      loop_.add(fd, EPOLLIN, conn);
+    }
+  }
+
+  void tick(uint64_t now) {
+    bool keepAlive = now >= nextKeepAlive_;
+    if (keepAlive) nextKeepAlive_ = now + DASH_KEEPALIVE_MS;
+    // send() and shutdown() may take a connection out of conns_: collect first
+    std::vector<DashConn*> streams, idle;
+    for (std::map<uint64_t, DashConn*>::iterator it = conns_.begin(); it != conns_.end(); ++it) {
+      DashConn* conn = it->second;
+      if (conn->state() == DashConn::STREAM) streams.push_back(conn);
+      else if (conn->state() == DashConn::READING && now - conn->lastActive() > DASH_IDLE_MS) idle.push_back(conn);
+    }
+    for (size_t i = 0; keepAlive && i < streams.size(); i++) streams[i]->send(": keep-alive\n\n");
+    for (size_t i = 0; i < idle.size(); i++) idle[i]->shutdown();
+  }
+
+  void handle(DashConn& conn, const HttpRequest& request);
+
+  // Called by the connection as it goes away
+  void closed(DashConn& conn) {
+    if (conn.state() == DashConn::STREAM) {
+      streams_[conn.stream()].erase(&conn);
+      Board* board = fleet_.find(conn.stream());
+      if (board && board->subscribers > 0) board->subscribers--;
+    }
+    conns_.erase(conn.id());
+    loop_.remove(conn.fd());
+    loop_.retire(&conn);
+  }
+
+  void subscribe(DashConn& conn, const std::string& stream) { streams_[stream].insert(&conn); }
+
+private:
+  // The frame is built once and appended to every subscriber's buffer
+  void broadcast(Board& board) {
+    if (!board.state.empty()) send(board.name, sseFrame(board.state));
+    send("*", sseFrame(summary(board)));
+  }
+
+  void send(const std::string& stream, const std::string& frame) {
+    std::map<std::string, std::set<DashConn*> >::iterator it = streams_.find(stream);
+    if (it == streams_.end()) return;
+    std::vector<DashConn*> targets(it->second.begin(), it->second.end());   // a slow one leaves the set
+    for (size_t i = 0; i < targets.size(); i++) targets[i]->send(frame);
+  }
+
+  // One "data:" line: the boards' JSON has no line breaks that matter
+  static std::string sseFrame(const std::string& json) {
+    std::string frame = "data: ";
+    for (size_t i = 0; i < json.size(); i++) frame += json[i] == '\n' || json[i] == '\r' ? ' ' : json[i];
+    frame += "\n\n";
+    return frame;
+  }
+
+  static std::string summary(const Board& board) {
+    std::string out = "{\"board\":";
+    appendJsonString(out, board.name);
+    out += ",\"online\":";
+    out += board.online ? "true" : "false";
+    out += ",\"state\":";
+    out += board.state.empty() ? "null" : board.state;
+    out += "}";
+    return out;
+  }
+
+  std::string boardList(uint64_t now) const {
+    std::string out = "[";
+    const Fleet::BoardMap& boards = fleet_.boards();
+    for (Fleet::BoardMap::const_iterator it = boards.begin(); it != boards.end(); ++it) {
+      const Board& board = *it->second;
+      if (out.size() > 1) out += ",";
+      out += "{\"name\":";
+      appendJsonString(out, board.name);
+      out += ",\"role\":\"";
+      out += board.battery ? "battery" : roleName(board.role);
+      out += "\",\"online\":";
+      out += board.online ? "true" : "false";
+      char line[192];
+      if (board.link) {
+        snprintf(line, sizeof(line), ",\"host\":\"%s\",\"port\":%u,\"queued\":%zu,\"sent\":%lu,\"coalesced\":%lu,\"rttMs\":%lu",
+                 board.link->host().c_str(), board.link->port(), board.link->queued(), (unsigned long)board.link->sent(),
+                 (unsigned long)board.link->coalesced(), board.link->rttMs());
+        out += line;
+      }
+      snprintf(line, sizeof(line), ",\"subscribers\":%lu,\"stateAgeMs\":", (unsigned long)board.subscribers);
+      out += line;
+      out += board.state.empty() ? "null" : std::to_string(now - board.stateAt);
+      out += "}";
+    }
+    out += "]";
+    return out;
+  }
+
+  std::string metrics() const {
+    std::string out;
+    char line[256];
+    size_t online = 0, streams = 0;
+    const Fleet::BoardMap& boards = fleet_.boards();
+    for (Fleet::BoardMap::const_iterator it = boards.begin(); it != boards.end(); ++it) online += it->second->online;
+    for (std::map<std::string, std::set<DashConn*> >::const_iterator it = streams_.begin(); it != streams_.end(); ++it) {
+      streams += it->second.size();
+    }
+    snprintf(line, sizeof(line),
+             "# TYPE gateway_boards gauge\ngateway_boards %zu\n# TYPE gateway_boards_online gauge\ngateway_boards_online %zu\n"
+             "# TYPE gateway_connections gauge\ngateway_connections %zu\n# TYPE gateway_streams gauge\ngateway_streams %zu\n",
+             boards.size(), online, conns_.size(), streams);
+    out += line;
+    out += "# TYPE gateway_board_requests_total counter\n# TYPE gateway_board_coalesced_total counter\n"
+           "# TYPE gateway_board_connects_total counter\n# TYPE gateway_board_rtt_seconds gauge\n";
+    for (Fleet::BoardMap::const_iterator it = boards.begin(); it != boards.end(); ++it) {
+      const Board& board = *it->second;
+      if (!board.link) continue;
+      const char* name = board.name.c_str();
+      snprintf(line, sizeof(line),
+               "gateway_board_requests_total{board=\"%s\"} %lu\ngateway_board_coalesced_total{board=\"%s\"} %lu\n"
+               "gateway_board_connects_total{board=\"%s\"} %lu\ngateway_board_rtt_seconds{board=\"%s\"} %lu.%03lu\n",
+               name, (unsigned long)board.link->sent(), name, (unsigned long)board.link->coalesced(), name,
+               (unsigned long)board.link->connects(), name, board.link->rttMs() / 1000, board.link->rttMs() % 1000);
+      out += line;
+    }
+    return out;
+  }
+
+  void forward(DashConn& conn, Board& board, const HttpRequest& request, const std::string& target);
+
+  EventLoop& loop_;
+  Fleet& fleet_;
+  int fd_;
+  uint64_t nextId_;
+  uint64_t nextKeepAlive_;
+  std::map<uint64_t, DashConn*> conns_;                    // by id: a reply finds its client, if still there
+  std::map<std::string, std::set<DashConn*> > streams_;    // SSE clients by board, "*" for all
+};
+
+// --- DashConn ---
+
+inline void DashConn::onEvent(uint32_t events) {
+  if (events & (EPOLLERR | EPOLLHUP)) {
+    shutdown();
+    return;
+  }
+  if (events & EPOLLOUT) flush();
+  if (state_ != CLOSING && (events & EPOLLIN)) readRequests();
+}
+
+inline void DashConn::readRequests() {
+  char buf[4096];
+  for (;;) {
+    ssize_t n = recv(fd_, buf, sizeof(buf), 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      shutdown();
+      return;
+    }
+    if (n < 0) return;
+    lastActive_ = monotonicMs();
+    if (state_ != READING) {
+      // A stream has nothing to say; a pipelined request waits its turn in the parser
+      if (state_ == WAITING) parser_.feed(buf, (size_t)n);
+      continue;
+    }
+    HttpParse result = parser_.feed(buf, (size_t)n);
+    if (result == HTTP_ERROR) {
+      respond(400, "text/plain", "Bad request\n", "", true);
+      return;
+    }
+    if (result == HTTP_DONE) dash_.handle(*this, parser_.request());
+  }
+}
+
+inline void DashConn::respond(int status, const char* contentType, const std::string& body, const char* extraHeaders,
+                              bool closing) {
+  bool keepAlive = parser_.request().keepAlive && !closing;
+  const char* reason = status == 200 ? "OK" : status == 204 ? "No Content" : status == 400 ? "Bad Request" :
+                       status == 404 ? "Not Found" : status == 502 ? "Bad Gateway" : status == 503 ? "Service Unavailable" : "";
+  char head[160];
+  snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n", status, reason,
+           contentType, body.size());
+  out_ += head;
+  out_ += "Access-Control-Allow-Origin: *\r\n";
+  out_ += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+  out_ += extraHeaders;
+  out_ += "\r\n";
+  out_ += body;
+  if (keepAlive) {
+    state_ = READING;
+    parser_.reset();
+  } else {
+    state_ = CLOSING;
+  }
+  flush();
+  // The next request may already be in
+  if (state_ == READING) {
+    HttpParse result = parser_.resume();
+    if (result == HTTP_DONE) dash_.handle(*this, parser_.request());
+    else if (result == HTTP_ERROR) respond(400, "text/plain", "Bad request\n", "", true);
+  }
+}
+
+inline void DashConn::startStream(const std::string& board) {
+  state_ = STREAM;
+  stream_ = board;
+  out_ += "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+          "Access-Control-Allow-Origin: *\r\nConnection: keep-alive\r\n\r\nretry: 2000\n\n";
+  dash_.subscribe(*this, board);
+  flush();
+}
+
+inline void DashConn::send(const std::string& data) {
+  if (state_ == CLOSING) return;
+  if (out_.size() + data.size() > DASH_OUT_MAX) {
+    fprintf(stderr, "dashboard client %llu too slow, dropped\n", (unsigned long long)id_);
+    shutdown();
+    return;
+  }
+  out_ += data;
+  flush();
+}
+
+inline void DashConn::flush() {
+  while (!out_.empty()) {
+    ssize_t n = ::send(fd_, out_.data(), out_.size(), MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        watchWrites(true);
+        return;
+      }
+      shutdown();
+      return;
+    }
+    out_.erase(0, (size_t)n);
+  }
+  watchWrites(false);
+  if (state_ == CLOSING) shutdown();
+}
+
+inline void DashConn::watchWrites(bool on) {
+  if (on == writing_) return;
+  writing_ = on;
+  dash_.loop().modify(fd_, on ? EPOLLIN | EPOLLOUT : EPOLLIN, this);
+}
+
+inline void DashConn::shutdown() {
+  if (fd_ < 0) return;
+  dash_.closed(*this);
+  state_ = CLOSING;
+  close(fd_);
+  fd_ = -1;
+}
+
+// --- Routing ---
+
+inline void Dashboard::handle(DashConn& conn, const HttpRequest& request) {
+  uint64_t now = monotonicMs();
+  std::string target = request.target;
+  std::string path = target.substr(0, target.find('?'));
+
+  if (request.method == "OPTIONS") {
+    conn.respond(204, "text/plain", "",
+                 "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\nAccess-Control-Allow-Headers: Content-Type, Accept\r\n");
+    return;
+  }
+  if (path == "/" || path == "/boards") {
+    conn.respond(200, "application/json", boardList(now));
+    return;
+  }
+  if (path == "/events") {
+    conn.startStream("*");
+    for (Fleet::BoardMap::const_iterator it = fleet_.boards().begin(); it != fleet_.boards().end(); ++it) {
+      conn.send(sseFrame(summary(*it->second)));
+    }
+    return;
+  }
+  if (path == "/metrics") {
+    conn.respond(200, "text/plain; version=0.0.4", metrics());
+    return;
+  }
+  if (path.compare(0, 3, "/b/") != 0) {
+    conn.respond(404, "text/plain", "Not found\n");
+    return;
+  }
+
+  size_t slash = target.find('/', 3);
+  size_t query = target.find('?', 3);
+  size_t end = slash < query ? slash : query;
+  Board* board = fleet_.find(target.substr(3, end == std::string::npos ? std::string::npos : end - 3));
+  if (!board) {
+    conn.respond(404, "text/plain", "No such board\n");
+    return;
+  }
+  std::string boardTarget = end == std::string::npos ? "/" : target.substr(end);
+  if (boardTarget[0] == '?') boardTarget = "/" + boardTarget;
+  fleet_.watch(*board, now);
+
+  if (boardTarget == "/events") {
+    board->subscribers++;
+    conn.startStream(board->name);
+    if (!board->state.empty()) conn.send(sseFrame(board->state));
+    return;
+  }
+  if (board->battery) {
+    if (boardTarget == "/ping" || boardTarget == "/status") conn.respond(200, "application/json", board->state);
+    else conn.respond(404, "text/plain", "Battery boards only report\n");
+    return;
+  }
+  if (request.method == "GET" && board->statePath >= 0 && boardTarget == FLEET_STATE_PATHS[board->statePath] &&
+      fleet_.fresh(*board, now)) {
+    conn.respond(200, "application/json", board->state);
+    return;
+  }
+  forward(conn, *board, request, boardTarget);
+}
+
+inline void Dashboard::forward(DashConn& conn, Board& board, const HttpRequest& request, const std::string& target) {
+  uint64_t id = conn.id();
+  conn.waitForBoard();   // before the request: a board that is down answers at once
+  bool queued = board.link->request(request.method, target, request.body, request.contentType,
+                                    [this, id](const HttpResponse* reply) {
+    std::map<uint64_t, DashConn*>::iterator it = conns_.find(id);
+    if (it == conns_.end()) return;   // the client left meanwhile
+    if (!reply) {
+      it->second->respond(502, "text/plain", "Board did not answer\n");
+      return;
+    }
+    const char* type = reply->contentType.empty() ? "text/plain" : reply->contentType.c_str();
+    it->second->respond(reply->status, type, reply->body);
+  });
+  if (!queued) conn.respond(503, "text/plain", board.link->backingOff(monotonicMs()) ? "Board unreachable, retrying\n" : "Board busy\n");
+}
+
+#endif
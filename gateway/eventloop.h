@@ -0,0 +1,112 @@
+#ifndef GATEWAY_EVENTLOOP_H
+#define GATEWAY_EVENTLOOP_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+// The gateway's one thread: every socket (board links, dashboard connections, the
+// listener, the beacon and report sockets) sits in a single epoll set, level-triggered,
+// non-blocking. Handlers do their work in onEvent() and never wait.
+//
+// A handler that is done calls retire() rather than deleting itself: another event for
+// it may still be in the same epoll batch. Retired handlers are deleted after the batch.
+// run() calls tick(now) every tickMs for the time-driven work (polls, timeouts, SSE
+// keep-alives), which scans the boards; at a few hundred boards that is well under a
+// millisecond per tick.
+
+const int GATEWAY_MAX_EVENTS = 256;
+
+inline uint64_t monotonicMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+inline bool setNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+class EventHandler {
+public:
+  virtual ~EventHandler() {}
+  virtual void onEvent(uint32_t events) = 0;
+};
+
+class EventLoop {
+public:
+  EventLoop() : fd_(epoll_create1(EPOLL_CLOEXEC)) {}
+
+  ~EventLoop() {
+    collect();
+    if (fd_ >= 0) close(fd_);
+  }
+
+  bool ok() const { return fd_ >= 0; }
+
+  bool add(int fd, uint32_t events, EventHandler* handler) { return control(EPOLL_CTL_ADD, fd, events, handler); }
+  bool modify(int fd, uint32_t events, EventHandler* handler) { return control(EPOLL_CTL_MOD, fd, events, handler); }
+  void remove(int fd) { epoll_ctl(fd_, EPOLL_CTL_DEL, fd, NULL); }
+
+  // Deleted once the current batch of events is through
+  void retire(EventHandler* handler) { retired_.push_back(handler); }
+
+  // Until *stop turns non-zero (a signal handler sets it)
+  template <class Tick>
+  void run(unsigned long tickMs, volatile sig_atomic_t* stop, Tick tick) {
+    epoll_event events[GATEWAY_MAX_EVENTS];
+    uint64_t nextTick = monotonicMs();
+    while (!*stop) {
+      uint64_t now = monotonicMs();
+      int timeout = now >= nextTick ? 0 : (int)(nextTick - now);
+      int n = epoll_wait(fd_, events, GATEWAY_MAX_EVENTS, timeout);
+      if (n < 0 && errno != EINTR) {
+        perror("epoll_wait");
+        return;
+      }
+      for (int i = 0; i < n; i++) {
+        EventHandler* handler = static_cast<EventHandler*>(events[i].data.ptr);
+        if (!isRetired(handler)) handler->onEvent(events[i].events);
+      }
+      collect();
+      now = monotonicMs();
+      if (now >= nextTick) {
+        tick(now);
+        collect();
+        nextTick = now + tickMs;
+      }
+    }
+  }
+
+private:
+  bool control(int op, int fd, uint32_t events, EventHandler* handler) {
+    epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = handler;
+    return epoll_ctl(fd_, op, fd, &ev) == 0;
+  }
+
+  bool isRetired(EventHandler* handler) const {
+    for (size_t i = 0; i < retired_.size(); i++) {
+      if (retired_[i] == handler) return true;
+    }
+    return false;
+  }
+
+  void collect() {
+    for (size_t i = 0; i < retired_.size(); i++) delete retired_[i];
+    retired_.clear();
+  }
+
+  int fd_;
+  std::vector<EventHandler*> retired_;
+};
+
+#endif
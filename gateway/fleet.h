@@ -0,0 +1,349 @@
+#ifndef GATEWAY_FLEET_H
+#define GATEWAY_FLEET_H
+
+#include <arpa/inet.h>
+#include <functional>
+#include <map>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+#include "boardlink.h"
+#include "eventloop.h"
+#include "binframe.h"
+#include "peerproto.h"
+#include "sleepcycle.h"
+
+// Every board the gateway knows, and its last state.
+//
+// Boards come from their discovery beacons (PEER_BEACON_PORT, the same ones the boards
+// use to find each other) and from name=host:port on the command line for networks
+// that do not pass broadcasts. Each gets one BoardLink. Its state is polled through
+// that link, only when the link has nothing else to do, from the first of /status and
+// /ping the board answers (boards with neither are only tracked as alive or not).
+// Boards somebody is watching are polled every pollMs, the others every idlePollMs, so
+// a fleet nobody looks at costs the boards almost nothing.
+//
+// Battery boards (sleepcycle.h) never run a server; their BIN_BATCH reports on
+// SLEEP_REPORT_PORT become a board named after the sender's address, whose state is the
+// newest sample of the last report.
+//
+// A new state, a board coming or going: onChange() listeners (the SSE fan-out) hear it.
+
+const unsigned long FLEET_EXPIRE_MS = 20000;            // four beacon intervals
+const unsigned long FLEET_WATCH_MS = 60000;             // a dashboard request keeps the fast poll this long
+const unsigned long FLEET_BATTERY_EXPIRE_MS = 3 * SLEEP_REPORT_EVERY * SLEEP_INTERVAL_MS;
+
+const char* const FLEET_STATE_PATHS[] = {"/status", "/ping"};
+const int FLEET_STATE_PATH_COUNT = 2;
+
+struct Board {
+  std::string name;
+  uint8_t role;
+  bool battery;
+  bool fixed;                 // from the command line
+  BoardLink* link;            // NULL for battery boards
+  int statePath;              // index in FLEET_STATE_PATHS, -1 when the board has none
+  std::string state;          // JSON
+  uint32_t version;           // bumped with every new state
+  uint64_t stateAt;
+  uint64_t lastHeard;         // beacon, report or reply
+  uint64_t nextPoll;
+  uint64_t watchedUntil;
+  uint32_t subscribers;       // open /events streams
+  bool online;
+  uint32_t lastReport;        // battery: report numbers, for lost reports
+  uint32_t lostReports;
+};
+
+inline void appendJsonString(std::string& out, const std::string& text) {
+  out += '"';
+  for (size_t i = 0; i < text.size(); i++) {
+    unsigned char c = (unsigned char)text[i];
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += (char)c;
+    } else if (c >= 0x20) {
+      out += (char)c;
+    }
+  }
+  out += '"';
+}
+
+inline const char* roleName(uint8_t role) {
+  switch (role) {
+    case PEER_ROLE_STATION: return "station";
+    case PEER_ROLE_ROVER: return "rover";
+    case PEER_ROLE_PROBE_PUMP: return "probe_pump";
+    case PEER_ROLE_PUMP: return "pump";
+    default: return "unknown";
+  }
+}
+
+class Fleet {
+public:
+  typedef std::function<void(Board& board)> ChangeFn;
+  typedef std::map<std::string, Board*> BoardMap;
+
+  Fleet(EventLoop& loop, unsigned long pollMs, unsigned long idlePollMs)
+    : loop_(loop), pollMs_(pollMs), idlePollMs_(idlePollMs), beacons_(*this, &Fleet::onBeacon),
+      reports_(*this, &Fleet::onReport) {}
+
+  ~Fleet() {
+    for (BoardMap::iterator it = boards_.begin(); it != boards_.end(); ++it) {
+      delete it->second->link;
+      delete it->second;
+    }
+  }
+
+  // UDP sockets for beacons and battery reports; port 0 leaves one out
+  bool listen(uint16_t beaconPort, uint16_t reportPort) {
+    return (!beaconPort || beacons_.open(loop_, beaconPort)) && (!reportPort || reports_.open(loop_, reportPort));
+  }
+
+  bool addFixed(const std::string& name, const std::string& host, uint16_t port) {
+    Board& board = get(name, false);
+    if (board.battery) return false;
+    board.fixed = true;
+    return board.link->setAddress(host, port);
+  }
+
+  void onChange(ChangeFn fn) { listeners_.push_back(fn); }
+
+  Board* find(const std::string& name) {
+    BoardMap::iterator it = boards_.find(name);
+    return it == boards_.end() ? NULL : it->second;
+  }
+
+  const BoardMap& boards() const { return boards_; }
+  unsigned long pollMs() const { return pollMs_; }
+
+  // A dashboard asked about the board: poll it at the fast rate for a while
+  void watch(Board& board, uint64_t now) {
+    bool slow = !watched(board, now);
+    board.watchedUntil = now + FLEET_WATCH_MS;
+    if (slow && board.nextPoll > now) board.nextPoll = now;
+  }
+
+  // Young enough to answer a dashboard's poll without asking the board
+  bool fresh(const Board& board, uint64_t now) const { return !board.state.empty() && now - board.stateAt < 2 * pollMs_; }
+
+  void tick(uint64_t now) {
+    for (BoardMap::iterator it = boards_.begin(); it != boards_.end(); ++it) {
+      Board& board = *it->second;
+      if (board.link) {
+        board.link->tick(now);
+        if (board.statePath >= 0 && now >= board.nextPoll && board.link->idle() && !board.link->backingOff(now)) poll(board, now);
+      }
+      if (board.online && now - board.lastHeard > expireMs(board)) {
+        board.online = false;
+        fprintf(stderr, "%s offline\n", board.name.c_str());
+        notify(board);
+      }
+    }
+  }
+
+private:
+  typedef void (Fleet::*DatagramFn)(const uint8_t* data, size_t len, const sockaddr_in& from, uint64_t now);
+
+  class DatagramSocket : public EventHandler {
+  public:
+    DatagramSocket(Fleet& fleet, DatagramFn fn) : fleet_(fleet), fn_(fn), fd_(-1) {}
+    ~DatagramSocket() {
+      if (fd_ >= 0) close(fd_);
+    }
+
+    bool open(EventLoop& loop, uint16_t port) {
+      fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if (fd_ < 0) return false;
+      int one = 1;
+      setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));   // next to a host-built board on this machine
+      sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_ANY);
+      addr.sin_port = htons(port);
+      if (bind(fd_, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("udp bind");
+        return false;
+      }
+      return loop.add(fd_, EPOLLIN, this);
+    }
+
+    virtual void onEvent(uint32_t) {
+      uint8_t buf[1500];
+      for (;;) {
+        sockaddr_in from;
+        socklen_t fromLen = sizeof(from);
+        ssize_t n = recvfrom(fd_, buf, sizeof(buf), 0, (sockaddr*)&from, &fromLen);
+        if (n < 0) return;
+        (fleet_.*fn_)(buf, (size_t)n, from, monotonicMs());
+      }
+    }
+
+  private:
+    Fleet& fleet_;
+    DatagramFn fn_;
+    int fd_;
+  };
+
+  Board& get(const std::string& name, bool battery) {
+    Board*& slot = boards_[name];
+    if (!slot) {
+      slot = new Board();
+      slot->name = name;
+      slot->role = PEER_ROLE_NONE;
+      slot->battery = battery;
+      slot->fixed = false;
+      slot->link = battery ? NULL : new BoardLink(loop_, name);
+      slot->statePath = battery ? -1 : 0;
+      slot->version = 0;
+      slot->stateAt = 0;
+      slot->lastHeard = 0;
+      slot->nextPoll = 0;
+      slot->watchedUntil = 0;
+      slot->subscribers = 0;
+      slot->online = false;
+      slot->lastReport = 0;
+      slot->lostReports = 0;
+    }
+    return *slot;
+  }
+
+  // Beacons come every 5 s; a board on the command line may only answer polls
+  unsigned long expireMs(const Board& board) const {
+    if (board.battery) return FLEET_BATTERY_EXPIRE_MS;
+    unsigned long polled = 2 * idlePollMs_ + BOARD_REPLY_MS;
+    return polled > FLEET_EXPIRE_MS ? polled : FLEET_EXPIRE_MS;
+  }
+
+  bool watched(const Board& board, uint64_t now) const { return board.subscribers > 0 || now < board.watchedUntil; }
+
+  void heard(Board& board, uint64_t now) {
+    board.lastHeard = now;
+    if (!board.online) {
+      board.online = true;
+      fprintf(stderr, "%s online\n", board.name.c_str());
+      notify(board);
+    }
+  }
+
+  void notify(Board& board) {
+    for (size_t i = 0; i < listeners_.size(); i++) listeners_[i](board);
+  }
+
+  void poll(Board& board, uint64_t now) {
+    board.nextPoll = now + (watched(board, now) ? pollMs_ : idlePollMs_);
+    Board* target = &board;
+    board.link->request("GET", FLEET_STATE_PATHS[board.statePath], "", "", [this, target](const HttpResponse* reply) {
+      if (!reply) return;
+      uint64_t now = monotonicMs();
+      if (reply->status == 404) {
+        // Not this one: try the next path right away
+        target->statePath = target->statePath + 1 < FLEET_STATE_PATH_COUNT ? target->statePath + 1 : -1;
+        target->nextPoll = now;
+        heard(*target, now);
+        return;
+      }
+      if (reply->status != 200) return;
+      target->stateAt = now;
+      if (reply->body != target->state) {
+        target->state = reply->body;
+        target->version++;
+        heard(*target, now);
+        notify(*target);
+      } else {
+        heard(*target, now);
+      }
+    });
+  }
+
+  void onBeacon(const uint8_t* data, size_t len, const sockaddr_in& from, uint64_t now) {
+    uint8_t role;
+    uint16_t httpPort;
+    char name[PEER_BEACON_NAME + 1];
+    if (!peerBeaconDecode(data, len, &role, &httpPort, name) || !name[0]) return;
+    char host[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &from.sin_addr, host, sizeof(host));
+    Board& board = get(name, false);
+    if (board.battery) return;
+    board.role = role;
+    if (!board.fixed && (board.link->host() != host || board.link->port() != httpPort)) {
+      fprintf(stderr, "%s (%s) at %s:%u\n", name, roleName(role), host, httpPort);
+      board.link->setAddress(host, httpPort);
+      board.nextPoll = now;
+    }
+    heard(board, now);
+  }
+
+  // BIN_BATCH, see sleepcycle.h
+  void onReport(const uint8_t* data, size_t len, const sockaddr_in& from, uint64_t now) {
+    if (len < 2 || data[0] != BIN_VERSION || data[1] != BIN_BATCH) return;
+    size_t pos = 2;
+    uint32_t header[5];   // wake, report, duty, dropped, count
+    for (int i = 0; i < 5; i++) {
+      size_t n = getVarint(data + pos, len - pos, &header[i]);
+      if (!n) return;
+      pos += n;
+    }
+    uint32_t sec = 0;
+    int32_t sample[4] = {0, 0, 0, 0};   // soil, water, temperature * 10, humidity * 10
+    for (uint32_t s = 0; s < header[4]; s++) {
+      uint32_t dsec;
+      size_t n = getVarint(data + pos, len - pos, &dsec);
+      if (!n) return;
+      pos += n;
+      sec += dsec;
+      for (int i = 0; i < 4; i++) {
+        int32_t delta;
+        n = getSignedVarint(data + pos, len - pos, &delta);
+        if (!n) return;
+        pos += n;
+        sample[i] += delta;
+      }
+    }
+
+    char host[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &from.sin_addr, host, sizeof(host));
+    Board& board = get(std::string("battery-") + host, true);
+    if (board.version > 0 && header[1] > board.lastReport + 1) board.lostReports += header[1] - board.lastReport - 1;
+    board.lastReport = header[1];
+
+    char json[320];
+    int used = snprintf(json, sizeof(json),
+                        "{\"device\":\"battery sensor\",\"wake\":%lu,\"report\":%lu,\"lostReports\":%lu,"
+                        "\"dutyPermille\":%lu,\"dropped\":%lu,\"samples\":%lu",
+                        (unsigned long)header[0], (unsigned long)header[1], (unsigned long)board.lostReports,
+                        (unsigned long)header[2], (unsigned long)header[3], (unsigned long)header[4]);
+    if (header[4] > 0) {
+      used += snprintf(json + used, sizeof(json) - used, ",\"sampleSec\":%lu,\"soilMoisture\":%ld,\"waterLevel\":%ld",
+                       (unsigned long)sec, (long)sample[0], (long)sample[1]);
+      if (sample[2] != SLEEP_MISSING && sample[3] != SLEEP_MISSING) {
+        used += snprintf(json + used, sizeof(json) - used, ",\"temperature\":%.1f,\"humidity\":%.1f", sample[2] / 10.0,
+                         sample[3] / 10.0);
+      }
+    }
+    snprintf(json + used, sizeof(json) - used, "}");
+
+    board.state = json;
+    board.stateAt = now;
+    board.version++;
+    heard(board, now);
+    notify(board);
+  }
+
+  EventLoop& loop_;
+  unsigned long pollMs_;
+  unsigned long idlePollMs_;
+  BoardMap boards_;
+  std::vector<ChangeFn> listeners_;
+  DatagramSocket beacons_;
+  DatagramSocket reports_;
+};
+
+#endif
@@ -0,0 +1,117 @@
+// Fleet gateway: one Linux process between the boards and any number of dashboards.
+//
+//   g++ -std=gnu++11 -O2 -I../esp -o /tmp/gateway gateway.cpp
+//   /tmp/gateway [-l port] [-p poll_ms] [-i idle_poll_ms] [-n] [name=host[:port] ...]
+//
+// Every board gets exactly one consumer, the gateway's BoardLink (boardlink.h): one
+// request at a time, in order, a repeat of the last queued command merged. Board states
+// are polled through it and cached (fleet.h); dashboards read the cache and subscribe to
+// changes over SSE (dashboard.h), so a board's load is the same with one operator
+// watching or fifty.
+// Boards are found from their discovery beacons; name=host:port adds one by address,
+// for networks that drop broadcasts (-n: only those). Battery boards' reports are
+// picked up too.
+//
+// Everything runs on one epoll loop (eventloop.h), no threads: hundreds of boards and
+// dashboards are a few hundred sockets, and each is only ever touched by its handler.
+//
+// Point the dashboard's board address at gateway-host:8090/b/<board name> (the name from
+// GET /boards), or read GET /events for the whole fleet.
+//
+// Next to host-built sketches on the same machine (their beacons carry made-up
+// addresses), add the boards by address:
+//
+//   HAL_HTTP_PORT=8081 /tmp/samplemotor &
+//   /tmp/gateway -n samplemotor=127.0.0.1:8081
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "dashboard.h"
+#include "eventloop.h"
+#include "fleet.h"
+
+const uint16_t GATEWAY_HTTP_PORT = 8090;
+const unsigned long GATEWAY_POLL_MS = 1000;
+const unsigned long GATEWAY_IDLE_POLL_MS = 10000;
+const unsigned long GATEWAY_TICK_MS = 20;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) { stopRequested = 1; }
+
+static void usage(const char* self) {
+  fprintf(stderr,
+          "usage: %s [-l port] [-p poll_ms] [-i idle_poll_ms] [-n] [name=host[:port] ...]\n"
+          "  -l  dashboard HTTP port (%u)\n"
+          "  -p  state poll of boards being watched (%lu ms)\n"
+          "  -i  state poll of the others (%lu ms)\n"
+          "  -n  no discovery: only the boards given by address\n",
+          self, GATEWAY_HTTP_PORT, GATEWAY_POLL_MS, GATEWAY_IDLE_POLL_MS);
+}
+
+int main(int argc, char** argv) {
+  uint16_t httpPort = GATEWAY_HTTP_PORT;
+  unsigned long pollMs = GATEWAY_POLL_MS;
+  unsigned long idlePollMs = GATEWAY_IDLE_POLL_MS;
+  bool discovery = true;
+  std::vector<std::string> fixed;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      httpPort = (uint16_t)atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      pollMs = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+      idlePollMs = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-n") == 0) {
+      discovery = false;
+    } else if (strchr(argv[i], '=')) {
+      fixed.push_back(argv[i]);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (pollMs == 0 || idlePollMs < pollMs) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  EventLoop loop;
+  if (!loop.ok()) {
+    perror("epoll");
+    return 1;
+  }
+  Fleet fleet(loop, pollMs, idlePollMs);
+  Dashboard dashboard(loop, fleet);
+
+  for (size_t i = 0; i < fixed.size(); i++) {
+    std::string arg = fixed[i];
+    size_t eq = arg.find('=');
+    size_t colon = arg.find(':', eq);
+    std::string name = arg.substr(0, eq);
+    std::string host = arg.substr(eq + 1, colon == std::string::npos ? std::string::npos : colon - eq - 1);
+    uint16_t port = colon == std::string::npos ? 80 : (uint16_t)atoi(arg.c_str() + colon + 1);
+    if (name.empty() || host.empty() || !fleet.addFixed(name, host, port)) {
+      fprintf(stderr, "cannot add board %s\n", arg.c_str());
+      return 1;
+    }
+  }
+  if (discovery && !fleet.listen(PEER_BEACON_PORT, SLEEP_REPORT_PORT)) return 1;
+  if (!dashboard.listen(httpPort)) return 1;
+  fprintf(stderr, "gateway on :%u, %zu boards by address%s\n", httpPort, fixed.size(),
+          discovery ? ", listening for beacons" : "");
+
+  loop.run(GATEWAY_TICK_MS, &stopRequested, [&](uint64_t now) {
+    fleet.tick(now);
+    dashboard.tick(now);
+  });
+  fprintf(stderr, "gateway stopped\n");
+  return 0;
+}
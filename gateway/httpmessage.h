@@ -0,0 +1,269 @@
+#ifndef GATEWAY_HTTPMESSAGE_H
+#define GATEWAY_HTTPMESSAGE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <strings.h>
+
+// Incremental HTTP/1.1 parsing for both sides of the gateway: responses from the boards
+// and requests from the dashboards. Bytes are fed as they arrive; feed() says when a
+// whole message is in. Only what the boards and browsers actually send is handled:
+// Content-Length, chunked bodies (PageStream answers), bodies ended by the connection
+// closing (WebServer with Connection: close), and Connection: keep-alive/close.
+
+const size_t HTTP_MAX_LINE = 8192;
+const size_t HTTP_MAX_BODY = 1 << 20;
+
+enum HttpParse { HTTP_MORE, HTTP_DONE, HTTP_ERROR };
+
+struct HttpResponse {
+  int status;
+  std::string contentType;
+  std::string body;
+  bool keepAlive;
+};
+
+struct HttpRequest {
+  std::string method;
+  std::string target;          // path and query, as sent
+  std::string body;
+  std::string contentType;
+  bool keepAlive;
+};
+
+// Header lines, body framing and the buffer, shared by both parsers
+class HttpParserBase {
+protected:
+  enum State { START, HEADERS, BODY_LENGTH, CHUNK_SIZE, CHUNK_DATA, CHUNK_END, TRAILERS, BODY_CLOSE, DONE };
+
+  HttpParserBase() { resetBase(); }
+
+  void resetBase() {
+    state_ = START;
+    in_.clear();
+    pos_ = 0;
+    remaining_ = 0;
+    contentLength_ = -1;
+    chunked_ = false;
+  }
+
+  // Runs the state machine over what is buffered; body goes to *body
+  HttpParse run(std::string* body) {
+    for (;;) {
+      switch (state_) {
+        case BODY_LENGTH:
+        case CHUNK_DATA: {
+          size_t take = in_.size() - pos_;
+          if (take > remaining_) take = remaining_;
+          body->append(in_, pos_, take);
+          pos_ += take;
+          remaining_ -= take;
+          if (remaining_ > 0) return more();
+          state_ = state_ == BODY_LENGTH ? DONE : CHUNK_END;
+          break;
+        }
+        case BODY_CLOSE:
+          body->append(in_, pos_, std::string::npos);
+          pos_ = in_.size();
+          if (body->size() > HTTP_MAX_BODY) return HTTP_ERROR;
+          return more();
+        case DONE:
+          return HTTP_DONE;
+        default: {
+          size_t eol = in_.find('\n', pos_);
+          if (eol == std::string::npos) return in_.size() - pos_ > HTTP_MAX_LINE ? HTTP_ERROR : more();
+          size_t end = eol > pos_ && in_[eol - 1] == '\r' ? eol - 1 : eol;
+          std::string line(in_, pos_, end - pos_);
+          pos_ = eol + 1;
+          if (!onLine(line, body)) return HTTP_ERROR;
+        }
+      }
+    }
+  }
+
+  bool onLine(const std::string& line, std::string* body) {
+    switch (state_) {
+      case START:
+        if (line.empty()) return true;   // stray CRLF between messages
+        if (!startLine(line)) return false;
+        state_ = HEADERS;
+        return true;
+      case HEADERS:
+        if (line.empty()) {
+          state_ = bodyState();
+          return true;
+        }
+        return headerLine(line);
+      case CHUNK_SIZE: {
+        char* end;
+        unsigned long size = strtoul(line.c_str(), &end, 16);
+        if (end == line.c_str() || body->size() + size > HTTP_MAX_BODY) return false;
+        remaining_ = size;
+        state_ = size ? CHUNK_DATA : TRAILERS;
+        return true;
+      }
+      case CHUNK_END:
+        state_ = CHUNK_SIZE;
+        return line.empty();
+      case TRAILERS:
+        if (line.empty()) state_ = DONE;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool headerLine(const std::string& line) {
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) return false;
+    std::string name = line.substr(0, colon);
+    size_t start = line.find_first_not_of(" \t", colon + 1);
+    std::string value = start == std::string::npos ? "" : line.substr(start);
+    if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+      contentLength_ = atol(value.c_str());
+      if (contentLength_ < 0 || (size_t)contentLength_ > HTTP_MAX_BODY) return false;
+    } else if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+      chunked_ = strcasestr(value.c_str(), "chunked") != NULL;
+    } else {
+      header(name, value);
+    }
+    return true;
+  }
+
+  // Drops what has been parsed, so the buffer does not grow with a long body
+  HttpParse more() {
+    if (pos_ > 4096 && pos_ * 2 > in_.size()) {
+      in_.erase(0, pos_);
+      pos_ = 0;
+    }
+    return HTTP_MORE;
+  }
+
+  virtual bool startLine(const std::string& line) = 0;
+  virtual void header(const std::string& name, const std::string& value) = 0;
+  virtual State bodyState() = 0;
+
+  virtual ~HttpParserBase() {}
+
+  State state_;
+  std::string in_;
+  size_t pos_;
+  size_t remaining_;
+  long contentLength_;
+  bool chunked_;
+};
+
+class HttpResponseParser : private HttpParserBase {
+public:
+  HttpResponseParser() { reset(); }
+
+  void reset() {
+    resetBase();
+    response_.status = 0;
+    response_.contentType.clear();
+    response_.body.clear();
+    response_.keepAlive = false;
+  }
+
+  HttpParse feed(const char* data, size_t len) {
+    in_.append(data, len);
+    return run(&response_.body);
+  }
+
+  // The board closed the connection: complete if the body was delimited by the close
+  HttpParse closed() {
+    if (state_ == BODY_CLOSE) state_ = DONE;
+    return state_ == DONE ? HTTP_DONE : HTTP_ERROR;
+  }
+
+  bool started() const { return state_ != START || !in_.empty(); }
+  const HttpResponse& response() const { return response_; }
+
+private:
+  virtual bool startLine(const std::string& line) {
+    if (line.compare(0, 7, "HTTP/1.") != 0 || line.size() < 12) return false;
+    response_.keepAlive = line[7] == '1';
+    response_.status = atoi(line.c_str() + 9);
+    return response_.status >= 100;
+  }
+
+  virtual void header(const std::string& name, const std::string& value) {
+    if (strcasecmp(name.c_str(), "Content-Type") == 0) {
+      response_.contentType = value;
+    } else if (strcasecmp(name.c_str(), "Connection") == 0) {
+      if (strcasecmp(value.c_str(), "close") == 0) response_.keepAlive = false;
+      if (strcasecmp(value.c_str(), "keep-alive") == 0) response_.keepAlive = true;
+    }
+  }
+
+  virtual State bodyState() {
+    if (response_.status < 200 || response_.status == 204 || response_.status == 304) return DONE;
+    if (chunked_) return CHUNK_SIZE;
+    if (contentLength_ >= 0) {
+      remaining_ = (size_t)contentLength_;
+      return BODY_LENGTH;
+    }
+    response_.keepAlive = false;
+    return BODY_CLOSE;
+  }
+
+  HttpResponse response_;
+};
+
+class HttpRequestParser : private HttpParserBase {
+public:
+  HttpRequestParser() { reset(); }
+
+  // Keeps bytes of a next request that came in with this one
+  void reset() {
+    std::string rest = pos_ < in_.size() ? in_.substr(pos_) : std::string();
+    resetBase();
+    in_ = rest;
+    request_.method.clear();
+    request_.target.clear();
+    request_.body.clear();
+    request_.contentType.clear();
+    request_.keepAlive = false;
+  }
+
+  HttpParse feed(const char* data, size_t len) {
+    in_.append(data, len);
+    return run(&request_.body);
+  }
+
+  // Parses what is already buffered (after reset())
+  HttpParse resume() { return run(&request_.body); }
+
+  const HttpRequest& request() const { return request_; }
+
+private:
+  virtual bool startLine(const std::string& line) {
+    size_t sp1 = line.find(' ');
+    size_t sp2 = line.rfind(' ');
+    if (sp1 == std::string::npos || sp2 == sp1) return false;
+    request_.method = line.substr(0, sp1);
+    request_.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    request_.keepAlive = line.compare(sp2 + 1, std::string::npos, "HTTP/1.1") == 0;
+    return !request_.target.empty() && request_.target[0] == '/';
+  }
+
+  virtual void header(const std::string& name, const std::string& value) {
+    if (strcasecmp(name.c_str(), "Content-Type") == 0) {
+      request_.contentType = value;
+    } else if (strcasecmp(name.c_str(), "Connection") == 0) {
+      if (strcasecmp(value.c_str(), "close") == 0) request_.keepAlive = false;
+      if (strcasecmp(value.c_str(), "keep-alive") == 0) request_.keepAlive = true;
+    }
+  }
+
+  virtual State bodyState() {
+    if (chunked_) return CHUNK_SIZE;
+    remaining_ = contentLength_ > 0 ? (size_t)contentLength_ : 0;
+    return remaining_ ? BODY_LENGTH : DONE;
+  }
+
+  HttpRequest request_;
+};
+
+#endif